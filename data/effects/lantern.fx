@@ -0,0 +1,11 @@
+# Lantern sway: a warm light swinging gently with a little flame flicker
+sway = sin(t * 0.3) * 0.15
+flicker = (noise(t * 6) - 0.5) * 0.2
+led0 = clamp(0.7 + sway + flicker, 0, 1)
+led1 = clamp(0.5 - sway * 0.5 + flicker, 0, 1)
+pixel {
+  glow = clamp(led0 - abs(x - 0.5 - sway) * 1.5, 0, 1)
+  r = glow
+  g = glow * 0.45
+  b = glow * 0.05
+}
@@ -0,0 +1,14 @@
+# Lightning storm: dim blue night, random double flashes that decay
+strike = select(rand() < 0.01, 1, 0)
+since = select(strike, 0, since + dt)
+armed = select(strike, 1, select(since > 0.25, 0, armed))
+echo = select(since > 0.12, select(since < 0.2, 1, 0), 0) * armed
+flash = max(flash * 0.75, max(strike, echo * 0.7))
+led0 = 0.05 + flash
+led1 = 0.03 + flash * 0.8
+led2 = flash
+pixel {
+  r = flash * 0.8
+  g = flash * 0.85
+  b = 0.08 + flash
+}
@@ -0,0 +1,29 @@
+#ifndef ACTIONS_H
+#define ACTIONS_H
+
+#include <Arduino.h>
+#include "BoardProfile.h"
+
+// Text action specs shared by the scheduler (and anything else that needs to
+// trigger outputs without a client in the loop). Several actions may be
+// chained with ';'.
+//
+//   scene:<name>                 run a scene (built-in or from /scenes.json)
+//   fire:on | fire:off
+//   effect:<name> | effect:off   user light effect from /effects
+//   smoke:on | smoke:off | smoke:puff[:<ms>]   (boards with smoke outputs)
+//   mill:<0..255>                (boards with a mill)
+//   led:<light>:<0..255>         light named in the board profile (red, ...)
+//   leds:on | leds:off
+//   play:<track> | stop | volume:<0..30>
+//   cue:<delayMs>:<action>       show-sync leader: run on every diorama in sync
+
+void setupActions();
+bool runAction(const String &spec);
+#if BOARD_HAS_SMOKE
+// Forget a pending smoke:puff so its timer does not turn off smoke that was
+// switched on or off explicitly since. smoke:on/off do this themselves.
+void cancelSmokePuff();
+#endif
+
+#endif // ACTIONS_H
@@ -0,0 +1,26 @@
+#ifndef APIRESPONSE_H
+#define APIRESPONSE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+// API responses are described once as a JsonDocument and encoded according
+// to the request's Accept header: JSON (default), MessagePack or CBOR.
+
+enum class ApiEncoding { Json, MsgPack, Cbor };
+
+ApiEncoding negotiateEncoding(AsyncWebServerRequest *req);
+const char *encodingContentType(ApiEncoding encoding);
+
+// Encode `doc` into `out`; returns the number of bytes written.
+size_t encodeDocument(const JsonDocument &doc, ApiEncoding encoding, Print &out);
+
+void sendApiResponse(AsyncWebServerRequest *req, int code, const JsonDocument &doc);
+void sendApiError(AsyncWebServerRequest *req, int code, const char *message);
+
+// Encode `doc` `iterations` times with each encoding (plus the String-based
+// JSON path) and add bytes / microseconds per response to `out`.
+void benchmarkEncodings(const JsonDocument &doc, int iterations, JsonObject out);
+
+#endif // APIRESPONSE_H
@@ -0,0 +1,51 @@
+#ifndef AUDIODECODER_H
+#define AUDIODECODER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <memory>
+#include "MemoryPolicy.h"
+
+// Streaming decoders for the I2S audio engine. Output is always 16-bit
+// stereo interleaved (mono sources are duplicated), at the source rate.
+//
+// WAV (PCM 8/16-bit, mono/stereo) is parsed here; MP3 uses libhelix from
+// ESP8266Audio and is only available when that library is in lib_deps.
+
+class AudioDecoder {
+public:
+    virtual ~AudioDecoder() = default;
+
+    // Decoders carry their input/PCM buffers inline (~14 KB for MP3) and are
+    // only touched by the audio task, so they live in PSRAM when present
+    static void *operator new(size_t size) {
+        void *p = memAlloc(MEM_AUDIO, MemClass::Cold, size);
+        if (!p) abort();
+        return p;
+    }
+    static void operator delete(void *p) { memFree(p); }
+
+    // Parse headers; the file stays owned by the decoder until destruction
+    virtual bool begin(fs::File file) = 0;
+    // Decode up to `frames` stereo frames into out[2 * frames]; 0 at end of stream
+    virtual size_t read(int16_t *out, size_t frames) = 0;
+
+    uint32_t sampleRate() const { return rate_; }
+    uint8_t channels() const { return channels_; } // of the source
+    // Total frames when the container says so (WAV), else 0
+    uint64_t lengthFrames() const { return length_; }
+    // Frames skipped as corrupt so far
+    uint32_t errors() const { return errors_; }
+
+protected:
+    uint32_t rate_ = 0;
+    uint8_t channels_ = 0;
+    uint64_t length_ = 0;
+    uint32_t errors_ = 0;
+};
+
+// Decoder for the file's extension (.wav, .mp3), or nullptr
+std::unique_ptr<AudioDecoder> audioDecoderFor(const String &path);
+bool audioIsPlayableFile(const String &path);
+
+#endif // AUDIODECODER_H
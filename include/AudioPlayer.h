@@ -2,17 +2,61 @@
 #define AUDIOPLAYER_H
 
 #include <Arduino.h>
+#include <vector>
+
+// Two backends implement this API: the DFPlayer Mini over UART (default) and
+// an I2S engine decoding WAV/MP3 from LittleFS or SD (build with
+// -DAUDIO_BACKEND_I2S, see the esp32-s3-i2s env). Boards whose profile has
+// no audio get stubs that report failure. Track numbers are 1-based; for the
+// I2S engine they index the sorted file list.
 
 void setupAudioSystem();
 bool audioInit();
 bool audioReinit();
 String audioGetInfo();
+const char *audioBackendName();
 bool playFile(const char *path);
+// DFPlayer track number named by `path` ("/001.mp3", "3"), or -1
+int audioTrackIndex(const char *path);
 void stopPlayback();
 bool isPlaying();
+// From loop(): notices tracks that ended and publishes TrackFinished
+void serviceAudio();
 
 // Volume control (DFPlayer volume range: 0..30)
 bool audioSetVolume(int vol);
 int audioGetVolume();
 
+struct AudioStatus {
+    bool playing;
+    String path;
+    uint32_t sampleRate;
+    uint8_t channels;
+    uint64_t positionFrames; // frames that have left the DAC
+    uint64_t lengthFrames;   // 0 when the format does not say (MP3)
+    uint32_t underruns;      // times the DMA ring ran dry mid-track
+    uint32_t decodeErrors;
+};
+
+// False when the backend cannot report a position (DFPlayer)
+bool audioGetStatus(AudioStatus &out);
+// Playable files in track order; false when the backend cannot list (DFPlayer)
+bool audioListFiles(std::vector<String> &out);
+
+#define AUDIO_BENCH_FS_RESERVE (16 * 1024) // left free for littlefs metadata
+
+struct AudioBenchResult {
+    uint32_t frames;
+    uint32_t sampleRate;
+    uint32_t decodeUs;
+    uint32_t sinkUs; // writing the WAV file, when requested
+    bool outLimited; // the WAV file was cut short to leave LittleFS space
+};
+
+// Decode up to maxSeconds of `path` as fast as possible, optionally
+// rendering it to a WAV file on LittleFS, never past its free space (less
+// AUDIO_BENCH_FS_RESERVE). False when unsupported, the file won't open or
+// there is no room for the WAV file.
+bool audioBenchmark(const char *path, uint32_t maxSeconds, const char *wavOut, AudioBenchResult &out);
+
 #endif // AUDIOPLAYER_H
@@ -0,0 +1,29 @@
+#ifndef BENCH_TASK_H
+#define BENCH_TASK_H
+
+#include <ArduinoJson.h>
+#include <functional>
+
+// Benchmarks hold a CPU for seconds, far past the network task's budget
+// (HandlerGuard.h). The /api/bench/* routes only validate their parameters
+// and start a job; the job runs on its own task and /api/bench reports its
+// state and, once done, its result. One job at a time; the result is kept
+// until the next one starts.
+
+#ifndef BENCH_TASK_CORE
+#define BENCH_TASK_CORE 0
+#endif
+#ifndef BENCH_TASK_PRIORITY
+#define BENCH_TASK_PRIORITY 1 // below the network and audio tasks
+#endif
+#define BENCH_TASK_STACK 8192
+
+// Fills `out` and returns the HTTP status the result is reported with
+using BenchJob = std::function<int(JsonObject out)>;
+
+// Network task only. False while another job runs or when the task cannot
+// be created. `name` must outlive the job (route literals).
+bool benchStart(const char *name, BenchJob job);
+void benchDescribe(JsonObject out);
+
+#endif // BENCH_TASK_H
@@ -0,0 +1,217 @@
+#ifndef BOARDPROFILE_H
+#define BOARDPROFILE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Board profiles: every output the firmware drives, declared once as a
+// constexpr channel table. Setup, the name -> channel dispatch used by the
+// API and actions, and the pin checks below are all derived from the table,
+// so adding an output or porting to another board means editing one block.
+//
+// Pick a profile with -DBOARD_PROFILE=BOARD_DIORAMA_MINI (default
+// BOARD_DIORAMA_S3). A profile also sets the BOARD_HAS_* / BOARD_AUDIO
+// switches; subsystems it does not use are compiled out and never set up.
+// The switches are checked against the table at compile time.
+
+#define BOARD_DIORAMA_S3 1   // the diorama: 3 lanterns, 2 smoke machines, mill, DFPlayer
+#define BOARD_DIORAMA_MINI 2 // lantern kit on an S3 mini: 3 lanterns, 1 smoke, strip, no audio
+
+#ifndef BOARD_PROFILE
+#define BOARD_PROFILE BOARD_DIORAMA_S3
+#endif
+
+#define BOARD_AUDIO_NONE 0
+#define BOARD_AUDIO_DFPLAYER 1
+#define BOARD_AUDIO_I2S 2
+
+enum class ChannelKind : uint8_t {
+    Pwm,   // LEDC duty
+    Gpio,  // on/off
+    Strip, // addressable strip data line
+    Audio  // UART / I2S pin of the audio backend
+};
+
+// What drives the channel; index within a group selects the LED/smoke slot
+enum class ChannelGroup : uint8_t { Lights, Smoke, Mill, Strip, Audio };
+
+struct BoardChannel {
+    const char *name;
+    ChannelKind kind;
+    ChannelGroup group;
+    int8_t pin;
+    uint8_t resolution; // bits of duty (PWM), 1 for GPIO, 0 otherwise
+    uint16_t min;       // accepted API range (0..255 for outputs,
+    uint16_t max;       // pixel count for a strip)
+};
+
+#if BOARD_PROFILE == BOARD_DIORAMA_S3
+
+#define BOARD_NAME "diorama-s3"
+#define BOARD_HAS_SMOKE 1
+#define BOARD_HAS_MILL 1
+#ifdef AUDIO_BACKEND_I2S
+#define BOARD_AUDIO BOARD_AUDIO_I2S
+#else
+#define BOARD_AUDIO BOARD_AUDIO_DFPLAYER
+#endif
+// The strip stays optional here: -DPIXEL_STRIP_COUNT=300 -DPIXEL_STRIP_PIN=4
+#ifndef PIXEL_STRIP_COUNT
+#define PIXEL_STRIP_COUNT 0
+#endif
+#ifndef PIXEL_STRIP_PIN
+#define PIXEL_STRIP_PIN 4
+#endif
+
+constexpr BoardChannel kBoardChannels[] = {
+    {"red", ChannelKind::Pwm, ChannelGroup::Lights, 15, 13, 0, 255},
+    {"yellow", ChannelKind::Pwm, ChannelGroup::Lights, 7, 13, 0, 255},
+    {"green", ChannelKind::Pwm, ChannelGroup::Lights, 6, 13, 0, 255},
+    {"smoke1", ChannelKind::Gpio, ChannelGroup::Smoke, 13, 1, 0, 255},
+    {"smoke2", ChannelKind::Gpio, ChannelGroup::Smoke, 5, 1, 0, 255},
+    {"mill", ChannelKind::Pwm, ChannelGroup::Mill, 12, 8, 0, 255},
+#if PIXEL_STRIP_COUNT > 0
+    {"strip", ChannelKind::Strip, ChannelGroup::Strip, PIXEL_STRIP_PIN, 0, 0, PIXEL_STRIP_COUNT},
+#endif
+#if BOARD_AUDIO == BOARD_AUDIO_I2S
+    {"i2s.bck", ChannelKind::Audio, ChannelGroup::Audio, 9, 0, 0, 0},
+    {"i2s.ws", ChannelKind::Audio, ChannelGroup::Audio, 10, 0, 0, 0},
+    {"i2s.dout", ChannelKind::Audio, ChannelGroup::Audio, 11, 0, 0, 0},
+#else
+    {"dfplayer.rx", ChannelKind::Audio, ChannelGroup::Audio, 16, 0, 0, 0},
+    {"dfplayer.tx", ChannelKind::Audio, ChannelGroup::Audio, 17, 0, 0, 0},
+#endif
+};
+
+#elif BOARD_PROFILE == BOARD_DIORAMA_MINI
+
+#define BOARD_NAME "diorama-mini"
+#define BOARD_HAS_SMOKE 1
+#define BOARD_HAS_MILL 0
+#define BOARD_AUDIO BOARD_AUDIO_NONE
+#undef PIXEL_STRIP_COUNT
+#undef PIXEL_STRIP_PIN
+#define PIXEL_STRIP_COUNT 60
+#define PIXEL_STRIP_PIN 8
+
+constexpr BoardChannel kBoardChannels[] = {
+    {"red", ChannelKind::Pwm, ChannelGroup::Lights, 1, 13, 0, 255},
+    {"yellow", ChannelKind::Pwm, ChannelGroup::Lights, 2, 13, 0, 255},
+    {"green", ChannelKind::Pwm, ChannelGroup::Lights, 3, 13, 0, 255},
+    {"smoke1", ChannelKind::Gpio, ChannelGroup::Smoke, 4, 1, 0, 255},
+    {"strip", ChannelKind::Strip, ChannelGroup::Strip, PIXEL_STRIP_PIN, 0, 0, PIXEL_STRIP_COUNT},
+};
+
+#else
+#error "Unknown BOARD_PROFILE"
+#endif
+
+constexpr int kBoardChannelCount = sizeof(kBoardChannels) / sizeof(kBoardChannels[0]);
+
+// Compile-time queries over the table
+
+constexpr bool boardNameEquals(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+constexpr int boardCount(ChannelGroup group) {
+    int n = 0;
+    for (int i = 0; i < kBoardChannelCount; i++) {
+        if (kBoardChannels[i].group == group) n++;
+    }
+    return n;
+}
+
+// Table index of the `index`-th channel of a group, or -1
+constexpr int boardFind(ChannelGroup group, int index) {
+    for (int i = 0; i < kBoardChannelCount; i++) {
+        if (kBoardChannels[i].group != group) continue;
+        if (index-- == 0) return i;
+    }
+    return -1;
+}
+
+constexpr int boardFind(const char *name) {
+    for (int i = 0; i < kBoardChannelCount; i++) {
+        if (boardNameEquals(kBoardChannels[i].name, name)) return i;
+    }
+    return -1;
+}
+
+constexpr int boardPin(ChannelGroup group, int index) {
+    return boardFind(group, index) < 0 ? -1 : kBoardChannels[boardFind(group, index)].pin;
+}
+
+constexpr int boardPin(const char *name) {
+    return boardFind(name) < 0 ? -1 : kBoardChannels[boardFind(name)].pin;
+}
+
+// GPIOs an output may use on the ESP32-S3: 0..48 minus the SPI flash/PSRAM
+// bus (26..32) and the native USB pair (19/20)
+constexpr bool boardPinUsable(int pin) {
+    return pin >= 0 && pin <= 48 && !(pin >= 26 && pin <= 32) && pin != 19 && pin != 20;
+}
+
+constexpr bool boardTableValid() {
+    for (int i = 0; i < kBoardChannelCount; i++) {
+        const BoardChannel &c = kBoardChannels[i];
+        if (!boardPinUsable(c.pin) || c.min > c.max) return false;
+        if (c.kind == ChannelKind::Pwm && (c.resolution < 1 || c.resolution > 14)) return false;
+        for (int k = i + 1; k < kBoardChannelCount; k++) {
+            if (kBoardChannels[k].pin == c.pin || boardNameEquals(kBoardChannels[k].name, c.name)) return false;
+        }
+    }
+    return true;
+}
+
+static_assert(boardTableValid(), "board profile: unusable or duplicate pin, duplicate name or bad range");
+static_assert(boardCount(ChannelGroup::Lights) >= 1 && boardCount(ChannelGroup::Lights) <= 3,
+              "board profile: 1-3 lights (LED slots in DeviceState and the command queue)");
+static_assert(boardCount(ChannelGroup::Smoke) <= 2, "board profile: at most 2 smoke outputs");
+static_assert(BOARD_HAS_SMOKE == (boardCount(ChannelGroup::Smoke) > 0), "BOARD_HAS_SMOKE disagrees with the table");
+static_assert(BOARD_HAS_MILL == (boardCount(ChannelGroup::Mill) == 1), "BOARD_HAS_MILL disagrees with the table");
+static_assert((PIXEL_STRIP_COUNT > 0) == (boardCount(ChannelGroup::Strip) == 1), "strip entry disagrees with PIXEL_STRIP_COUNT");
+static_assert((BOARD_AUDIO == BOARD_AUDIO_NONE) == (boardCount(ChannelGroup::Audio) == 0), "audio pins disagree with BOARD_AUDIO");
+
+// Call `fn(const BoardChannel &, int index)` for each channel of a group, in
+// table order; the loop bound is a constant so it unrolls
+template <ChannelGroup Group, typename Fn>
+inline void boardForEach(Fn fn) {
+    int index = 0;
+    for (int i = 0; i < kBoardChannelCount; i++) {
+        if (kBoardChannels[i].group == Group) fn(kBoardChannels[i], index++);
+    }
+}
+
+// Pins of a group as a constant array (dispatch by slot index)
+template <ChannelGroup Group>
+struct BoardPins {
+    static constexpr int count = boardCount(Group);
+    int8_t pin[count > 0 ? count : 1];
+
+    constexpr BoardPins() : pin{} {
+        for (int i = 0; i < count; i++) pin[i] = static_cast<int8_t>(boardPin(Group, i));
+    }
+    constexpr int operator[](int index) const { return pin[index]; }
+    // Slot of a pin, or -1 when the pin is not in this group
+    constexpr int indexOf(int p) const {
+        for (int i = 0; i < count; i++) {
+            if (pin[i] == p) return i;
+        }
+        return -1;
+    }
+};
+
+// Runtime lookup by name (API and actions). Null when the board has no such
+// channel or it belongs to another group.
+const BoardChannel *boardChannel(const String &name, ChannelGroup group);
+// Slot of the channel within its group
+int boardSlot(const BoardChannel &channel);
+
+void boardDescribe(JsonObject out);
+
+#endif // BOARDPROFILE_H
@@ -0,0 +1,55 @@
+#ifndef CLOCKESTIMATOR_H
+#define CLOCKESTIMATOR_H
+
+#include <stdint.h>
+
+// Maps a local microsecond clock onto a remote one from one-way timestamped
+// beacons. Both drift and offset follow the upper envelope of
+// (remote - local) over the last WINDOW samples, i.e. the samples that saw
+// the least network delay.
+//
+// The fit is double arithmetic over the whole window (software floating
+// point on the ESP32), so a caller that keeps the estimator under a spinlock
+// can split addSample(): record() under the lock, fit() a copy outside it,
+// apply() the result under the lock again.
+class ClockEstimator {
+public:
+    static constexpr int WINDOW = 32;
+    static constexpr double MAX_DRIFT = 500e-6; // crystals are far better than 500 ppm
+
+    struct Fit {
+        uint32_t version; // samples it was computed from
+        int64_t ref;
+        double offset;
+        double drift;
+    };
+
+    void reset();
+    void addSample(int64_t localUs, int64_t remoteUs);
+
+    void record(int64_t localUs, int64_t remoteUs);
+    Fit fit() const;
+    // Ignored (false) when a sample was recorded or reset() ran since fit()
+    bool apply(const Fit &f);
+
+    bool valid() const { return fitted; }
+    int samples() const { return count; }
+    int64_t toRemote(int64_t localUs) const;
+    int64_t toLocal(int64_t remoteUs) const;
+    double driftPpm() const { return drift * 1e6; }
+    int64_t offsetUs() const { return static_cast<int64_t>(offset); }
+
+private:
+    int64_t local[WINDOW] = {};
+    int64_t delta[WINDOW] = {}; // remote - local
+    int count = 0;
+    int next = 0;
+    uint32_t version = 0; // bumped by record() and reset()
+
+    bool fitted = false;
+    int64_t ref = 0;     // local time the fit is centred on
+    double offset = 0;   // remote - local at `ref`
+    double drift = 0;    // d(remote - local) / d(local)
+};
+
+#endif // CLOCKESTIMATOR_H
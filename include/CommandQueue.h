@@ -0,0 +1,68 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Control changes from request handlers (AsyncTCP task) are queued here and
+// applied by the loop task at a frame boundary, so hardware and the DFPlayer
+// UART only ever have one writer.
+//
+// Continuous controls (sliders) use one slot per channel plus a pending
+// bitmask: a newer value for the same channel replaces the older one before
+// it is applied (last writer wins). Discrete commands go through a bounded
+// lock-free multi-producer ring and keep their order. Producers never block;
+// the ring only retries a CAS when two of them race for the same cell.
+//
+// Each change carries the producer's journal cause (journalCause(), i.e. the
+// request that made it) and the loop applies it under that cause, so the
+// journal names the request rather than the queue. A coalesced slot keeps the
+// cause of its last write.
+
+#ifndef COMMAND_RING_SIZE
+#define COMMAND_RING_SIZE 16 // power of two
+#endif
+// One DFPlayer volume frame is ~10 ms at 9600 baud and the module needs time
+// to act on it; slider bursts are thinned to this interval.
+#ifndef COMMAND_VOLUME_INTERVAL_MS
+#define COMMAND_VOLUME_INTERVAL_MS 150
+#endif
+#define COMMAND_ACTION_LEN 64 // action spec carried by CommandType::Action
+#define COMMAND_CAUSE_LEN 48  // journal cause carried with each change (truncated)
+
+enum CommandChannel : uint8_t {
+    CMD_LED0, CMD_LED1, CMD_LED2, // 0..255
+    CMD_SMOKE0, CMD_SMOKE1,       // 0..255
+    CMD_MILL,                     // 0..255
+    CMD_VOLUME,                   // 0..30
+    COMMAND_CHANNELS
+};
+
+// Reinit restarts the audio backend (the DFPlayer probe blocks for seconds):
+// the loop is the only task that touches its UART
+enum class CommandType : uint8_t { Play, Stop, FireStart, FireStop, SmokeOn, SmokeOff, Action, Reinit };
+
+void setupCommandQueue(); // before setupWebServer()
+// Drain from loop() at a frame boundary (before effects render)
+void serviceCommandQueue();
+
+// Coalescing write; never fails
+void commandSet(CommandChannel channel, int32_t value);
+// Ordered discrete command; false when the ring is full
+bool commandPost(CommandType type, int32_t arg = 0);
+// Run an action spec (see Actions.h) from the loop; false when the ring is
+// full or the spec is COMMAND_ACTION_LEN or longer
+bool commandPostAction(const char *spec);
+
+struct CommandQueueStats {
+    uint32_t submitted; // commandSet() + commandPost() calls
+    uint32_t coalesced; // slot writes that replaced a value not yet applied
+    uint32_t applied;
+    uint32_t dropped;   // ring full
+    uint32_t volumeDeferred; // drains that held volume back for the rate limit
+};
+
+CommandQueueStats commandQueueStats();
+void commandQueueDescribe(JsonObject out);
+
+#endif // COMMANDQUEUE_H
@@ -0,0 +1,38 @@
+#ifndef DEVICESTATE_H
+#define DEVICESTATE_H
+
+#include <Arduino.h>
+
+// Shadow copy of every output the firmware drives. Writers (setLed, setPwm,
+// setSmoke, fire effect, audio) update it after touching hardware; readers
+// take a consistent snapshot through a seqlock, so status endpoints never
+// read GPIO/ADC and never block a writer.
+
+#define DEVICE_STATE_LEDS 3
+#define DEVICE_STATE_SMOKES 2
+
+struct DeviceState {
+    uint16_t led[DEVICE_STATE_LEDS];    // perceptual level (0..LED_LEVEL_MAX), by light slot
+    bool smoke[DEVICE_STATE_SMOKES];    // by smoke slot (kSmokePins)
+    uint8_t mill;                       // mill PWM (0..255)
+    bool fireActive;
+    bool audioPlaying;
+    uint8_t volume;                     // DFPlayer volume (0..30)
+    uint32_t version;                   // bumped on every committed update
+    uint32_t updatedMs;                 // millis() of the last update
+};
+
+// Lock-free consistent copy of the current state
+DeviceState deviceStateSnapshot();
+
+void deviceStateSetLed(int index, uint16_t level);
+// Level rendered by the fire or a user effect: updates the shadow only, not
+// the journal or the event bus (their on/off is recorded instead)
+void deviceStateShowLed(int index, uint16_t level);
+void deviceStateSetSmoke(int index, bool on);
+void deviceStateSetMill(uint8_t value);
+void deviceStateSetFireActive(bool active);
+void deviceStateSetAudioPlaying(bool playing);
+void deviceStateSetVolume(uint8_t volume);
+
+#endif // DEVICESTATE_H
@@ -0,0 +1,83 @@
+#ifndef EFFECTVM_H
+#define EFFECTVM_H
+
+#include <Arduino.h>
+#include <vector>
+#include "MemoryPolicy.h"
+
+// Compiler and sandboxed VM for user light effects.
+//
+// Source is a list of assignments, evaluated top to bottom once per frame;
+// an optional `pixel { ... }` block runs once per strip pixel:
+//
+//   # lantern sway
+//   sway = sin(t * 0.3) * 0.15
+//   led0 = clamp(0.7 + sway + (noise(t * 4) - 0.5) * 0.2, 0, 1)
+//   pixel { r = led0  g = led0 * 0.45  b = 0 }
+//
+// Numbers are Q16.16 fixed point (range +-32768, step 1/65536). Inputs:
+// t (seconds since start), dt, frame; in the pixel block also i, n and
+// x = i / n. Outputs are led0..led2 (0..1) and, per pixel, r, g, b (0..1).
+// Any other name is a variable that keeps its value across frames.
+// Functions: sin, cos (argument in turns), noise (smooth, 0..1), rand
+// (0..1), abs, floor, frac, min, max, clamp, mix, select(c, a, b).
+// Comparisons yield 1 or 0; division by zero yields 0; results saturate.
+//
+// There are no loops or jumps, so every run executes exactly as many
+// instructions as the program has and the per-frame cost is known when the
+// program is loaded. Bytecode is verified (opcodes, slots, stack depth)
+// before it runs, whether it came from the compiler or from a file.
+
+typedef int32_t fx_t; // Q16.16
+#define FX_ONE 65536
+
+#define EFFECT_STACK 16
+#define EFFECT_MAX_SLOTS 48
+#define EFFECT_MAX_CODE 2048 // bytes per section
+
+// Fixed slots; user variables follow
+enum EffectSlot : uint8_t {
+    FXS_T, FXS_DT, FXS_FRAME, FXS_I, FXS_N, FXS_X,
+    FXS_LED0, FXS_LED1, FXS_LED2, FXS_R, FXS_G, FXS_B,
+    FXS_USER
+};
+
+// Compile source into a bytecode image (what is stored as <name>.fxb).
+// On failure `error` reads "line N: message".
+bool effectCompile(const char *source, std::vector<uint8_t> &image, String &error);
+
+class EffectVm {
+public:
+    // Verify and take a copy of an image; the VM is unchanged on failure
+    bool load(const uint8_t *image, size_t len, String &error);
+    bool loaded() const { return !main_.empty() || !pixel_.empty(); }
+    bool hasPixelBlock() const { return !pixel_.empty(); }
+    // Whether the program assigns led<index>; unassigned LEDs are left alone
+    bool writesLed(int index) const { return ledMask_ & (1 << index); }
+
+    // Instructions executed per frame for `pixels` strip pixels
+    uint32_t opsPerFrame(size_t pixels) const;
+
+    // Start a frame: t and dt in milliseconds
+    void runFrame(uint32_t tMs, uint32_t dtMs);
+    fx_t led(int index) const { return slots_[FXS_LED0 + index]; }
+    // Per-pixel outputs of the current frame; 0..255
+    void runPixel(size_t index, size_t count, uint8_t &r, uint8_t &g, uint8_t &b);
+
+private:
+    typedef std::vector<uint8_t, MemAllocator<uint8_t, MEM_EFFECTS, MemClass::Hot>> Code;
+
+    void run(const Code &code);
+
+    Code main_;
+    Code pixel_;
+    uint16_t mainOps_ = 0;
+    uint16_t pixelOps_ = 0;
+    uint8_t slotCount_ = FXS_USER;
+    uint8_t ledMask_ = 0;
+    uint32_t frame_ = 0;
+    uint32_t rng_ = 0x9E3779B9;
+    fx_t slots_[EFFECT_MAX_SLOTS] = {};
+};
+
+#endif // EFFECTVM_H
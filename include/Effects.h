@@ -0,0 +1,42 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "EventBus.h"
+
+// User light effects (see EffectVm.h for the language). Uploads are
+// compiled straight away and stored as /effects/<name>.fx (source) and
+// <name>.fxb (bytecode). Running one loads it off the request task and the
+// loop swaps it in at the next frame boundary, so effects can be replaced
+// while running. The fire effect and user effects share the LEDs: starting
+// one stops the other.
+
+#define EFFECTS_DIR "/effects"
+#ifndef EFFECT_FRAME_MS
+#define EFFECT_FRAME_MS 20
+#endif
+// Instruction budget per frame, main part plus pixel block times pixels
+#ifndef EFFECT_MAX_OPS_PER_FRAME
+#define EFFECT_MAX_OPS_PER_FRAME 20000
+#endif
+#define EFFECT_NAME_MAX 24
+
+void setupEffects();
+void serviceEffects(); // from loop()
+
+// Compile and store; opsPerFrame (optional) gets the cost on this board
+bool effectSave(const String &name, const String &source, String &error, uint32_t *opsPerFrame = nullptr);
+bool effectRun(const String &name, String &error);
+void effectStop();
+bool effectRemove(const String &name);
+bool effectActive();
+// Bus subscriber: a started fire effect takes the LEDs over
+void effectsOnFireChanged(const FireChanged &event);
+
+void effectsDescribe(JsonObject out);
+// Run every stored effect (or just `name`) for `frames` frames without
+// touching the outputs and report the cost against the frame budget
+void effectsBenchmark(const String &name, uint32_t frames, JsonObject out);
+
+#endif // EFFECTS_H
@@ -0,0 +1,63 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "EventBus.h"
+
+// Audio-driven modulation from precomputed track envelopes.
+//
+// tools/envelope/envelope.py turns each track into <ENVELOPE_DIR>/NNN.env
+// (NNN = track number, as in the DFPlayer's 001.mp3 or the I2S track list):
+//
+//   offset 0   "ENV1"
+//          4   uint16  frames per second
+//          6   uint8   version (0), uint8 reserved
+//          8   uint32  frame count
+//         12   frame count x {uint8 loudness, uint8 beat}
+//
+// little endian. Loudness is normalised per track (0..255); beat is the
+// onset strength at detected beats and 0 elsewhere.
+//
+// On TrackStarted the file is opened and read ENVELOPE_BUFFER_FRAMES at a
+// time into a small window. The clock starts at the event's stamp plus the
+// backend's output latency; the I2S backend also re-anchors on its DAC
+// position every ENVELOPE_RESYNC_MS. serviceEnvelope() does work only when
+// the clock reaches a new frame, and then writes an output only if its value
+// changed: the fire's sparking gain, the mill's PWM scale and, on strong
+// beats, a smoke puff. Depths and the beat threshold are set per channel
+// and saved in ENVELOPE_CONFIG_FILE; 0 leaves a channel alone.
+
+#ifndef ENVELOPE_DIR
+#define ENVELOPE_DIR "/audio"
+#endif
+#define ENVELOPE_CONFIG_FILE "/envelope.json"
+#ifndef ENVELOPE_BUFFER_FRAMES
+#define ENVELOPE_BUFFER_FRAMES 256 // 1.28 s at 200 Hz
+#endif
+#define ENVELOPE_RESYNC_MS 250
+// From the play command to sound out of the DFPlayer; calibrate per module
+#ifndef ENVELOPE_DFPLAYER_LATENCY_MS
+#define ENVELOPE_DFPLAYER_LATENCY_MS 100
+#endif
+
+struct EnvelopeConfig {
+    uint8_t fireDepth = 60;  // % swing of the fire's sparking with loudness
+    uint8_t millDepth = 0;   // % swing of the mill speed with loudness
+    uint8_t smokeBeat = 0;   // beat strength that fires a smoke puff
+    uint16_t smokePuffMs = 400;
+    uint16_t smokeCooldownMs = 3000;
+    int16_t latencyMs = 0; // added to the backend's own latency
+};
+
+void setupEnvelope();   // after setupFileSystem()
+void serviceEnvelope(); // from loop(), after serviceEventBus()
+
+// Bus subscriber for TrackStarted/TrackFinished (needs the event stamp)
+void envelopeOnEvent(const Event &event);
+
+EnvelopeConfig envelopeConfig();
+bool envelopeSetConfig(const EnvelopeConfig &config, String &error);
+void envelopeDescribe(JsonObject out);
+
+#endif // ENVELOPE_H
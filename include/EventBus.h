@@ -0,0 +1,128 @@
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <type_traits>
+#include "DeviceState.h"
+
+// Internal publish/subscribe between subsystems.
+//
+// Each event is a small trivially copyable struct, declared below with
+// EVENT_TYPE(). eventPublish() copies it into the ring of the calling core
+// and returns; it never blocks or allocates and may be called from any task
+// or an ISR. serviceEventBus() drains both rings on the loop task, oldest
+// first, and calls the subscribers. They are listed in a table fixed at
+// compile time in EventBus.cpp, so routing is an array lookup. The last
+// subscriber is the rule table (Rules.h), which runs actions for events.
+//
+// Events published while dispatching (e.g. by an action a rule ran) are
+// handled in the same drain, up to EVENT_DRAIN_MAX per call.
+
+#ifndef EVENT_RING_SIZE
+#define EVENT_RING_SIZE 32 // per core, power of two
+#endif
+#ifndef EVENT_DRAIN_MAX
+#define EVENT_DRAIN_MAX 32
+#endif
+#define EVENT_PAYLOAD_BYTES 8
+
+enum class EventType : uint8_t {
+    TrackStarted,
+    TrackFinished,
+    FireChanged,
+    SmokeChanged,
+    MillChanged,
+    EffectChanged,
+    Count
+};
+
+// Payloads. value() is what rules compare against.
+struct TrackStarted {
+    int16_t track; // 1-based
+};
+struct TrackFinished {
+    int16_t track; // ran to the end (not stopped)
+};
+struct FireChanged {
+    bool active;
+};
+struct SmokeChanged {
+    uint8_t slot;
+    bool on;
+};
+struct MillChanged {
+    uint8_t from;
+    uint8_t to;
+};
+struct EffectChanged {
+    bool running;
+};
+
+template <typename E>
+struct EventTraits;
+
+#define EVENT_TYPE(Payload, valueExpr)                                              \
+    template <>                                                                     \
+    struct EventTraits<Payload> {                                                   \
+        static constexpr EventType type = EventType::Payload;                       \
+        static int32_t value(const Payload &e) { return valueExpr; }                \
+    };                                                                              \
+    static_assert(std::is_trivially_copyable<Payload>::value && sizeof(Payload) <= EVENT_PAYLOAD_BYTES, \
+                  #Payload " must be a small trivially copyable struct")
+
+EVENT_TYPE(TrackStarted, e.track);
+EVENT_TYPE(TrackFinished, e.track);
+EVENT_TYPE(FireChanged, e.active);
+EVENT_TYPE(SmokeChanged, e.on);
+EVENT_TYPE(MillChanged, e.to);
+EVENT_TYPE(EffectChanged, e.running);
+
+// What subscribers receive; payload<E>() is checked against the type
+struct Event {
+    EventType type;
+    int32_t value;
+    uint32_t stampUs; // esp_timer time of publication (low 32 bits)
+    alignas(4) uint8_t payload[EVENT_PAYLOAD_BYTES];
+
+    template <typename E>
+    E as() const {
+        E e;
+        memcpy(&e, payload, sizeof(E));
+        return e;
+    }
+};
+
+// "track_finished", ... (the names rules use); null for an unknown type
+const char *eventTypeName(EventType type);
+bool eventTypeFromName(const char *name, EventType &out);
+
+void setupEventBus(); // before anything publishes
+// Drain from loop(), after the command queue and before effects render
+void serviceEventBus();
+
+// Raw form of eventPublish(); false when the core's ring is full
+bool eventPublishRaw(EventType type, int32_t value, const void *payload, size_t len);
+
+template <typename E>
+inline bool eventPublish(const E &payload) {
+    return eventPublishRaw(EventTraits<E>::type, EventTraits<E>::value(payload), &payload, sizeof(E));
+}
+
+// Publishes FireChanged / SmokeChanged / MillChanged for a committed
+// DeviceState update (called by DeviceState)
+void eventsStateChange(const DeviceState &before, const DeviceState &after);
+
+struct EventBusStats {
+    uint32_t published[2]; // per core
+    uint32_t dropped[2];   // ring full
+    uint32_t dispatched;
+    uint32_t deferred;     // left for the next drain (EVENT_DRAIN_MAX)
+    uint32_t maxLatencyUs; // publish -> dispatch
+    uint32_t maxDispatchUs; // all subscribers of one event, rule actions included
+};
+
+EventBusStats eventBusStats();
+void eventBusDescribe(JsonObject out);
+
+#endif // EVENTBUS_H
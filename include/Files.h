@@ -2,8 +2,50 @@
 #define FILES_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <LittleFS.h>
+#include "FsBench.h"
+
+// Mount profile, persisted in FS_PROFILE_FILE:
+//   max_open_files  descriptors reserved at mount; applies at the next boot
+//   read_ahead      stdio buffer of files opened with fsOpen() (0: newlib's
+//                   default)
+//   chunk           most bytes per static file response chunk (0: whatever
+//                   the TCP window takes)
+// LittleFS's own cache and lookahead sizes are fixed by sdkconfig in the
+// prebuilt esp_littlefs; fsDescribe() reports them and tools/fsbench tries
+// other values on the host against the same image.
+
+#define FS_PROFILE_FILE "/fs.json"
+// VFS mount point of LittleFS, for stdio access (fopen(FS_BASE_PATH "/x"))
+#define FS_BASE_PATH "/littlefs"
+#ifndef FS_MAX_OPEN_FILES
+#define FS_MAX_OPEN_FILES 10
+#endif
+#ifndef FS_READ_AHEAD_BYTES
+#define FS_READ_AHEAD_BYTES 0
+#endif
+#ifndef FS_CHUNK_BYTES
+#define FS_CHUNK_BYTES 0
+#endif
+
+struct FsProfile {
+    uint8_t maxOpenFiles = FS_MAX_OPEN_FILES;
+    uint16_t readAheadBytes = FS_READ_AHEAD_BYTES;
+    uint16_t chunkBytes = FS_CHUNK_BYTES;
+};
 
 void setupFileSystem();
 
-#endif // FILES_H
\ No newline at end of file
+const FsProfile &fsProfile();
+// Validates, applies and saves to FS_PROFILE_FILE
+bool fsSetProfile(const FsProfile &profile, String &error);
+void fsDescribe(JsonObject out); // profile, sdkconfig sizes, usage
+
+// Open for reading with the profile's read-ahead
+File fsOpen(const char *path);
+
+// FsBench.h suite on LittleFS; config.buffer is supplied here
+void fsBenchmark(FsBenchConfig config, JsonObject out);
+
+#endif // FILES_H
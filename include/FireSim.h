@@ -0,0 +1,94 @@
+#ifndef FIRESIM_H
+#define FIRESIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fire model behind fireEffect(), kept free of Arduino so it builds on the
+// host (tools/firebench).
+//
+// Heat lives on a FIRE_GRID_W x FIRE_GRID_H grid (row 0 is the base) in
+// 0..0xFFFF fixed point, finer than any set of physical outputs. Each frame
+// cools every cell, lets heat rise and spread sideways, and ignites sparks
+// near the base. The columns are split into zones, one per light, each with
+// its own cooling and sparking; outputs read the grid back through
+// zoneLevel() (lights) and heightLevel() (strip pixels).
+//
+// All randomness comes from a seeded xorshift32, so a seed and a frame count
+// fix the output bit for bit on any platform (see FIRE_GOLDEN_*).
+
+#ifndef FIRE_GRID_W
+#define FIRE_GRID_W 12
+#endif
+#ifndef FIRE_GRID_H
+#define FIRE_GRID_H 24
+#endif
+#define FIRE_MAX_ZONES 4
+#define FIRE_DEFAULT_COOLING 55
+#define FIRE_DEFAULT_SPARKING 120
+
+// Reference run: grid checksum after FIRE_GOLDEN_FRAMES steps from
+// FIRE_GOLDEN_SEED with 3 zones at the defaults. Changes to the model that
+// alter its output must update the value (tools/firebench prints it).
+#define FIRE_GOLDEN_SEED 0x5EEDu
+#define FIRE_GOLDEN_FRAMES 500
+#define FIRE_GOLDEN_CHECKSUM 0xADC478AFu
+
+// xorshift32 (Marsaglia): three shifts per number, period 2^32 - 1
+class FireRng {
+public:
+    explicit FireRng(uint32_t seed = 1) { reseed(seed); }
+    void reseed(uint32_t seed) { state_ = seed ? seed : 0x9E3779B9u; }
+    uint32_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+    // Uniform in [0, n) without a division
+    uint32_t below(uint32_t n) { return static_cast<uint32_t>((static_cast<uint64_t>(next()) * n) >> 32); }
+
+private:
+    uint32_t state_;
+};
+
+struct FireZone {
+    uint8_t cooling;  // how fast heat fades as it rises (0..255)
+    uint8_t sparking; // chance of a new spark per frame (0..255)
+};
+
+class FireSim {
+public:
+    // Split the columns into `zones` (1..FIRE_MAX_ZONES) at default parameters
+    void begin(int zones);
+    // Clear the grid and restart the random sequence
+    void reset(uint32_t seed);
+    void setZone(int zone, FireZone params);
+    FireZone zone(int zone) const { return zones_[zone]; }
+    int zones() const { return zoneCount_; }
+    // Scales every zone's sparking, Q8 (256: as set); audio envelopes drive it
+    void setSparkGain(uint16_t gain) { sparkGain_ = gain; }
+
+    void step();
+
+    // Mean heat over a zone's columns, 0..0xFFFF
+    uint16_t zoneLevel(int zone) const;
+    // Heat at `pos` along the flame (0 base .. 0xFFFF tip), averaged across
+    // the columns and interpolated between rows
+    uint16_t heightLevel(uint16_t pos) const;
+    // FNV-1a over the grid (golden-output checks)
+    uint32_t checksum() const;
+
+private:
+    uint16_t heat_[FIRE_GRID_H][FIRE_GRID_W] = {};
+    uint16_t rowMean_[FIRE_GRID_H] = {};
+    uint16_t zoneMean_[FIRE_MAX_ZONES] = {};
+    FireZone zones_[FIRE_MAX_ZONES] = {};
+    uint8_t zoneOf_[FIRE_GRID_W] = {};
+    uint8_t zoneColumns_[FIRE_MAX_ZONES] = {}; // columns mapped to each zone by zoneOf_
+    int zoneCount_ = 1;
+    uint16_t sparkGain_ = 256;
+    FireRng rng_;
+};
+
+#endif // FIRESIM_H
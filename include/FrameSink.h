@@ -0,0 +1,62 @@
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Strip frames and where they go, kept free of Arduino so the double
+// buffering builds on the host (test/test_frame_sink). PixelStrip.h drives
+// the real strip through the RMT sink (RmtFrameSink.h).
+
+struct Pixel {
+    uint8_t g, r, b; // WS2812 wire order
+};
+
+// Destination of finished frames. The RMT sink drives the real strip; the
+// memory sink keeps the last frame and counts traffic (tests, benchmarks).
+class FrameSink {
+public:
+    virtual ~FrameSink() {}
+    virtual bool begin(size_t pixels) = 0;
+    // Start sending `pixels`; the buffer stays untouched until waitIdle() returns
+    virtual void submit(const Pixel *pixels, size_t count) = 0;
+    // Block until the previous submit() has been fully sent
+    virtual void waitIdle() = 0;
+};
+
+class MemoryFrameSink : public FrameSink {
+public:
+    ~MemoryFrameSink() override;
+    bool begin(size_t pixels) override;
+    void submit(const Pixel *pixels, size_t count) override;
+    void waitIdle() override {}
+
+    const Pixel *lastFrame() const { return frame; }
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+
+private:
+    Pixel *frame = nullptr;
+    size_t capacity = 0;
+};
+
+// Two frames over caller-owned storage (2 x pixels): effects render into the
+// back one while the front one is still being sent.
+class PixelFrames {
+public:
+    void begin(FrameSink *sink, Pixel *storage, size_t pixels);
+    Pixel *back() { return frames_ + back_ * pixels_; }
+    size_t pixels() const { return pixels_; }
+    // Wait for the previous transfer, send the back frame and swap. The new
+    // back frame starts as a copy of the one sent, so effects that update
+    // incrementally keep working.
+    void show();
+
+private:
+    FrameSink *sink_ = nullptr;
+    Pixel *frames_ = nullptr;
+    size_t pixels_ = 0;
+    int back_ = 0;
+};
+
+#endif // FRAMESINK_H
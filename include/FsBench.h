@@ -0,0 +1,89 @@
+#ifndef FSBENCH_H
+#define FSBENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Filesystem benchmark suite, kept free of Arduino so the same code runs on
+// the device (LittleFS, /api/bench/fs) and on the host against littlefs on a
+// file-backed block device (tools/fsbench).
+//
+// Phases, in order:
+//   open        open + close of the file
+//   sequential  whole-file read, once per chunk size
+//   random      seek + read of randomReadBytes at random offsets
+//   stat        existence check of the file and of a missing path
+//   list        directory listing of the file's directory
+//   create      create, write 32 bytes and close a new file
+//   remove      delete the files made by "create"
+// Without a path the suite writes a scratch file first and removes it after.
+
+#define FSBENCH_MAX_CHUNKS 4
+#define FSBENCH_SCRATCH_PATH "/fsbench.bin"
+#define FSBENCH_SCRATCH_FREE_SHARE 4 // /api/bench/fs: scratch file <= 1/N of free space
+
+// Operations the suite drives. One file is open at a time.
+class FsBenchTarget {
+public:
+    virtual ~FsBenchTarget() = default;
+    virtual uint32_t nowUs() = 0;
+    virtual bool open(const char *path, bool write) = 0;
+    virtual int read(uint8_t *buf, size_t len) = 0;
+    virtual int write(const uint8_t *buf, size_t len) = 0;
+    virtual bool seek(uint32_t pos) = 0;
+    virtual uint32_t size() = 0; // of the open file
+    virtual void close() = 0;
+    virtual bool exists(const char *path) = 0;
+    virtual int list(const char *dir) = 0; // entries, -1 on error
+    virtual bool remove(const char *path) = 0;
+    // Bytes read from the block device so far, where the target can see it
+    virtual uint64_t deviceBytesRead() { return 0; }
+};
+
+struct FsBenchConfig {
+    const char *path = nullptr; // file to read; nullptr: scratch file
+    uint32_t scratchBytes = 64 * 1024;
+    uint16_t chunks[FSBENCH_MAX_CHUNKS] = {256, 1024, 4096, 8192}; // 0 ends the list
+    uint32_t opens = 50;
+    uint32_t randomReads = 200;
+    uint32_t randomReadBytes = 512;
+    uint32_t metaOps = 20;
+    uint32_t seed = 1;
+    // Scratch space for reads and writes, at least the largest chunk
+    uint8_t *buffer = nullptr;
+    size_t bufferBytes = 0;
+};
+
+struct FsBenchTiming {
+    uint32_t count = 0;
+    uint32_t totalUs = 0;
+    uint32_t maxUs = 0;
+    uint64_t bytes = 0;       // file bytes moved (reads and writes)
+    uint64_t deviceBytes = 0; // block device bytes read, 0 if unknown
+
+    void add(uint32_t us) {
+        count++;
+        totalUs += us;
+        if (us > maxUs) maxUs = us;
+    }
+    uint32_t avgUs() const { return count ? totalUs / count : 0; }
+    // KiB/s over the whole phase
+    uint32_t kibPerSec() const { return totalUs ? static_cast<uint32_t>(bytes * 1000000 / 1024 / totalUs) : 0; }
+};
+
+struct FsBenchResult {
+    const char *error = nullptr; // set when the suite stopped early
+    uint32_t fileBytes = 0;
+    FsBenchTiming open;
+    uint16_t chunks[FSBENCH_MAX_CHUNKS] = {};
+    FsBenchTiming sequential[FSBENCH_MAX_CHUNKS];
+    FsBenchTiming random;
+    FsBenchTiming stat;
+    FsBenchTiming list;
+    FsBenchTiming create;
+    FsBenchTiming remove;
+};
+
+bool fsBenchRun(FsBenchTarget &fs, const FsBenchConfig &config, FsBenchResult &out);
+
+#endif // FSBENCH_H
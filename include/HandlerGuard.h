@@ -0,0 +1,67 @@
+#ifndef HANDLER_GUARD_H
+#define HANDLER_GUARD_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Time budget for callbacks on the AsyncTCP task. Every request runs on that
+// one task, so a handler that sleeps or waits (a delay(), a device probe, a
+// contended Logger mutex) stalls all clients at once.
+//
+// onApi() runs each handler inside a HandlerGuard. When the handler passes
+// its budget a one-shot esp_timer samples the network task's stack, which is
+// saved while the task is blocked (a task still computing is sampled again
+// until it blocks or returns). On return the route, duration and backtrace
+// go into a ring of the last GUARD_RING_SIZE offenders and the route's
+// counters are updated; /api/guard reports both. Backtraces are raw PCs:
+//
+//   xtensa-esp32s3-elf-addr2line -pfiaC -e .pio/build/<env>/firmware.elf <pcs>
+//
+// Fail-fast (off by default, /api/guard?failfast=1): a route that overran
+// GUARD_TRIP_COUNT times in a row is answered 503 without running. After
+// GUARD_COOLDOWN_MS one call is let through again (half-open): within budget
+// it closes the route, another overrun restarts the cool-down. Routes
+// registered with failFast false (/api/guard itself) are never rejected.
+//
+// Build with -DGUARD_WRAP_DELAY -Wl,--wrap=delay to also record every
+// delay() made on the network task, at the call site and whatever its length.
+
+#ifndef GUARD_BUDGET_MS
+#define GUARD_BUDGET_MS 20
+#endif
+#define GUARD_MAX_ROUTES 64
+#define GUARD_RING_SIZE 8
+#define GUARD_BACKTRACE_DEPTH 12
+#define GUARD_TRIP_COUNT 3
+#define GUARD_COOLDOWN_MS 30000
+
+struct GuardRoute; // budget and counters of one route
+
+void setupHandlerGuard(); // before routes are registered
+
+// At route registration; nullptr (route unguarded) when the table is full.
+// `uri` must outlive the server (route literals).
+GuardRoute *guardRegister(const char *uri, uint32_t budgetMs = GUARD_BUDGET_MS, bool failFast = true);
+
+// False while fail-fast has the route tripped and cooling down: reject
+// instead of running it
+bool guardAdmit(GuardRoute *route);
+
+// Times the enclosing handler. Network task only; nested guards are ignored.
+class HandlerGuard {
+public:
+    explicit HandlerGuard(GuardRoute *route);
+    ~HandlerGuard();
+    HandlerGuard(const HandlerGuard &) = delete;
+    HandlerGuard &operator=(const HandlerGuard &) = delete;
+
+private:
+    GuardRoute *route_;
+    uint32_t startUs_;
+};
+
+void guardSetFailFast(bool on);
+void guardReset(); // counters, offenders and tripped routes
+void guardDescribe(JsonObject out);
+
+#endif // HANDLER_GUARD_H
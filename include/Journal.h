@@ -0,0 +1,61 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <Arduino.h>
+#include "DeviceState.h"
+
+// Append-only, delta-encoded journal of state changes on LittleFS.
+//
+// Records are buffered in RAM and flushed in batches by serviceJournal().
+// Every batch starts with a keyframe (absolute values), so a batch decodes on
+// its own and the file can rotate at any batch boundary. tools/journal/
+// decodes and replays the files.
+//
+// Batch:   'J' u16le(length) <keyframe> <record>*   (length excludes the 3-byte prefix)
+// Keyframe: 0xF1 varint(millis) varint(field value) x JOURNAL_FIELDS
+// Record:  varint(ms since previous record) <tag> <payload>
+//   tag < JOURNAL_FIELDS  state field, payload zigzag varint delta
+//   0x40                   audio command, payload byte(cmd) zigzag varint(arg)
+//   0x41                   cause, payload varint(len) bytes (route + query)
+//   0x42                   user effect, payload varint(len) bytes (name, empty when stopped)
+//   0xF0                   boot, payload varint(reset reason)
+
+#define JOURNAL_FILE "/journal.bin"
+#define JOURNAL_ROTATED_FILE "/journal.1.bin"
+#ifndef JOURNAL_MAX_BYTES
+#define JOURNAL_MAX_BYTES (64 * 1024)
+#endif
+#ifndef JOURNAL_BUFFER_BYTES
+#define JOURNAL_BUFFER_BYTES 2048
+#endif
+#ifndef JOURNAL_FLUSH_MS
+#define JOURNAL_FLUSH_MS 10000
+#endif
+
+// Field order is part of the file format
+enum JournalField : uint8_t {
+    JF_LED0, JF_LED1, JF_LED2, JF_SMOKE0, JF_SMOKE1, JF_MILL, JF_FIRE, JF_PLAYING, JF_VOLUME,
+    JOURNAL_FIELDS
+};
+
+enum JournalAudioCmd : uint8_t { JA_PLAY = 1, JA_STOP = 2, JA_VOLUME = 3, JA_REINIT = 4 };
+
+void setupJournal();   // after setupFileSystem()
+void serviceJournal(); // call from loop(); flushes when due
+
+void journalStateChange(const DeviceState &before, const DeviceState &after);
+void journalAudioCommand(JournalAudioCmd cmd, int32_t arg);
+// A user effect started (name) or stopped (nullptr). Its LED frames are not
+// journaled, nor are the fire's.
+void journalEffect(const char *name);
+
+// Request that the changes made by the current task are attributed to
+// (cleared with nullptr). Only recorded when a change actually follows.
+void journalSetCause(const char *cause);
+// This task's current cause ("" when none), for work handed to another task
+const char *journalCause();
+
+void journalFlush();
+uint32_t journalDroppedRecords();
+
+#endif // JOURNAL_H
@@ -0,0 +1,46 @@
+#ifndef LEDOUTPUT_H
+#define LEDOUTPUT_H
+
+#include <Arduino.h>
+
+// High-resolution LED output stage.
+//
+// Callers pass a 16-bit light level (0..LED_LEVEL_MAX) that is linear in
+// perceived brightness. The stage maps it through a CIE 1931 lightness table
+// (built at compile time) onto LEDC duty at LED_PWM_RESOLUTION bits, and
+// sigma-delta dithers the remaining fractional bits at LED_DITHER_HZ so slow
+// effects (20 Hz fire) still fade smoothly at the dim end.
+
+#ifndef LED_PWM_RESOLUTION
+#define LED_PWM_RESOLUTION 13 // 13-bit -> 0..8191, max ~9.7 kHz on LEDC
+#endif
+#ifndef LED_PWM_FREQ
+#define LED_PWM_FREQ 5000
+#endif
+#ifndef LED_DITHER_HZ
+#define LED_DITHER_HZ 1000
+#endif
+// LEDC channels 0/1 share timer 0 with the mill PWM (8-bit), so LEDs start at 2
+#ifndef LED_LEDC_CHANNEL_BASE
+#define LED_LEDC_CHANNEL_BASE 2
+#endif
+#ifndef LED_OUTPUT_MAX_CHANNELS
+#define LED_OUTPUT_MAX_CHANNELS 4
+#endif
+
+#define LED_LEVEL_MAX 0xFFFF
+
+void setupLedOutput();
+
+// Bind a pin to the next free LEDC channel. Returns false when out of channels.
+bool ledOutputAttach(int pin);
+
+// Set the perceptual light level of an attached pin (ignored if not attached).
+void ledOutputWrite(int pin, uint16_t level);
+uint16_t ledOutputLevel(int pin);
+
+// Expand an 8-bit level (API/UI range) to the 16-bit level range
+inline uint16_t ledLevelFrom8(uint8_t v) { return static_cast<uint16_t>((v << 8) | v); }
+inline uint8_t ledLevelTo8(uint16_t level) { return static_cast<uint8_t>(level >> 8); }
+
+#endif // LEDOUTPUT_H
@@ -2,15 +2,21 @@
 #define LED_H
 
 #include <Arduino.h>
+#include "BoardProfile.h"
+#include "FireSim.h"
 
-#define LED_ONE 15
-#define LED_TWO 7
-#define LED_THREE 6
+// Light pins by slot (red, yellow, green on the diorama), from the profile
+constexpr BoardPins<ChannelGroup::Lights> kLightPins{};
 
 void setupLeds();
 void tryLeds();
 void setLed(int ledPin, int brightness);
-bool getLed(int ledPin);
+// Set a perceptual 16-bit light level (0..LED_LEVEL_MAX, see LedOutput.h)
+void setLedLevel(int ledPin, uint16_t level);
+// Same, for frames rendered by an effect: not journaled (see DeviceState.h)
+void renderLedLevel(int ledPin, uint16_t level);
+// Last brightness written to the LED (0..255), from the shadow state
+int getLed(int ledPin);
 void turnOffLeds();
 void turnOnLeds();
 
@@ -24,4 +30,11 @@ void startFireEffect();
 void stopFireEffect();
 bool isFireEffectActive();
 
+// Fire tuning per zone (one zone per light, see FireSim.h)
+bool setFireZone(int zone, uint8_t cooling, uint8_t sparking);
+FireZone getFireZone(int zone);
+int fireZoneCount();
+// Scale the sparking of every zone, Q8 (256: as tuned); see Envelope.h
+void setFireSparkGain(uint16_t gain);
+
 #endif // LED_H
@@ -3,13 +3,27 @@
 #define LOGGER_H
 
 #include <Arduino.h>
+#include <atomic>
+#include <vector>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 
+// Bytes of RAM kept for recent log records (PSRAM when available)
+#ifndef LOG_RETENTION_BYTES
+#define LOG_RETENTION_BYTES (16 * 1024)
+#endif
+
 class Logger {
 public:
     enum Level { DEBUG = 0, INFO = 1, WARN = 2, ERROR = 3 };
 
+    struct Record {
+        uint32_t seq;
+        unsigned long timestamp;
+        Level level;
+        String message;
+    };
+
     // Initialize the singleton (call once after Serial.begin)
     static void init(const String &appName = "App", Level minLevel = INFO);
 
@@ -19,9 +33,23 @@ public:
     // Optional deinit (rarely needed)
     static void deinit();
 
+    // Level filter for serial output
     void setLevel(Level minLevel);
     Level getLevel() const;
 
+    // Level filter for the in-RAM retention buffer (independent of serial)
+    void setRetentionLevel(Level minLevel);
+    Level getRetentionLevel() const;
+
+    // Copy up to maxRecords retained records with seq >= since into out.
+    // Never blocks writers: records overwritten while being read are skipped
+    // and counted in *dropped. Returns the cursor to pass as `since` next time.
+    uint32_t readRetained(uint32_t since, std::vector<Record> &out, size_t maxRecords, uint32_t *dropped = nullptr) const;
+    uint32_t nextSeq() const;
+    size_t retentionCapacity() const;
+
+    const char* levelToString(Level lvl) const;
+
     void log(const String &message);
     void log(const String &message, unsigned long timestamp);
     void log(const String &message, unsigned long timestamp, unsigned long threadTime);
@@ -33,10 +61,22 @@ private:
 
     String appName;
     Level minLevel;
+    Level retainLevel;
     SemaphoreHandle_t mutex;
 
+    // Retention ring: byte offsets grow monotonically and wrap modulo ringSize.
+    // Writers append under ringMux; readers validate against ringTail afterwards.
+    uint8_t *ring;
+    size_t ringSize;
+    std::atomic<uint32_t> ringHead;
+    std::atomic<uint32_t> ringTail;
+    std::atomic<uint32_t> seqCounter;
+    portMUX_TYPE ringMux;
+
     void output(Level lvl, const String &message, unsigned long timestamp, unsigned long threadTime);
-    const char* levelToString(Level lvl) const;
+    void retain(Level lvl, const String &message, unsigned long timestamp);
+    void ringWrite(uint32_t offset, const void *src, size_t len);
+    void ringRead(uint32_t offset, void *dst, size_t len) const;
 
     static Logger* s_instance;
 };
@@ -0,0 +1,94 @@
+#ifndef MEMORYPOLICY_H
+#define MEMORYPOLICY_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <new>
+
+// Heap placement policy and per-subsystem accounting.
+//
+// Internal SRAM is what lwIP, WiFi and the AsyncTCP task allocate from, so
+// large buffers that are touched at human or network speed (log retention,
+// journal batches, trace buffers, decoders, JSON responses, rule tables) are
+// Cold and go to PSRAM when the board has it. Hot buffers (shared with loop
+// timing or a critical section on every frame) and anything read from an ISR
+// or by DMA stay internal: PSRAM is unreachable while flash writes have the
+// cache disabled.
+//
+// Every allocation is tagged with a subsystem; the map (/api/memory, and at
+// boot) shows static and heap bytes per subsystem next to the heap totals.
+
+enum MemSubsystem : uint8_t {
+    MEM_LOGS,
+    MEM_JOURNAL,
+    MEM_TRACE,
+    MEM_AUDIO,
+    MEM_PIXELS,
+    MEM_WEB,
+    MEM_SCHEDULE,
+    MEM_SHOW,
+    MEM_WIFI,
+    MEM_COMMANDS,
+    MEM_EFFECTS,
+    MEM_EVENTS,
+    MEM_SUBSYSTEMS
+};
+
+enum class MemClass : uint8_t {
+    Hot,  // internal SRAM
+    Dma,  // internal, DMA capable
+    Cold, // PSRAM if present, else internal
+};
+
+// nullptr when neither region has room; failures are counted
+void *memAlloc(MemSubsystem sub, MemClass cls, size_t size);
+void *memRealloc(MemSubsystem sub, MemClass cls, void *ptr, size_t size);
+void memFree(void *ptr);
+
+// Fixed arrays a module owns in .bss/.data, for the map
+void memRegisterStatic(MemSubsystem sub, size_t bytes);
+
+struct MemSubsystemStats {
+    uint32_t staticBytes;
+    uint32_t internalBytes;
+    uint32_t psramBytes;
+    uint32_t peakBytes; // internal + psram
+    uint32_t allocations;
+    uint32_t failures;
+};
+MemSubsystemStats memStats(MemSubsystem sub);
+const char *memSubsystemName(MemSubsystem sub);
+
+void memDescribe(JsonObject out);
+void memLogMap();
+
+// std:: container allocator, e.g. std::vector<Rule, MemAllocator<Rule, MEM_SCHEDULE>>
+template <typename T, MemSubsystem Sub, MemClass Cls = MemClass::Cold>
+struct MemAllocator {
+    using value_type = T;
+    template <typename U>
+    struct rebind {
+        using other = MemAllocator<U, Sub, Cls>;
+    };
+
+    MemAllocator() = default;
+    template <typename U>
+    MemAllocator(const MemAllocator<U, Sub, Cls> &) {}
+
+    T *allocate(size_t n) {
+        void *p = memAlloc(Sub, Cls, n * sizeof(T));
+        if (!p) abort(); // callers have no recovery path, as with operator new
+        return static_cast<T *>(p);
+    }
+    void deallocate(T *p, size_t) { memFree(p); }
+
+    template <typename U>
+    bool operator==(const MemAllocator<U, Sub, Cls> &) const { return true; }
+    template <typename U>
+    bool operator!=(const MemAllocator<U, Sub, Cls> &) const { return false; }
+};
+
+// For JsonDocument doc(memJsonAllocator(MEM_WEB)); always Cold
+ArduinoJson::Allocator *memJsonAllocator(MemSubsystem sub);
+
+#endif // MEMORYPOLICY_H
@@ -0,0 +1,41 @@
+#ifndef PCMSINK_H
+#define PCMSINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// Destination for decoded 16-bit stereo PCM. The I2S engine writes to the
+// DMA ring through one; WavFileSink renders to a file instead, so decoding
+// can be checked and benchmarked without a DAC. WavFileSink uses stdio (on
+// the device through the VFS mount, FS_BASE_PATH) so it also builds on the
+// host (test/test_wav_format, tools/wavbench).
+class PcmSink {
+public:
+    virtual ~PcmSink() = default;
+    virtual bool begin(uint32_t sampleRate) = 0;
+    // Frames are interleaved L/R; may block until there is room
+    virtual size_t write(const int16_t *frames, size_t count) = 0;
+    virtual void end() {}
+};
+
+class WavFileSink : public PcmSink {
+public:
+    explicit WavFileSink(const char *path) : path_(path) {}
+    ~WavFileSink() override { end(); }
+
+    bool begin(uint32_t sampleRate) override;
+    size_t write(const int16_t *frames, size_t count) override;
+    void end() override; // patches the header sizes
+
+    uint32_t frames() const { return frames_; }
+
+private:
+    std::string path_;
+    FILE *file_ = nullptr;
+    uint32_t rate_ = 0;
+    uint32_t frames_ = 0;
+};
+
+#endif // PCMSINK_H
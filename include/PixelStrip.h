@@ -0,0 +1,38 @@
+#ifndef PIXELSTRIP_H
+#define PIXELSTRIP_H
+
+#include <Arduino.h>
+
+// Addressable (WS2812) strip output with double-buffered frames: effects
+// render into the back buffer while the front buffer is still being clocked
+// out, then pixelStripShow() swaps them.
+//
+// The strip is compiled out unless the board profile has one (see
+// BoardProfile.h), which sets PIXEL_STRIP_COUNT and PIXEL_STRIP_PIN. The
+// buffering itself is PixelFrames (FrameSink.h).
+
+#include "BoardProfile.h"
+#include "FrameSink.h"
+
+#ifndef PIXEL_STRIP_RMT_CHANNEL
+#define PIXEL_STRIP_RMT_CHANNEL 0
+#endif
+
+struct PixelStripStats {
+    uint32_t frames;
+    uint32_t lastWaitUs;   // time show() blocked on the previous transfer
+    uint32_t maxWaitUs;
+};
+
+// Uses the RMT sink when `sink` is null. No-op when PIXEL_STRIP_COUNT is 0.
+void setupPixelStrip(FrameSink *sink = nullptr);
+bool pixelStripEnabled();
+size_t pixelStripCount();
+
+// Buffer the next frame is rendered into (null when disabled)
+Pixel *pixelStripBackBuffer();
+// Wait for the previous transfer, swap buffers and start sending
+void pixelStripShow();
+PixelStripStats pixelStripStats();
+
+#endif // PIXELSTRIP_H
@@ -6,8 +6,10 @@
 #define PWM_H
 
 #include <Arduino.h>
+#include "BoardProfile.h"
 
-#define MOULIN_PWM_PIN 12
+// Mill motor PWM; pin and resolution come from the profile's "mill" channel.
+// Compiled out on boards without one (BOARD_HAS_MILL 0).
 
 void setupPwm();
 void setPwm(int brightness);
@@ -15,5 +17,8 @@ int getPwm();
 void turnOffPwm();
 void turnOnPwm();
 void tryPwm();
+// Scale the output against the set level, Q8 (256: as set). Only the duty
+// changes; the level in DeviceState stays what was asked for (Envelope.h).
+void setPwmScale(uint16_t scale);
 
 #endif // PWM_H
@@ -0,0 +1,10 @@
+#ifndef RMTFRAMESINK_H
+#define RMTFRAMESINK_H
+
+#include "FrameSink.h"
+
+// WS2812 strip on PIXEL_STRIP_PIN through the RMT peripheral; only built
+// when the board profile has a strip
+FrameSink &rmtFrameSink();
+
+#endif // RMTFRAMESINK_H
@@ -0,0 +1,41 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "EventBus.h"
+
+// Event -> action bindings, loaded from /rules.json:
+//
+//   [
+//     {"on": "track_finished", "value": 3, "do": "smoke:off;fire:on"},
+//     {"on": "mill", "min": 1, "do": "led:red:60;led:yellow:60", "cooldown_ms": 500},
+//     {"on": "mill", "value": 0, "do": "leds:on"}
+//   ]
+//
+// "on" is an event name (see eventTypeName()); the rule fires when the
+// event's value is within [min, max] ("value" sets both; default any).
+// Values: track number, fire/smoke/effect 1 or 0, mill level after the
+// change. "do" is an action spec (Actions.h). "cooldown_ms" ignores the
+// rule for that long after it fired, which also breaks rule feedback loops.
+//
+// Rules are kept in a fixed table grouped by event type, so finding the ones
+// for an event is an index lookup and never allocates.
+
+#define RULES_FILE "/rules.json"
+#ifndef RULES_MAX
+#define RULES_MAX 32
+#endif
+#define RULE_ACTION_MAX 96
+
+void setupRules();   // after setupActions()
+void serviceRules(); // from loop(); applies a requested reload
+
+// Bus subscriber (see EventBus.cpp)
+void rulesOnEvent(const Event &event);
+
+// Re-read RULES_FILE on the loop task (safe from request handlers)
+void rulesReload();
+void rulesDescribe(JsonObject out);
+
+#endif // RULES_H
@@ -0,0 +1,63 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "TimerWheel.h"
+
+// Timed automations: rules persisted on LittleFS trigger action specs (see
+// Actions.h) from a timer wheel serviced in loop(). Wall-clock rules wait for
+// the browser to push the time (/api/time?epoch=...&tz=...).
+
+#ifndef SCHEDULER_TICK_MS
+#define SCHEDULER_TICK_MS 100
+#endif
+// One per armed rule plus the one-shots (smoke puffs); 20 bytes each
+#ifndef SCHEDULER_MAX_TIMERS
+#define SCHEDULER_MAX_TIMERS 64
+#endif
+#ifndef SCHEDULER_MAX_RULES
+#define SCHEDULER_MAX_RULES 32
+#endif
+#define SCHEDULE_FILE "/schedule.json"
+
+enum class RuleKind : uint8_t {
+    Once,     // at = UTC epoch seconds
+    Daily,    // at = seconds after local midnight
+    Hourly,   // at = seconds after the hour
+    Interval  // at = period in seconds, no clock needed
+};
+
+struct ScheduleRule {
+    uint16_t id;
+    RuleKind kind;
+    uint32_t at;
+    String action;
+    bool enabled;
+    time_t nextDue;                 // epoch of the next run (0 when unarmed)
+    TimerWheel::Handle timer;
+};
+
+void setupScheduler();   // after setupFileSystem()
+void serviceScheduler(); // call from loop(); runs due actions
+
+// Time sync pushed from the browser. tzOffsetMinutes is local - UTC.
+void schedulerSetTime(time_t epoch, int tzOffsetMinutes);
+bool schedulerTimeSynced();
+
+// Parse "HH:MM[:SS]" (daily), "MM[:SS]" (hourly), epoch (once) or seconds
+// (interval) into the rule's `at` value
+bool schedulerParseAt(RuleKind kind, const String &text, uint32_t &at);
+bool schedulerParseKind(const String &text, RuleKind &kind);
+
+// Returns the new rule id, or -1 when full/invalid. Persists the rule set.
+int schedulerAddRule(RuleKind kind, uint32_t at, const String &action);
+bool schedulerRemoveRule(uint16_t id);
+
+// One-shot timer on the scheduler wheel; the callback runs in loop()
+TimerWheel::Handle schedulerAfter(uint32_t delayMs, TimerWheel::Callback cb, uint32_t arg);
+bool schedulerCancel(TimerWheel::Handle handle);
+
+void schedulerDescribe(JsonDocument &doc);
+
+#endif // SCHEDULER_H
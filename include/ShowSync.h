@@ -0,0 +1,38 @@
+#ifndef SHOWSYNC_H
+#define SHOWSYNC_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "ShowSyncNode.h"
+
+// Multi-diorama show sync over UDP multicast. The leader broadcasts clock
+// beacons (its esp_timer microseconds) and cue events stamped on that
+// timeline; followers track offset and drift (ClockEstimator) and run each
+// cue's action (see Actions.h) when their local clock reaches it. The
+// protocol itself is ShowSyncNode.h; this is the UDP side.
+
+#ifndef SHOW_SYNC_PORT
+#define SHOW_SYNC_PORT 4210
+#endif
+#ifndef SHOW_SYNC_BEACON_MS
+#define SHOW_SYNC_BEACON_MS 500
+#endif
+#define SHOW_SYNC_GROUP IPAddress(239, 72, 68, 1)
+#define SHOW_SYNC_FILE "/sync.json"
+
+void setupShowSync();   // after WiFi and the filesystem are up
+void serviceShowSync(); // call from loop(): beacons, due cues
+
+bool showSyncSetRole(SyncRole role);
+SyncRole showSyncRole();
+bool showSyncParseRole(const String &text, SyncRole &role);
+
+// Shared timeline in microseconds (leader clock); false until aligned
+bool showSyncNow(int64_t &timelineUs);
+
+// Leader only: broadcast `action` to run on every node `delayMs` from now
+bool showSyncCue(const String &action, uint32_t delayMs);
+
+void showSyncDescribe(JsonDocument &doc);
+
+#endif // SHOWSYNC_H
@@ -0,0 +1,105 @@
+#ifndef SHOWSYNCNODE_H
+#define SHOWSYNCNODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "ClockEstimator.h"
+
+// Show sync protocol state for one node, without the transport: ShowSync.cpp
+// feeds it datagrams and local esp_timer times and sends what it returns,
+// the host tests run several of them over a simulated network.
+//
+// Cues are re-broadcast with the next beacons, so a follower sees each one
+// up to SHOW_SYNC_CUE_REPEATS times. The sequence numbers of the last
+// SHOW_SYNC_RECENT_CUES cues taken from the current leader are kept, so a
+// repeat is dropped whether the cue is still pending or has already run.
+
+#define SHOW_SYNC_ACTION_LEN 64
+#define SHOW_SYNC_MAX_CUES 16
+#define SHOW_SYNC_CUE_REPEATS 3
+#define SHOW_SYNC_RECENT_CUES 32
+
+enum class SyncRole : uint8_t { Off, Leader, Follower };
+
+struct __attribute__((packed)) SyncPacket {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint16_t reserved;
+    uint32_t node;
+    uint32_t seq;
+    int64_t sentUs; // sender timeline at send
+    int64_t atUs;   // cue: timeline time to fire
+    char action[SHOW_SYNC_ACTION_LEN];
+};
+
+class ShowSyncNode {
+public:
+    static constexpr uint32_t MAGIC = 0x4E595344; // "DSYN"
+    static constexpr uint8_t VERSION = 1;
+    static constexpr uint8_t TYPE_BEACON = 1;
+    static constexpr uint8_t TYPE_CUE = 2;
+    static constexpr int64_t LEADER_TIMEOUT_US = 5000000;
+    static constexpr int64_t RESYNC_JUMP_US = 1000000; // leader rebooted / clock jumped
+
+    void begin(uint32_t nodeId) { nodeId_ = nodeId; }
+    uint32_t nodeId() const { return nodeId_; }
+
+    // Drops the leader, the clock fit and every pending cue
+    void setRole(SyncRole role);
+    SyncRole role() const { return role_; }
+
+    // Follower: a datagram received at local time nowUs. With deferFit the
+    // clock sample is only recorded and the result says whether one was: the
+    // caller then fits a copy of clock() outside its lock and hands the
+    // result to applyFit() (ClockEstimator.h).
+    bool receive(const uint8_t *data, size_t len, int64_t nowUs, bool deferFit = false);
+    void applyFit(const ClockEstimator::Fit &fit) { clock_.apply(fit); }
+
+    // Leader: schedule `action` delayUs from now; `out` is the packet to send
+    bool cue(const char *action, int64_t nowUs, int64_t delayUs, SyncPacket &out);
+    // Leader: the beacon to send at nowUs, a pending cue's re-broadcast if any
+    void beacon(int64_t nowUs, SyncPacket &out);
+
+    // Remove and return the next cue due at local time nowUs
+    bool takeDue(int64_t nowUs, char *action, size_t len, int64_t &lateUs);
+
+    // Shared timeline at local time localUs; false until aligned
+    bool timeline(int64_t localUs, int64_t &timelineUs) const;
+
+    const ClockEstimator &clock() const { return clock_; }
+    uint32_t leader() const { return leaderId_; }
+    int64_t lastBeaconUs() const { return lastBeaconUs_; }
+    uint32_t duplicates() const { return duplicates_; }
+
+private:
+    struct Cue {
+        bool used;
+        uint32_t seq;
+        int64_t atUs;    // timeline
+        int repeatsLeft; // leader: remaining re-broadcasts
+        char action[SHOW_SYNC_ACTION_LEN];
+    };
+
+    void fill(SyncPacket &p, uint8_t type, uint32_t seq, int64_t atUs, const char *action, int64_t nowUs) const;
+    bool seen(uint32_t seq) const;
+    bool addCue(uint32_t seq, int64_t atUs, const char *action, int repeats);
+    void forget();
+
+    uint32_t nodeId_ = 0;
+    SyncRole role_ = SyncRole::Off;
+    // Cues are posted from the request task, beacons from the loop
+    std::atomic<uint32_t> seq_{0};
+
+    ClockEstimator clock_;
+    uint32_t leaderId_ = 0;
+    int64_t lastBeaconUs_ = 0;
+    Cue cues_[SHOW_SYNC_MAX_CUES] = {};
+    uint32_t recent_[SHOW_SYNC_RECENT_CUES] = {};
+    int recentCount_ = 0;
+    int recentNext_ = 0;
+    uint32_t duplicates_ = 0;
+};
+
+#endif // SHOWSYNCNODE_H
@@ -2,9 +2,11 @@
 #define SMOKE_H
 
 #include <Arduino.h>
+#include "BoardProfile.h"
 
-#define SMOKE_1 13
-#define SMOKE_2 5
+// Smoke machine pins by slot, from the profile. The whole module is compiled
+// out on boards without smoke outputs (BOARD_HAS_SMOKE 0).
+constexpr BoardPins<ChannelGroup::Smoke> kSmokePins{};
 
 void setupSmoke();
 void trySmoke();
@@ -0,0 +1,72 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <Arduino.h>
+#include "MemoryPolicy.h"
+
+// Hierarchical timer wheel: 4 levels x 64 slots over a 32-bit tick counter.
+// Arming and cancelling are O(1) (intrusive lists in a fixed node pool);
+// advancing costs one slot visit per tick plus an occasional cascade,
+// independent of how many timers are pending. The pool is allocated on
+// begin() and accounted to `subsystem`. Not thread-safe: the owner
+// serializes access.
+class TimerWheel {
+public:
+    typedef void (*Callback)(uint32_t arg);
+    typedef uint32_t Handle; // 0 is never a valid handle
+
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    // Longest delay in ticks; longer requests are clamped (callers re-arm)
+    static constexpr uint32_t MAX_DELAY = (1u << (LEVELS * SLOT_BITS)) - 1;
+
+    TimerWheel(uint16_t capacity, MemSubsystem subsystem);
+    ~TimerWheel();
+
+    bool begin(uint32_t nowTick);
+
+    // Arm a one-shot timer `delayTicks` from the current tick (min 1).
+    // Returns 0 when the pool is exhausted.
+    Handle arm(uint32_t delayTicks, Callback cb, uint32_t arg);
+    bool cancel(Handle handle);
+
+    // Move the wheel forward to `nowTick`; due timers go to the expired list
+    void advance(uint32_t nowTick);
+    // Pop one expired timer; its node is freed before returning
+    bool popExpired(Callback &cb, uint32_t &arg);
+
+    uint32_t now() const { return current; }
+    size_t pending() const { return used; }
+    size_t capacity() const { return cap; }
+
+private:
+    static constexpr uint16_t NIL = 0xFFFF;
+    static constexpr uint16_t LIST_EXPIRED = LEVELS * SLOTS;
+    static constexpr uint16_t LIST_FREE = LIST_EXPIRED + 1;
+
+    struct Node {
+        uint32_t expires;
+        uint32_t arg;
+        Callback cb;
+        uint16_t next;
+        uint16_t prev;
+        uint16_t list; // slot index, LIST_EXPIRED or LIST_FREE
+        uint16_t gen;  // bumped on free so stale handles don't match
+    };
+
+    Node *nodes;
+    MemSubsystem sub;
+    uint16_t cap;
+    uint16_t freeHead;
+    size_t used;
+    uint32_t current;
+    uint16_t heads[LEVELS * SLOTS + 1]; // + expired list
+
+    void link(uint16_t index, uint16_t list);
+    void unlink(uint16_t index);
+    void place(uint16_t index);
+    void cascade(int level);
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,104 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Event tracing into per-core buffers, exported as Chrome trace-event JSON
+// (/api/trace, opens in Perfetto or chrome://tracing).
+//
+// A capture is armed for a window of at most TRACE_MAX_WINDOW_MS; timestamps
+// are the core's cycle counter, which wraps after ~17 s at 240 MHz, and are
+// converted with a per-core anchor taken when the capture starts. Recording
+// reserves a slot with one uncontended atomic add on the current core's
+// buffer; when the buffer is full further events are counted as dropped.
+//
+// A scope that ends on another core than it began on (the task migrated)
+// or began before the capture was armed is counted as dropped too.
+//
+// While no capture is running TRACE_SCOPE costs one relaxed load and a
+// branch. Build with -DTRACE_DISABLE to compile the macros out entirely.
+//
+// Names must outlive the capture (string literals, route URIs).
+
+#ifndef TRACE_EVENTS_PER_CORE
+#define TRACE_EVENTS_PER_CORE 2048
+#endif
+#define TRACE_MAX_WINDOW_MS 15000
+
+extern std::atomic<bool> g_traceActive;
+
+inline bool traceActive() {
+    return g_traceActive.load(std::memory_order_relaxed);
+}
+
+uint32_t traceNow(); // cycle counter of the current core
+void traceComplete(const char *name, uint32_t startCycles, uint8_t startCore, uint32_t arg);
+void traceInstant(const char *name, uint32_t arg);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, uint32_t arg = 0)
+        : name_(traceActive() ? name : nullptr), arg_(arg), core_(name_ ? xPortGetCoreID() : 0),
+          start_(name_ ? traceNow() : 0) {}
+    ~TraceScope() {
+        if (name_) traceComplete(name_, start_, core_, arg_);
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name_;
+    uint32_t arg_;
+    uint8_t core_;
+    uint32_t start_;
+};
+
+#ifndef TRACE_DISABLE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name, arg)
+#define TRACE_INSTANT(name, arg) \
+    do { \
+        if (traceActive()) traceInstant(name, arg); \
+    } while (0)
+#else
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_SCOPE_ARG(name, arg) do {} while (0)
+#define TRACE_INSTANT(name, arg) do {} while (0)
+#endif
+
+// Start a capture (discarding the previous one); stops by itself after windowMs
+bool traceStart(uint32_t windowMs);
+void traceStop();
+
+struct TraceStats {
+    bool active;
+    uint32_t events[2];
+    uint32_t dropped;
+    uint32_t windowMs;
+    uint32_t elapsedMs;
+};
+TraceStats traceStats();
+
+// Streamed export for a chunked response: fills buf with up to maxLen bytes
+// of Chrome JSON per call, 0 when complete. A cursor stays bound to the
+// capture it started on and ends early if a new capture is armed.
+struct TraceExportCursor {
+    uint32_t generation = 0;
+    uint8_t phase = 0;
+    uint8_t core = 0;
+    uint32_t index = 0;
+    struct {
+        void *task;
+        uint8_t core;
+    } seen[32];
+    uint8_t seenCount = 0;
+    char pending[384];
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+};
+size_t traceExport(TraceExportCursor &cursor, uint8_t *buf, size_t maxLen);
+
+#endif // TRACE_H
@@ -0,0 +1,59 @@
+#ifndef WAVFORMAT_H
+#define WAVFORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// RIFF/WAVE container handling shared by the WAV decoder (AudioDecoder.h)
+// and the file sink (PcmSink.h). Kept free of Arduino so it builds on the
+// host (test/test_wav_format, tools/wavbench).
+
+#define WAV_HEADER_BYTES 44 // header written by wavHeader()
+
+struct WavFormat {
+    uint16_t channels = 0;   // 1 or 2
+    uint32_t rate = 0;
+    uint16_t bits = 0;       // 8 (unsigned) or 16 (signed)
+    uint32_t frameBytes = 0; // channels * bits / 8
+    uint32_t dataBytes = 0;  // size of the "data" chunk
+};
+
+// Sequential input of the container
+class WavSource {
+public:
+    virtual ~WavSource() = default;
+    virtual size_t read(uint8_t *buf, size_t len) = 0;
+    virtual bool skip(uint32_t bytes) = 0;
+};
+
+// Walk the chunks up to "data" ("fmt " must come first); on success `src`
+// is at the first sample. False for anything but 8/16-bit PCM, 1-2 channels.
+bool wavParseHeader(WavSource &src, WavFormat &out);
+
+// `frames` frames of `format` to 16-bit stereo (mono duplicated)
+void wavToStereo16(const uint8_t *in, size_t frames, const WavFormat &format, int16_t *out);
+
+// Header of 16-bit stereo PCM holding `frames` frames
+void wavHeader(uint8_t hdr[WAV_HEADER_BYTES], uint32_t rate, uint32_t frames);
+
+// Streaming 16-bit stereo output from a WavSource. The I2S backend's WAV
+// decoder wraps one around its file; tools/wavbench times it on the host.
+class WavDecoder {
+public:
+    // Parse the header; `src` must outlive the decoder
+    bool begin(WavSource &src);
+    // Decode up to `frames` frames into out[2 * frames]; 0 at the end of the
+    // data (or of a truncated file)
+    size_t read(int16_t *out, size_t frames);
+
+    const WavFormat &format() const { return format_; }
+    uint32_t lengthFrames() const { return format_.frameBytes ? format_.dataBytes / format_.frameBytes : 0; }
+
+private:
+    WavSource *src_ = nullptr;
+    WavFormat format_;
+    uint32_t remaining_ = 0;
+    uint8_t buf_[1024];
+};
+
+#endif // WAVFORMAT_H
@@ -3,4 +3,7 @@
 
 void setupWebServer();
 
+// Push pending server-sent events (log tail). Call from loop().
+void serviceWebServer();
+
 #endif // WEBSERVER_H
@@ -2,19 +2,50 @@
 #define WIFIROUTER_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <WiFi.h>
 
 #define WIFI_SSID "marine-l-esp32"
 #define WIFI_PASSWORD "password"
 
-void setupWiFi(const char *ssid, const char *password);
-
-void checkWiFiConnection();
-
+// Optional upstream network. When configured (build flags or /wifi.json via
+// /api/wifi) the radio runs AP+STA; the AP then follows the STA's channel.
+#ifndef WIFI_STA_SSID
+#define WIFI_STA_SSID ""
+#endif
+#ifndef WIFI_STA_PASSWORD
+#define WIFI_STA_PASSWORD ""
+#endif
+#define WIFI_CONFIG_FILE "/wifi.json"
+
+#ifndef WIFI_AP_MAX_CLIENTS
+#define WIFI_AP_MAX_CLIENTS 8
+#endif
+#define WIFI_STA_CONNECT_TIMEOUT_MS 15000
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 60000
+#define WIFI_STATION_SAMPLE_MS 2000
+#define WIFI_WEAK_RSSI -75
+
+// STA side of the state machine; the AP is always up
+enum class StaState : uint8_t { Disabled, Connecting, Connected, Backoff };
+
+void setupWiFi(const char *ssid, const char *password); // after setupFileSystem()
+void serviceWiFi(); // call from loop(); never blocks
+
+// Empty ssid disables the STA side. Persisted to WIFI_CONFIG_FILE.
+bool wifiSetStation(const String &ssid, const String &password);
+
+StaState wifiStaState();
 String getWiFiStatus();
 
+// Address visitors should use: the STA address when connected, else the AP's
 String getLocalIP();
+String getApIP();
 
 String getSSID();
 
+// AP, STA and per-station diagnostics for /api/wifi
+void wifiDescribe(JsonDocument &doc);
+
 #endif // WIFIROUTER_H
@@ -0,0 +1,180 @@
+#include "Actions.h"
+
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <atomic>
+#include <map>
+
+#include "AudioPlayer.h"
+#include "Effects.h"
+#include "Leds.h"
+#include "Logger.h"
+#include "MemoryPolicy.h"
+#include "Pwm.h"
+#include "Scheduler.h"
+#include "ShowSync.h"
+#include "Smoke.h"
+
+#ifndef BELL_TRACK
+#define BELL_TRACK "1"
+#endif
+#define SCENES_FILE "/scenes.json"
+
+static constexpr int MAX_SCENE_DEPTH = 4;
+
+// Built-in scenes; /scenes.json may add or override entries
+static std::map<String, String> g_scenes = {
+    {"night", "mill:0;leds:off;fire:on"},
+    {"day", "fire:off;leds:on;mill:180"},
+    {"bell", "play:" BELL_TRACK ";smoke:puff:3000"},
+    {"closing", "mill:0;fire:off;smoke:off;stop;leds:off"},
+};
+
+#if BOARD_HAS_SMOKE
+static constexpr uint32_t SMOKE_PUFF_DEFAULT_MS = 3000;
+// Puffs start from the loop and the request tasks. Each one bumps the
+// sequence; a timer only ends the puff it was armed for.
+static std::atomic<uint32_t> g_puffSeq{0};
+static std::atomic<TimerWheel::Handle> g_puffTimer{0};
+
+void cancelSmokePuff() {
+    ++g_puffSeq;
+    TimerWheel::Handle timer = g_puffTimer.exchange(0);
+    if (timer) schedulerCancel(timer);
+}
+#endif
+
+void setupActions() {
+    File f = LittleFS.open(SCENES_FILE, "r");
+    if (!f) return;
+    JsonDocument doc(memJsonAllocator(MEM_SHOW));
+    DeserializationError err = deserializeJson(doc, f);
+    f.close();
+    if (err) {
+        LOGE("Actions: " SCENES_FILE " is invalid: " + String(err.c_str()));
+        return;
+    }
+    for (JsonPair kv : doc.as<JsonObject>()) {
+        g_scenes[String(kv.key().c_str())] = kv.value().as<String>();
+    }
+    LOGI("Actions: " + String(static_cast<int>(g_scenes.size())) + " scene(s) available");
+}
+
+static int ledPinForColor(const String &color) {
+    const BoardChannel *c = boardChannel(color, ChannelGroup::Lights);
+    return c ? c->pin : -1;
+}
+
+static bool runSingle(const String &spec, int depth);
+
+static bool runChain(const String &chain, int depth) {
+    bool ok = true;
+    int start = 0;
+    while (start <= static_cast<int>(chain.length())) {
+        int sep = chain.indexOf(';', start);
+        String part = sep < 0 ? chain.substring(start) : chain.substring(start, sep);
+        part.trim();
+        if (part.length() > 0) ok = runSingle(part, depth) && ok;
+        if (sep < 0) break;
+        start = sep + 1;
+    }
+    return ok;
+}
+
+static bool runSingle(const String &spec, int depth) {
+    int colon = spec.indexOf(':');
+    String verb = colon < 0 ? spec : spec.substring(0, colon);
+    String arg = colon < 0 ? String("") : spec.substring(colon + 1);
+
+    if (verb == "scene") {
+        auto it = g_scenes.find(arg);
+        if (it == g_scenes.end() || depth >= MAX_SCENE_DEPTH) {
+            LOGW("Actions: unknown or recursive scene '" + arg + "'");
+            return false;
+        }
+        return runChain(it->second, depth + 1);
+    }
+    if (verb == "fire") {
+        if (arg == "on") startFireEffect();
+        else if (arg == "off") stopFireEffect();
+        else return false;
+        return true;
+    }
+    if (verb == "effect") {
+        if (arg == "off") {
+            effectStop();
+            return true;
+        }
+        String error;
+        if (effectRun(arg, error)) return true;
+        LOGW("Actions: effect " + error);
+        return false;
+    }
+#if BOARD_HAS_SMOKE
+    if (verb == "smoke") {
+        if (arg == "on") {
+            cancelSmokePuff();
+            turnOnSmoke();
+        } else if (arg == "off") {
+            cancelSmokePuff();
+            turnOffSmoke();
+        } else if (arg.startsWith("puff")) {
+            uint32_t ms = arg.length() > 5 ? arg.substring(5).toInt() : SMOKE_PUFF_DEFAULT_MS;
+            turnOnSmoke();
+            uint32_t seq = ++g_puffSeq;
+            TimerWheel::Handle timer = schedulerAfter(ms, [](uint32_t puff) {
+                if (puff == g_puffSeq.load()) turnOffSmoke();
+            }, seq);
+            if (!timer) {
+                LOGW("Actions: no timer left for the smoke puff");
+                turnOffSmoke();
+                return false;
+            }
+            // The wheel ignores a stale handle, so a timer that already fired is fine
+            TimerWheel::Handle previous = g_puffTimer.exchange(timer);
+            if (previous) schedulerCancel(previous);
+        } else return false;
+        return true;
+    }
+#endif
+#if BOARD_HAS_MILL
+    if (verb == "mill") {
+        setPwm(arg.toInt());
+        return true;
+    }
+#endif
+    if (verb == "leds") {
+        if (arg == "on") turnOnLeds();
+        else if (arg == "off") turnOffLeds();
+        else return false;
+        return true;
+    }
+    if (verb == "led") {
+        int sep = arg.indexOf(':');
+        int pin = ledPinForColor(sep < 0 ? arg : arg.substring(0, sep));
+        if (pin < 0) return false;
+        setLed(pin, sep < 0 ? 255 : arg.substring(sep + 1).toInt());
+        return true;
+    }
+    if (verb == "play") {
+        return playFile(arg.c_str());
+    }
+    if (verb == "stop") {
+        stopPlayback();
+        return true;
+    }
+    if (verb == "volume") {
+        return audioSetVolume(arg.toInt());
+    }
+    if (verb == "cue") {
+        int sep = arg.indexOf(':');
+        if (sep < 0) return false;
+        return showSyncCue(arg.substring(sep + 1), arg.substring(0, sep).toInt());
+    }
+    LOGW("Actions: unknown action '" + spec + "'");
+    return false;
+}
+
+bool runAction(const String &spec) {
+    return runChain(spec, 0);
+}
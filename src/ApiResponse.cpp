@@ -0,0 +1,249 @@
+#include "ApiResponse.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+namespace {
+
+// Print sink that only counts bytes (benchmarks)
+class CountingPrint : public Print {
+public:
+    size_t count = 0;
+    size_t write(uint8_t) override { count++; return 1; }
+    size_t write(const uint8_t *, size_t len) override { count += len; return len; }
+};
+
+size_t writeCborHead(Print &out, uint8_t major, uint64_t value) {
+    uint8_t buf[9];
+    size_t len;
+    major <<= 5;
+    if (value < 24) {
+        buf[0] = major | static_cast<uint8_t>(value);
+        len = 1;
+    } else if (value <= 0xFF) {
+        buf[0] = major | 24;
+        len = 2;
+    } else if (value <= 0xFFFF) {
+        buf[0] = major | 25;
+        len = 3;
+    } else if (value <= 0xFFFFFFFFULL) {
+        buf[0] = major | 26;
+        len = 5;
+    } else {
+        buf[0] = major | 27;
+        len = 9;
+    }
+    for (size_t i = 1; i < len; i++) {
+        buf[i] = static_cast<uint8_t>(value >> (8 * (len - 1 - i)));
+    }
+    return out.write(buf, len);
+}
+
+size_t writeCbor(JsonVariantConst v, Print &out) {
+    if (v.isNull()) return out.write(static_cast<uint8_t>(0xF6));
+    if (v.is<bool>()) return out.write(static_cast<uint8_t>(v.as<bool>() ? 0xF5 : 0xF4));
+    if (v.is<int64_t>()) {
+        int64_t n = v.as<int64_t>();
+        if (n >= 0) return writeCborHead(out, 0, static_cast<uint64_t>(n));
+        return writeCborHead(out, 1, static_cast<uint64_t>(-1 - n));
+    }
+    if (v.is<uint64_t>()) return writeCborHead(out, 0, v.as<uint64_t>());
+    if (v.is<double>()) {
+        double d = v.as<double>();
+        float f = static_cast<float>(d);
+        uint8_t buf[9];
+        if (static_cast<double>(f) == d) {
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            buf[0] = 0xFA;
+            for (int i = 0; i < 4; i++) buf[1 + i] = static_cast<uint8_t>(bits >> (24 - 8 * i));
+            return out.write(buf, 5);
+        }
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        buf[0] = 0xFB;
+        for (int i = 0; i < 8; i++) buf[1 + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        return out.write(buf, 9);
+    }
+    if (v.is<const char *>()) {
+        const char *s = v.as<const char *>();
+        size_t len = strlen(s);
+        return writeCborHead(out, 3, len) + out.write(reinterpret_cast<const uint8_t *>(s), len);
+    }
+    if (v.is<JsonArrayConst>()) {
+        JsonArrayConst arr = v.as<JsonArrayConst>();
+        size_t n = writeCborHead(out, 4, arr.size());
+        for (JsonVariantConst item : arr) n += writeCbor(item, out);
+        return n;
+    }
+    if (v.is<JsonObjectConst>()) {
+        JsonObjectConst obj = v.as<JsonObjectConst>();
+        size_t n = writeCborHead(out, 5, obj.size());
+        for (JsonPairConst kv : obj) {
+            const char *key = kv.key().c_str();
+            size_t len = strlen(key);
+            n += writeCborHead(out, 3, len) + out.write(reinterpret_cast<const uint8_t *>(key), len);
+            n += writeCbor(kv.value(), out);
+        }
+        return n;
+    }
+    return out.write(static_cast<uint8_t>(0xF7)); // undefined
+}
+
+// Accept header matching (RFC 9110 12.5.1). Each encoding takes the q-value
+// of the most specific media range that names it; q is kept in thousandths.
+struct MediaMatch {
+    int specificity = 0; // 0 none, 1 */*, 2 application/*, 3 exact
+    int q = 0;
+    int order = 0; // position of the range in the header
+};
+
+bool tokenIs(const char *begin, const char *end, const char *token) {
+    size_t len = strlen(token);
+    return static_cast<size_t>(end - begin) == len && strncasecmp(begin, token, len) == 0;
+}
+
+// "q=0.5" style weight; malformed values count as 1 like a missing one
+int parseQ(const char *begin, const char *end) {
+    if (begin == end || (*begin != '0' && *begin != '1')) return 1000;
+    int q = (*begin - '0') * 1000;
+    const char *p = begin + 1;
+    if (p < end && *p == '.') {
+        int scale = 100;
+        for (p++; p < end && scale > 0 && *p >= '0' && *p <= '9'; p++, scale /= 10) q += (*p - '0') * scale;
+    }
+    return q > 1000 ? 1000 : q;
+}
+
+int specificity(const char *begin, const char *end, ApiEncoding encoding) {
+    if (tokenIs(begin, end, "*/*")) return 1;
+    if (tokenIs(begin, end, "application/*")) return 2;
+    switch (encoding) {
+        case ApiEncoding::MsgPack:
+            return tokenIs(begin, end, "application/msgpack") || tokenIs(begin, end, "application/x-msgpack") ||
+                           tokenIs(begin, end, "application/vnd.msgpack")
+                       ? 3
+                       : 0;
+        case ApiEncoding::Cbor: return tokenIs(begin, end, "application/cbor") ? 3 : 0;
+        default: return tokenIs(begin, end, "application/json") ? 3 : 0;
+    }
+}
+
+MediaMatch matchAccept(const char *accept, ApiEncoding encoding) {
+    MediaMatch best;
+    int order = 0;
+    for (const char *range = accept; *range; order++) {
+        const char *next = strchr(range, ',');
+        const char *rangeEnd = next ? next : range + strlen(range);
+        while (range < rangeEnd && isspace(static_cast<unsigned char>(*range))) range++;
+        const char *typeEnd = range;
+        while (typeEnd < rangeEnd && *typeEnd != ';' && !isspace(static_cast<unsigned char>(*typeEnd))) typeEnd++;
+        int level = specificity(range, typeEnd, encoding);
+        if (level > best.specificity) {
+            int q = 1000;
+            for (const char *param = typeEnd; (param = static_cast<const char *>(memchr(param, ';', rangeEnd - param)));) {
+                param++;
+                while (param < rangeEnd && isspace(static_cast<unsigned char>(*param))) param++;
+                if (rangeEnd - param >= 2 && (*param == 'q' || *param == 'Q') && param[1] == '=') {
+                    const char *valueEnd = param + 2;
+                    while (valueEnd < rangeEnd && *valueEnd != ';' && !isspace(static_cast<unsigned char>(*valueEnd))) valueEnd++;
+                    q = parseQ(param + 2, valueEnd);
+                    break;
+                }
+            }
+            best.specificity = level;
+            best.q = q;
+            best.order = order;
+        }
+        range = next ? next + 1 : rangeEnd;
+    }
+    return best;
+}
+
+template <typename F>
+float microsPerCall(int iterations, F &&fn) {
+    unsigned long start = micros();
+    for (int i = 0; i < iterations; i++) fn();
+    return static_cast<float>(micros() - start) / iterations;
+}
+
+} // namespace
+
+ApiEncoding negotiateEncoding(AsyncWebServerRequest *req) {
+    if (!req->hasHeader("Accept")) return ApiEncoding::Json;
+    const char *accept = req->header("Accept").c_str();
+    // Highest q wins, then a range naming the type over a wildcard, then the
+    // range listed first; JSON on a full tie and when nothing acceptable
+    // (q=0 everywhere) is offered
+    const ApiEncoding encodings[] = {ApiEncoding::Json, ApiEncoding::MsgPack, ApiEncoding::Cbor};
+    ApiEncoding chosen = ApiEncoding::Json;
+    MediaMatch best;
+    for (ApiEncoding encoding : encodings) {
+        MediaMatch m = matchAccept(accept, encoding);
+        if (m.specificity == 0 || m.q == 0) continue;
+        bool better = best.specificity == 0 || m.q > best.q ||
+                      (m.q == best.q && ((m.specificity == 3) > (best.specificity == 3) ||
+                                         ((m.specificity == 3) == (best.specificity == 3) && m.order < best.order)));
+        if (better) {
+            best = m;
+            chosen = encoding;
+        }
+    }
+    return chosen;
+}
+
+const char *encodingContentType(ApiEncoding encoding) {
+    switch (encoding) {
+        case ApiEncoding::MsgPack: return "application/msgpack";
+        case ApiEncoding::Cbor: return "application/cbor";
+        default: return "application/json";
+    }
+}
+
+size_t encodeDocument(const JsonDocument &doc, ApiEncoding encoding, Print &out) {
+    switch (encoding) {
+        case ApiEncoding::MsgPack: return serializeMsgPack(doc, out);
+        case ApiEncoding::Cbor: return writeCbor(doc.as<JsonVariantConst>(), out);
+        default: return serializeJson(doc, out);
+    }
+}
+
+void sendApiResponse(AsyncWebServerRequest *req, int code, const JsonDocument &doc) {
+    ApiEncoding encoding = negotiateEncoding(req);
+    AsyncResponseStream *resp = req->beginResponseStream(encodingContentType(encoding));
+    resp->setCode(code);
+    resp->addHeader("Vary", "Accept");
+    encodeDocument(doc, encoding, *resp);
+    req->send(resp);
+}
+
+void sendApiError(AsyncWebServerRequest *req, int code, const char *message) {
+    StaticJsonDocument<256> doc;
+    doc["error"] = message;
+    sendApiResponse(req, code, doc);
+}
+
+void benchmarkEncodings(const JsonDocument &doc, int iterations, JsonObject out) {
+    // Current path: serialize JSON into a String, as handlers used to
+    JsonObject str = out.createNestedObject("json_string");
+    size_t strBytes = 0;
+    str["us"] = microsPerCall(iterations, [&] {
+        String s;
+        serializeJson(doc, s);
+        strBytes = s.length();
+    });
+    str["bytes"] = strBytes;
+
+    const ApiEncoding encodings[] = {ApiEncoding::Json, ApiEncoding::MsgPack, ApiEncoding::Cbor};
+    const char *names[] = {"json", "msgpack", "cbor"};
+    for (int e = 0; e < 3; e++) {
+        CountingPrint sink;
+        JsonObject o = out.createNestedObject(names[e]);
+        o["us"] = microsPerCall(iterations, [&] {
+            sink.count = 0;
+            encodeDocument(doc, encodings[e], sink);
+        });
+        o["bytes"] = sink.count;
+    }
+}
@@ -0,0 +1,170 @@
+#include "AudioDecoder.h"
+#include "Trace.h"
+#include "WavFormat.h"
+
+#if __has_include(<libhelix-mp3/mp3dec.h>)
+#include <libhelix-mp3/mp3dec.h>
+#define AUDIO_HAVE_MP3 1
+#else
+#define AUDIO_HAVE_MP3 0
+#endif
+
+namespace {
+
+class FileSource : public WavSource {
+public:
+    explicit FileSource(fs::File &file) : file_(file) {}
+    size_t read(uint8_t *buf, size_t len) override {
+        TRACE_SCOPE_ARG("fs.read", len);
+        return file_.read(buf, len);
+    }
+    bool skip(uint32_t bytes) override { return file_.seek(file_.position() + bytes); }
+
+private:
+    fs::File &file_;
+};
+
+// The container and sample conversion are WavDecoder's (WavFormat.h); this
+// only owns the file
+class WavFileDecoder : public AudioDecoder {
+public:
+    WavFileDecoder() : src_(file_) {}
+
+    bool begin(fs::File file) override {
+        file_ = file;
+        if (!wav_.begin(src_)) return false;
+        channels_ = wav_.format().channels;
+        rate_ = wav_.format().rate;
+        length_ = wav_.lengthFrames();
+        return true;
+    }
+
+    size_t read(int16_t *out, size_t frames) override { return wav_.read(out, frames); }
+
+private:
+    fs::File file_;
+    FileSource src_;
+    WavDecoder wav_;
+};
+
+#if AUDIO_HAVE_MP3
+class Mp3Decoder : public AudioDecoder {
+public:
+    ~Mp3Decoder() override {
+        if (helix_) MP3FreeDecoder(helix_);
+    }
+
+    bool begin(fs::File file) override {
+        file_ = file;
+        helix_ = MP3InitDecoder();
+        if (!helix_) return false;
+        skipId3();
+        // Decode the first frame to learn the format
+        if (!decodeFrame()) return false;
+        return rate_ != 0;
+    }
+
+    size_t read(int16_t *out, size_t frames) override {
+        size_t done = 0;
+        while (done < frames) {
+            if (pcmPos_ == pcmFrames_ && !decodeFrame()) break;
+            size_t n = min<size_t>(frames - done, pcmFrames_ - pcmPos_);
+            memcpy(out + 2 * done, pcm_ + 2 * pcmPos_, n * 2 * sizeof(int16_t));
+            pcmPos_ += n;
+            done += n;
+        }
+        return done;
+    }
+
+private:
+    void skipId3() {
+        uint8_t tag[10];
+        if (file_.read(tag, 10) == 10 && memcmp(tag, "ID3", 3) == 0) {
+            uint32_t size = (tag[6] & 0x7F) << 21 | (tag[7] & 0x7F) << 14 | (tag[8] & 0x7F) << 7 | (tag[9] & 0x7F);
+            file_.seek(10 + size);
+        } else {
+            file_.seek(0);
+        }
+    }
+
+    void refill() {
+        if (inLeft_ > 0 && inPtr_ != in_) memmove(in_, inPtr_, inLeft_);
+        inPtr_ = in_;
+        if (eof_) return;
+        TRACE_SCOPE_ARG("fs.read", sizeof(in_) - inLeft_);
+        int got = file_.read(in_ + inLeft_, sizeof(in_) - inLeft_);
+        if (got <= 0) eof_ = true;
+        else inLeft_ += got;
+    }
+
+    bool decodeFrame() {
+        pcmPos_ = pcmFrames_ = 0;
+        for (;;) {
+            if (inLeft_ < MAINBUF_SIZE && !eof_) refill();
+            if (inLeft_ == 0) return false;
+            int offset = MP3FindSyncWord(inPtr_, inLeft_);
+            if (offset < 0) {
+                inLeft_ = 0; // no sync in what we have; fetch more
+                if (eof_) return false;
+                continue;
+            }
+            inPtr_ += offset;
+            inLeft_ -= offset;
+            int err = MP3Decode(helix_, &inPtr_, &inLeft_, pcm_, 0);
+            if (err == ERR_MP3_INDATA_UNDERFLOW || err == ERR_MP3_MAINDATA_UNDERFLOW) {
+                if (eof_) return false;
+                refill();
+                continue;
+            }
+            if (err) {
+                // Corrupt frame: step past this sync word and resync
+                errors_++;
+                inPtr_++;
+                inLeft_--;
+                continue;
+            }
+            MP3FrameInfo info;
+            MP3GetLastFrameInfo(helix_, &info);
+            rate_ = info.samprate;
+            channels_ = info.nChans;
+            pcmFrames_ = info.outputSamps / info.nChans;
+            if (info.nChans == 1) {
+                for (int i = pcmFrames_ - 1; i >= 0; i--) pcm_[2 * i] = pcm_[2 * i + 1] = pcm_[i];
+            }
+            return pcmFrames_ > 0;
+        }
+    }
+
+    fs::File file_;
+    HMP3Decoder helix_ = nullptr;
+    uint8_t in_[2 * MAINBUF_SIZE];
+    uint8_t *inPtr_ = in_;
+    int inLeft_ = 0;
+    bool eof_ = false;
+    int16_t pcm_[MAX_NSAMP * MAX_NGRAN * 2];
+    size_t pcmFrames_ = 0;
+    size_t pcmPos_ = 0;
+};
+#endif
+
+} // namespace
+
+bool audioIsPlayableFile(const String &path) {
+    String lower = path;
+    lower.toLowerCase();
+    if (lower.endsWith(".wav")) return true;
+#if AUDIO_HAVE_MP3
+    if (lower.endsWith(".mp3")) return true;
+#endif
+    return false;
+}
+
+std::unique_ptr<AudioDecoder> audioDecoderFor(const String &path) {
+    String lower = path;
+    lower.toLowerCase();
+    if (lower.endsWith(".wav")) return std::unique_ptr<AudioDecoder>(new WavFileDecoder());
+#if AUDIO_HAVE_MP3
+    if (lower.endsWith(".mp3")) return std::unique_ptr<AudioDecoder>(new Mp3Decoder());
+#endif
+    return nullptr;
+}
@@ -0,0 +1,497 @@
+#include "AudioPlayer.h"
+
+// I2S backend: WAV/MP3 from LittleFS (or SD) decoded on a dedicated task into
+// the I2S DMA ring. Replaces the DFPlayer backend in AudioPlayer.cpp.
+#include "BoardProfile.h"
+
+#if BOARD_AUDIO == BOARD_AUDIO_I2S
+
+#include <LittleFS.h>
+#include <algorithm>
+#include <atomic>
+#include <driver/i2s.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#ifdef AUDIO_SD_CS_PIN
+#include <SD.h>
+#include <SPI.h>
+#ifndef AUDIO_SD_SCK_PIN
+#define AUDIO_SD_SCK_PIN 40
+#endif
+#ifndef AUDIO_SD_MISO_PIN
+#define AUDIO_SD_MISO_PIN 42
+#endif
+#ifndef AUDIO_SD_MOSI_PIN
+#define AUDIO_SD_MOSI_PIN 41
+#endif
+#endif
+
+#include "AudioDecoder.h"
+#include "WavFormat.h"
+#include "MemoryPolicy.h"
+#include "Trace.h"
+#include "DeviceState.h"
+#include "EventBus.h"
+#include "Files.h"
+#include "Journal.h"
+#include "Logger.h"
+#include "PcmSink.h"
+
+static constexpr int AUDIO_I2S_BCK_PIN = boardPin("i2s.bck");
+static constexpr int AUDIO_I2S_WS_PIN = boardPin("i2s.ws");
+static constexpr int AUDIO_I2S_DOUT_PIN = boardPin("i2s.dout");
+static_assert(AUDIO_I2S_BCK_PIN >= 0 && AUDIO_I2S_WS_PIN >= 0 && AUDIO_I2S_DOUT_PIN >= 0,
+              "board profile lacks the I2S pins");
+#ifndef AUDIO_DIR
+#define AUDIO_DIR "/audio"
+#endif
+// 8 x 512 frames is ~93 ms at 44.1 kHz: enough to ride out an MP3 frame
+// decode plus a LittleFS block read
+#ifndef AUDIO_DMA_BUFFERS
+#define AUDIO_DMA_BUFFERS 8
+#endif
+#ifndef AUDIO_DMA_FRAMES
+#define AUDIO_DMA_FRAMES 512
+#endif
+#ifndef AUDIO_TASK_CORE
+#define AUDIO_TASK_CORE 0
+#endif
+#ifndef AUDIO_TASK_PRIORITY
+#define AUDIO_TASK_PRIORITY 5
+#endif
+#ifndef AUDIO_DEFAULT_VOLUME
+#define AUDIO_DEFAULT_VOLUME 20 // 0..30, same scale as the DFPlayer
+#endif
+
+namespace {
+
+constexpr i2s_port_t kPort = I2S_NUM_0;
+constexpr size_t kPathLen = 96;
+constexpr uint64_t kRingFrames = static_cast<uint64_t>(AUDIO_DMA_BUFFERS) * AUDIO_DMA_FRAMES;
+
+enum class CmdType : uint8_t { Play, Stop, Reinit };
+
+struct Cmd {
+    CmdType type;
+    int16_t track; // 1-based, for the track events
+    char path[kPathLen];
+};
+
+// Playback state shared with readers; written by the audio task
+struct Shared {
+    bool playing;
+    char path[kPathLen];
+    uint32_t rate;
+    uint8_t channels;
+    uint64_t length;
+    uint64_t written;   // frames of the track handed to the DMA ring
+    int64_t lastDoneUs; // last DMA buffer completion
+    uint32_t underruns;
+    uint32_t decodeErrors;
+};
+
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+Shared g_shared = {};
+
+QueueHandle_t g_cmds = nullptr;
+QueueHandle_t g_i2sEvents = nullptr;
+SemaphoreHandle_t g_filesMutex = nullptr;
+TaskHandle_t g_task = nullptr;
+bool g_driverOk = false;
+std::atomic<int32_t> g_gain{0}; // Q15
+
+fs::FS *g_fs = &LittleFS;
+const char *g_fsName = "littlefs";
+std::vector<String, MemAllocator<String, MEM_AUDIO>> g_files;
+
+bool installDriver() {
+    i2s_config_t cfg = {};
+    cfg.mode = static_cast<i2s_mode_t>(I2S_MODE_MASTER | I2S_MODE_TX);
+    cfg.sample_rate = 44100;
+    cfg.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    cfg.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
+    cfg.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+    cfg.intr_alloc_flags = ESP_INTR_FLAG_LEVEL1;
+    cfg.dma_buf_count = AUDIO_DMA_BUFFERS;
+    cfg.dma_buf_len = AUDIO_DMA_FRAMES;
+    cfg.tx_desc_auto_clear = true; // a dry ring plays silence, not the last buffer again
+    if (i2s_driver_install(kPort, &cfg, AUDIO_DMA_BUFFERS, &g_i2sEvents) != ESP_OK) return false;
+
+    i2s_pin_config_t pins = {};
+    pins.mck_io_num = I2S_PIN_NO_CHANGE;
+    pins.bck_io_num = AUDIO_I2S_BCK_PIN;
+    pins.ws_io_num = AUDIO_I2S_WS_PIN;
+    pins.data_out_num = AUDIO_I2S_DOUT_PIN;
+    pins.data_in_num = I2S_PIN_NO_CHANGE;
+    if (i2s_set_pin(kPort, &pins) != ESP_OK) {
+        i2s_driver_uninstall(kPort);
+        return false;
+    }
+    return true;
+}
+
+// Feeds the I2S DMA ring and keeps the position/underrun accounting.
+// Position is the frames written minus the ring depth, advanced between DMA
+// completions by the elapsed time, so it resolves single samples.
+class I2sSink : public PcmSink {
+public:
+    bool begin(uint32_t sampleRate) override {
+        if (!g_driverOk) return false;
+        i2s_set_clk(kPort, sampleRate, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO);
+        i2s_zero_dma_buffer(kPort);
+        xQueueReset(g_i2sEvents);
+        doneSinceWrite_ = 0;
+        writes_ = 0;
+        return true;
+    }
+
+    size_t write(const int16_t *frames, size_t count) override {
+        size_t bytes = 0;
+        i2s_write(kPort, frames, count * 4, &bytes, portMAX_DELAY);
+        size_t n = bytes / 4;
+        pollEvents();
+        // All buffers completed since the previous write: the DMA ran dry
+        bool underrun = writes_ >= AUDIO_DMA_BUFFERS && doneSinceWrite_ >= AUDIO_DMA_BUFFERS;
+        doneSinceWrite_ = 0;
+        writes_++;
+        portENTER_CRITICAL(&g_mux);
+        g_shared.written += n;
+        if (underrun) g_shared.underruns++;
+        portEXIT_CRITICAL(&g_mux);
+        return n;
+    }
+
+    // Let the last frames play out before the track is reported finished
+    void drain() {
+        static const int16_t silence[AUDIO_DMA_FRAMES * 2] = {};
+        for (int i = 0; i < AUDIO_DMA_BUFFERS; i++) {
+            size_t bytes = 0;
+            i2s_write(kPort, silence, sizeof(silence), &bytes, portMAX_DELAY);
+        }
+        pollEvents();
+    }
+
+    void pollEvents() {
+        i2s_event_t ev;
+        while (xQueueReceive(g_i2sEvents, &ev, 0) == pdTRUE) {
+            if (ev.type != I2S_EVENT_TX_DONE) continue;
+            doneSinceWrite_++;
+            int64_t now = esp_timer_get_time();
+            portENTER_CRITICAL(&g_mux);
+            g_shared.lastDoneUs = now;
+            portEXIT_CRITICAL(&g_mux);
+        }
+    }
+
+private:
+    uint32_t doneSinceWrite_ = 0;
+    uint32_t writes_ = 0;
+};
+
+void setGain(int vol) {
+    // Square law: roughly even loudness steps across 0..30
+    g_gain.store(vol * vol * 32767 / 900, std::memory_order_relaxed);
+}
+
+void applyGain(int16_t *samples, size_t count) {
+    int32_t gain = g_gain.load(std::memory_order_relaxed);
+    if (gain >= 32767) return;
+    for (size_t i = 0; i < count; i++) samples[i] = static_cast<int16_t>((samples[i] * gain) >> 15);
+}
+
+// Caller holds g_filesMutex
+void refreshFiles() {
+    g_files.clear();
+    File dir = g_fs->open(AUDIO_DIR);
+    if (!dir || !dir.isDirectory()) return;
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        String path = f.path();
+        if (!f.isDirectory() && audioIsPlayableFile(path)) g_files.push_back(path);
+    }
+    std::sort(g_files.begin(), g_files.end(), [](const String &a, const String &b) { return a < b; });
+}
+
+void setPlaying(bool playing, const char *path, const AudioDecoder *dec) {
+    portENTER_CRITICAL(&g_mux);
+    g_shared.playing = playing;
+    if (playing) {
+        strlcpy(g_shared.path, path, sizeof(g_shared.path));
+        g_shared.rate = dec->sampleRate();
+        g_shared.channels = dec->channels();
+        g_shared.length = dec->lengthFrames();
+        g_shared.written = 0;
+        g_shared.lastDoneUs = esp_timer_get_time();
+        g_shared.decodeErrors = 0;
+    }
+    portEXIT_CRITICAL(&g_mux);
+    deviceStateSetAudioPlaying(playing);
+}
+
+std::unique_ptr<AudioDecoder> openTrack(const char *path, I2sSink &sink) {
+    std::unique_ptr<AudioDecoder> dec = audioDecoderFor(path);
+    File f = g_fs->open(path, "r");
+    if (!dec || !f || !dec->begin(f) || !sink.begin(dec->sampleRate())) {
+        LOGE(String("Audio: cannot play ") + path);
+        return nullptr;
+    }
+    setPlaying(true, path, dec.get());
+    LOGI(String("Audio: playing ") + path + " @ " + String(dec->sampleRate()) + " Hz");
+    return dec;
+}
+
+void audioTask(void *) {
+    static int16_t buf[AUDIO_DMA_FRAMES * 2];
+    I2sSink sink;
+    std::unique_ptr<AudioDecoder> dec;
+    int16_t track = 0;
+    for (;;) {
+        Cmd cmd;
+        if (xQueueReceive(g_cmds, &cmd, dec ? 0 : portMAX_DELAY) == pdTRUE) {
+            bool wasPlaying = dec != nullptr;
+            dec.reset();
+            if (wasPlaying && g_driverOk) i2s_zero_dma_buffer(kPort);
+            if (cmd.type == CmdType::Reinit) {
+                if (g_driverOk) i2s_driver_uninstall(kPort);
+                g_driverOk = installDriver();
+                LOGI(String("Audio: I2S reinit ") + (g_driverOk ? "ok" : "failed"));
+            } else if (cmd.type == CmdType::Play) {
+                dec = openTrack(cmd.path, sink);
+                track = cmd.track;
+                if (dec) eventPublish(TrackStarted{track});
+            }
+            if (!dec) setPlaying(false, nullptr, nullptr);
+            continue;
+        }
+
+        size_t n;
+        {
+            TRACE_SCOPE("audio.decode");
+            n = dec->read(buf, AUDIO_DMA_FRAMES);
+        }
+        if (n == 0) {
+            sink.drain();
+            portENTER_CRITICAL(&g_mux);
+            g_shared.decodeErrors = dec->errors();
+            portEXIT_CRITICAL(&g_mux);
+            dec.reset();
+            setPlaying(false, nullptr, nullptr);
+            eventPublish(TrackFinished{track});
+            continue;
+        }
+        applyGain(buf, n * 2);
+        TRACE_SCOPE_ARG("audio.i2s.write", n);
+        sink.write(buf, n);
+    }
+}
+
+bool post(CmdType type, const char *path, int track = 0) {
+    if (!g_cmds) return false;
+    Cmd cmd = {};
+    cmd.type = type;
+    cmd.track = static_cast<int16_t>(track);
+    if (path) strlcpy(cmd.path, path, sizeof(cmd.path));
+    return xQueueSend(g_cmds, &cmd, 0) == pdTRUE;
+}
+
+// Leading digits of "/003.wav" or "3", else -1
+int leadingNumber(const char *path) {
+    if (*path == '/') path++;
+    if (*path < '0' || *path > '9') return -1;
+    return atoi(path);
+}
+
+String resolveTrack(int index) {
+    String path;
+    xSemaphoreTake(g_filesMutex, portMAX_DELAY);
+    if (index >= 1 && index <= static_cast<int>(g_files.size())) path = g_files[index - 1];
+    xSemaphoreGive(g_filesMutex);
+    return path;
+}
+
+} // namespace
+
+void setupAudioSystem() {
+    deviceStateSetVolume(AUDIO_DEFAULT_VOLUME);
+    setGain(AUDIO_DEFAULT_VOLUME);
+#ifdef AUDIO_SD_CS_PIN
+    SPI.begin(AUDIO_SD_SCK_PIN, AUDIO_SD_MISO_PIN, AUDIO_SD_MOSI_PIN, AUDIO_SD_CS_PIN);
+    if (SD.begin(AUDIO_SD_CS_PIN)) {
+        g_fs = &SD;
+        g_fsName = "sd";
+    } else {
+        LOGW("Audio: SD card not found, using LittleFS");
+    }
+#endif
+    // PCM staging buffers of the audio task and the benchmark (internal: i2s_write source)
+    memRegisterStatic(MEM_AUDIO, 2 * sizeof(int16_t) * AUDIO_DMA_FRAMES * 2);
+    g_filesMutex = xSemaphoreCreateMutex();
+    g_cmds = xQueueCreate(4, sizeof(Cmd));
+    xSemaphoreTake(g_filesMutex, portMAX_DELAY);
+    refreshFiles();
+    size_t count = g_files.size();
+    xSemaphoreGive(g_filesMutex);
+
+    if (audioInit()) LOGI("Audio: I2S ready, " + String(static_cast<int>(count)) + " file(s) in " + g_fsName + ":" AUDIO_DIR);
+    else LOGE("Audio: I2S driver install failed");
+    xTaskCreatePinnedToCore(audioTask, "audio", 6144, nullptr, AUDIO_TASK_PRIORITY, &g_task, AUDIO_TASK_CORE);
+}
+
+bool audioInit() {
+    if (!g_driverOk) g_driverOk = installDriver();
+    return g_driverOk;
+}
+
+bool audioReinit() {
+    journalAudioCommand(JA_REINIT, 0);
+    // The audio task owns the driver; it reinstalls between buffers
+    return post(CmdType::Reinit, nullptr);
+}
+
+String audioGetInfo() {
+    String info = "backend: i2s\n";
+    info += "files: " + String(g_fsName) + ":" AUDIO_DIR + "\n";
+    info += "pins: bck=" + String(AUDIO_I2S_BCK_PIN) + " ws=" + String(AUDIO_I2S_WS_PIN) + " dout=" + String(AUDIO_I2S_DOUT_PIN) + "\n";
+    info += "dma: " + String(AUDIO_DMA_BUFFERS) + " x " + String(AUDIO_DMA_FRAMES) + " frames\n";
+    info += String("driver: ") + (g_driverOk ? "ok" : "not installed") + "\n";
+    return info;
+}
+
+const char *audioBackendName() {
+    return "i2s";
+}
+
+int audioTrackIndex(const char *path) {
+    String wanted = path;
+    if (!wanted.startsWith("/")) wanted = "/" + wanted;
+    int index = -1;
+    xSemaphoreTake(g_filesMutex, portMAX_DELAY);
+    for (size_t i = 0; i < g_files.size() && index < 0; i++) {
+        if (g_files[i] == wanted || g_files[i].endsWith(wanted)) index = i + 1;
+    }
+    int count = g_files.size();
+    xSemaphoreGive(g_filesMutex);
+    if (index > 0) return index;
+    int n = leadingNumber(path);
+    return n >= 1 && n <= count ? n : -1;
+}
+
+bool playFile(const char *path) {
+    int index = audioTrackIndex(path);
+    String resolved = resolveTrack(index);
+    if (resolved.length() == 0 || resolved.length() >= kPathLen) {
+        LOGW(String("Audio: no track for ") + path);
+        return false;
+    }
+    if (!post(CmdType::Play, resolved.c_str(), index)) return false;
+    TRACE_INSTANT("audio.play", index);
+    journalAudioCommand(JA_PLAY, index);
+    deviceStateSetAudioPlaying(true);
+    return true;
+}
+
+void stopPlayback() {
+    post(CmdType::Stop, nullptr);
+    TRACE_INSTANT("audio.stop", 0);
+    journalAudioCommand(JA_STOP, 0);
+}
+
+bool isPlaying() {
+    return deviceStateSnapshot().audioPlaying;
+}
+
+// The audio task publishes the track events itself
+void serviceAudio() {}
+
+bool audioSetVolume(int vol) {
+    vol = constrain(vol, 0, 30);
+    deviceStateSetVolume(static_cast<uint8_t>(vol));
+    setGain(vol);
+    TRACE_INSTANT("audio.volume", vol);
+    journalAudioCommand(JA_VOLUME, vol);
+    return true;
+}
+
+int audioGetVolume() {
+    return deviceStateSnapshot().volume;
+}
+
+bool audioGetStatus(AudioStatus &out) {
+    portENTER_CRITICAL(&g_mux);
+    Shared s = g_shared;
+    portEXIT_CRITICAL(&g_mux);
+    int64_t now = esp_timer_get_time();
+
+    out = AudioStatus();
+    out.playing = s.playing;
+    out.sampleRate = s.rate;
+    out.channels = s.channels;
+    out.lengthFrames = s.length;
+    out.underruns = s.underruns;
+    out.decodeErrors = s.decodeErrors;
+    if (s.playing) {
+        out.path = s.path;
+        uint64_t sinceDone = static_cast<uint64_t>(now - s.lastDoneUs) * s.rate / 1000000;
+        uint64_t pos = s.written + min<uint64_t>(sinceDone, AUDIO_DMA_FRAMES);
+        out.positionFrames = pos > kRingFrames ? min<uint64_t>(pos - kRingFrames, s.written) : 0;
+    }
+    return true;
+}
+
+bool audioListFiles(std::vector<String> &out) {
+    xSemaphoreTake(g_filesMutex, portMAX_DELAY);
+    refreshFiles();
+    out.assign(g_files.begin(), g_files.end());
+    xSemaphoreGive(g_filesMutex);
+    return true;
+}
+
+bool audioBenchmark(const char *path, uint32_t maxSeconds, const char *wavOut, AudioBenchResult &out) {
+    out = AudioBenchResult();
+    String resolved = resolveTrack(audioTrackIndex(path));
+    std::unique_ptr<AudioDecoder> dec = audioDecoderFor(resolved);
+    File f = resolved.length() ? g_fs->open(resolved, "r") : File();
+    if (!dec || !f || !dec->begin(f)) return false;
+
+    uint64_t limit = static_cast<uint64_t>(maxSeconds) * dec->sampleRate();
+    std::unique_ptr<WavFileSink> sink;
+    if (wavOut && *wavOut) {
+        // Written through stdio under the LittleFS mount: keep it there
+        if (wavOut[0] != '/' || strstr(wavOut, "..")) return false;
+        // Counts a file being replaced as used: errs on the small side
+        uint64_t used = static_cast<uint64_t>(LittleFS.usedBytes()) + AUDIO_BENCH_FS_RESERVE + WAV_HEADER_BYTES;
+        uint64_t total = LittleFS.totalBytes();
+        uint64_t room = total > used ? (total - used) / 4 : 0; // 16-bit stereo frames
+        if (room == 0) return false;
+        if (room < limit) {
+            limit = room;
+            out.outLimited = true;
+        }
+        sink.reset(new WavFileSink((String(FS_BASE_PATH) + wavOut).c_str()));
+        if (!sink->begin(dec->sampleRate())) return false;
+    }
+    static int16_t buf[AUDIO_DMA_FRAMES * 2]; // one benchmark at a time (BenchTask.h)
+    int64_t decodeUs = 0;
+    int64_t sinkUs = 0;
+    while (out.frames < limit) {
+        int64_t t0 = esp_timer_get_time();
+        size_t n = dec->read(buf, AUDIO_DMA_FRAMES);
+        int64_t t1 = esp_timer_get_time();
+        decodeUs += t1 - t0;
+        if (n == 0) break;
+        if (sink) {
+            sink->write(buf, n);
+            sinkUs += esp_timer_get_time() - t1;
+        }
+        out.frames += n;
+    }
+    if (sink) sink->end();
+    out.sampleRate = dec->sampleRate();
+    out.decodeUs = decodeUs;
+    out.sinkUs = sinkUs;
+    return true;
+}
+
+#endif // BOARD_AUDIO == BOARD_AUDIO_I2S
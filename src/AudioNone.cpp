@@ -0,0 +1,69 @@
+#include "AudioPlayer.h"
+
+// Boards without audio (BOARD_AUDIO_NONE): the API stays so routes, actions
+// and the scheduler build unchanged, but no driver or decoder is linked in.
+#include "BoardProfile.h"
+
+#if BOARD_AUDIO == BOARD_AUDIO_NONE
+
+#include "Logger.h"
+
+void setupAudioSystem() {
+    LOGI("Audio: not fitted on " BOARD_NAME);
+}
+
+bool audioInit() {
+    return false;
+}
+
+bool audioReinit() {
+    return false;
+}
+
+String audioGetInfo() {
+    return "no audio on this board (" BOARD_NAME ")\n";
+}
+
+const char *audioBackendName() {
+    return "none";
+}
+
+bool playFile(const char *) {
+    return false;
+}
+
+int audioTrackIndex(const char *) {
+    return -1;
+}
+
+void stopPlayback() {}
+
+bool isPlaying() {
+    return false;
+}
+
+void serviceAudio() {}
+
+bool audioSetVolume(int) {
+    return false;
+}
+
+int audioGetVolume() {
+    return 0;
+}
+
+bool audioGetStatus(AudioStatus &out) {
+    out = AudioStatus();
+    return false;
+}
+
+bool audioListFiles(std::vector<String> &out) {
+    out.clear();
+    return false;
+}
+
+bool audioBenchmark(const char *, uint32_t, const char *, AudioBenchResult &) {
+    return false;
+}
+
+#endif // BOARD_AUDIO == BOARD_AUDIO_NONE
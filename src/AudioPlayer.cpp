@@ -1,30 +1,69 @@
 #include "AudioPlayer.h"
 
+#include "BoardProfile.h"
+
+// DFPlayer Mini backend; AudioI2s.cpp / AudioNone.cpp replace it when the
+// board profile picks another BOARD_AUDIO
+#if BOARD_AUDIO == BOARD_AUDIO_DFPLAYER
+
 #include <Arduino.h>
 #include <DFRobotDFPlayerMini.h>
+#include <memory>
 
-#ifndef DFPLAYER_RX_PIN
-#define DFPLAYER_RX_PIN 16
-#endif
-#ifndef DFPLAYER_TX_PIN
-#define DFPLAYER_TX_PIN 17
-#endif
+#include "DeviceState.h"
+#include "EventBus.h"
+#include "Journal.h"
+#include "MemoryPolicy.h"
+#include "Trace.h"
+
+static constexpr int DFPLAYER_RX_PIN = boardPin("dfplayer.rx");
+static constexpr int DFPLAYER_TX_PIN = boardPin("dfplayer.tx");
+static_assert(DFPLAYER_RX_PIN >= 0 && DFPLAYER_TX_PIN >= 0, "board profile lacks the DFPlayer UART pins");
 #ifndef DFPLAYER_BAUD
 #define DFPLAYER_BAUD 9600
 #endif
+#ifndef DFPLAYER_DEFAULT_VOLUME
+#define DFPLAYER_DEFAULT_VOLUME 20 // DFPlayer volume range 0..30
+#endif
 
 static DFRobotDFPlayerMini dfplayer;
 static bool audioInitialized = false;
-static volatile bool audioIsPlaying = false;
 static Stream *dfSerial = nullptr;
-static String lastInfo = "";
+#ifndef DFPLAYER_INFO_BYTES
+#define DFPLAYER_INFO_BYTES 1024
+#endif
 
-// add volume state
-static int currentVolume = 20; // DFPlayer volume range 0..30
+// Diagnostic text for /api/sd/status, newest lines kept. Bounded and in
+// PSRAM since it is only read on request. Written by the loop (the DFPlayer's
+// only user), read by handlers: g_infoMux covers the text, not the UART.
+static char *lastInfo = nullptr;
+static size_t lastInfoLen = 0;
+static portMUX_TYPE g_infoMux = portMUX_INITIALIZER_UNLOCKED;
 
 static void appendInfo(const char *msg) {
-  lastInfo += msg;
-  lastInfo += '\n';
+  if (!lastInfo) {
+    char *buf = static_cast<char *>(memAlloc(MEM_AUDIO, MemClass::Cold, DFPLAYER_INFO_BYTES));
+    if (!buf) return;
+    buf[0] = '\0';
+    portENTER_CRITICAL(&g_infoMux);
+    lastInfo = buf;
+    portEXIT_CRITICAL(&g_infoMux);
+  }
+  size_t len = min(strlen(msg) + 1, static_cast<size_t>(DFPLAYER_INFO_BYTES - 1));
+  portENTER_CRITICAL(&g_infoMux);
+  if (lastInfoLen + len >= DFPLAYER_INFO_BYTES) {
+    // Drop whole lines from the front until the new one fits
+    size_t cut = lastInfoLen + len - (DFPLAYER_INFO_BYTES - 1);
+    const char *nl = static_cast<const char *>(memchr(lastInfo + cut, '\n', lastInfoLen - cut));
+    cut = nl ? nl - lastInfo + 1 : lastInfoLen;
+    memmove(lastInfo, lastInfo + cut, lastInfoLen - cut);
+    lastInfoLen -= cut;
+  }
+  memcpy(lastInfo + lastInfoLen, msg, len - 1);
+  lastInfoLen += len;
+  lastInfo[lastInfoLen - 1] = '\n';
+  lastInfo[lastInfoLen] = '\0';
+  portEXIT_CRITICAL(&g_infoMux);
 }
 
 static bool tryBegin(Stream &s) {
@@ -35,6 +74,8 @@ static bool tryBegin(Stream &s) {
 }
 
 void setupAudioSystem() {
+  // Playing/volume state lives in DeviceState
+  deviceStateSetVolume(DFPLAYER_DEFAULT_VOLUME);
   // Initialize audio subsystem
   if (audioInit()) {
     Serial.println("[OK] Audio subsystem initialized");
@@ -45,7 +86,9 @@ void setupAudioSystem() {
 
 
 bool audioInit() {
-  lastInfo = "";
+  portENTER_CRITICAL(&g_infoMux);
+  lastInfoLen = 0;
+  portEXIT_CRITICAL(&g_infoMux);
   appendInfo("[INFO] Initializing DFPlayer...");
 
   // First try the configured Serial2 pins (RX then TX)
@@ -147,9 +190,10 @@ bool audioInit() {
 }
 
 bool audioReinit() {
+  journalAudioCommand(JA_REINIT, 0);
   // Try to reinitialize; clear previous state and call audioInit
   audioInitialized = false;
-  audioIsPlaying = false;
+  deviceStateSetAudioPlaying(false);
   // End serials to ensure a clean start
   Serial1.end();
   Serial2.end();
@@ -161,7 +205,13 @@ bool audioReinit() {
 }
 
 String audioGetInfo() {
-  return lastInfo;
+  // Copy out under the lock; the String is built outside it
+  std::unique_ptr<char[]> copy(new char[DFPLAYER_INFO_BYTES]);
+  copy[0] = '\0';
+  portENTER_CRITICAL(&g_infoMux);
+  if (lastInfo) memcpy(copy.get(), lastInfo, lastInfoLen + 1);
+  portEXIT_CRITICAL(&g_infoMux);
+  return String(copy.get());
 }
 
 // Accepts paths like "/001.mp3" or numeric strings "1"; maps to DFPlayer track index
@@ -187,6 +237,10 @@ static int parseIndexFromPath(const char *path) {
   return found ? idx : -1;
 }
 
+int audioTrackIndex(const char *path) {
+  return parseIndexFromPath(path);
+}
+
 bool playFile(const char *path) {
   if (!audioInitialized) {
     appendInfo("[WARN] audioInit() not called or failed - trying to init now");
@@ -199,8 +253,13 @@ bool playFile(const char *path) {
     char buf[64];
     snprintf(buf, sizeof(buf), "[OK] DFPlayer play index %d", index);
     appendInfo(buf);
-    dfplayer.play(index);
-    audioIsPlaying = true;
+    {
+      TRACE_SCOPE_ARG("audio.play", index);
+      dfplayer.play(index);
+    }
+    journalAudioCommand(JA_PLAY, index);
+    deviceStateSetAudioPlaying(true);
+    eventPublish(TrackStarted{static_cast<int16_t>(index)});
     return true;
   }
 
@@ -212,18 +271,40 @@ bool playFile(const char *path) {
 
 void stopPlayback() {
   if (!audioInitialized) return;
-  dfplayer.stop();
-  audioIsPlaying = false;
+  {
+    TRACE_SCOPE("audio.stop");
+    dfplayer.stop();
+  }
+  journalAudioCommand(JA_STOP, 0);
+  deviceStateSetAudioPlaying(false);
   appendInfo("[INFO] stopPlayback called");
 }
 
 bool isPlaying() {
-  return audioIsPlaying;
+  return deviceStateSnapshot().audioPlaying;
+}
+
+// The module reports the end of a track on its own over the UART; without
+// reading it `playing` would stay set until the next stop
+void serviceAudio() {
+  if (!audioInitialized || !dfplayer.available()) return;
+  uint8_t type = dfplayer.readType();
+  int value = dfplayer.read();
+  if (type == DFPlayerPlayFinished) {
+    // Sent twice per track; only the first one while playing counts
+    if (!isPlaying()) return;
+    deviceStateSetAudioPlaying(false);
+    eventPublish(TrackFinished{static_cast<int16_t>(value)});
+  } else if (type == DFPlayerError) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "[WARN] DFPlayer error %d", value);
+    appendInfo(buf);
+  }
 }
 
 bool audioSetVolume(int vol) {
   vol = constrain(vol, 0, 30);
-  currentVolume = vol;
+  deviceStateSetVolume(static_cast<uint8_t>(vol));
 
   if (!audioInitialized) {
     appendInfo("[WARN] audioSetVolume: DFPlayer not initialized, attempting init");
@@ -233,7 +314,11 @@ bool audioSetVolume(int vol) {
     }
   }
 
-  dfplayer.volume((uint8_t)vol);
+  {
+    TRACE_SCOPE_ARG("audio.volume", vol);
+    dfplayer.volume((uint8_t)vol);
+  }
+  journalAudioCommand(JA_VOLUME, vol);
   char buf[64];
   snprintf(buf, sizeof(buf), "[INFO] audioSetVolume: set to %d", vol);
   appendInfo(buf);
@@ -241,5 +326,27 @@ bool audioSetVolume(int vol) {
 }
 
 int audioGetVolume() {
-  return currentVolume;
+  return deviceStateSnapshot().volume;
+}
+
+const char *audioBackendName() {
+  return "dfplayer";
+}
+
+// The DFPlayer reports neither position nor a file list over UART
+bool audioGetStatus(AudioStatus &out) {
+  out = AudioStatus();
+  out.playing = isPlaying();
+  return false;
+}
+
+bool audioListFiles(std::vector<String> &out) {
+  out.clear();
+  return false;
 }
+
+bool audioBenchmark(const char *, uint32_t, const char *, AudioBenchResult &) {
+  return false;
+}
+
+#endif // BOARD_AUDIO == BOARD_AUDIO_DFPLAYER
@@ -0,0 +1,68 @@
+#include "BenchTask.h"
+
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <memory>
+
+#include "Logger.h"
+#include "MemoryPolicy.h"
+
+namespace {
+
+enum : uint8_t { Idle, Running, Done };
+
+// The job task owns the job and the result while Running; the network task
+// touches them only in the other states
+std::atomic<uint8_t> g_state{Idle};
+const char *g_name = nullptr;
+BenchJob g_job;
+std::unique_ptr<JsonDocument> g_result;
+int g_status = 0;
+uint32_t g_startMs = 0;
+uint32_t g_elapsedMs = 0;
+
+void benchTask(void *) {
+    g_status = g_job(g_result->to<JsonObject>());
+    g_elapsedMs = millis() - g_startMs;
+    g_job = nullptr;
+    g_state.store(Done, std::memory_order_release);
+    vTaskDelete(nullptr);
+}
+
+} // namespace
+
+bool benchStart(const char *name, BenchJob job) {
+    if (g_state.load(std::memory_order_acquire) == Running) return false;
+    g_name = name;
+    g_job = std::move(job);
+    g_result.reset(new JsonDocument(memJsonAllocator(MEM_WEB)));
+    g_status = 0;
+    g_startMs = millis();
+    g_elapsedMs = 0;
+    g_state = Running;
+    if (xTaskCreatePinnedToCore(benchTask, "bench", BENCH_TASK_STACK, nullptr, BENCH_TASK_PRIORITY, nullptr,
+                                BENCH_TASK_CORE) != pdPASS) {
+        LOGE(String("Bench: cannot start ") + name);
+        g_job = nullptr;
+        g_state = Idle;
+        return false;
+    }
+    LOGI(String("Bench: ") + name + " started");
+    return true;
+}
+
+void benchDescribe(JsonObject out) {
+    uint8_t state = g_state.load(std::memory_order_acquire);
+    out["state"] = state == Idle ? "idle" : state == Running ? "running" : "done";
+    if (state == Idle) return;
+    out["bench"] = g_name;
+    out["started_ms"] = g_startMs;
+    if (state == Running) {
+        out["elapsed_ms"] = millis() - g_startMs;
+        return;
+    }
+    out["elapsed_ms"] = g_elapsedMs;
+    out["status"] = g_status;
+    out["result"] = g_result->as<JsonObjectConst>();
+}
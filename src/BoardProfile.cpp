@@ -0,0 +1,61 @@
+#include "BoardProfile.h"
+
+namespace {
+
+const char *kindName(ChannelKind kind) {
+    switch (kind) {
+        case ChannelKind::Pwm: return "pwm";
+        case ChannelKind::Gpio: return "gpio";
+        case ChannelKind::Strip: return "strip";
+        case ChannelKind::Audio: return "audio";
+    }
+    return "?";
+}
+
+const char *audioName() {
+#if BOARD_AUDIO == BOARD_AUDIO_I2S
+    return "i2s";
+#elif BOARD_AUDIO == BOARD_AUDIO_DFPLAYER
+    return "dfplayer";
+#else
+    return "none";
+#endif
+}
+
+} // namespace
+
+const BoardChannel *boardChannel(const String &name, ChannelGroup group) {
+    for (const BoardChannel &c : kBoardChannels) {
+        if (c.group == group && name == c.name) return &c;
+    }
+    return nullptr;
+}
+
+int boardSlot(const BoardChannel &channel) {
+    int slot = 0;
+    for (const BoardChannel &c : kBoardChannels) {
+        if (&c == &channel) return slot;
+        if (c.group == channel.group) slot++;
+    }
+    return -1;
+}
+
+void boardDescribe(JsonObject out) {
+    out["board"] = BOARD_NAME;
+    out["audio"] = audioName();
+    out["smoke"] = static_cast<bool>(BOARD_HAS_SMOKE);
+    out["mill"] = static_cast<bool>(BOARD_HAS_MILL);
+    out["strip_pixels"] = PIXEL_STRIP_COUNT;
+    JsonArray channels = out.createNestedArray("channels");
+    for (const BoardChannel &c : kBoardChannels) {
+        JsonObject ch = channels.createNestedObject();
+        ch["name"] = c.name;
+        ch["kind"] = kindName(c.kind);
+        ch["pin"] = c.pin;
+        if (c.resolution) ch["bits"] = c.resolution;
+        if (c.max) {
+            ch["min"] = c.min;
+            ch["max"] = c.max;
+        }
+    }
+}
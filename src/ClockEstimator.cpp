@@ -0,0 +1,79 @@
+#include "ClockEstimator.h"
+
+void ClockEstimator::reset() {
+    count = 0;
+    next = 0;
+    version++;
+    fitted = false;
+    ref = 0;
+    offset = 0;
+    drift = 0;
+}
+
+void ClockEstimator::addSample(int64_t localUs, int64_t remoteUs) {
+    record(localUs, remoteUs);
+    apply(fit());
+}
+
+void ClockEstimator::record(int64_t localUs, int64_t remoteUs) {
+    local[next] = localUs;
+    delta[next] = remoteUs - localUs;
+    next = (next + 1) % WINDOW;
+    if (count < WINDOW) count++;
+    version++;
+}
+
+bool ClockEstimator::apply(const Fit &f) {
+    if (f.version != version || count == 0) return false;
+    ref = f.ref;
+    offset = f.offset;
+    drift = f.drift;
+    fitted = true;
+    return true;
+}
+
+ClockEstimator::Fit ClockEstimator::fit() const {
+    int newest = (next + WINDOW - 1) % WINDOW;
+    Fit f{version, local[newest], 0, drift};
+
+    // Drift from the upper envelope of the older and newer half of the
+    // window: the least-delayed sample of each half is nearly jitter free,
+    // where a plain least-squares fit would absorb the delay noise.
+    if (count >= 4) {
+        int oldest = count < WINDOW ? 0 : next;
+        int half = count / 2;
+        int bestA = -1, bestB = -1;
+        for (int k = 0; k < count; k++) {
+            int i = (oldest + k) % WINDOW;
+            int &best = k < half ? bestA : bestB;
+            if (best < 0 || delta[i] > delta[best]) best = i;
+        }
+        double span = static_cast<double>(local[bestB] - local[bestA]);
+        if (span > 0) {
+            double measured = static_cast<double>(delta[bestB] - delta[bestA]) / span;
+            // Smooth across refits; beacons arrive far more often than drift changes
+            f.drift += (measured - f.drift) * 0.25;
+        }
+        if (f.drift > MAX_DRIFT) f.drift = MAX_DRIFT;
+        if (f.drift < -MAX_DRIFT) f.drift = -MAX_DRIFT;
+    }
+
+    // Offset from the least-delayed sample: network delay only ever lowers delta
+    bool first = true;
+    for (int i = 0; i < count; i++) {
+        double projected = static_cast<double>(delta[i]) - f.drift * static_cast<double>(local[i] - f.ref);
+        if (first || projected > f.offset) f.offset = projected;
+        first = false;
+    }
+    return f;
+}
+
+int64_t ClockEstimator::toRemote(int64_t localUs) const {
+    return localUs + static_cast<int64_t>(offset + drift * static_cast<double>(localUs - ref));
+}
+
+int64_t ClockEstimator::toLocal(int64_t remoteUs) const {
+    // remote = local + offset + drift * (local - ref)
+    double local = (static_cast<double>(remoteUs - ref) - offset) / (1.0 + drift);
+    return ref + static_cast<int64_t>(local);
+}
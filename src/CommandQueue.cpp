@@ -0,0 +1,243 @@
+#include "CommandQueue.h"
+
+#include <atomic>
+
+#include "Actions.h"
+#include "AudioPlayer.h"
+#include "Journal.h"
+#include "Logger.h"
+#include "MemoryPolicy.h"
+#include "Leds.h"
+#include "Pwm.h"
+#include "Smoke.h"
+#include "Trace.h"
+
+namespace {
+
+static_assert((COMMAND_RING_SIZE & (COMMAND_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+constexpr uint32_t kRingMask = COMMAND_RING_SIZE - 1;
+
+// Coalescing slots: the value is stored before its pending bit is set, and the
+// consumer clears the bit before reading the value, so a racing write is either
+// applied now or left pending for the next drain - never lost. The value and
+// its cause are written and read together under g_slotMux so they never tear.
+struct Slot {
+    int32_t value;
+    char cause[COMMAND_CAUSE_LEN];
+};
+Slot g_slots[COMMAND_CHANNELS];
+portMUX_TYPE g_slotMux = portMUX_INITIALIZER_UNLOCKED;
+std::atomic<uint32_t> g_pending{0};
+
+// Bounded MPSC ring (per-cell sequence numbers). A cell is free for position p
+// when seq == p and readable when seq == p + 1.
+struct Command {
+    CommandType type;
+    int32_t arg;
+    char action[COMMAND_ACTION_LEN]; // CommandType::Action only
+    char cause[COMMAND_CAUSE_LEN];   // producer's journal cause
+};
+struct Cell {
+    std::atomic<uint32_t> seq;
+    Command command;
+};
+Cell g_ring[COMMAND_RING_SIZE];
+std::atomic<uint32_t> g_head{0};
+uint32_t g_tail = 0; // consumer only
+
+std::atomic<uint32_t> g_submitted{0};
+std::atomic<uint32_t> g_coalesced{0};
+std::atomic<uint32_t> g_dropped{0};
+uint32_t g_applied = 0;
+uint32_t g_volumeDeferred = 0;
+uint32_t g_lastVolumeMs = 0;
+
+// Trace names, and the journal cause when the producer had none
+const char *const kChannelCauses[COMMAND_CHANNELS] = {
+    "queue:led", "queue:led", "queue:led", "queue:smoke", "queue:smoke", "queue:mill", "queue:volume"};
+
+void copyCause(char (&out)[COMMAND_CAUSE_LEN]) {
+    strlcpy(out, journalCause(), COMMAND_CAUSE_LEN);
+}
+
+// Claim the next free cell; the caller fills it and publishes it with
+// seq = pos + 1. Null when the ring is full.
+Cell *reserve(uint32_t &pos) {
+    g_submitted.fetch_add(1, std::memory_order_relaxed);
+    pos = g_head.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell *cell = &g_ring[pos & kRingMask];
+        uint32_t seq = cell->seq.load(std::memory_order_acquire);
+        int32_t diff = static_cast<int32_t>(seq - pos);
+        if (diff == 0) {
+            if (g_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return cell;
+        } else if (diff < 0) {
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = g_head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool popCommand(Command &command) {
+    Cell &cell = g_ring[g_tail & kRingMask];
+    uint32_t seq = cell.seq.load(std::memory_order_acquire);
+    if (static_cast<int32_t>(seq - (g_tail + 1)) < 0) return false;
+    command = cell.command;
+    cell.seq.store(g_tail + COMMAND_RING_SIZE, std::memory_order_release);
+    g_tail++;
+    return true;
+}
+
+void applyCommand(const Command &command) {
+    int32_t arg = command.arg;
+    switch (command.type) {
+        case CommandType::Play: playFile(String(arg).c_str()); break;
+        case CommandType::Stop: stopPlayback(); break;
+        case CommandType::FireStart: startFireEffect(); break;
+        case CommandType::FireStop: stopFireEffect(); break;
+#if BOARD_HAS_SMOKE
+        case CommandType::SmokeOn:
+            cancelSmokePuff();
+            turnOnSmoke();
+            break;
+        case CommandType::SmokeOff:
+            cancelSmokePuff();
+            turnOffSmoke();
+            break;
+#else
+        case CommandType::SmokeOn:
+        case CommandType::SmokeOff: break;
+#endif
+        case CommandType::Reinit: audioReinit(); break;
+        case CommandType::Action:
+            if (!runAction(command.action)) LOGW(String("Commands: action failed: ") + command.action);
+            break;
+    }
+}
+
+void applyChannel(int channel, int32_t value) {
+    switch (channel) {
+        case CMD_LED0:
+        case CMD_LED1:
+        case CMD_LED2:
+            // Slots the board does not have are rejected by the API; skip stray ones
+            if (channel - CMD_LED0 < kLightPins.count) setLed(kLightPins[channel - CMD_LED0], value);
+            break;
+#if BOARD_HAS_SMOKE
+        case CMD_SMOKE0:
+        case CMD_SMOKE1:
+            if (channel - CMD_SMOKE0 < kSmokePins.count) setSmoke(kSmokePins[channel - CMD_SMOKE0], value);
+            break;
+#endif
+#if BOARD_HAS_MILL
+        case CMD_MILL:
+            setPwm(value);
+            break;
+#endif
+        case CMD_VOLUME:
+            audioSetVolume(value);
+            break;
+    }
+}
+
+} // namespace
+
+void setupCommandQueue() {
+    memRegisterStatic(MEM_COMMANDS, sizeof(g_ring) + sizeof(g_slots));
+    for (uint32_t i = 0; i < COMMAND_RING_SIZE; i++) g_ring[i].seq.store(i, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void commandSet(CommandChannel channel, int32_t value) {
+    if (channel >= COMMAND_CHANNELS) return;
+    g_submitted.fetch_add(1, std::memory_order_relaxed);
+    portENTER_CRITICAL(&g_slotMux);
+    g_slots[channel].value = value;
+    copyCause(g_slots[channel].cause);
+    portEXIT_CRITICAL(&g_slotMux);
+    uint32_t bit = 1u << channel;
+    if (g_pending.fetch_or(bit, std::memory_order_release) & bit) {
+        g_coalesced.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool commandPost(CommandType type, int32_t arg) {
+    uint32_t pos;
+    Cell *cell = reserve(pos);
+    if (!cell) return false;
+    cell->command.type = type;
+    cell->command.arg = arg;
+    copyCause(cell->command.cause);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool commandPostAction(const char *spec) {
+    size_t len = strnlen(spec, COMMAND_ACTION_LEN);
+    if (len == COMMAND_ACTION_LEN) return false;
+    uint32_t pos;
+    Cell *cell = reserve(pos);
+    if (!cell) return false;
+    cell->command.type = CommandType::Action;
+    cell->command.arg = 0;
+    memcpy(cell->command.action, spec, len + 1);
+    copyCause(cell->command.cause);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void serviceCommandQueue() {
+    // Discrete commands first, in order, so "fire stop" lands before a
+    // following LED level rather than after it
+    Command command;
+    while (popCommand(command)) {
+        TRACE_SCOPE_ARG("queue:command", static_cast<uint32_t>(command.type));
+        journalSetCause(command.cause[0] ? command.cause : "queue:command");
+        applyCommand(command);
+        g_applied++;
+    }
+
+    uint32_t pending = g_pending.exchange(0, std::memory_order_acquire);
+    uint32_t now = millis();
+    if ((pending & (1u << CMD_VOLUME)) && now - g_lastVolumeMs < COMMAND_VOLUME_INTERVAL_MS) {
+        // Too soon for another UART frame: keep the latest level pending
+        pending &= ~(1u << CMD_VOLUME);
+        g_pending.fetch_or(1u << CMD_VOLUME, std::memory_order_relaxed);
+        g_volumeDeferred++;
+    }
+    while (pending) {
+        int channel = __builtin_ctz(pending);
+        pending &= pending - 1;
+        Slot slot;
+        portENTER_CRITICAL(&g_slotMux);
+        slot = g_slots[channel];
+        portEXIT_CRITICAL(&g_slotMux);
+        journalSetCause(slot.cause[0] ? slot.cause : kChannelCauses[channel]);
+        TRACE_SCOPE(kChannelCauses[channel]);
+        applyChannel(channel, slot.value);
+        if (channel == CMD_VOLUME) g_lastVolumeMs = now;
+        g_applied++;
+    }
+    journalSetCause(nullptr);
+}
+
+CommandQueueStats commandQueueStats() {
+    CommandQueueStats s;
+    s.submitted = g_submitted.load(std::memory_order_relaxed);
+    s.coalesced = g_coalesced.load(std::memory_order_relaxed);
+    s.applied = g_applied;
+    s.dropped = g_dropped.load(std::memory_order_relaxed);
+    s.volumeDeferred = g_volumeDeferred;
+    return s;
+}
+
+void commandQueueDescribe(JsonObject out) {
+    CommandQueueStats s = commandQueueStats();
+    out["submitted"] = s.submitted;
+    out["coalesced"] = s.coalesced;
+    out["applied"] = s.applied;
+    out["dropped"] = s.dropped;
+    out["volume_deferred"] = s.volumeDeferred;
+}
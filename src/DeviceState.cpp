@@ -0,0 +1,79 @@
+#include "DeviceState.h"
+
+#include <atomic>
+
+#include "freertos/FreeRTOS.h"
+
+#include "EventBus.h"
+#include "Journal.h"
+
+// Seqlock: the sequence is odd while a write is in progress. Writers from
+// different tasks/cores are serialized by a spinlock held only for the copy;
+// readers retry instead of waiting.
+static DeviceState g_state = {};
+static std::atomic<uint32_t> g_seq{0};
+static portMUX_TYPE g_writeMux = portMUX_INITIALIZER_UNLOCKED;
+
+// `record` is false for effect frames: they would flood the journal, and
+// replaying the effect's start reproduces them
+template <typename F>
+static void update(F &&apply, bool record = true) {
+    portENTER_CRITICAL(&g_writeMux);
+    DeviceState before = g_state;
+    g_seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    apply(g_state);
+    g_state.version++;
+    g_state.updatedMs = millis();
+    std::atomic_thread_fence(std::memory_order_release);
+    g_seq.fetch_add(1, std::memory_order_release);
+    DeviceState after = g_state;
+    portEXIT_CRITICAL(&g_writeMux);
+    if (!record) return;
+    journalStateChange(before, after);
+    eventsStateChange(before, after);
+}
+
+DeviceState deviceStateSnapshot() {
+    DeviceState copy;
+    uint32_t before, after;
+    do {
+        before = g_seq.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        memcpy(&copy, const_cast<const DeviceState *>(&g_state), sizeof(copy));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = g_seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return copy;
+}
+
+void deviceStateSetLed(int index, uint16_t level) {
+    if (index < 0 || index >= DEVICE_STATE_LEDS) return;
+    update([&](DeviceState &s) { s.led[index] = level; });
+}
+
+void deviceStateShowLed(int index, uint16_t level) {
+    if (index < 0 || index >= DEVICE_STATE_LEDS) return;
+    update([&](DeviceState &s) { s.led[index] = level; }, false);
+}
+
+void deviceStateSetSmoke(int index, bool on) {
+    if (index < 0 || index >= DEVICE_STATE_SMOKES) return;
+    update([&](DeviceState &s) { s.smoke[index] = on; });
+}
+
+void deviceStateSetMill(uint8_t value) {
+    update([&](DeviceState &s) { s.mill = value; });
+}
+
+void deviceStateSetFireActive(bool active) {
+    update([&](DeviceState &s) { s.fireActive = active; });
+}
+
+void deviceStateSetAudioPlaying(bool playing) {
+    update([&](DeviceState &s) { s.audioPlaying = playing; });
+}
+
+void deviceStateSetVolume(uint8_t volume) {
+    update([&](DeviceState &s) { s.volume = volume; });
+}
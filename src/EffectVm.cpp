@@ -0,0 +1,561 @@
+#include "EffectVm.h"
+
+#include <ctype.h>
+#include <math.h>
+
+namespace {
+
+enum Op : uint8_t {
+    OP_PUSH = 1, // i32 immediate
+    OP_LOAD,     // u8 slot
+    OP_STORE,    // u8 slot
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_NEG,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_SIN, OP_COS, OP_NOISE, OP_RAND, OP_ABS, OP_FLOOR, OP_FRAC,
+    OP_MIN, OP_MAX, OP_CLAMP, OP_MIX, OP_SELECT,
+    OP_LAST = OP_SELECT
+};
+
+// Image: "FXB1", slot count, max stack, u16le main length, u16le pixel length, code
+const uint8_t kMagic[4] = {'F', 'X', 'B', '1'};
+constexpr size_t kHeaderLen = 10;
+
+struct Function {
+    const char *name;
+    Op op;
+    uint8_t arity;
+};
+
+const Function kFunctions[] = {
+    {"sin", OP_SIN, 1},     {"cos", OP_COS, 1},   {"noise", OP_NOISE, 1}, {"rand", OP_RAND, 0},
+    {"abs", OP_ABS, 1},     {"floor", OP_FLOOR, 1}, {"frac", OP_FRAC, 1}, {"min", OP_MIN, 2},
+    {"max", OP_MAX, 2},     {"clamp", OP_CLAMP, 3}, {"mix", OP_MIX, 3},   {"select", OP_SELECT, 3},
+};
+
+const char *const kFixedSlots[FXS_USER] = {"t", "dt", "frame", "i", "n", "x", "led0", "led1", "led2", "r", "g", "b"};
+
+// Stack effect of an opcode (pops, pushes)
+void opStack(uint8_t op, int &pops, int &pushes) {
+    pushes = 1;
+    switch (op) {
+        case OP_PUSH: case OP_LOAD: case OP_RAND: pops = 0; break;
+        case OP_STORE: pops = 1; pushes = 0; break;
+        case OP_NEG: case OP_SIN: case OP_COS: case OP_NOISE: case OP_ABS: case OP_FLOOR: case OP_FRAC: pops = 1; break;
+        case OP_CLAMP: case OP_MIX: case OP_SELECT: pops = 3; break;
+        default: pops = 2; break;
+    }
+}
+
+size_t opLength(uint8_t op) {
+    if (op == OP_PUSH) return 5;
+    if (op == OP_LOAD || op == OP_STORE) return 2;
+    return 1;
+}
+
+inline fx_t saturate(int64_t v) {
+    if (v > INT32_MAX) return INT32_MAX;
+    if (v < INT32_MIN) return INT32_MIN;
+    return static_cast<fx_t>(v);
+}
+
+// 256 steps per turn with linear interpolation, plenty for light levels
+fx_t g_sinTable[257];
+
+void initSinTable() {
+    if (g_sinTable[64] != 0) return;
+    for (int i = 0; i <= 256; i++) g_sinTable[i] = static_cast<fx_t>(lroundf(sinf(i * 2.0f * PI / 256) * FX_ONE));
+}
+
+// Argument in turns
+fx_t fxSin(fx_t turns) {
+    uint32_t f = static_cast<uint32_t>(turns) & 0xFFFF;
+    uint32_t idx = f >> 8;
+    int32_t a = g_sinTable[idx];
+    int32_t b = g_sinTable[idx + 1];
+    return a + static_cast<int32_t>((static_cast<int64_t>(b - a) * (f & 0xFF)) >> 8);
+}
+
+uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+}
+
+// 1D value noise, smoothstep between integer lattice points; 0..1
+fx_t fxNoise(fx_t x) {
+    int32_t cell = x >> 16;
+    int64_t f = x & 0xFFFF;
+    int64_t a = hash32(static_cast<uint32_t>(cell)) >> 16;
+    int64_t b = hash32(static_cast<uint32_t>(cell + 1)) >> 16;
+    int64_t s = (f * f >> 16) * (3 * FX_ONE - 2 * f) >> 16;
+    return static_cast<fx_t>(a + ((b - a) * s >> 16));
+}
+
+class Compiler {
+public:
+    Compiler(const char *src, String &error) : p_(src), error_(error) {
+        for (int i = 0; i < FXS_USER; i++) names_.push_back(kFixedSlots[i]);
+    }
+
+    bool compile(std::vector<uint8_t> &image) {
+        next();
+        while (ok_ && tok_ != T_EOF) statement(false);
+        if (!ok_) return false;
+        if (main_.size() > EFFECT_MAX_CODE || pixel_.size() > EFFECT_MAX_CODE) return fail("program too long");
+        image.assign(kMagic, kMagic + 4);
+        image.push_back(static_cast<uint8_t>(names_.size()));
+        image.push_back(static_cast<uint8_t>(maxDepth_));
+        image.push_back(main_.size() & 0xFF);
+        image.push_back(main_.size() >> 8);
+        image.push_back(pixel_.size() & 0xFF);
+        image.push_back(pixel_.size() >> 8);
+        image.insert(image.end(), main_.begin(), main_.end());
+        image.insert(image.end(), pixel_.begin(), pixel_.end());
+        return true;
+    }
+
+private:
+    enum Token { T_EOF, T_NUM, T_IDENT, T_PUNCT, T_CMP };
+
+    bool fail(const String &msg) {
+        if (ok_) error_ = "line " + String(line_) + ": " + msg;
+        ok_ = false;
+        return false;
+    }
+
+    void next() {
+        for (;;) {
+            while (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n' || *p_ == ';') {
+                if (*p_ == '\n') line_++;
+                p_++;
+            }
+            if (*p_ != '#') break;
+            while (*p_ && *p_ != '\n') p_++;
+        }
+        text_ = "";
+        if (!*p_) {
+            tok_ = T_EOF;
+        } else if (isdigit(static_cast<unsigned char>(*p_)) || (*p_ == '.' && isdigit(static_cast<unsigned char>(p_[1])))) {
+            tok_ = T_NUM;
+            int64_t whole = 0;
+            while (isdigit(static_cast<unsigned char>(*p_))) {
+                whole = whole * 10 + (*p_++ - '0');
+                if (whole >= 32768) {
+                    fail("number out of range");
+                    return;
+                }
+            }
+            int64_t frac = 0, scale = 1;
+            if (*p_ == '.') {
+                p_++;
+                while (isdigit(static_cast<unsigned char>(*p_))) {
+                    if (scale < 100000000) {
+                        frac = frac * 10 + (*p_ - '0');
+                        scale *= 10;
+                    }
+                    p_++;
+                }
+            }
+            num_ = static_cast<fx_t>((whole << 16) + (frac * FX_ONE + scale / 2) / scale);
+        } else if (isalpha(static_cast<unsigned char>(*p_)) || *p_ == '_') {
+            tok_ = T_IDENT;
+            while (isalnum(static_cast<unsigned char>(*p_)) || *p_ == '_') text_ += *p_++;
+        } else if ((*p_ == '<' || *p_ == '>' || *p_ == '=' || *p_ == '!') && p_[1] == '=') {
+            tok_ = T_CMP;
+            text_ += *p_++;
+            text_ += *p_++;
+        } else if (*p_ == '<' || *p_ == '>') {
+            tok_ = T_CMP;
+            text_ += *p_++;
+        } else {
+            tok_ = T_PUNCT;
+            text_ += *p_++;
+        }
+    }
+
+    bool accept(const char *punct) {
+        if (tok_ != T_PUNCT || text_ != punct) return false;
+        next();
+        return true;
+    }
+
+    void expect(const char *punct) {
+        if (!accept(punct)) fail(String("expected '") + punct + "'");
+    }
+
+    std::vector<uint8_t> &code() { return inPixel_ ? pixel_ : main_; }
+
+    void emit(uint8_t op, int pops, int pushes) {
+        code().push_back(op);
+        depth_ += pushes - pops;
+        if (depth_ > maxDepth_) maxDepth_ = depth_;
+        if (maxDepth_ > EFFECT_STACK) fail("expression too deep");
+    }
+
+    void emitPush(fx_t v) {
+        emit(OP_PUSH, 0, 1);
+        uint32_t u = static_cast<uint32_t>(v);
+        for (int i = 0; i < 4; i++) code().push_back(u >> (8 * i));
+    }
+
+    int slotOf(const String &name) {
+        for (size_t i = 0; i < names_.size(); i++) {
+            if (names_[i] == name) return i;
+        }
+        return -1;
+    }
+
+    void statement(bool nested) {
+        if (tok_ != T_IDENT) {
+            fail("expected a name");
+            return;
+        }
+        String name = text_;
+        next();
+        if (name == "pixel" && tok_ == T_PUNCT && text_ == "{") {
+            if (nested || hadPixel_) {
+                fail("only one top-level pixel block is allowed");
+                return;
+            }
+            next();
+            hadPixel_ = inPixel_ = true;
+            while (ok_ && !accept("}")) {
+                if (tok_ == T_EOF) {
+                    fail("missing '}'");
+                    return;
+                }
+                statement(true);
+            }
+            inPixel_ = false;
+            return;
+        }
+        expect("=");
+        if (!ok_) return;
+
+        int slot = slotOf(name);
+        if (slot < 0) {
+            if (names_.size() >= EFFECT_MAX_SLOTS) {
+                fail("too many variables");
+                return;
+            }
+            slot = names_.size();
+            names_.push_back(name); // visible in its own right-hand side: x = x + dt
+        }
+        if (slot <= FXS_X) {
+            fail("'" + name + "' is read-only");
+            return;
+        }
+        if (!inPixel_ && slot >= FXS_R && slot <= FXS_B) {
+            fail("'" + name + "' can only be set in the pixel block");
+            return;
+        }
+        expression();
+        emit(OP_STORE, 1, 0);
+        code().push_back(slot);
+    }
+
+    void expression() { comparison(); }
+
+    void comparison() {
+        additive();
+        while (ok_ && tok_ == T_CMP) {
+            String op = text_;
+            next();
+            additive();
+            uint8_t code = op == "<" ? OP_LT : op == "<=" ? OP_LE : op == ">" ? OP_GT : op == ">=" ? OP_GE : op == "==" ? OP_EQ : OP_NE;
+            emit(code, 2, 1);
+        }
+    }
+
+    void additive() {
+        term();
+        while (ok_ && tok_ == T_PUNCT && (text_ == "+" || text_ == "-")) {
+            uint8_t op = text_ == "+" ? OP_ADD : OP_SUB;
+            next();
+            term();
+            emit(op, 2, 1);
+        }
+    }
+
+    void term() {
+        unary();
+        while (ok_ && tok_ == T_PUNCT && (text_ == "*" || text_ == "/" || text_ == "%")) {
+            uint8_t op = text_ == "*" ? OP_MUL : text_ == "/" ? OP_DIV : OP_MOD;
+            next();
+            unary();
+            emit(op, 2, 1);
+        }
+    }
+
+    void unary() {
+        if (accept("-")) {
+            if (tok_ == T_NUM) {
+                fx_t v = num_;
+                next();
+                emitPush(-v);
+                return;
+            }
+            unary();
+            emit(OP_NEG, 1, 1);
+            return;
+        }
+        primary();
+    }
+
+    void primary() {
+        if (!ok_) return;
+        if (tok_ == T_NUM) {
+            fx_t v = num_;
+            next();
+            emitPush(v);
+            return;
+        }
+        if (accept("(")) {
+            expression();
+            expect(")");
+            return;
+        }
+        if (tok_ != T_IDENT) {
+            fail(tok_ == T_EOF ? String("unexpected end of program") : "unexpected '" + text_ + "'");
+            return;
+        }
+        String name = text_;
+        next();
+        if (accept("(")) {
+            const Function *fn = nullptr;
+            for (const Function &f : kFunctions) {
+                if (name == f.name) fn = &f;
+            }
+            if (!fn) {
+                fail("unknown function '" + name + "'");
+                return;
+            }
+            int args = 0;
+            if (!accept(")")) {
+                do {
+                    expression();
+                    args++;
+                } while (ok_ && accept(","));
+                expect(")");
+            }
+            if (ok_ && args != fn->arity) {
+                fail(name + "() takes " + String(fn->arity) + " argument(s)");
+                return;
+            }
+            int pops, pushes;
+            opStack(fn->op, pops, pushes);
+            emit(fn->op, pops, pushes);
+            return;
+        }
+        int slot = slotOf(name);
+        if (slot < 0) {
+            fail("unknown name '" + name + "'");
+            return;
+        }
+        if (!inPixel_ && ((slot >= FXS_I && slot <= FXS_X) || (slot >= FXS_R && slot <= FXS_B))) {
+            fail("'" + name + "' only exists in the pixel block");
+            return;
+        }
+        emit(OP_LOAD, 0, 1);
+        code().push_back(slot);
+    }
+
+    const char *p_;
+    String &error_;
+    bool ok_ = true;
+    int line_ = 1;
+    Token tok_ = T_EOF;
+    String text_;
+    fx_t num_ = 0;
+    std::vector<String> names_;
+    std::vector<uint8_t> main_;
+    std::vector<uint8_t> pixel_;
+    bool inPixel_ = false;
+    bool hadPixel_ = false;
+    int depth_ = 0;
+    int maxDepth_ = 0;
+};
+
+// Opcodes, operands, slot range and stack depth; counts instructions and
+// notes which LEDs are assigned
+bool verify(const uint8_t *code, size_t len, uint8_t slots, bool pixel, uint16_t &ops, uint8_t &ledMask, String &error) {
+    int depth = 0;
+    ops = 0;
+    for (size_t pc = 0; pc < len;) {
+        uint8_t op = code[pc];
+        if (op < OP_PUSH || op > OP_LAST || pc + opLength(op) > len) {
+            error = "bad opcode at " + String(pc);
+            return false;
+        }
+        if (op == OP_LOAD || op == OP_STORE) {
+            uint8_t slot = code[pc + 1];
+            bool pixelOnly = (slot >= FXS_I && slot <= FXS_X) || (slot >= FXS_R && slot <= FXS_B);
+            if (slot >= slots || (op == OP_STORE && slot <= FXS_X) || (!pixel && pixelOnly)) {
+                error = "bad slot at " + String(pc);
+                return false;
+            }
+            if (op == OP_STORE && slot >= FXS_LED0 && slot <= FXS_LED2) ledMask |= 1 << (slot - FXS_LED0);
+        }
+        int pops, pushes;
+        opStack(op, pops, pushes);
+        depth -= pops;
+        if (depth < 0) {
+            error = "stack underflow at " + String(pc);
+            return false;
+        }
+        depth += pushes;
+        if (depth > EFFECT_STACK) {
+            error = "stack overflow at " + String(pc);
+            return false;
+        }
+        pc += opLength(op);
+        ops++;
+    }
+    if (depth != 0) {
+        error = "unbalanced stack";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool effectCompile(const char *source, std::vector<uint8_t> &image, String &error) {
+    Compiler compiler(source, error);
+    return compiler.compile(image);
+}
+
+bool EffectVm::load(const uint8_t *image, size_t len, String &error) {
+    if (len < kHeaderLen || memcmp(image, kMagic, 4) != 0) {
+        error = "not an effect image";
+        return false;
+    }
+    uint8_t slots = image[4];
+    size_t mainLen = image[6] | image[7] << 8;
+    size_t pixelLen = image[8] | image[9] << 8;
+    if (slots < FXS_USER || slots > EFFECT_MAX_SLOTS || kHeaderLen + mainLen + pixelLen != len) {
+        error = "corrupt effect image";
+        return false;
+    }
+    const uint8_t *mainCode = image + kHeaderLen;
+    const uint8_t *pixelCode = mainCode + mainLen;
+    uint16_t mainOps, pixelOps;
+    uint8_t ledMask = 0;
+    if (!verify(mainCode, mainLen, slots, false, mainOps, ledMask, error) ||
+        !verify(pixelCode, pixelLen, slots, true, pixelOps, ledMask, error)) {
+        return false;
+    }
+    initSinTable();
+    main_.assign(mainCode, mainCode + mainLen);
+    pixel_.assign(pixelCode, pixelCode + pixelLen);
+    mainOps_ = mainOps;
+    pixelOps_ = pixelOps;
+    slotCount_ = slots;
+    ledMask_ = ledMask;
+    frame_ = 0;
+    memset(slots_, 0, sizeof(slots_));
+    return true;
+}
+
+uint32_t EffectVm::opsPerFrame(size_t pixels) const {
+    return mainOps_ + static_cast<uint32_t>(pixelOps_) * pixels;
+}
+
+void EffectVm::runFrame(uint32_t tMs, uint32_t dtMs) {
+    // t wraps after 32768 s
+    slots_[FXS_T] = static_cast<fx_t>((static_cast<uint64_t>(tMs) << 16) / 1000);
+    slots_[FXS_DT] = static_cast<fx_t>((static_cast<uint64_t>(dtMs < 60000 ? dtMs : 60000) << 16) / 1000);
+    slots_[FXS_FRAME] = static_cast<fx_t>(frame_++ << 16);
+    run(main_);
+}
+
+void EffectVm::runPixel(size_t index, size_t count, uint8_t &r, uint8_t &g, uint8_t &b) {
+    slots_[FXS_I] = static_cast<fx_t>(index << 16);
+    slots_[FXS_N] = static_cast<fx_t>(count << 16);
+    slots_[FXS_X] = count ? static_cast<fx_t>((static_cast<uint64_t>(index) << 16) / count) : 0;
+    slots_[FXS_R] = slots_[FXS_G] = slots_[FXS_B] = 0;
+    run(pixel_);
+    auto to8 = [](fx_t v) -> uint8_t { return v <= 0 ? 0 : v >= FX_ONE ? 255 : static_cast<uint8_t>((v * 255 + FX_ONE / 2) >> 16); };
+    r = to8(slots_[FXS_R]);
+    g = to8(slots_[FXS_G]);
+    b = to8(slots_[FXS_B]);
+}
+
+// Bytecode was verified on load: no bounds or stack checks here
+void EffectVm::run(const Code &code) {
+    fx_t stack[EFFECT_STACK];
+    int sp = 0;
+    const uint8_t *pc = code.data();
+    const uint8_t *end = pc + code.size();
+    while (pc < end) {
+        uint8_t op = *pc++;
+        switch (op) {
+            case OP_PUSH:
+                stack[sp++] = static_cast<fx_t>(pc[0] | pc[1] << 8 | pc[2] << 16 | static_cast<uint32_t>(pc[3]) << 24);
+                pc += 4;
+                break;
+            case OP_LOAD: stack[sp++] = slots_[*pc++]; break;
+            case OP_STORE: slots_[*pc++] = stack[--sp]; break;
+            case OP_NEG: stack[sp - 1] = saturate(-static_cast<int64_t>(stack[sp - 1])); break;
+            case OP_SIN: stack[sp - 1] = fxSin(stack[sp - 1]); break;
+            case OP_COS: stack[sp - 1] = fxSin(stack[sp - 1] + FX_ONE / 4); break;
+            case OP_NOISE: stack[sp - 1] = fxNoise(stack[sp - 1]); break;
+            case OP_ABS: stack[sp - 1] = saturate(llabs(stack[sp - 1])); break;
+            case OP_FLOOR: stack[sp - 1] &= ~0xFFFF; break;
+            case OP_FRAC: stack[sp - 1] &= 0xFFFF; break;
+            case OP_RAND:
+                rng_ ^= rng_ << 13;
+                rng_ ^= rng_ >> 17;
+                rng_ ^= rng_ << 5;
+                stack[sp++] = rng_ >> 16;
+                break;
+            case OP_CLAMP: {
+                sp -= 2;
+                fx_t v = stack[sp - 1];
+                stack[sp - 1] = v < stack[sp] ? stack[sp] : v > stack[sp + 1] ? stack[sp + 1] : v;
+                break;
+            }
+            case OP_MIX: {
+                sp -= 2;
+                int64_t a = stack[sp - 1];
+                // (b - a) takes 33 bits and c 32: check the product rather
+                // than rely on it fitting by one bit
+                int64_t product;
+                if (__builtin_mul_overflow(stack[sp] - a, static_cast<int64_t>(stack[sp + 1]), &product)) {
+                    product = ((stack[sp] - a) < 0) != (stack[sp + 1] < 0) ? INT64_MIN : INT64_MAX;
+                }
+                stack[sp - 1] = saturate(a + (product >> 16));
+                break;
+            }
+            case OP_SELECT:
+                sp -= 2;
+                stack[sp - 1] = stack[sp - 1] ? stack[sp] : stack[sp + 1];
+                break;
+            default: {
+                fx_t b = stack[--sp];
+                fx_t a = stack[sp - 1];
+                fx_t r = 0;
+                switch (op) {
+                    case OP_ADD: r = saturate(static_cast<int64_t>(a) + b); break;
+                    case OP_SUB: r = saturate(static_cast<int64_t>(a) - b); break;
+                    case OP_MUL: r = saturate((static_cast<int64_t>(a) * b) >> 16); break;
+                    case OP_DIV: r = b ? saturate(static_cast<int64_t>(a) * FX_ONE / b) : 0; break;
+                    case OP_MOD: r = b && b != -1 ? a % b : 0; break;
+                    case OP_LT: r = a < b ? FX_ONE : 0; break;
+                    case OP_LE: r = a <= b ? FX_ONE : 0; break;
+                    case OP_GT: r = a > b ? FX_ONE : 0; break;
+                    case OP_GE: r = a >= b ? FX_ONE : 0; break;
+                    case OP_EQ: r = a == b ? FX_ONE : 0; break;
+                    case OP_NE: r = a != b ? FX_ONE : 0; break;
+                    case OP_MIN: r = a < b ? a : b; break;
+                    case OP_MAX: r = a > b ? a : b; break;
+                }
+                stack[sp - 1] = r;
+                break;
+            }
+        }
+    }
+}
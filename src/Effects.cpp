@@ -0,0 +1,337 @@
+#include "Effects.h"
+
+#include <LittleFS.h>
+#include <atomic>
+#include <esp_timer.h>
+
+#include "EffectVm.h"
+#include "Journal.h"
+#include "LedOutput.h"
+#include "Leds.h"
+#include "Logger.h"
+#include "PixelStrip.h"
+#include "Trace.h"
+
+namespace {
+
+struct LoadedEffect {
+    EffectVm vm;
+    char name[EFFECT_NAME_MAX + 1];
+};
+
+struct EffectStats {
+    uint32_t frames;
+    uint32_t lastUs;
+    uint32_t maxUs;
+    uint32_t overruns; // frames that took longer than the frame period
+};
+
+// Handed from request handlers to the loop; whoever exchanges it out owns it
+std::atomic<LoadedEffect *> g_pending{nullptr};
+std::atomic<bool> g_stopRequested{false};
+std::atomic<bool> g_active{false};
+bool g_fireStarted = false; // loop task only (set by the bus subscriber)
+
+// Loop task only
+LoadedEffect *g_current = nullptr;
+uint32_t g_startMs = 0;
+uint32_t g_lastFrameMs = 0;
+EffectStats g_stats = {};
+
+// Name shown by /api/effects; written by the loop, read by handlers
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+char g_activeName[EFFECT_NAME_MAX + 1] = "";
+
+bool validName(const String &name) {
+    if (name.length() == 0 || name.length() > EFFECT_NAME_MAX) return false;
+    for (size_t i = 0; i < name.length(); i++) {
+        char c = name[i];
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-') return false;
+    }
+    return true;
+}
+
+String pathFor(const String &name, const char *ext) {
+    return String(EFFECTS_DIR "/") + name + ext;
+}
+
+bool readFile(const String &path, std::vector<uint8_t> &out) {
+    File f = LittleFS.open(path, "r");
+    if (!f) return false;
+    out.resize(f.size());
+    TRACE_SCOPE_ARG("fs.read", out.size());
+    bool ok = f.read(out.data(), out.size()) == out.size();
+    f.close();
+    return ok;
+}
+
+// Write next to `path`; effectSave() renames it into place once complete
+bool writeTemp(const String &path, const uint8_t *data, size_t len) {
+    File f = LittleFS.open(path + ".tmp", "w");
+    if (!f) return false;
+    bool ok = f.write(data, len) == len;
+    f.close();
+    if (!ok) LittleFS.remove(path + ".tmp");
+    return ok;
+}
+
+// Bytecode if present, else compile the source (e.g. shipped in the data image)
+bool loadEffect(const String &name, EffectVm &vm, String &error) {
+    if (!validName(name)) {
+        error = "invalid effect name";
+        return false;
+    }
+    std::vector<uint8_t> image;
+    if (!readFile(pathFor(name, ".fxb"), image)) {
+        std::vector<uint8_t> source;
+        if (!readFile(pathFor(name, ".fx"), source)) {
+            error = "no effect named '" + name + "'";
+            return false;
+        }
+        source.push_back('\0');
+        if (!effectCompile(reinterpret_cast<const char *>(source.data()), image, error)) return false;
+    }
+    return vm.load(image.data(), image.size(), error);
+}
+
+bool withinBudget(const EffectVm &vm, String &error) {
+    uint32_t ops = vm.opsPerFrame(pixelStripCount());
+    if (ops <= EFFECT_MAX_OPS_PER_FRAME) return true;
+    error = "needs " + String(ops) + " instructions per frame, budget is " + String(EFFECT_MAX_OPS_PER_FRAME);
+    return false;
+}
+
+void setActiveName(const char *name) {
+    portENTER_CRITICAL(&g_mux);
+    strlcpy(g_activeName, name, sizeof(g_activeName));
+    portEXIT_CRITICAL(&g_mux);
+}
+
+void unload(bool blank) {
+    if (!g_current) return;
+    LOGI(String("Effects: stopped ") + g_current->name);
+    if (blank) {
+        for (int k = 0; k < kLightPins.count; k++) {
+            if (g_current->vm.writesLed(k)) setLedLevel(kLightPins[k], 0);
+        }
+        Pixel *frame = pixelStripBackBuffer();
+        if (frame && g_current->vm.hasPixelBlock()) {
+            memset(frame, 0, pixelStripCount() * sizeof(Pixel));
+            pixelStripShow();
+        }
+    }
+    delete g_current;
+    g_current = nullptr;
+    g_active = false;
+    setActiveName("");
+    journalEffect(nullptr);
+    eventPublish(EffectChanged{false});
+}
+
+uint16_t toLevel(fx_t v) {
+    if (v <= 0) return 0;
+    if (v >= FX_ONE) return LED_LEVEL_MAX;
+    return static_cast<uint16_t>((static_cast<uint32_t>(v) * LED_LEVEL_MAX) >> 16);
+}
+
+// Render one frame into `frame` (may be null); LEDs only when `outputs`
+void renderFrame(EffectVm &vm, uint32_t tMs, uint32_t dtMs, Pixel *frame, size_t pixels, bool outputs) {
+    vm.runFrame(tMs, dtMs);
+    if (outputs) {
+        for (int k = 0; k < kLightPins.count; k++) {
+            if (vm.writesLed(k)) renderLedLevel(kLightPins[k], toLevel(vm.led(k)));
+        }
+    }
+    if (!vm.hasPixelBlock()) return;
+    for (size_t i = 0; i < pixels; i++) {
+        uint8_t r, g, b;
+        vm.runPixel(i, pixels, r, g, b);
+        if (frame) frame[i] = Pixel{g, r, b};
+    }
+}
+
+} // namespace
+
+void setupEffects() {
+    if (!LittleFS.exists(EFFECTS_DIR)) LittleFS.mkdir(EFFECTS_DIR);
+}
+
+void serviceEffects() {
+    if (g_fireStarted) {
+        g_fireStarted = false;
+        unload(false); // the fire effect owns the LEDs now
+    }
+    if (g_stopRequested.exchange(false)) unload(true);
+
+    uint32_t now = millis();
+    LoadedEffect *next = g_pending.exchange(nullptr);
+    if (next) {
+        if (isFireEffectActive()) stopFireEffect();
+        unload(true);
+        g_current = next;
+        g_startMs = now;
+        g_lastFrameMs = now - EFFECT_FRAME_MS;
+        g_stats = {};
+        g_active = true;
+        setActiveName(next->name);
+        journalEffect(next->name);
+        eventPublish(EffectChanged{true});
+        LOGI(String("Effects: running ") + next->name + " (" +
+             String(next->vm.opsPerFrame(pixelStripCount())) + " instructions per frame)");
+    }
+    if (!g_current) return;
+    if (now - g_lastFrameMs < EFFECT_FRAME_MS) return;
+
+    TRACE_SCOPE("effect.frame");
+    int64_t start = esp_timer_get_time();
+    Pixel *frame = g_current->vm.hasPixelBlock() ? pixelStripBackBuffer() : nullptr;
+    renderFrame(g_current->vm, now - g_startMs, now - g_lastFrameMs, frame, frame ? pixelStripCount() : 0, true);
+    if (frame) pixelStripShow();
+    g_lastFrameMs = now;
+
+    uint32_t us = esp_timer_get_time() - start;
+    g_stats.frames++;
+    g_stats.lastUs = us;
+    if (us > g_stats.maxUs) g_stats.maxUs = us;
+    if (us > EFFECT_FRAME_MS * 1000) g_stats.overruns++;
+}
+
+bool effectSave(const String &name, const String &source, String &error, uint32_t *opsPerFrame) {
+    if (!validName(name)) {
+        error = "name must be 1-" + String(EFFECT_NAME_MAX) + " of [A-Za-z0-9_-]";
+        return false;
+    }
+    std::vector<uint8_t> image;
+    if (!effectCompile(source.c_str(), image, error)) return false;
+    EffectVm vm;
+    if (!vm.load(image.data(), image.size(), error) || !withinBudget(vm, error)) return false;
+    if (opsPerFrame) *opsPerFrame = vm.opsPerFrame(pixelStripCount());
+
+    // A failed or interrupted save leaves the previous version intact. The
+    // bytecode goes away before the source is replaced, so at any point it
+    // is either missing (loadEffect() compiles the source) or matches it.
+    String src = pathFor(name, ".fx");
+    String bin = pathFor(name, ".fxb");
+    bool ok = writeTemp(src, reinterpret_cast<const uint8_t *>(source.c_str()), source.length());
+    if (ok && !writeTemp(bin, image.data(), image.size())) {
+        LittleFS.remove(src + ".tmp");
+        ok = false;
+    }
+    if (ok) {
+        if (LittleFS.exists(bin)) LittleFS.remove(bin);
+        ok = LittleFS.rename(src + ".tmp", src) && LittleFS.rename(bin + ".tmp", bin);
+    }
+    if (!ok) {
+        error = "cannot write " EFFECTS_DIR;
+        return false;
+    }
+    LOGI("Effects: saved " + name + " (" + String(image.size()) + " bytes of bytecode)");
+    return true;
+}
+
+bool effectRun(const String &name, String &error) {
+    LoadedEffect *e = new LoadedEffect();
+    if (!loadEffect(name, e->vm, error) || !withinBudget(e->vm, error)) {
+        delete e;
+        return false;
+    }
+    strlcpy(e->name, name.c_str(), sizeof(e->name));
+    delete g_pending.exchange(e); // a run that was not picked up yet is superseded
+    return true;
+}
+
+void effectStop() {
+    delete g_pending.exchange(nullptr);
+    g_stopRequested = true;
+}
+
+bool effectRemove(const String &name) {
+    if (!validName(name)) return false;
+    bool removed = LittleFS.remove(pathFor(name, ".fx"));
+    removed = LittleFS.remove(pathFor(name, ".fxb")) || removed;
+    return removed;
+}
+
+bool effectActive() {
+    return g_active;
+}
+
+void effectsOnFireChanged(const FireChanged &event) {
+    if (event.active) g_fireStarted = true;
+}
+
+void effectsDescribe(JsonObject out) {
+    char active[EFFECT_NAME_MAX + 1];
+    portENTER_CRITICAL(&g_mux);
+    strlcpy(active, g_activeName, sizeof(active));
+    portEXIT_CRITICAL(&g_mux);
+    if (active[0]) out["active"] = active;
+    else out["active"] = nullptr;
+    // Read without locking: counters from the loop, display only
+    EffectStats s = g_stats;
+    out["frames"] = s.frames;
+    out["last_us"] = s.lastUs;
+    out["max_us"] = s.maxUs;
+    out["overruns"] = s.overruns;
+    out["frame_ms"] = EFFECT_FRAME_MS;
+    out["max_ops"] = EFFECT_MAX_OPS_PER_FRAME;
+
+    JsonArray programs = out.createNestedArray("programs");
+    File dir = LittleFS.open(EFFECTS_DIR);
+    if (!dir || !dir.isDirectory()) return;
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        String file = f.name();
+        if (file.endsWith(".fx")) programs.add(file.substring(0, file.length() - 3));
+    }
+}
+
+void effectsBenchmark(const String &name, uint32_t frames, JsonObject out) {
+    size_t pixels = pixelStripCount();
+    out["pixels"] = pixels;
+    out["frames"] = frames;
+    out["budget_us"] = EFFECT_FRAME_MS * 1000;
+    JsonArray results = out.createNestedArray("effects");
+
+    std::vector<String> names;
+    if (name.length()) {
+        names.push_back(name);
+    } else {
+        File dir = LittleFS.open(EFFECTS_DIR);
+        if (dir && dir.isDirectory()) {
+            for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+                String file = f.name();
+                if (file.endsWith(".fx")) names.push_back(file.substring(0, file.length() - 3));
+            }
+        }
+    }
+
+    std::vector<Pixel> frame(pixels);
+    for (const String &n : names) {
+        JsonObject r = results.createNestedObject();
+        r["name"] = n;
+        EffectVm vm;
+        String error;
+        if (!loadEffect(n, vm, error)) {
+            r["error"] = error;
+            continue;
+        }
+        uint32_t maxUs = 0;
+        int64_t total = 0;
+        for (uint32_t i = 0; i < frames; i++) {
+            int64_t start = esp_timer_get_time();
+            renderFrame(vm, i * EFFECT_FRAME_MS, EFFECT_FRAME_MS, frame.data(), pixels, false);
+            uint32_t us = esp_timer_get_time() - start;
+            total += us;
+            if (us > maxUs) maxUs = us;
+        }
+        uint32_t avgUs = frames ? total / frames : 0;
+        uint32_t ops = vm.opsPerFrame(pixels);
+        r["ops_per_frame"] = ops;
+        r["avg_us"] = avgUs;
+        r["max_us"] = maxUs;
+        r["ns_per_op"] = ops ? static_cast<uint32_t>(total * 1000 / (static_cast<int64_t>(ops) * max<uint32_t>(frames, 1))) : 0;
+        // Share of the frame period, in percent
+        r["budget_pct"] = static_cast<float>(avgUs) * 100 / (EFFECT_FRAME_MS * 1000);
+        r["within_budget"] = ops <= EFFECT_MAX_OPS_PER_FRAME;
+    }
+}
@@ -0,0 +1,306 @@
+#include "Envelope.h"
+
+#include <LittleFS.h>
+#include <esp_timer.h>
+
+#include "Actions.h"
+#include "AudioPlayer.h"
+#include "BoardProfile.h"
+#include "Leds.h"
+#include "Logger.h"
+#include "MemoryPolicy.h"
+#include "Pwm.h"
+#include "Trace.h"
+
+namespace {
+
+struct Frame {
+    uint8_t loudness;
+    uint8_t beat;
+};
+static_assert(sizeof(Frame) == 2, "frames are two bytes on disk");
+
+constexpr uint32_t kHeaderBytes = 12;
+constexpr uint8_t kVersion = 0;
+// The I2S backend re-anchors on its DAC position, which already includes
+// the DMA ring
+constexpr int32_t kBackendLatencyUs = BOARD_AUDIO == BOARD_AUDIO_DFPLAYER ? ENVELOPE_DFPLAYER_LATENCY_MS * 1000 : 0;
+
+EnvelopeConfig g_config;
+
+// Loop task only
+File g_file;
+bool g_active = false;
+int16_t g_track = 0;
+uint16_t g_rate = 0;
+uint32_t g_frames = 0;
+int64_t g_startUs = 0; // when frame 0 is heard
+uint32_t g_frame = 0;  // last applied
+bool g_applied = false;
+uint32_t g_resyncAtMs = 0;
+
+// Read-ahead window: frames g_bufStart .. g_bufStart + g_bufCount - 1
+Frame g_buf[ENVELOPE_BUFFER_FRAMES];
+uint32_t g_bufStart = 0;
+uint32_t g_bufCount = 0;
+
+Frame g_current = {};
+uint16_t g_fireGain = 256;
+uint16_t g_millScale = 256;
+uint32_t g_lastPuffMs = 0;
+
+uint32_t g_tracks = 0;
+uint32_t g_missing = 0;
+uint32_t g_puffs = 0;
+uint32_t g_applyCount = 0;
+uint32_t g_applyMaxUs = 0;
+uint64_t g_applyTotalUs = 0;
+
+bool validate(const EnvelopeConfig &c, String &error) {
+    if (c.fireDepth > 100 || c.millDepth > 100) {
+        error = "depths are 0-100 (%)";
+        return false;
+    }
+    if (c.smokePuffMs < 50 || c.smokePuffMs > 5000) {
+        error = "smoke_puff_ms must be 50-5000";
+        return false;
+    }
+    if (c.latencyMs < -1000 || c.latencyMs > 1000) {
+        error = "latency_ms must be -1000..1000";
+        return false;
+    }
+    return true;
+}
+
+void loadConfig() {
+    File f = LittleFS.open(ENVELOPE_CONFIG_FILE, "r");
+    if (!f) return;
+    StaticJsonDocument<256> doc;
+    EnvelopeConfig c;
+    if (!deserializeJson(doc, f)) {
+        c.fireDepth = doc["fire_depth"] | c.fireDepth;
+        c.millDepth = doc["mill_depth"] | c.millDepth;
+        c.smokeBeat = doc["smoke_beat"] | c.smokeBeat;
+        c.smokePuffMs = doc["smoke_puff_ms"] | c.smokePuffMs;
+        c.smokeCooldownMs = doc["smoke_cooldown_ms"] | c.smokeCooldownMs;
+        c.latencyMs = doc["latency_ms"] | c.latencyMs;
+    }
+    f.close();
+    String error;
+    if (validate(c, error)) g_config = c;
+    else LOGW("Envelope: " ENVELOPE_CONFIG_FILE " ignored: " + error);
+}
+
+// 256 +- depth% of 256, following loudness around its midpoint
+uint16_t modulation(uint8_t depth, uint8_t loudness) {
+    int32_t gain = 256 + static_cast<int32_t>(depth) * (2 * loudness - 255) * 256 / 25500;
+    return static_cast<uint16_t>(gain < 0 ? 0 : gain);
+}
+
+void setFireGain(uint16_t gain) {
+    if (gain == g_fireGain) return;
+    g_fireGain = gain;
+    setFireSparkGain(gain);
+}
+
+void setMillScale(uint16_t scale) {
+    if (scale == g_millScale) return;
+    g_millScale = scale;
+#if BOARD_HAS_MILL
+    setPwmScale(scale);
+#endif
+}
+
+void stop() {
+    if (!g_active) return;
+    g_active = false;
+    g_file.close();
+    g_current = Frame();
+    setFireGain(256);
+    setMillScale(256);
+}
+
+// Make `from` the first frame of the window, keeping what is already read
+bool fill(uint32_t from) {
+    uint32_t keep = 0;
+    if (from >= g_bufStart && from < g_bufStart + g_bufCount) {
+        keep = g_bufStart + g_bufCount - from;
+        memmove(g_buf, g_buf + (from - g_bufStart), keep * sizeof(Frame));
+    } else if (!g_file.seek(kHeaderBytes + from * sizeof(Frame))) {
+        return false;
+    }
+    size_t want = (ENVELOPE_BUFFER_FRAMES - keep) * sizeof(Frame);
+    TRACE_SCOPE_ARG("fs.read", want);
+    int n = g_file.read(reinterpret_cast<uint8_t *>(g_buf + keep), want);
+    g_bufStart = from;
+    g_bufCount = keep + (n > 0 ? n / sizeof(Frame) : 0);
+    return g_bufCount > 0;
+}
+
+void start(int16_t track, uint32_t stampUs) {
+    stop();
+    g_tracks++;
+    char path[32];
+    snprintf(path, sizeof(path), ENVELOPE_DIR "/%03d.env", track);
+    g_file = LittleFS.open(path, "r");
+    if (!g_file) {
+        g_missing++;
+        return;
+    }
+    uint8_t h[kHeaderBytes];
+    if (g_file.read(h, sizeof(h)) != sizeof(h) || memcmp(h, "ENV1", 4) || h[6] != kVersion) {
+        LOGW(String("Envelope: ") + path + " is not an envelope");
+        g_file.close();
+        return;
+    }
+    g_rate = h[4] | h[5] << 8;
+    g_frames = h[8] | h[9] << 8 | h[10] << 16 | static_cast<uint32_t>(h[11]) << 24;
+    if (!g_rate || g_rate > 1000 || !g_frames) {
+        LOGW(String("Envelope: ") + path + " has no frames");
+        g_file.close();
+        return;
+    }
+    // Anchor on the event stamp rather than now: the bus may have queued it
+    int64_t now = esp_timer_get_time();
+    uint32_t age = static_cast<uint32_t>(now) - stampUs;
+    g_startUs = now - age + kBackendLatencyUs + g_config.latencyMs * 1000;
+    g_track = track;
+    g_bufStart = 0;
+    g_bufCount = 0;
+    g_applied = false;
+    g_resyncAtMs = millis() + ENVELOPE_RESYNC_MS;
+    g_active = fill(0);
+    if (!g_active) g_file.close();
+}
+
+// Stop with the audio; on the I2S backend also follow its DAC position
+void resync(int64_t now) {
+    g_resyncAtMs = millis() + ENVELOPE_RESYNC_MS;
+    if (!isPlaying()) {
+        stop();
+        return;
+    }
+    AudioStatus s;
+    if (audioGetStatus(s) && s.playing && s.sampleRate) {
+        g_startUs = now - static_cast<int64_t>(s.positionFrames * 1000000 / s.sampleRate) + g_config.latencyMs * 1000;
+    }
+}
+
+void apply(uint32_t frame) {
+    // Frames the loop skipped may hold a beat
+    uint8_t beat = 0;
+    uint32_t first = g_applied && frame > g_frame ? g_frame + 1 : frame;
+    if (first < g_bufStart) first = g_bufStart;
+    for (uint32_t f = first; f <= frame; f++) beat = max(beat, g_buf[f - g_bufStart].beat);
+    g_current = g_buf[frame - g_bufStart];
+    g_current.beat = beat;
+    g_frame = frame;
+    g_applied = true;
+
+    setFireGain(modulation(g_config.fireDepth, g_current.loudness));
+    setMillScale(modulation(g_config.millDepth, g_current.loudness));
+#if BOARD_HAS_SMOKE
+    uint32_t nowMs = millis();
+    if (g_config.smokeBeat && beat >= g_config.smokeBeat && nowMs - g_lastPuffMs >= g_config.smokeCooldownMs) {
+        g_lastPuffMs = nowMs;
+        g_puffs++;
+        runAction("smoke:puff:" + String(g_config.smokePuffMs));
+    }
+#endif
+}
+
+} // namespace
+
+void setupEnvelope() {
+    memRegisterStatic(MEM_AUDIO, sizeof(g_buf));
+    loadConfig();
+}
+
+void serviceEnvelope() {
+    if (!g_active) return;
+    int64_t now = esp_timer_get_time();
+    if (static_cast<int32_t>(millis() - g_resyncAtMs) >= 0) {
+        resync(now);
+        if (!g_active) return;
+    }
+    if (now < g_startUs) return;
+    uint32_t frame = static_cast<uint32_t>((now - g_startUs) * g_rate / 1000000);
+    if (g_applied && frame == g_frame) return;
+    if (frame >= g_frames) {
+        stop();
+        return;
+    }
+
+    uint32_t t = micros();
+    bool inWindow = frame >= g_bufStart && frame < g_bufStart + g_bufCount;
+    bool halfUsed = frame - g_bufStart >= ENVELOPE_BUFFER_FRAMES / 2 && g_bufStart + g_bufCount < g_frames;
+    if ((!inWindow || halfUsed) && !fill(frame)) {
+        LOGW("Envelope: read failed at frame " + String(frame));
+        stop();
+        return;
+    }
+    apply(frame);
+    uint32_t us = micros() - t;
+    g_applyCount++;
+    g_applyTotalUs += us;
+    g_applyMaxUs = max(g_applyMaxUs, us);
+}
+
+void envelopeOnEvent(const Event &event) {
+    if (event.type == EventType::TrackStarted) start(event.as<TrackStarted>().track, event.stampUs);
+    else if (event.type == EventType::TrackFinished) stop();
+}
+
+EnvelopeConfig envelopeConfig() {
+    return g_config;
+}
+
+bool envelopeSetConfig(const EnvelopeConfig &config, String &error) {
+    if (!validate(config, error)) return false;
+    File f = LittleFS.open(ENVELOPE_CONFIG_FILE, "w");
+    if (!f) {
+        error = "cannot write " ENVELOPE_CONFIG_FILE;
+        return false;
+    }
+    StaticJsonDocument<256> doc;
+    doc["fire_depth"] = config.fireDepth;
+    doc["mill_depth"] = config.millDepth;
+    doc["smoke_beat"] = config.smokeBeat;
+    doc["smoke_puff_ms"] = config.smokePuffMs;
+    doc["smoke_cooldown_ms"] = config.smokeCooldownMs;
+    doc["latency_ms"] = config.latencyMs;
+    serializeJson(doc, f);
+    f.close();
+    // Read by the loop task at the next frame; a torn read lasts one frame
+    g_config = config;
+    return true;
+}
+
+void envelopeDescribe(JsonObject out) {
+    // Loop task state, read without locking: display only
+    out["active"] = g_active;
+    if (g_active) {
+        out["track"] = g_track;
+        out["rate_hz"] = g_rate;
+        out["frame"] = g_frame;
+        out["frames"] = g_frames;
+        out["loudness"] = g_current.loudness;
+        out["beat"] = g_current.beat;
+    }
+    out["fire_gain"] = g_fireGain;
+    out["mill_scale"] = g_millScale;
+    out["tracks"] = g_tracks;
+    out["missing"] = g_missing;
+    out["puffs"] = g_puffs;
+    out["apply_avg_us"] = g_applyCount ? static_cast<uint32_t>(g_applyTotalUs / g_applyCount) : 0;
+    out["apply_max_us"] = g_applyMaxUs;
+    out["backend_latency_ms"] = kBackendLatencyUs / 1000;
+
+    JsonObject c = out.createNestedObject("config");
+    c["fire_depth"] = g_config.fireDepth;
+    c["mill_depth"] = g_config.millDepth;
+    c["smoke_beat"] = g_config.smokeBeat;
+    c["smoke_puff_ms"] = g_config.smokePuffMs;
+    c["smoke_cooldown_ms"] = g_config.smokeCooldownMs;
+    c["latency_ms"] = g_config.latencyMs;
+}
@@ -0,0 +1,258 @@
+#include "EventBus.h"
+
+#include <atomic>
+#include <esp_timer.h>
+
+#include "Effects.h"
+#include "Envelope.h"
+#include "Journal.h"
+#include "MemoryPolicy.h"
+#include "Rules.h"
+#include "Trace.h"
+
+namespace {
+
+static_assert((EVENT_RING_SIZE & (EVENT_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+constexpr uint32_t kRingMask = EVENT_RING_SIZE - 1;
+constexpr int kTypes = static_cast<int>(EventType::Count);
+
+// ---- Subscribers ----------------------------------------------------------
+
+typedef void (*EventHandler)(const Event &);
+
+struct Subscriber {
+    EventType type; // EventType::Count: every event
+    EventHandler fn;
+};
+
+template <typename E, void (*Fn)(const E &)>
+void typedHandler(const Event &event) {
+    Fn(event.as<E>());
+}
+
+template <typename E, void (*Fn)(const E &)>
+constexpr Subscriber on() {
+    return {EventTraits<E>::type, &typedHandler<E, Fn>};
+}
+
+// Untyped handler for one type, for subscribers that need the stamp
+template <typename E>
+constexpr Subscriber onEvent(EventHandler fn) {
+    return {EventTraits<E>::type, fn};
+}
+
+constexpr Subscriber onAll(EventHandler fn) {
+    return {EventType::Count, fn};
+}
+
+// Called in this order for every event of their type
+constexpr Subscriber kSubscribers[] = {
+    on<FireChanged, effectsOnFireChanged>(),
+    onEvent<TrackStarted>(envelopeOnEvent),
+    onEvent<TrackFinished>(envelopeOnEvent),
+    onAll(rulesOnEvent),
+};
+constexpr int kSubscriberCount = sizeof(kSubscribers) / sizeof(kSubscribers[0]);
+
+// Per-type handler lists, flattened: handlers of type t are
+// fn[begin[t]] .. fn[begin[t + 1] - 1]
+struct DispatchTable {
+    uint8_t begin[kTypes + 1];
+    EventHandler fn[kTypes * kSubscriberCount];
+};
+
+constexpr DispatchTable makeDispatchTable() {
+    DispatchTable t{};
+    int n = 0;
+    for (int type = 0; type < kTypes; type++) {
+        t.begin[type] = n;
+        for (int i = 0; i < kSubscriberCount; i++) {
+            EventType want = kSubscribers[i].type;
+            if (want == EventType::Count || static_cast<int>(want) == type) t.fn[n++] = kSubscribers[i].fn;
+        }
+    }
+    t.begin[kTypes] = n;
+    return t;
+}
+
+constexpr DispatchTable kDispatch = makeDispatchTable();
+
+const char *const kNames[kTypes] = {
+    "track_started", "track_finished", "fire", "smoke", "mill", "effect",
+};
+// Journal causes for changes made while handling an event
+const char *const kCauses[kTypes] = {
+    "event:track_started", "event:track_finished", "event:fire", "event:smoke", "event:mill", "event:effect",
+};
+
+// ---- Per-core rings -------------------------------------------------------
+
+// Bounded MPSC ring, as in CommandQueue: a cell is free for position p when
+// seq == p and readable when seq == p + 1. Producers on one core are tasks
+// and ISRs that may preempt each other mid-publish; the consumer simply
+// stops at a cell that is not readable yet.
+struct Cell {
+    std::atomic<uint32_t> seq;
+    Event event;
+};
+
+struct Ring {
+    Cell cells[EVENT_RING_SIZE];
+    std::atomic<uint32_t> head{0};
+    uint32_t tail = 0; // consumer only
+    std::atomic<uint32_t> published{0};
+    std::atomic<uint32_t> dropped{0};
+
+    Ring() {
+        for (uint32_t i = 0; i < EVENT_RING_SIZE; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // Oldest unread event, or null
+    Cell *peek() {
+        Cell &cell = cells[tail & kRingMask];
+        uint32_t seq = cell.seq.load(std::memory_order_acquire);
+        return static_cast<int32_t>(seq - (tail + 1)) < 0 ? nullptr : &cell;
+    }
+
+    void pop(Cell *cell) {
+        cell->seq.store(tail + EVENT_RING_SIZE, std::memory_order_release);
+        tail++;
+    }
+};
+
+Ring g_rings[portNUM_PROCESSORS];
+
+// Loop task only
+uint32_t g_dispatched = 0;
+uint32_t g_deferred = 0;
+uint32_t g_maxLatencyUs = 0;
+uint32_t g_maxDispatchUs = 0;
+
+// Oldest ready event across the cores (stamps are one clock)
+Ring *oldestReady(Cell *&cell) {
+    Ring *best = nullptr;
+    cell = nullptr;
+    for (Ring &ring : g_rings) {
+        Cell *c = ring.peek();
+        if (!c) continue;
+        if (!cell || static_cast<int32_t>(c->event.stampUs - cell->event.stampUs) < 0) {
+            best = &ring;
+            cell = c;
+        }
+    }
+    return best;
+}
+
+void dispatch(const Event &event) {
+    int type = static_cast<int>(event.type);
+    journalSetCause(kCauses[type]);
+    TRACE_SCOPE_ARG(kCauses[type], event.value);
+    for (int i = kDispatch.begin[type]; i < kDispatch.begin[type + 1]; i++) kDispatch.fn[i](event);
+    journalSetCause(nullptr);
+}
+
+} // namespace
+
+const char *eventTypeName(EventType type) {
+    return type < EventType::Count ? kNames[static_cast<int>(type)] : nullptr;
+}
+
+bool eventTypeFromName(const char *name, EventType &out) {
+    for (int i = 0; i < kTypes; i++) {
+        if (strcmp(kNames[i], name) == 0) {
+            out = static_cast<EventType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void setupEventBus() {
+    memRegisterStatic(MEM_EVENTS, sizeof(g_rings));
+    // Output self-tests during boot published events nobody asked for
+    Cell *cell;
+    while (Ring *ring = oldestReady(cell)) ring->pop(cell);
+}
+
+bool IRAM_ATTR eventPublishRaw(EventType type, int32_t value, const void *payload, size_t len) {
+    Ring &ring = g_rings[xPortGetCoreID()];
+    uint32_t pos = ring.head.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+        cell = &ring.cells[pos & kRingMask];
+        uint32_t seq = cell->seq.load(std::memory_order_acquire);
+        int32_t diff = static_cast<int32_t>(seq - pos);
+        if (diff == 0) {
+            if (ring.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = ring.head.load(std::memory_order_relaxed);
+        }
+    }
+    cell->event.type = type;
+    cell->event.value = value;
+    cell->event.stampUs = static_cast<uint32_t>(esp_timer_get_time());
+    memcpy(cell->event.payload, payload, len);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    ring.published.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void serviceEventBus() {
+    Cell *cell;
+    for (int n = 0; n < EVENT_DRAIN_MAX; n++) {
+        Ring *ring = oldestReady(cell);
+        if (!ring) return;
+        Event event = cell->event;
+        ring->pop(cell);
+
+        uint32_t start = static_cast<uint32_t>(esp_timer_get_time());
+        uint32_t latency = start - event.stampUs;
+        if (latency > g_maxLatencyUs) g_maxLatencyUs = latency;
+        dispatch(event);
+        uint32_t us = static_cast<uint32_t>(esp_timer_get_time()) - start;
+        if (us > g_maxDispatchUs) g_maxDispatchUs = us;
+        g_dispatched++;
+    }
+    // Events kept coming (e.g. rules triggering each other): yield the loop
+    if (oldestReady(cell)) g_deferred++;
+}
+
+void eventsStateChange(const DeviceState &before, const DeviceState &after) {
+    if (after.fireActive != before.fireActive) eventPublish(FireChanged{after.fireActive});
+    for (int i = 0; i < DEVICE_STATE_SMOKES; i++) {
+        if (after.smoke[i] != before.smoke[i]) eventPublish(SmokeChanged{static_cast<uint8_t>(i), after.smoke[i]});
+    }
+    if (after.mill != before.mill) eventPublish(MillChanged{before.mill, after.mill});
+}
+
+EventBusStats eventBusStats() {
+    EventBusStats s = {};
+    for (int core = 0; core < portNUM_PROCESSORS && core < 2; core++) {
+        s.published[core] = g_rings[core].published.load(std::memory_order_relaxed);
+        s.dropped[core] = g_rings[core].dropped.load(std::memory_order_relaxed);
+    }
+    s.dispatched = g_dispatched;
+    s.deferred = g_deferred;
+    s.maxLatencyUs = g_maxLatencyUs;
+    s.maxDispatchUs = g_maxDispatchUs;
+    return s;
+}
+
+void eventBusDescribe(JsonObject out) {
+    EventBusStats s = eventBusStats();
+    JsonArray published = out.createNestedArray("published");
+    JsonArray dropped = out.createNestedArray("dropped");
+    for (int core = 0; core < 2; core++) {
+        published.add(s.published[core]);
+        dropped.add(s.dropped[core]);
+    }
+    out["dispatched"] = s.dispatched;
+    out["deferred"] = s.deferred;
+    out["max_latency_us"] = s.maxLatencyUs;
+    out["max_dispatch_us"] = s.maxDispatchUs;
+    JsonObject subs = out.createNestedObject("subscribers");
+    for (int i = 0; i < kTypes; i++) subs[kNames[i]] = kDispatch.begin[i + 1] - kDispatch.begin[i];
+}
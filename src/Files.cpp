@@ -4,12 +4,188 @@
 
 #include "Files.h"
 
+#include <sdkconfig.h>
+
 #include "Logger.h"
+#include "MemoryPolicy.h"
+
+namespace {
+
+constexpr size_t kBenchBufferBytes = 8192;
+
+FsProfile g_profile;
+
+bool validate(const FsProfile &p, String &error) {
+    if (p.maxOpenFiles < 2 || p.maxOpenFiles > 32) {
+        error = "max_open_files must be 2-32";
+        return false;
+    }
+    if (p.readAheadBytes > 16384) {
+        error = "read_ahead must be 0-16384";
+        return false;
+    }
+    if (p.chunkBytes && (p.chunkBytes < 256 || p.chunkBytes > 16384)) {
+        error = "chunk must be 0 or 256-16384";
+        return false;
+    }
+    return true;
+}
+
+void loadProfile() {
+    File f = LittleFS.open(FS_PROFILE_FILE, "r");
+    if (!f) return;
+    StaticJsonDocument<128> doc;
+    FsProfile p;
+    if (!deserializeJson(doc, f)) {
+        p.maxOpenFiles = doc["max_open_files"] | p.maxOpenFiles;
+        p.readAheadBytes = doc["read_ahead"] | p.readAheadBytes;
+        p.chunkBytes = doc["chunk"] | p.chunkBytes;
+    }
+    f.close();
+    String error;
+    if (validate(p, error)) g_profile = p;
+    else LOGW("LittleFS: " FS_PROFILE_FILE " ignored: " + error);
+}
+
+class LittleFsTarget : public FsBenchTarget {
+public:
+    uint32_t nowUs() override { return micros(); }
+    bool open(const char *path, bool write) override {
+        file_ = write ? LittleFS.open(path, "w") : fsOpen(path);
+        return static_cast<bool>(file_);
+    }
+    int read(uint8_t *buf, size_t len) override { return file_.read(buf, len); }
+    int write(const uint8_t *buf, size_t len) override { return file_.write(buf, len); }
+    bool seek(uint32_t pos) override { return file_.seek(pos); }
+    uint32_t size() override { return file_.size(); }
+    void close() override { file_.close(); }
+    bool exists(const char *path) override { return LittleFS.exists(path); }
+    int list(const char *dir) override {
+        File d = LittleFS.open(dir);
+        if (!d || !d.isDirectory()) return -1;
+        int n = 0;
+        for (File e = d.openNextFile(); e; e = d.openNextFile()) n++;
+        return n;
+    }
+    bool remove(const char *path) override { return LittleFS.remove(path); }
+
+private:
+    File file_;
+};
+
+void addTiming(JsonObject out, const char *name, const FsBenchTiming &t) {
+    JsonObject o = out.createNestedObject(name);
+    o["count"] = t.count;
+    o["avg_us"] = t.avgUs();
+    o["max_us"] = t.maxUs;
+    if (t.bytes) o["kib_s"] = t.kibPerSec();
+}
+
+} // namespace
 
 void setupFileSystem() {
-    if (!LittleFS.begin(true)) {
+    if (!LittleFS.begin(true, FS_BASE_PATH, FS_MAX_OPEN_FILES)) {
         LOGE("LittleFS mount failed!");
         return;
     }
-    LOGI("LittleFS mounted successfully");
+    loadProfile();
+    // Descriptors are reserved by the mount itself
+    if (g_profile.maxOpenFiles != FS_MAX_OPEN_FILES) {
+        LittleFS.end();
+        if (!LittleFS.begin(false, FS_BASE_PATH, g_profile.maxOpenFiles)) {
+            LOGE("LittleFS remount with " + String(g_profile.maxOpenFiles) + " files failed, using the default");
+            g_profile.maxOpenFiles = FS_MAX_OPEN_FILES;
+            LittleFS.begin(true, FS_BASE_PATH, FS_MAX_OPEN_FILES);
+        }
+    }
+    LOGI("LittleFS mounted successfully (" + String(g_profile.maxOpenFiles) + " files, read-ahead " +
+         String(g_profile.readAheadBytes) + ", chunk " + String(g_profile.chunkBytes) + ")");
+}
+
+const FsProfile &fsProfile() {
+    return g_profile;
+}
+
+bool fsSetProfile(const FsProfile &profile, String &error) {
+    if (!validate(profile, error)) return false;
+    File f = LittleFS.open(FS_PROFILE_FILE, "w");
+    if (!f) {
+        error = "cannot write " FS_PROFILE_FILE;
+        return false;
+    }
+    StaticJsonDocument<128> doc;
+    doc["max_open_files"] = profile.maxOpenFiles;
+    doc["read_ahead"] = profile.readAheadBytes;
+    doc["chunk"] = profile.chunkBytes;
+    serializeJson(doc, f);
+    f.close();
+    // max_open_files stays as mounted until the next boot
+    uint8_t mounted = g_profile.maxOpenFiles;
+    g_profile = profile;
+    g_profile.maxOpenFiles = mounted;
+    return true;
+}
+
+void fsDescribe(JsonObject out) {
+    JsonObject p = out.createNestedObject("profile");
+    p["max_open_files"] = g_profile.maxOpenFiles;
+    p["read_ahead"] = g_profile.readAheadBytes;
+    p["chunk"] = g_profile.chunkBytes;
+
+    // Compiled into esp_littlefs; change them in sdkconfig
+    JsonObject lfs = out.createNestedObject("littlefs");
+#ifdef CONFIG_LITTLEFS_PAGE_SIZE
+    lfs["page_size"] = CONFIG_LITTLEFS_PAGE_SIZE;
+#endif
+#ifdef CONFIG_LITTLEFS_READ_SIZE
+    lfs["read_size"] = CONFIG_LITTLEFS_READ_SIZE;
+#endif
+#ifdef CONFIG_LITTLEFS_WRITE_SIZE
+    lfs["write_size"] = CONFIG_LITTLEFS_WRITE_SIZE;
+#endif
+#ifdef CONFIG_LITTLEFS_CACHE_SIZE
+    lfs["cache_size"] = CONFIG_LITTLEFS_CACHE_SIZE;
+#endif
+#ifdef CONFIG_LITTLEFS_LOOKAHEAD_SIZE
+    lfs["lookahead_size"] = CONFIG_LITTLEFS_LOOKAHEAD_SIZE;
+#endif
+#ifdef CONFIG_LITTLEFS_BLOCK_CYCLES
+    lfs["block_cycles"] = CONFIG_LITTLEFS_BLOCK_CYCLES;
+#endif
+    out["total_bytes"] = LittleFS.totalBytes();
+    out["used_bytes"] = LittleFS.usedBytes();
+}
+
+File fsOpen(const char *path) {
+    File f = LittleFS.open(path, "r");
+    if (f && g_profile.readAheadBytes) f.setBufferSize(g_profile.readAheadBytes);
+    return f;
+}
+
+void fsBenchmark(FsBenchConfig config, JsonObject out) {
+    config.bufferBytes = kBenchBufferBytes;
+    config.buffer = static_cast<uint8_t *>(memAlloc(MEM_WEB, MemClass::Hot, kBenchBufferBytes));
+    LittleFsTarget target;
+    FsBenchResult r;
+    bool ok = fsBenchRun(target, config, r);
+    memFree(config.buffer);
+
+    out["ok"] = ok;
+    if (r.error) out["error"] = r.error;
+    out["path"] = config.path ? config.path : FSBENCH_SCRATCH_PATH;
+    out["file_bytes"] = r.fileBytes;
+    out["read_ahead"] = g_profile.readAheadBytes;
+    addTiming(out, "open", r.open);
+    JsonArray seq = out.createNestedArray("sequential");
+    for (int c = 0; c < FSBENCH_MAX_CHUNKS && r.chunks[c]; c++) {
+        JsonObject o = seq.createNestedObject();
+        o["chunk"] = r.chunks[c];
+        o["us"] = r.sequential[c].totalUs;
+        o["kib_s"] = r.sequential[c].kibPerSec();
+    }
+    addTiming(out, "random", r.random);
+    addTiming(out, "stat", r.stat);
+    addTiming(out, "list", r.list);
+    addTiming(out, "create", r.create);
+    addTiming(out, "remove", r.remove);
 }
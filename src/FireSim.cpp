@@ -0,0 +1,114 @@
+#include "FireSim.h"
+
+namespace {
+
+constexpr int kSparkRows = FIRE_GRID_H / 6 > 0 ? FIRE_GRID_H / 6 : 1;
+
+inline uint16_t saturate(uint32_t v) {
+    return v > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(v);
+}
+
+} // namespace
+
+void FireSim::begin(int zones) {
+    if (zones < 1) zones = 1;
+    if (zones > FIRE_MAX_ZONES) zones = FIRE_MAX_ZONES;
+    zoneCount_ = zones;
+    for (int z = 0; z < FIRE_MAX_ZONES; z++) zones_[z] = FireZone{FIRE_DEFAULT_COOLING, FIRE_DEFAULT_SPARKING};
+    for (uint8_t &n : zoneColumns_) n = 0;
+    for (int x = 0; x < FIRE_GRID_W; x++) {
+        zoneOf_[x] = static_cast<uint8_t>(x * zones / FIRE_GRID_W);
+        zoneColumns_[zoneOf_[x]]++;
+    }
+}
+
+void FireSim::reset(uint32_t seed) {
+    for (auto &row : heat_) {
+        for (uint16_t &cell : row) cell = 0;
+    }
+    for (uint16_t &m : rowMean_) m = 0;
+    for (uint16_t &m : zoneMean_) m = 0;
+    rng_.reseed(seed);
+}
+
+void FireSim::setZone(int zone, FireZone params) {
+    if (zone >= 0 && zone < FIRE_MAX_ZONES) zones_[zone] = params;
+}
+
+void FireSim::step() {
+    // Cool every cell by up to (cooling * 10 / height + 2) / 255 of full heat
+    uint32_t maxCool[FIRE_MAX_ZONES];
+    for (int z = 0; z < zoneCount_; z++) maxCool[z] = (zones_[z].cooling * 10u * 256u) / FIRE_GRID_H + 512u;
+    for (int y = 0; y < FIRE_GRID_H; y++) {
+        for (int x = 0; x < FIRE_GRID_W; x++) {
+            uint32_t cool = rng_.below(maxCool[zoneOf_[x]]);
+            heat_[y][x] = cool >= heat_[y][x] ? 0 : heat_[y][x] - cool;
+        }
+    }
+
+    // Rise and spread, top row first so every read sees last frame's heat:
+    // 4/8 from below, 1/8 from each lower diagonal, 2/8 from two below
+    for (int y = FIRE_GRID_H - 1; y >= 2; y--) {
+        const uint16_t *below = heat_[y - 1];
+        const uint16_t *below2 = heat_[y - 2];
+        for (int x = 0; x < FIRE_GRID_W; x++) {
+            int xl = x > 0 ? x - 1 : x;
+            int xr = x < FIRE_GRID_W - 1 ? x + 1 : x;
+            uint32_t sum = 4u * below[x] + below[xl] + below[xr] + 2u * below2[x];
+            heat_[y][x] = static_cast<uint16_t>(sum >> 3);
+        }
+    }
+    for (int x = 0; x < FIRE_GRID_W; x++) {
+        heat_[1][x] = static_cast<uint16_t>((3u * heat_[0][x] + heat_[1][x]) >> 2);
+    }
+
+    // Sparks near the base: each column rolls against its zone's sparking
+    for (int x = 0; x < FIRE_GRID_W; x++) {
+        uint32_t sparking = (zones_[zoneOf_[x]].sparking * static_cast<uint32_t>(sparkGain_)) >> 8;
+        if (rng_.below(256) >= (sparking > 255 ? 255 : sparking)) continue;
+        int y = static_cast<int>(rng_.below(kSparkRows));
+        uint32_t added = (160u + rng_.below(96)) << 8;
+        heat_[y][x] = saturate(heat_[y][x] + added);
+    }
+
+    // Downsample once per frame; outputs then read the means
+    uint32_t zoneSum[FIRE_MAX_ZONES] = {};
+    for (int y = 0; y < FIRE_GRID_H; y++) {
+        uint32_t rowSum = 0;
+        for (int x = 0; x < FIRE_GRID_W; x++) {
+            rowSum += heat_[y][x];
+            zoneSum[zoneOf_[x]] += heat_[y][x];
+        }
+        rowMean_[y] = static_cast<uint16_t>(rowSum / FIRE_GRID_W);
+    }
+    for (int z = 0; z < zoneCount_; z++) {
+        uint32_t cells = static_cast<uint32_t>(zoneColumns_[z]) * FIRE_GRID_H;
+        zoneMean_[z] = cells ? static_cast<uint16_t>(zoneSum[z] / cells) : 0;
+    }
+}
+
+uint16_t FireSim::zoneLevel(int zone) const {
+    return zone >= 0 && zone < zoneCount_ ? zoneMean_[zone] : 0;
+}
+
+uint16_t FireSim::heightLevel(uint16_t pos) const {
+    // Q8 row position
+    uint32_t p = (static_cast<uint32_t>(pos) * (FIRE_GRID_H - 1) * 256u) / 0xFFFF;
+    uint32_t row = p >> 8;
+    uint32_t frac = p & 0xFF;
+    if (row >= FIRE_GRID_H - 1) return rowMean_[FIRE_GRID_H - 1];
+    uint32_t a = rowMean_[row];
+    uint32_t b = rowMean_[row + 1];
+    return static_cast<uint16_t>((a * (256u - frac) + b * frac) >> 8);
+}
+
+uint32_t FireSim::checksum() const {
+    uint32_t h = 2166136261u;
+    for (const auto &row : heat_) {
+        for (uint16_t cell : row) {
+            h = (h ^ (cell & 0xFF)) * 16777619u;
+            h = (h ^ (cell >> 8)) * 16777619u;
+        }
+    }
+    return h;
+}
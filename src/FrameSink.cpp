@@ -0,0 +1,38 @@
+#include "FrameSink.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+MemoryFrameSink::~MemoryFrameSink() {
+    free(frame);
+}
+
+bool MemoryFrameSink::begin(size_t pixels) {
+    free(frame);
+    frame = static_cast<Pixel *>(calloc(pixels, sizeof(Pixel)));
+    capacity = frame ? pixels : 0;
+    return frame != nullptr;
+}
+
+void MemoryFrameSink::submit(const Pixel *pixels, size_t count) {
+    if (count > capacity) count = capacity;
+    memcpy(frame, pixels, count * sizeof(Pixel));
+    frames++;
+    bytes += count * sizeof(Pixel);
+}
+
+void PixelFrames::begin(FrameSink *sink, Pixel *storage, size_t pixels) {
+    sink_ = sink;
+    frames_ = storage;
+    pixels_ = pixels;
+    back_ = 0;
+    memset(frames_, 0, 2 * pixels * sizeof(Pixel));
+}
+
+void PixelFrames::show() {
+    sink_->waitIdle(); // front frame is free again
+    Pixel *sent = back();
+    sink_->submit(sent, pixels_);
+    back_ ^= 1;
+    memcpy(back(), sent, pixels_ * sizeof(Pixel));
+}
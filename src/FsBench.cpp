@@ -0,0 +1,188 @@
+#include "FsBench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+uint32_t xorshift(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Times one phase, including how much the block device read meanwhile
+class Phase {
+public:
+    Phase(FsBenchTarget &fs, FsBenchTiming &timing) : fs_(fs), timing_(timing), device_(fs.deviceBytesRead()) {}
+    ~Phase() { timing_.deviceBytes += fs_.deviceBytesRead() - device_; }
+    uint32_t start() { return fs_.nowUs(); }
+    void stop(uint32_t startUs) { timing_.add(fs_.nowUs() - startUs); }
+
+private:
+    FsBenchTarget &fs_;
+    FsBenchTiming &timing_;
+    uint64_t device_;
+};
+
+bool writeScratch(FsBenchTarget &fs, const FsBenchConfig &config) {
+    if (!fs.open(FSBENCH_SCRATCH_PATH, true)) return false;
+    uint32_t state = config.seed ? config.seed : 1;
+    uint32_t left = config.scratchBytes;
+    bool ok = true;
+    while (left && ok) {
+        size_t n = left < config.bufferBytes ? left : config.bufferBytes;
+        for (size_t i = 0; i < n; i++) config.buffer[i] = static_cast<uint8_t>(xorshift(state));
+        ok = fs.write(config.buffer, n) == static_cast<int>(n);
+        left -= n;
+    }
+    fs.close();
+    return ok;
+}
+
+void parentDir(const char *path, char *dir, size_t len) {
+    const char *slash = strrchr(path, '/');
+    size_t n = slash && slash != path ? static_cast<size_t>(slash - path) : 1;
+    if (n >= len) n = len - 1;
+    memcpy(dir, path, n);
+    dir[n] = '\0';
+}
+
+bool run(FsBenchTarget &fs, const FsBenchConfig &config, const char *path, FsBenchResult &out) {
+    // open
+    {
+        Phase phase(fs, out.open);
+        for (uint32_t i = 0; i < config.opens; i++) {
+            uint32_t t = phase.start();
+            if (!fs.open(path, false)) {
+                out.error = "open failed";
+                return false;
+            }
+            if (i == 0) out.fileBytes = fs.size();
+            fs.close();
+            phase.stop(t);
+        }
+    }
+    if (!out.fileBytes) {
+        out.error = "file is empty";
+        return false;
+    }
+
+    // sequential, one pass per chunk size
+    for (int c = 0; c < FSBENCH_MAX_CHUNKS && config.chunks[c]; c++) {
+        size_t chunk = config.chunks[c] < config.bufferBytes ? config.chunks[c] : config.bufferBytes;
+        out.chunks[c] = static_cast<uint16_t>(chunk);
+        FsBenchTiming &timing = out.sequential[c];
+        Phase phase(fs, timing);
+        uint32_t t = phase.start();
+        if (!fs.open(path, false)) {
+            out.error = "open failed";
+            return false;
+        }
+        int n;
+        while ((n = fs.read(config.buffer, chunk)) > 0) timing.bytes += n;
+        fs.close();
+        phase.stop(t);
+    }
+
+    // random
+    {
+        size_t len = config.randomReadBytes < config.bufferBytes ? config.randomReadBytes : config.bufferBytes;
+        if (len > out.fileBytes) len = out.fileBytes;
+        uint32_t span = out.fileBytes - static_cast<uint32_t>(len) + 1;
+        uint32_t state = config.seed ? config.seed : 1;
+        if (!fs.open(path, false)) {
+            out.error = "open failed";
+            return false;
+        }
+        Phase phase(fs, out.random);
+        for (uint32_t i = 0; i < config.randomReads; i++) {
+            uint32_t pos = static_cast<uint32_t>((static_cast<uint64_t>(xorshift(state)) * span) >> 32);
+            uint32_t t = phase.start();
+            if (!fs.seek(pos)) break;
+            int n = fs.read(config.buffer, len);
+            phase.stop(t);
+            if (n > 0) out.random.bytes += n;
+        }
+        fs.close();
+    }
+
+    // stat: alternate a hit and a miss
+    {
+        Phase phase(fs, out.stat);
+        for (uint32_t i = 0; i < config.metaOps; i++) {
+            uint32_t t = phase.start();
+            fs.exists(i & 1 ? "/fsbench.missing" : path);
+            phase.stop(t);
+        }
+    }
+
+    // list
+    {
+        char dir[64];
+        parentDir(path, dir, sizeof(dir));
+        Phase phase(fs, out.list);
+        for (uint32_t i = 0; i < config.metaOps; i++) {
+            uint32_t t = phase.start();
+            int entries = fs.list(dir);
+            phase.stop(t);
+            if (entries < 0) {
+                out.error = "list failed";
+                return false;
+            }
+        }
+    }
+
+    // create, then remove
+    char name[32];
+    uint32_t created = 0;
+    {
+        Phase phase(fs, out.create);
+        memset(config.buffer, 0xA5, 32);
+        for (; created < config.metaOps; created++) {
+            snprintf(name, sizeof(name), "/fsbench.%u", static_cast<unsigned>(created));
+            uint32_t t = phase.start();
+            if (!fs.open(name, true)) break;
+            if (fs.write(config.buffer, 32) == 32) out.create.bytes += 32;
+            fs.close();
+            phase.stop(t);
+        }
+    }
+    {
+        Phase phase(fs, out.remove);
+        for (uint32_t i = 0; i < created; i++) {
+            snprintf(name, sizeof(name), "/fsbench.%u", static_cast<unsigned>(i));
+            uint32_t t = phase.start();
+            fs.remove(name);
+            phase.stop(t);
+        }
+    }
+    if (created < config.metaOps) {
+        out.error = "create failed";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool fsBenchRun(FsBenchTarget &fs, const FsBenchConfig &config, FsBenchResult &out) {
+    out = FsBenchResult();
+    if (!config.buffer || config.bufferBytes < 32) {
+        out.error = "no buffer";
+        return false;
+    }
+    const char *path = config.path;
+    if (!path) {
+        if (!writeScratch(fs, config)) {
+            fs.remove(FSBENCH_SCRATCH_PATH);
+            out.error = "cannot write the scratch file";
+            return false;
+        }
+        path = FSBENCH_SCRATCH_PATH;
+    }
+    bool ok = run(fs, config, path, out);
+    if (!config.path) fs.remove(FSBENCH_SCRATCH_PATH);
+    return ok;
+}
@@ -0,0 +1,317 @@
+#include "HandlerGuard.h"
+
+#include <atomic>
+#include <esp_debug_helpers.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/xtensa_context.h>
+#include <soc/soc_memory_layout.h>
+
+#include "Logger.h"
+#include "MemoryPolicy.h"
+
+struct GuardRoute {
+    const char *uri;
+    uint32_t budgetUs;
+    bool failFast; // false: never rejected
+    uint32_t calls;
+    uint32_t overruns;
+    uint32_t inRow; // consecutive overruns, for fail-fast
+    uint32_t trippedMs; // last overrun at or past GUARD_TRIP_COUNT in a row
+    uint32_t rejected;
+    uint32_t delays; // delay() calls seen (GUARD_WRAP_DELAY)
+    uint32_t maxUs;
+    uint64_t totalUs;
+};
+
+namespace {
+
+constexpr uint32_t kResampleUs = 2000;
+constexpr int kMaxSamples = 50; // ~100 ms of a task that never blocks
+
+enum class Kind : uint8_t { Overrun, Delay };
+
+struct Offender {
+    const GuardRoute *route; // nullptr: outside any guarded handler
+    Kind kind;
+    bool sampled; // false: the task never blocked while overdue
+    uint8_t depth;
+    uint32_t atMs;
+    uint32_t us; // handler time, or the delay requested
+    uint32_t pcs[GUARD_BACKTRACE_DEPTH];
+};
+
+// Sample handshake between the network task and the esp_timer task
+enum : uint8_t { Idle, Armed, Sampling, Done };
+
+GuardRoute g_routes[GUARD_MAX_ROUTES];
+int g_routeCount = 0;
+bool g_failFast = false;
+
+// Network task only (written by guards, read by the /api/guard handler)
+Offender g_ring[GUARD_RING_SIZE];
+uint32_t g_ringPushed = 0;
+GuardRoute *g_active = nullptr;
+
+std::atomic<uint8_t> g_state{Idle};
+esp_timer_handle_t g_timer = nullptr;
+TaskHandle_t g_netTask = nullptr;
+uint32_t g_activeStartUs = 0;
+uint32_t g_activeBudgetUs = 0;
+int g_samples = 0;
+uint32_t g_samplePcs[GUARD_BACKTRACE_DEPTH];
+uint8_t g_sampleDepth = 0;
+
+// Return address -> address of the call instruction. Windowed calls keep
+// the window increment in the top two bits.
+inline uint32_t callSite(uint32_t pc) {
+    if (pc & 0x80000000) pc = (pc & 0x3fffffff) | 0x40000000;
+    return pc - 3;
+}
+
+uint8_t walk(esp_backtrace_frame_t frame, uint32_t *pcs) {
+    uint8_t depth = 0;
+    if (!esp_stack_ptr_is_sane(frame.sp)) return 0;
+    pcs[depth++] = frame.pc;
+    while (depth < GUARD_BACKTRACE_DEPTH && frame.next_pc) {
+        if (!esp_backtrace_get_next_frame(&frame)) break;
+        pcs[depth++] = callSite(frame.pc);
+    }
+    return depth;
+}
+
+// Stack of a task that is switched out. Its context was saved on its own
+// stack, pxTopOfStack (the first TCB member) points at the frame, and the
+// port spilled the register windows, so the chain can be walked from there.
+uint8_t walkBlocked(TaskHandle_t task, uint32_t *pcs) {
+    const void *top = *reinterpret_cast<void *const *>(task);
+    const XtExcFrame *exc = static_cast<const XtExcFrame *>(top);
+    esp_backtrace_frame_t frame = {};
+    if (exc->exit == 0) {
+        // Solicited switch (the task yielded: delay, semaphore, queue)
+        const XtSolFrame *sol = static_cast<const XtSolFrame *>(top);
+        frame.pc = sol->pc;
+        frame.sp = sol->a1;
+        frame.next_pc = sol->a0;
+    } else {
+        frame.pc = exc->pc;
+        frame.sp = exc->a1;
+        frame.next_pc = exc->a0;
+    }
+    uint8_t depth = walk(frame, pcs);
+    // The task may have woken while we read its stack; drop a torn sample
+    if (*reinterpret_cast<void *const *>(task) != top) return 0;
+    return depth;
+}
+
+void onBudgetExpired(void *) {
+    uint8_t expected = Armed;
+    if (!g_state.compare_exchange_strong(expected, Sampling)) return;
+    // Fired for a guard that has already been replaced
+    if (static_cast<uint32_t>(esp_timer_get_time()) - g_activeStartUs < g_activeBudgetUs) {
+        g_state = Armed;
+        return;
+    }
+    eTaskState st = eTaskGetState(g_netTask);
+    uint8_t depth = 0;
+    if (st == eBlocked || st == eSuspended) depth = walkBlocked(g_netTask, g_samplePcs);
+    if (!depth && ++g_samples < kMaxSamples) {
+        // Still computing (its saved context is stale) or woke mid-walk
+        esp_timer_start_once(g_timer, kResampleUs);
+        g_state = Armed;
+        return;
+    }
+    g_sampleDepth = depth;
+    g_state = Done;
+}
+
+Offender &push(const GuardRoute *route, Kind kind, uint32_t us) {
+    Offender &o = g_ring[g_ringPushed++ % GUARD_RING_SIZE];
+    o.route = route;
+    o.kind = kind;
+    o.sampled = false;
+    o.depth = 0;
+    o.atMs = millis();
+    o.us = us;
+    return o;
+}
+
+bool tripped(const GuardRoute &r) {
+    return g_failFast && r.failFast && r.inRow >= GUARD_TRIP_COUNT;
+}
+
+} // namespace
+
+void setupHandlerGuard() {
+    memRegisterStatic(MEM_WEB, sizeof(g_routes) + sizeof(g_ring));
+    esp_timer_create_args_t args = {};
+    args.callback = onBudgetExpired;
+    args.name = "guard";
+    if (esp_timer_create(&args, &g_timer) != ESP_OK) {
+        g_timer = nullptr;
+        LOGE("Guard: no timer, handler backtraces disabled");
+    }
+}
+
+GuardRoute *guardRegister(const char *uri, uint32_t budgetMs, bool failFast) {
+    if (g_routeCount == GUARD_MAX_ROUTES) {
+        LOGW(String("Guard: route table full, ") + uri + " is not timed");
+        return nullptr;
+    }
+    GuardRoute &r = g_routes[g_routeCount++];
+    r = GuardRoute();
+    r.uri = uri;
+    r.budgetUs = budgetMs * 1000;
+    r.failFast = failFast;
+    return &r;
+}
+
+bool guardAdmit(GuardRoute *route) {
+    if (!route || !tripped(*route)) return true;
+    // Cooled down: let one call probe the route. Handlers run one at a time
+    // on the network task, so the probe ends before the next admission.
+    if (millis() - route->trippedMs >= GUARD_COOLDOWN_MS) return true;
+    route->rejected++;
+    return false;
+}
+
+HandlerGuard::HandlerGuard(GuardRoute *route)
+    : route_(g_active ? nullptr : route), startUs_(static_cast<uint32_t>(esp_timer_get_time())) {
+    if (!route_) return;
+    g_active = route_;
+    g_netTask = xTaskGetCurrentTaskHandle();
+    if (!g_timer) return;
+    g_activeStartUs = startUs_;
+    g_activeBudgetUs = route_->budgetUs;
+    g_samples = 0;
+    g_sampleDepth = 0;
+    g_state = Armed;
+    esp_timer_start_once(g_timer, route_->budgetUs);
+}
+
+HandlerGuard::~HandlerGuard() {
+    if (!route_) return;
+    uint32_t us = static_cast<uint32_t>(esp_timer_get_time()) - startUs_;
+    g_active = nullptr;
+    uint8_t state = Idle;
+    if (g_timer) {
+        // A sample in progress finishes within microseconds
+        do {
+            state = g_state.load();
+        } while (state == Sampling || !g_state.compare_exchange_weak(state, Idle));
+        esp_timer_stop(g_timer);
+    }
+
+    GuardRoute &r = *route_;
+    r.calls++;
+    r.totalUs += us;
+    if (us > r.maxUs) r.maxUs = us;
+    if (us <= r.budgetUs) {
+        r.inRow = 0;
+        return;
+    }
+    r.overruns++;
+    r.inRow++;
+    if (r.inRow >= GUARD_TRIP_COUNT) r.trippedMs = millis();
+    Offender &o = push(route_, Kind::Overrun, us);
+    if (state == Done && g_sampleDepth) {
+        o.sampled = true;
+        o.depth = g_sampleDepth;
+        memcpy(o.pcs, g_samplePcs, g_sampleDepth * sizeof(uint32_t));
+    }
+    LOGW(String("Guard: ") + r.uri + " held the network task " + String(us / 1000) + " ms (budget " +
+         String(r.budgetUs / 1000) + " ms)");
+}
+
+#ifdef GUARD_WRAP_DELAY
+// Linked with -Wl,--wrap=delay: every delay() outside the Arduino core's own
+// translation unit comes here first
+extern "C" void __real_delay(uint32_t ms);
+
+extern "C" void __wrap_delay(uint32_t ms) {
+    if (ms && g_netTask && xTaskGetCurrentTaskHandle() == g_netTask) {
+        if (g_active) g_active->delays++;
+        Offender &o = push(g_active, Kind::Delay, ms * 1000);
+        esp_backtrace_frame_t frame = {};
+        esp_backtrace_get_start(&frame.pc, &frame.sp, &frame.next_pc);
+        o.depth = walk(frame, o.pcs);
+        o.sampled = o.depth > 0;
+    }
+    __real_delay(ms);
+}
+#endif
+
+void guardSetFailFast(bool on) {
+    g_failFast = on;
+}
+
+void guardReset() {
+    for (int i = 0; i < g_routeCount; i++) {
+        const char *uri = g_routes[i].uri;
+        uint32_t budgetUs = g_routes[i].budgetUs;
+        bool failFast = g_routes[i].failFast;
+        g_routes[i] = GuardRoute();
+        g_routes[i].uri = uri;
+        g_routes[i].budgetUs = budgetUs;
+        g_routes[i].failFast = failFast;
+    }
+    g_ringPushed = 0;
+}
+
+void guardDescribe(JsonObject out) {
+    out["budget_ms"] = GUARD_BUDGET_MS;
+    out["fail_fast"] = g_failFast;
+    out["cooldown_ms"] = GUARD_COOLDOWN_MS;
+#ifdef GUARD_WRAP_DELAY
+    out["delay_check"] = true;
+#else
+    out["delay_check"] = false;
+#endif
+    out["sampling"] = g_timer != nullptr;
+
+    JsonArray routes = out.createNestedArray("routes");
+    for (int i = 0; i < g_routeCount; i++) {
+        const GuardRoute &r = g_routes[i];
+        if (!r.calls && !r.delays) continue;
+        JsonObject o = routes.createNestedObject();
+        o["uri"] = r.uri;
+        o["budget_ms"] = r.budgetUs / 1000;
+        o["calls"] = r.calls;
+        o["avg_us"] = r.calls ? static_cast<uint32_t>(r.totalUs / r.calls) : 0;
+        o["max_us"] = r.maxUs;
+        o["overruns"] = r.overruns;
+        if (r.delays) o["delays"] = r.delays;
+        if (tripped(r)) {
+            uint32_t sinceMs = millis() - r.trippedMs;
+            o["tripped"] = true;
+            o["retry_in_ms"] = sinceMs < GUARD_COOLDOWN_MS ? GUARD_COOLDOWN_MS - sinceMs : 0;
+        }
+        if (r.rejected) o["rejected"] = r.rejected;
+    }
+
+    // Newest first
+    JsonArray offenders = out.createNestedArray("offenders");
+    uint32_t n = min<uint32_t>(g_ringPushed, GUARD_RING_SIZE);
+    for (uint32_t k = 1; k <= n; k++) {
+        const Offender &e = g_ring[(g_ringPushed - k) % GUARD_RING_SIZE];
+        JsonObject o = offenders.createNestedObject();
+        o["route"] = e.route ? e.route->uri : "(outside a handler)";
+        o["kind"] = e.kind == Kind::Overrun ? "overrun" : "delay";
+        o["at_ms"] = e.atMs;
+        o[e.kind == Kind::Overrun ? "us" : "delay_ms"] = e.kind == Kind::Overrun ? e.us : e.us / 1000;
+        if (!e.sampled) {
+            o["backtrace"] = nullptr; // never blocked while overdue
+            continue;
+        }
+        String bt;
+        for (uint8_t i = 0; i < e.depth; i++) {
+            char pc[12];
+            snprintf(pc, sizeof(pc), "0x%08x", static_cast<unsigned>(e.pcs[i]));
+            if (i) bt += ' ';
+            bt += pc;
+        }
+        o["backtrace"] = bt;
+    }
+    out["offenders_total"] = g_ringPushed;
+}
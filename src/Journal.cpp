@@ -0,0 +1,245 @@
+#include "Journal.h"
+
+#include <LittleFS.h>
+#include <esp_system.h>
+#include "freertos/FreeRTOS.h"
+
+#include "Logger.h"
+#include "MemoryPolicy.h"
+#include "Trace.h"
+
+namespace {
+
+constexpr uint8_t kBatchMagic = 'J';
+constexpr uint8_t kTagAudio = 0x40;
+constexpr uint8_t kTagCause = 0x41;
+constexpr uint8_t kTagEffect = 0x42;
+constexpr uint8_t kTagBoot = 0xF0;
+constexpr uint8_t kTagKeyframe = 0xF1;
+constexpr size_t kMaxCause = 63;
+const char kFileMagic[4] = {'D', 'J', '0', '1'};
+
+static_assert(JOURNAL_BUFFER_BYTES <= 0xFFFF, "batch length is stored as u16");
+
+struct Buffer {
+    uint8_t data[JOURNAL_BUFFER_BYTES];
+    size_t len;
+};
+
+Buffer *g_buffers = nullptr; // [2], in PSRAM: a few bytes per state change
+int g_active = 0;
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+int32_t g_prev[JOURNAL_FIELDS] = {};
+uint32_t g_lastMs = 0;
+bool g_ready = false;
+uint32_t g_dropped = 0;
+size_t g_batchHeaderLen = 0;
+volatile bool g_flushRequested = false;
+char g_lastCause[kMaxCause + 1] = "";
+
+// Request attribution is per task (handlers run on the AsyncTCP task)
+thread_local char t_cause[kMaxCause + 1] = "";
+
+size_t putVarint(uint8_t *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = static_cast<uint8_t>(v) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+
+uint32_t zigzag(int32_t v) {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+void fieldValues(const DeviceState &s, int32_t out[JOURNAL_FIELDS]) {
+    out[JF_LED0] = s.led[0];
+    out[JF_LED1] = s.led[1];
+    out[JF_LED2] = s.led[2];
+    out[JF_SMOKE0] = s.smoke[0];
+    out[JF_SMOKE1] = s.smoke[1];
+    out[JF_MILL] = s.mill;
+    out[JF_FIRE] = s.fireActive;
+    out[JF_PLAYING] = s.audioPlaying;
+    out[JF_VOLUME] = s.volume;
+}
+
+// Caller holds g_mux. All-or-nothing so a full buffer never leaves half a record.
+bool append(const uint8_t *bytes, size_t len) {
+    Buffer &b = g_buffers[g_active];
+    if (b.len + len > sizeof(b.data)) {
+        g_dropped++;
+        g_flushRequested = true;
+        return false;
+    }
+    memcpy(b.data + b.len, bytes, len);
+    b.len += len;
+    if (b.len > sizeof(b.data) * 3 / 4) g_flushRequested = true;
+    return true;
+}
+
+// Caller holds g_mux: start a new batch in the active buffer
+void beginBatch(uint32_t now) {
+    uint8_t tmp[1 + 5 + 5 * JOURNAL_FIELDS];
+    size_t n = 0;
+    tmp[n++] = kTagKeyframe;
+    n += putVarint(tmp + n, now);
+    for (int f = 0; f < JOURNAL_FIELDS; f++) n += putVarint(tmp + n, static_cast<uint32_t>(g_prev[f]));
+    g_buffers[g_active].len = 0;
+    append(tmp, n);
+    g_batchHeaderLen = n;
+    g_lastMs = now;
+    g_lastCause[0] = '\0'; // each batch re-states its cause
+}
+
+// Caller holds g_mux: record prefix (time delta + tag)
+size_t putHeader(uint8_t *out, uint32_t now, uint8_t tag) {
+    size_t n = putVarint(out, now - g_lastMs);
+    g_lastMs = now;
+    out[n++] = tag;
+    return n;
+}
+
+// Caller holds g_mux: emit a cause record if this task's cause differs from the last one
+void syncCause(uint32_t now) {
+    if (strcmp(t_cause, g_lastCause) == 0) return;
+    uint8_t tmp[5 + 1 + 5 + kMaxCause];
+    size_t len = strlen(t_cause);
+    size_t n = putHeader(tmp, now, kTagCause);
+    n += putVarint(tmp + n, len);
+    memcpy(tmp + n, t_cause, len);
+    if (append(tmp, n + len)) strcpy(g_lastCause, t_cause);
+}
+
+void writeBatch(const Buffer &b) {
+    TRACE_SCOPE_ARG("fs.write", b.len);
+    File f = LittleFS.open(JOURNAL_FILE, "a");
+    if (!f) {
+        LOGE("Journal: cannot open " JOURNAL_FILE);
+        return;
+    }
+    if (f.size() + b.len > JOURNAL_MAX_BYTES) {
+        f.close();
+        LittleFS.remove(JOURNAL_ROTATED_FILE);
+        LittleFS.rename(JOURNAL_FILE, JOURNAL_ROTATED_FILE);
+        f = LittleFS.open(JOURNAL_FILE, "w");
+        if (!f) return;
+    }
+    if (f.size() == 0) f.write(reinterpret_cast<const uint8_t *>(kFileMagic), sizeof(kFileMagic));
+    // Length-prefixed so a decoder never has to tell a batch start from record bytes
+    const uint8_t prefix[3] = {kBatchMagic, static_cast<uint8_t>(b.len), static_cast<uint8_t>(b.len >> 8)};
+    f.write(prefix, sizeof(prefix));
+    f.write(b.data, b.len);
+    f.close();
+}
+
+} // namespace
+
+void setupJournal() {
+    g_buffers = static_cast<Buffer *>(memAlloc(MEM_JOURNAL, MemClass::Cold, 2 * sizeof(Buffer)));
+    if (!g_buffers) {
+        LOGE("Journal: no memory for buffers, journal disabled");
+        return;
+    }
+    DeviceState s = deviceStateSnapshot();
+    uint32_t now = millis();
+    portENTER_CRITICAL(&g_mux);
+    fieldValues(s, g_prev);
+    beginBatch(now);
+    uint8_t tmp[16];
+    size_t n = putHeader(tmp, now, kTagBoot);
+    n += putVarint(tmp + n, static_cast<uint32_t>(esp_reset_reason()));
+    append(tmp, n);
+    g_ready = true;
+    portEXIT_CRITICAL(&g_mux);
+    LOGI("Journal: recording to " JOURNAL_FILE);
+}
+
+void journalSetCause(const char *cause) {
+    if (!cause) {
+        t_cause[0] = '\0';
+        return;
+    }
+    strlcpy(t_cause, cause, sizeof(t_cause));
+}
+
+const char *journalCause() {
+    return t_cause;
+}
+
+void journalStateChange(const DeviceState &before, const DeviceState &after) {
+    if (!g_ready) return;
+    int32_t a[JOURNAL_FIELDS], b[JOURNAL_FIELDS];
+    fieldValues(before, a);
+    fieldValues(after, b);
+    uint32_t now = millis();
+    portENTER_CRITICAL(&g_mux);
+    for (int f = 0; f < JOURNAL_FIELDS; f++) {
+        if (a[f] == b[f] || b[f] == g_prev[f]) continue;
+        syncCause(now);
+        uint8_t tmp[16];
+        size_t n = putHeader(tmp, now, static_cast<uint8_t>(f));
+        n += putVarint(tmp + n, zigzag(b[f] - g_prev[f]));
+        if (append(tmp, n)) g_prev[f] = b[f];
+    }
+    portEXIT_CRITICAL(&g_mux);
+}
+
+void journalAudioCommand(JournalAudioCmd cmd, int32_t arg) {
+    if (!g_ready) return;
+    uint32_t now = millis();
+    portENTER_CRITICAL(&g_mux);
+    syncCause(now);
+    uint8_t tmp[16];
+    size_t n = putHeader(tmp, now, kTagAudio);
+    tmp[n++] = cmd;
+    n += putVarint(tmp + n, zigzag(arg));
+    append(tmp, n);
+    portEXIT_CRITICAL(&g_mux);
+}
+
+void journalEffect(const char *name) {
+    if (!g_ready) return;
+    size_t len = name ? strnlen(name, kMaxCause) : 0;
+    uint32_t now = millis();
+    portENTER_CRITICAL(&g_mux);
+    syncCause(now);
+    uint8_t tmp[5 + 1 + 5 + kMaxCause];
+    size_t n = putHeader(tmp, now, kTagEffect);
+    n += putVarint(tmp + n, len);
+    memcpy(tmp + n, name, len);
+    append(tmp, n + len);
+    portEXIT_CRITICAL(&g_mux);
+}
+
+void journalFlush() {
+    g_flushRequested = true;
+}
+
+uint32_t journalDroppedRecords() {
+    return g_dropped;
+}
+
+void serviceJournal() {
+    static unsigned long lastFlush = 0;
+    if (!g_ready) return;
+    unsigned long now = millis();
+    if (!g_flushRequested && now - lastFlush < JOURNAL_FLUSH_MS) return;
+    lastFlush = now;
+    g_flushRequested = false;
+
+    // Swap buffers so writers keep appending while the full one goes to flash
+    portENTER_CRITICAL(&g_mux);
+    Buffer &full = g_buffers[g_active];
+    bool empty = full.len <= g_batchHeaderLen;
+    if (!empty) {
+        g_active ^= 1;
+        beginBatch(now);
+    }
+    portEXIT_CRITICAL(&g_mux);
+    if (empty) return;
+
+    writeBatch(full);
+}
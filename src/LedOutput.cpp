@@ -0,0 +1,133 @@
+#include "LedOutput.h"
+
+#include <esp_timer.h>
+
+#include "Logger.h"
+
+namespace {
+
+constexpr uint32_t kDutyMax = (1u << LED_PWM_RESOLUTION) - 1;
+constexpr int kFracBits = 8; // dithered sub-LSB precision
+constexpr int kTableSize = 257; // 256 segments + end point for interpolation
+
+struct GammaTable {
+    uint32_t duty[kTableSize]; // duty in Q(LED_PWM_RESOLUTION).kFracBits
+};
+
+// CIE 1931 lightness (L*) -> relative luminance (Y)
+constexpr double cieLuminance(double lightness) {
+    if (lightness <= 8.0) return lightness / 903.3;
+    double t = (lightness + 16.0) / 116.0;
+    return t * t * t;
+}
+
+constexpr GammaTable makeGammaTable() {
+    GammaTable t{};
+    for (int i = 0; i < kTableSize; i++) {
+        double y = cieLuminance(i * 100.0 / (kTableSize - 1));
+        t.duty[i] = static_cast<uint32_t>(y * (kDutyMax << kFracBits) + 0.5);
+    }
+    return t;
+}
+
+constexpr GammaTable kGamma = makeGammaTable();
+static_assert(kGamma.duty[0] == 0, "gamma table must start dark");
+static_assert(kGamma.duty[kTableSize - 1] == (kDutyMax << kFracBits), "gamma table must end at full duty");
+
+struct Channel {
+    int pin = -1;
+    uint16_t level = 0;
+    volatile uint32_t target = 0; // Q.kFracBits duty, written by callers
+    uint32_t accum = 0; // dither error, owned by the refresh timer
+    uint32_t lastDuty = 0xFFFFFFFF;
+};
+
+Channel g_channels[LED_OUTPUT_MAX_CHANNELS];
+int g_channelCount = 0;
+esp_timer_handle_t g_ditherTimer = nullptr;
+
+uint32_t levelToDuty(uint16_t level) {
+    uint32_t idx = level >> 8;
+    uint32_t frac = level & 0xFF;
+    uint32_t a = kGamma.duty[idx];
+    uint32_t b = kGamma.duty[idx + 1];
+    return a + (((b - a) * frac) >> 8);
+}
+
+Channel *findChannel(int pin) {
+    for (int i = 0; i < g_channelCount; i++) {
+        if (g_channels[i].pin == pin) return &g_channels[i];
+    }
+    return nullptr;
+}
+
+// Periodic refresh: first-order sigma-delta on the fractional duty bits.
+// Only touches LEDC when the emitted duty actually changes.
+void ditherTick(void *) {
+    for (int i = 0; i < g_channelCount; i++) {
+        Channel &ch = g_channels[i];
+        uint32_t target = ch.target;
+        uint32_t duty = target >> kFracBits;
+        ch.accum += target & ((1u << kFracBits) - 1);
+        if (ch.accum >= (1u << kFracBits)) {
+            ch.accum -= (1u << kFracBits);
+            if (duty < kDutyMax) duty++;
+        }
+        if (duty != ch.lastDuty) {
+            ledcWrite(LED_LEDC_CHANNEL_BASE + i, duty);
+            ch.lastDuty = duty;
+        }
+    }
+}
+
+} // namespace
+
+void setupLedOutput() {
+    if (g_ditherTimer) return;
+    esp_timer_create_args_t args = {};
+    args.callback = ditherTick;
+    args.name = "led_dither";
+    if (esp_timer_create(&args, &g_ditherTimer) != ESP_OK) {
+        LOGE("LED dither timer creation failed");
+        g_ditherTimer = nullptr;
+        return;
+    }
+    esp_timer_start_periodic(g_ditherTimer, 1000000ULL / LED_DITHER_HZ);
+    LOGD("LED output: " + String(LED_PWM_RESOLUTION) + "-bit LEDC, dither at " + String(LED_DITHER_HZ) + " Hz");
+}
+
+bool ledOutputAttach(int pin) {
+    if (findChannel(pin)) return true;
+    if (g_channelCount >= LED_OUTPUT_MAX_CHANNELS) {
+        LOGE("LED output: no free channel for pin " + String(pin));
+        return false;
+    }
+    int ledc = LED_LEDC_CHANNEL_BASE + g_channelCount;
+    ledcSetup(ledc, LED_PWM_FREQ, LED_PWM_RESOLUTION);
+    ledcAttachPin(pin, ledc);
+    ledcWrite(ledc, 0);
+    Channel &ch = g_channels[g_channelCount];
+    ch.pin = pin;
+    ch.level = 0;
+    ch.target = 0;
+    ch.accum = 0;
+    ch.lastDuty = 0;
+    g_channelCount++;
+    return true;
+}
+
+void ledOutputWrite(int pin, uint16_t level) {
+    Channel *ch = findChannel(pin);
+    if (!ch) return;
+    ch->level = level;
+    ch->target = levelToDuty(level);
+    if (!g_ditherTimer) {
+        // no refresh timer: fall back to undithered output
+        ledcWrite(LED_LEDC_CHANNEL_BASE + static_cast<int>(ch - g_channels), ch->target >> kFracBits);
+    }
+}
+
+uint16_t ledOutputLevel(int pin) {
+    Channel *ch = findChannel(pin);
+    return ch ? ch->level : 0;
+}
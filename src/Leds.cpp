@@ -1,36 +1,56 @@
 #include "Leds.h"
 
+#include "DeviceState.h"
+#include "FireSim.h"
+#include "LedOutput.h"
+#include "PixelStrip.h"
 #include "Logger.h"
+#include "Trace.h"
+
+// Internal state for the fire effect (active flag lives in DeviceState).
+// The simulated grid is finer than the outputs and downsampled onto them.
+static FireSim g_fire;
+static unsigned long g_lastFrame = 0;
 
 void setupLeds() {
     LOGD("Init leds");
-    pinMode(LED_ONE, OUTPUT);
-    pinMode(LED_TWO, OUTPUT);
-    pinMode(LED_THREE, OUTPUT);
-    // seed PRNG for pseudo-random fire effect
-    randomSeed(micros());
+    setupLedOutput();
+    boardForEach<ChannelGroup::Lights>([](const BoardChannel &c, int) { ledOutputAttach(c.pin); });
+    g_fire.begin(kLightPins.count); // one zone per light
     tryLeds();
     turnOffLeds();
 }
 
 void setLed(int ledPin, int brightness) {
-    analogWrite(ledPin, brightness);
+    setLedLevel(ledPin, ledLevelFrom8(constrain(brightness, 0, 255)));
+}
+
+static int ledIndex(int ledPin) {
+    return kLightPins.indexOf(ledPin);
 }
 
-bool getLed(int ledPin) {
-    return analogRead(ledPin);
+void setLedLevel(int ledPin, uint16_t level) {
+    ledOutputWrite(ledPin, level);
+    deviceStateSetLed(ledIndex(ledPin), level);
+}
+
+void renderLedLevel(int ledPin, uint16_t level) {
+    ledOutputWrite(ledPin, level);
+    deviceStateShowLed(ledIndex(ledPin), level);
+}
+
+int getLed(int ledPin) {
+    int index = ledIndex(ledPin);
+    if (index < 0) return 0;
+    return ledLevelTo8(deviceStateSnapshot().led[index]);
 }
 
 void turnOffLeds() {
-    analogWrite(LED_ONE, 0);
-    analogWrite(LED_TWO, 0);
-    analogWrite(LED_THREE, 0);
+    for (int i = 0; i < kLightPins.count; i++) setLedLevel(kLightPins[i], 0);
 }
 
 void turnOnLeds() {
-    analogWrite(LED_ONE, 255);
-    analogWrite(LED_TWO, 255);
-    analogWrite(LED_THREE, 255);
+    for (int i = 0; i < kLightPins.count; i++) setLedLevel(kLightPins[i], LED_LEVEL_MAX);
 }
 
 void tryLeds() {
@@ -40,83 +60,91 @@ void tryLeds() {
     LOGD("Leds OK");
 }
 
-// Internal state for the fire effect
-static volatile bool g_fireActive = false;
+// Black -> red -> yellow -> white ramp for strip pixels
+static Pixel heatColor(uint8_t heat) {
+    uint8_t t192 = static_cast<uint8_t>((heat * 191) / 255);
+    uint8_t ramp = static_cast<uint8_t>((t192 & 0x3F) << 2);
+    if (t192 & 0x80) return Pixel{255, 255, ramp};
+    if (t192 & 0x40) return Pixel{ramp, 255, 0};
+    return Pixel{0, ramp, 0};
+}
 
-// Move heat and timing to file-scope so we can reset them when starting
-static uint8_t g_heat[3] = {0, 0, 0};
-static unsigned long g_lastFrame = 0;
+static void clearStrip() {
+    Pixel *frame = pixelStripBackBuffer();
+    if (!frame) return;
+    memset(frame, 0, pixelStripCount() * sizeof(Pixel));
+    pixelStripShow();
+}
 
 // Provide external control for the fire effect
 void startFireEffect() {
-    // reset internal heat array by restarting the effect
-    g_heat[0] = g_heat[1] = g_heat[2] = 0;
+    // A fresh flame each time; the seed only matters for reproducing a run
+    g_fire.reset(esp_random());
     g_lastFrame = millis();
-    g_fireActive = true;
+    deviceStateSetFireActive(true);
     LOGI("Fire effect started");
 }
 
 void stopFireEffect() {
-    g_fireActive = false;
+    deviceStateSetFireActive(false);
     // ensure LEDs are turned off when stopping the effect
     turnOffLeds();
+    clearStrip();
     LOGI("Fire effect stopped");
 }
 
 bool isFireEffectActive() {
-    return g_fireActive;
+    return deviceStateSnapshot().fireActive;
+}
+
+bool setFireZone(int zone, uint8_t cooling, uint8_t sparking) {
+    if (zone < 0 || zone >= g_fire.zones()) return false;
+    // Two bytes read by the next frame; a torn pair only lasts one frame
+    g_fire.setZone(zone, FireZone{cooling, sparking});
+    return true;
+}
+
+FireZone getFireZone(int zone) {
+    return g_fire.zone(zone);
+}
+
+int fireZoneCount() {
+    return g_fire.zones();
+}
+
+void setFireSparkGain(uint16_t gain) {
+    g_fire.setSparkGain(gain);
 }
 
 // Non-blocking fire effect inspired by simple heat-simulation.
 // Call fireEffect() frequently from loop() to animate when the
 // effect is active.
 void fireEffect() {
-    if (!g_fireActive) return; // no-op when effect is not active
+    if (!isFireEffectActive()) return; // no-op when effect is not active
 
-    constexpr uint8_t sparking = 120; // chance of new spark (0..255)
     constexpr uint16_t frameDelay = 50; // ms between updates
-    // use file-scope g_heat[] and g_lastFrame
 
     unsigned long now = millis();
     if (now - g_lastFrame < frameDelay) return;
     g_lastFrame = now;
-
-    // Step 1. Cool down every cell a little
-    for (int i = 0; i < 3; i++) {
-        constexpr uint8_t cooling = 55;
-        int cooldown = random(0, ((cooling * 10) / 3) + 2);
-        if (cooldown >= g_heat[i]) g_heat[i] = 0;
-        else g_heat[i] = g_heat[i] - cooldown;
-    }
-
-    // Step 2. Heat diffusion upward (towards higher indices)
-    // We'll mix the lower cells into the ones above to simulate rising heat.
-    uint8_t newHeat2 = static_cast<uint8_t>((g_heat[1] + g_heat[0] + g_heat[0]) / 3);
-    uint8_t newHeat1 = static_cast<uint8_t>((g_heat[0] + g_heat[0] + g_heat[1]) / 3);
-    g_heat[2] = newHeat2;
-    g_heat[1] = newHeat1;
-    // g_heat[0] will get sparks below
-
-    // Step 3. Randomly ignite new 'sparks' near the bottom
-    if (random(255) < sparking) {
-        int y = 0; // create spark at bottom
-        int added = random(160, 255);
-        int v = g_heat[y] + added;
-        g_heat[y] = (v > 255) ? 255 : v;
-    }
-
-    // Step 4. Map heat to LED brightness (non-linear for nicer look)
-    for (int i = 0; i < 3; i++) {
-        // scale heat (0..255) to brightness 0..255 with a quadratic curve
-        int h = g_heat[i];
-        int brightness = (h * h) / 255; // simple gamma-like curve
-        if (brightness > 255) brightness = 255;
-
-        int pin = LED_ONE;
-        if (i == 0) pin = LED_ONE;
-        else if (i == 1) pin = LED_TWO;
-        else if (i == 2) pin = LED_THREE;
-
-        analogWrite(pin, brightness);
+    TRACE_SCOPE("fire.frame");
+
+    g_fire.step();
+
+    // Each light shows the mean heat of its zone. Heat is already
+    // perceptual, the output stage applies the gamma curve and dithers the
+    // dim end between frames.
+    for (int i = 0; i < kLightPins.count; i++) renderLedLevel(kLightPins[i], g_fire.zoneLevel(i));
+
+    // Render the flame along the strip (if fitted), base at pixel 0.
+    // The previous frame is still being sent while this one renders.
+    Pixel *frame = pixelStripBackBuffer();
+    if (frame) {
+        size_t count = pixelStripCount();
+        for (size_t k = 0; k < count; k++) {
+            uint16_t pos = count > 1 ? static_cast<uint16_t>(k * 0xFFFF / (count - 1)) : 0;
+            frame[k] = heatColor(g_fire.heightLevel(pos) >> 8);
+        }
+        pixelStripShow();
     }
 }
@@ -1,5 +1,26 @@
 // File: `src/Logger.cpp`
 #include "Logger.h"
+#include "MemoryPolicy.h"
+#include "Trace.h"
+
+// Longest message kept in the retention buffer (longer ones are truncated)
+#ifndef LOG_RETENTION_MAX_MESSAGE
+#define LOG_RETENTION_MAX_MESSAGE 256
+#endif
+
+namespace {
+struct RecordHeader {
+    uint32_t seq;
+    uint32_t timestamp;
+    uint16_t length;
+    uint8_t level;
+    uint8_t reserved;
+};
+
+uint32_t recordSize(uint16_t length) {
+    return (sizeof(RecordHeader) + length + 3u) & ~3u;
+}
+} // namespace
 
 Logger* Logger::s_instance = nullptr;
 
@@ -27,9 +48,19 @@ void Logger::deinit() {
 }
 
 Logger::Logger(const String &appName, Level minLevel)
-    : appName(appName), minLevel(minLevel)
+    : appName(appName), minLevel(minLevel), retainLevel(minLevel),
+      ring(nullptr), ringSize(0), ringHead(0), ringTail(0), seqCounter(0)
 {
     mutex = xSemaphoreCreateMutex();
+    ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+    // Power-of-two size so monotonic offsets stay valid across uint32 wrap
+    size_t size = 1;
+    while (size * 2 <= LOG_RETENTION_BYTES) size *= 2;
+    for (; size >= 1024 && !ring; size /= 2) {
+        ring = static_cast<uint8_t *>(memAlloc(MEM_LOGS, MemClass::Cold, size));
+        if (ring) ringSize = size;
+    }
 }
 
 Logger::~Logger()
@@ -38,11 +69,19 @@ Logger::~Logger()
         vSemaphoreDelete(mutex);
         mutex = nullptr;
     }
+    memFree(ring);
+    ring = nullptr;
 }
 
 void Logger::setLevel(Level level) { minLevel = level; }
 Logger::Level Logger::getLevel() const { return minLevel; }
 
+void Logger::setRetentionLevel(Level level) { retainLevel = level; }
+Logger::Level Logger::getRetentionLevel() const { return retainLevel; }
+
+uint32_t Logger::nextSeq() const { return seqCounter.load(std::memory_order_acquire); }
+size_t Logger::retentionCapacity() const { return ringSize; }
+
 void Logger::log(const String &message) {
     log(INFO, message, millis(), 0);
 }
@@ -54,8 +93,92 @@ void Logger::log(const String &message, unsigned long timestamp, unsigned long t
 }
 
 void Logger::log(Level lvl, const String &message, unsigned long timestamp, unsigned long threadTime) {
-    if (lvl < minLevel) return;
-    output(lvl, message, timestamp == 0 ? millis() : timestamp, threadTime);
+    if (lvl < minLevel && lvl < retainLevel) return;
+    if (timestamp == 0) timestamp = millis();
+    if (lvl >= retainLevel) retain(lvl, message, timestamp);
+    if (lvl >= minLevel) output(lvl, message, timestamp, threadTime);
+}
+
+void Logger::ringWrite(uint32_t offset, const void *src, size_t len) {
+    size_t start = offset & (ringSize - 1);
+    size_t first = min(len, ringSize - start);
+    memcpy(ring + start, src, first);
+    memcpy(ring, static_cast<const uint8_t *>(src) + first, len - first);
+}
+
+void Logger::ringRead(uint32_t offset, void *dst, size_t len) const {
+    size_t start = offset & (ringSize - 1);
+    size_t first = min(len, ringSize - start);
+    memcpy(dst, ring + start, first);
+    memcpy(static_cast<uint8_t *>(dst) + first, ring, len - first);
+}
+
+void Logger::retain(Level lvl, const String &message, unsigned long timestamp) {
+    if (!ring) return;
+    RecordHeader hdr = {};
+    hdr.length = static_cast<uint16_t>(min<size_t>(message.length(), LOG_RETENTION_MAX_MESSAGE));
+    hdr.timestamp = timestamp;
+    hdr.level = static_cast<uint8_t>(lvl);
+    uint32_t size = recordSize(hdr.length);
+
+    portENTER_CRITICAL(&ringMux);
+    uint32_t head = ringHead.load(std::memory_order_relaxed);
+    uint32_t tail = ringTail.load(std::memory_order_relaxed);
+    // Evict oldest records until the new one fits; publish the new tail
+    // before overwriting so concurrent readers can detect the overlap.
+    while (head + size - tail > ringSize) {
+        RecordHeader old;
+        ringRead(tail, &old, sizeof(old));
+        tail += recordSize(old.length);
+    }
+    ringTail.store(tail, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    hdr.seq = seqCounter.load(std::memory_order_relaxed);
+    ringWrite(head, &hdr, sizeof(hdr));
+    ringWrite(head + sizeof(hdr), message.c_str(), hdr.length);
+    ringHead.store(head + size, std::memory_order_release);
+    seqCounter.store(hdr.seq + 1, std::memory_order_release);
+    portEXIT_CRITICAL(&ringMux);
+}
+
+uint32_t Logger::readRetained(uint32_t since, std::vector<Record> &out, size_t maxRecords, uint32_t *dropped) const {
+    uint32_t lost = 0;
+    if (dropped) *dropped = 0;
+    if (!ring) return since;
+    // A cursor from before a reboot is ahead of us: restart from the oldest record
+    if (static_cast<int32_t>(since - nextSeq()) > 0) since = 0;
+
+    char text[LOG_RETENTION_MAX_MESSAGE + 1];
+    uint32_t pos = ringTail.load(std::memory_order_acquire);
+    uint32_t head = ringHead.load(std::memory_order_acquire);
+    size_t taken = 0;
+    while (pos != head && taken < maxRecords) {
+        RecordHeader hdr;
+        ringRead(pos, &hdr, sizeof(hdr));
+        // A torn header is caught by the tail check below; just keep the copy in bounds
+        if (hdr.length > LOG_RETENTION_MAX_MESSAGE) hdr.length = LOG_RETENTION_MAX_MESSAGE;
+        bool wanted = static_cast<int32_t>(hdr.seq - since) >= 0;
+        if (wanted) ringRead(pos + sizeof(hdr), text, hdr.length);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t tail = ringTail.load(std::memory_order_relaxed);
+        if (static_cast<int32_t>(tail - pos) > 0) {
+            // Writer lapped us while copying: resync at the new oldest record
+            pos = tail;
+            head = ringHead.load(std::memory_order_acquire);
+            continue;
+        }
+        pos += recordSize(hdr.length);
+        if (!wanted) continue;
+
+        if (hdr.seq != since) lost += hdr.seq - since;
+        text[hdr.length] = '\0';
+        out.push_back(Record{hdr.seq, hdr.timestamp, static_cast<Level>(hdr.level), String(text)});
+        since = hdr.seq + 1;
+        taken++;
+    }
+    if (dropped) *dropped = lost;
+    return since;
 }
 
 const char* Logger::levelToString(Level lvl) const {
@@ -69,6 +192,7 @@ const char* Logger::levelToString(Level lvl) const {
 }
 
 void Logger::output(Level lvl, const String &message, unsigned long timestamp, unsigned long threadTime) {
+    TRACE_SCOPE_ARG("log.output", message.length());
     if (mutex && xSemaphoreTake(mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
         Serial.print('[');
         Serial.print(appName);
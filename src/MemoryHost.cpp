@@ -0,0 +1,24 @@
+// Host builds (pio test -e native) have no heap_caps: MemoryPolicy's
+// allocation calls map onto malloc so modules that allocate through it can
+// be unit tested. The firmware uses MemoryPolicy.cpp.
+#ifndef ESP_PLATFORM
+
+#include "MemoryPolicy.h"
+
+#include <stdlib.h>
+
+void *memAlloc(MemSubsystem, MemClass, size_t size) {
+    return malloc(size);
+}
+
+void *memRealloc(MemSubsystem, MemClass, void *ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+void memFree(void *ptr) {
+    free(ptr);
+}
+
+void memRegisterStatic(MemSubsystem, size_t) {}
+
+#endif // ESP_PLATFORM
@@ -0,0 +1,202 @@
+#include "MemoryPolicy.h"
+
+#include <array>
+#include <atomic>
+#include <utility>
+#include <esp_heap_caps.h>
+
+#include "Logger.h"
+
+namespace {
+
+// Prepended to every block so memFree() knows what to give back to whom.
+// 8 bytes keeps the heap's alignment for the payload.
+struct BlockHeader {
+    uint32_t size;
+    uint8_t sub;
+    uint8_t external;
+    uint16_t magic;
+};
+static_assert(sizeof(BlockHeader) == 8, "payload alignment");
+constexpr uint16_t kMagic = 0xA10C;
+
+struct Counters {
+    std::atomic<uint32_t> staticBytes{0};
+    std::atomic<uint32_t> internalBytes{0};
+    std::atomic<uint32_t> psramBytes{0};
+    std::atomic<uint32_t> peakBytes{0};
+    std::atomic<uint32_t> allocations{0};
+    std::atomic<uint32_t> failures{0};
+};
+
+Counters g_counters[MEM_SUBSYSTEMS];
+
+const char *const kNames[] = {
+    "logs", "journal", "trace", "audio", "pixels", "web", "schedule", "show", "wifi", "commands", "effects", "events",
+};
+static_assert(sizeof(kNames) / sizeof(kNames[0]) == MEM_SUBSYSTEMS, "one name per MemSubsystem");
+
+void notePeak(Counters &c) {
+    uint32_t now = c.internalBytes.load(std::memory_order_relaxed) + c.psramBytes.load(std::memory_order_relaxed);
+    uint32_t peak = c.peakBytes.load(std::memory_order_relaxed);
+    while (now > peak && !c.peakBytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+}
+
+void *rawAlloc(MemClass cls, size_t size, bool &external) {
+    external = false;
+    switch (cls) {
+        case MemClass::Hot:
+            return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        case MemClass::Dma:
+            return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+        case MemClass::Cold:
+        default: {
+            void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (p) {
+                external = true;
+                return p;
+            }
+            return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+    }
+}
+
+class ColdJsonAllocator : public ArduinoJson::Allocator {
+public:
+    explicit ColdJsonAllocator(MemSubsystem sub) : sub_(sub) {}
+    void *allocate(size_t size) override { return memAlloc(sub_, MemClass::Cold, size); }
+    void deallocate(void *ptr) override { memFree(ptr); }
+    void *reallocate(void *ptr, size_t size) override { return memRealloc(sub_, MemClass::Cold, ptr, size); }
+
+private:
+    MemSubsystem sub_;
+};
+
+// One allocator per subsystem, indexed by it; sized from the enum so a new
+// subsystem cannot be left without one
+template <size_t... Sub>
+std::array<ColdJsonAllocator, sizeof...(Sub)> makeJsonAllocators(std::index_sequence<Sub...>) {
+    return {{ColdJsonAllocator(static_cast<MemSubsystem>(Sub))...}};
+}
+
+void addHeapInfo(JsonObject out, uint32_t caps) {
+    out["total"] = heap_caps_get_total_size(caps);
+    out["free"] = heap_caps_get_free_size(caps);
+    out["min_free"] = heap_caps_get_minimum_free_size(caps);
+    out["largest"] = heap_caps_get_largest_free_block(caps);
+}
+
+} // namespace
+
+void *memAlloc(MemSubsystem sub, MemClass cls, size_t size) {
+    if (sub >= MEM_SUBSYSTEMS) return nullptr;
+    Counters &c = g_counters[sub];
+    bool external;
+    BlockHeader *h = size <= UINT32_MAX - sizeof(BlockHeader)
+                         ? static_cast<BlockHeader *>(rawAlloc(cls, sizeof(BlockHeader) + size, external))
+                         : nullptr;
+    if (!h) {
+        c.failures.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    h->size = size;
+    h->sub = sub;
+    h->external = external;
+    h->magic = kMagic;
+    (external ? c.psramBytes : c.internalBytes).fetch_add(size, std::memory_order_relaxed);
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    notePeak(c);
+    return h + 1;
+}
+
+void *memRealloc(MemSubsystem sub, MemClass cls, void *ptr, size_t size) {
+    if (!ptr) return memAlloc(sub, cls, size);
+    if (size == 0) {
+        memFree(ptr);
+        return nullptr;
+    }
+    const BlockHeader *old = static_cast<BlockHeader *>(ptr) - 1;
+    if (old->size >= size && old->size - size < 64) return ptr; // not worth moving
+    void *p = memAlloc(sub, cls, size);
+    if (!p) return nullptr; // old block stays valid, as with realloc()
+    memcpy(p, ptr, min<size_t>(old->size, size));
+    memFree(ptr);
+    return p;
+}
+
+void memFree(void *ptr) {
+    if (!ptr) return;
+    BlockHeader *h = static_cast<BlockHeader *>(ptr) - 1;
+    if (h->magic != kMagic || h->sub >= MEM_SUBSYSTEMS) {
+        LOGE("Memory: free of a block memAlloc() did not return");
+        return;
+    }
+    Counters &c = g_counters[h->sub];
+    (h->external ? c.psramBytes : c.internalBytes).fetch_sub(h->size, std::memory_order_relaxed);
+    h->magic = 0;
+    heap_caps_free(h);
+}
+
+void memRegisterStatic(MemSubsystem sub, size_t bytes) {
+    if (sub < MEM_SUBSYSTEMS) g_counters[sub].staticBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+MemSubsystemStats memStats(MemSubsystem sub) {
+    MemSubsystemStats s = {};
+    if (sub >= MEM_SUBSYSTEMS) return s;
+    const Counters &c = g_counters[sub];
+    s.staticBytes = c.staticBytes.load(std::memory_order_relaxed);
+    s.internalBytes = c.internalBytes.load(std::memory_order_relaxed);
+    s.psramBytes = c.psramBytes.load(std::memory_order_relaxed);
+    s.peakBytes = c.peakBytes.load(std::memory_order_relaxed);
+    s.allocations = c.allocations.load(std::memory_order_relaxed);
+    s.failures = c.failures.load(std::memory_order_relaxed);
+    return s;
+}
+
+const char *memSubsystemName(MemSubsystem sub) {
+    return sub < MEM_SUBSYSTEMS ? kNames[sub] : "?";
+}
+
+ArduinoJson::Allocator *memJsonAllocator(MemSubsystem sub) {
+    static std::array<ColdJsonAllocator, MEM_SUBSYSTEMS> allocators =
+        makeJsonAllocators(std::make_index_sequence<MEM_SUBSYSTEMS>());
+    return &allocators[sub < MEM_SUBSYSTEMS ? sub : MEM_WEB];
+}
+
+void memDescribe(JsonObject out) {
+    addHeapInfo(out.createNestedObject("internal"), MALLOC_CAP_INTERNAL);
+    if (psramFound()) addHeapInfo(out.createNestedObject("psram"), MALLOC_CAP_SPIRAM);
+    else out["psram"] = nullptr;
+    JsonObject subs = out.createNestedObject("subsystems");
+    for (int i = 0; i < MEM_SUBSYSTEMS; i++) {
+        MemSubsystemStats s = memStats(static_cast<MemSubsystem>(i));
+        JsonObject o = subs.createNestedObject(kNames[i]);
+        o["static"] = s.staticBytes;
+        o["internal"] = s.internalBytes;
+        o["psram"] = s.psramBytes;
+        o["peak"] = s.peakBytes;
+        o["allocs"] = s.allocations;
+        o["failed"] = s.failures;
+    }
+}
+
+void memLogMap() {
+    LOGI("Memory: internal " + String(heap_caps_get_free_size(MALLOC_CAP_INTERNAL)) + " free of " +
+         String(heap_caps_get_total_size(MALLOC_CAP_INTERNAL)) + ", largest block " +
+         String(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL)));
+    if (psramFound()) {
+        LOGI("Memory: psram " + String(heap_caps_get_free_size(MALLOC_CAP_SPIRAM)) + " free of " +
+             String(heap_caps_get_total_size(MALLOC_CAP_SPIRAM)));
+    } else {
+        LOGW("Memory: no PSRAM, cold buffers are in internal RAM");
+    }
+    for (int i = 0; i < MEM_SUBSYSTEMS; i++) {
+        MemSubsystemStats s = memStats(static_cast<MemSubsystem>(i));
+        if (!s.staticBytes && !s.internalBytes && !s.psramBytes && !s.failures) continue;
+        LOGI(String("Memory: ") + kNames[i] + " static " + String(s.staticBytes) + ", internal " +
+             String(s.internalBytes) + ", psram " + String(s.psramBytes) +
+             (s.failures ? ", " + String(s.failures) + " failed" : String("")));
+    }
+}
@@ -0,0 +1,31 @@
+#include "PcmSink.h"
+#include "WavFormat.h"
+
+bool WavFileSink::begin(uint32_t sampleRate) {
+    end();
+    file_ = fopen(path_.c_str(), "wb");
+    if (!file_) return false;
+    rate_ = sampleRate;
+    frames_ = 0;
+    uint8_t hdr[WAV_HEADER_BYTES];
+    wavHeader(hdr, rate_, 0);
+    return fwrite(hdr, sizeof(hdr), 1, file_) == 1;
+}
+
+size_t WavFileSink::write(const int16_t *frames, size_t count) {
+    if (!file_) return 0;
+    // The ESP32 (and the hosts the tests run on) are little-endian, like WAV
+    size_t written = fwrite(frames, 4, count, file_);
+    frames_ += written;
+    return written;
+}
+
+void WavFileSink::end() {
+    if (!file_) return;
+    uint8_t hdr[WAV_HEADER_BYTES];
+    wavHeader(hdr, rate_, frames_);
+    fseek(file_, 0, SEEK_SET);
+    fwrite(hdr, sizeof(hdr), 1, file_);
+    fclose(file_);
+    file_ = nullptr;
+}
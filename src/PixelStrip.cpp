@@ -0,0 +1,71 @@
+#include "PixelStrip.h"
+
+#include "Logger.h"
+#include "MemoryPolicy.h"
+#include "RmtFrameSink.h"
+#include "Trace.h"
+
+#if PIXEL_STRIP_COUNT > 0
+
+namespace {
+
+FrameSink *g_sink = nullptr;
+Pixel g_storage[2][PIXEL_STRIP_COUNT];
+PixelFrames g_frames;
+PixelStripStats g_stats = {};
+
+} // namespace
+
+void setupPixelStrip(FrameSink *sink) {
+    g_sink = sink ? sink : &rmtFrameSink();
+    if (!g_sink->begin(PIXEL_STRIP_COUNT)) {
+        LOGE("Pixel strip: sink initialization failed");
+        g_sink = nullptr;
+        return;
+    }
+    g_frames.begin(g_sink, g_storage[0], PIXEL_STRIP_COUNT);
+    // Internal on purpose: the RMT translator reads the front buffer from an ISR
+    memRegisterStatic(MEM_PIXELS, sizeof(g_storage));
+    pixelStripShow(); // blank the strip
+    LOGI("Pixel strip: " + String(PIXEL_STRIP_COUNT) + " pixels on GPIO " + String(PIXEL_STRIP_PIN));
+}
+
+bool pixelStripEnabled() {
+    return g_sink != nullptr;
+}
+
+size_t pixelStripCount() {
+    return g_sink ? PIXEL_STRIP_COUNT : 0;
+}
+
+Pixel *pixelStripBackBuffer() {
+    return g_sink ? g_frames.back() : nullptr;
+}
+
+void pixelStripShow() {
+    if (!g_sink) return;
+    TRACE_SCOPE("pixels.show");
+    unsigned long start = micros();
+    g_sink->waitIdle(); // front buffer is free again
+    uint32_t waited = micros() - start;
+    g_stats.lastWaitUs = waited;
+    if (waited > g_stats.maxWaitUs) g_stats.maxWaitUs = waited;
+
+    g_frames.show();
+    g_stats.frames++;
+}
+
+PixelStripStats pixelStripStats() {
+    return g_stats;
+}
+
+#else // PIXEL_STRIP_COUNT == 0
+
+void setupPixelStrip(FrameSink *) {}
+bool pixelStripEnabled() { return false; }
+size_t pixelStripCount() { return 0; }
+Pixel *pixelStripBackBuffer() { return nullptr; }
+void pixelStripShow() {}
+PixelStripStats pixelStripStats() { return PixelStripStats{}; }
+
+#endif
@@ -1,30 +1,47 @@
 // filepath: /Users/fullgreen/Documents/cours/stein/untitled/src/Pwm.cpp
 #include "Pwm.h"
+
+#if BOARD_HAS_MILL
+
+#include "DeviceState.h"
 #include "Logger.h"
 
-// Use LEDC on ESP32 for PWM control
-static int g_pwmValue = 0;
+// Use LEDC on ESP32 for PWM control (current value lives in DeviceState)
+static constexpr BoardChannel MILL = kBoardChannels[boardFind("mill")];
 static const int PWM_CHANNEL = 0;
 static const int PWM_FREQ = 5000; // 5kHz
-static const int PWM_RESOLUTION = 8; // 8-bit -> 0..255
+static const int PWM_RESOLUTION = MILL.resolution;
+static_assert(MILL.kind == ChannelKind::Pwm && MILL.max <= 255, "mill must be a PWM channel with an 8-bit range");
+
+// Envelope scale (Q8) and the level it applies to, so rescaling needs no
+// DeviceState snapshot
+static uint16_t g_scale = 256;
+static int g_level = 0;
+
+static void writeDuty(int level) {
+    g_level = level;
+    uint32_t scaled = min<uint32_t>((static_cast<uint32_t>(level) * g_scale) >> 8, MILL.max);
+    ledcWrite(PWM_CHANNEL, (scaled * ((1u << PWM_RESOLUTION) - 1)) / 255);
+}
 
 void setupPwm() {
     LOGD("Init PWM");
     // configure LEDC channel
     ledcSetup(PWM_CHANNEL, PWM_FREQ, PWM_RESOLUTION);
-    ledcAttachPin(MOULIN_PWM_PIN, PWM_CHANNEL);
+    ledcAttachPin(MILL.pin, PWM_CHANNEL);
     // default off
     turnOffPwm();
 }
 
 void setPwm(int brightness) {
-    brightness = constrain(brightness, 0, 255);
-    g_pwmValue = brightness;
-    ledcWrite(PWM_CHANNEL, brightness);
+    brightness = constrain(brightness, MILL.min, MILL.max);
+    // API range is 0..255 whatever the duty resolution
+    writeDuty(brightness);
+    deviceStateSetMill(static_cast<uint8_t>(brightness));
 }
 
 int getPwm() {
-    return g_pwmValue;
+    return deviceStateSnapshot().mill;
 }
 
 void turnOffPwm() {
@@ -35,6 +52,12 @@ void turnOnPwm() {
     setPwm(255);
 }
 
+void setPwmScale(uint16_t scale) {
+    if (scale == g_scale) return;
+    g_scale = scale;
+    writeDuty(g_level);
+}
+
 void tryPwm() {
     // Simple test pulse
     setPwm(255);
@@ -42,3 +65,4 @@ void tryPwm() {
     setPwm(0);
 }
 
+#endif // BOARD_HAS_MILL
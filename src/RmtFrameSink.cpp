@@ -0,0 +1,74 @@
+#include "RmtFrameSink.h"
+
+#include <driver/rmt.h>
+
+#include "PixelStrip.h"
+
+#if PIXEL_STRIP_COUNT > 0
+
+namespace {
+
+// 80 MHz APB / 2 = 25 ns per RMT tick
+constexpr uint8_t kRmtClockDiv = 2;
+constexpr uint16_t kT0H = 16; // 0.40 us
+constexpr uint16_t kT0L = 34; // 0.85 us
+constexpr uint16_t kT1H = 32; // 0.80 us
+constexpr uint16_t kT1L = 18; // 0.45 us
+
+// Expands bytes into RMT symbols on the fly from the driver ISR, so only a
+// ping-pong half of RMT RAM is needed instead of 24 symbols per pixel.
+void IRAM_ATTR ws2812Translate(const void *src, rmt_item32_t *dest, size_t srcSize,
+                               size_t wantedNum, size_t *translatedSize, size_t *itemNum) {
+    const rmt_item32_t bit0 = {{{kT0H, 1, kT0L, 0}}};
+    const rmt_item32_t bit1 = {{{kT1H, 1, kT1L, 0}}};
+    const uint8_t *p = static_cast<const uint8_t *>(src);
+    size_t size = 0;
+    size_t num = 0;
+    while (size < srcSize && num + 8 <= wantedNum) {
+        uint8_t byte = p[size];
+        for (int bit = 7; bit >= 0; bit--) {
+            dest[num++].val = (byte & (1 << bit)) ? bit1.val : bit0.val;
+        }
+        size++;
+    }
+    *translatedSize = size;
+    *itemNum = num;
+}
+
+class RmtFrameSink : public FrameSink {
+public:
+    bool begin(size_t) override {
+        rmt_config_t config = RMT_DEFAULT_CONFIG_TX(static_cast<gpio_num_t>(PIXEL_STRIP_PIN),
+                                                    static_cast<rmt_channel_t>(PIXEL_STRIP_RMT_CHANNEL));
+        config.clk_div = kRmtClockDiv;
+        config.mem_block_num = 2; // larger ping-pong halves -> fewer refill interrupts
+        if (rmt_config(&config) != ESP_OK) return false;
+        if (rmt_driver_install(config.channel, 0, 0) != ESP_OK) return false;
+        return rmt_translator_init(config.channel, ws2812Translate) == ESP_OK;
+    }
+
+    void submit(const Pixel *pixels, size_t count) override {
+        rmt_write_sample(static_cast<rmt_channel_t>(PIXEL_STRIP_RMT_CHANNEL),
+                         reinterpret_cast<const uint8_t *>(pixels), count * sizeof(Pixel), false);
+        busy = true;
+    }
+
+    void waitIdle() override {
+        if (!busy) return;
+        rmt_wait_tx_done(static_cast<rmt_channel_t>(PIXEL_STRIP_RMT_CHANNEL), pdMS_TO_TICKS(100));
+        busy = false;
+    }
+
+private:
+    bool busy = false;
+};
+
+RmtFrameSink g_sink;
+
+} // namespace
+
+FrameSink &rmtFrameSink() {
+    return g_sink;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "Rules.h"
+
+#include <LittleFS.h>
+#include <atomic>
+
+#include "Actions.h"
+#include "Logger.h"
+#include "MemoryPolicy.h"
+
+namespace {
+
+constexpr int kTypes = static_cast<int>(EventType::Count);
+
+struct Rule {
+    EventType type;
+    int32_t min;
+    int32_t max;
+    uint32_t cooldownMs;
+    uint32_t lastMs;
+    uint32_t fired;
+    uint32_t suppressed; // matched during the cooldown
+    char action[RULE_ACTION_MAX];
+};
+
+// Loop task only. Sorted by type; rules for type t are
+// g_rules[g_first[t]] .. g_rules[g_first[t + 1] - 1].
+Rule g_rules[RULES_MAX];
+uint8_t g_first[kTypes + 1] = {};
+int g_count = 0;
+std::atomic<bool> g_reloadRequested{false};
+
+bool parseRule(JsonObject o, Rule &rule, String &error) {
+    const char *on = o["on"] | "";
+    if (!eventTypeFromName(on, rule.type)) {
+        error = String("unknown event '") + on + "'";
+        return false;
+    }
+    const char *action = o["do"] | "";
+    if (!*action || strlen(action) >= RULE_ACTION_MAX) {
+        error = "'do' must be 1-" + String(RULE_ACTION_MAX - 1) + " characters";
+        return false;
+    }
+    strlcpy(rule.action, action, sizeof(rule.action));
+    rule.min = o["min"] | INT32_MIN;
+    rule.max = o["max"] | INT32_MAX;
+    if (!o["value"].isNull()) rule.min = rule.max = o["value"].as<int32_t>();
+    rule.cooldownMs = o["cooldown_ms"] | 0;
+    rule.lastMs = 0;
+    rule.fired = 0;
+    rule.suppressed = 0;
+    return true;
+}
+
+void load() {
+    g_count = 0;
+    memset(g_first, 0, sizeof(g_first));
+    File f = LittleFS.open(RULES_FILE, "r");
+    if (!f) return;
+    JsonDocument doc(memJsonAllocator(MEM_EVENTS));
+    DeserializationError err = deserializeJson(doc, f);
+    f.close();
+    if (err || !doc.is<JsonArray>()) {
+        LOGE("Rules: " RULES_FILE " is invalid: " + String(err ? err.c_str() : "not an array"));
+        return;
+    }
+
+    // Parse into a scratch table, then counting-sort by event type
+    static Rule parsed[RULES_MAX];
+    int n = 0;
+    int index = 0;
+    for (JsonObject o : doc.as<JsonArray>()) {
+        String error;
+        if (n == RULES_MAX) {
+            LOGW("Rules: more than " + String(RULES_MAX) + " rules, ignoring the rest");
+            break;
+        }
+        if (parseRule(o, parsed[n], error)) n++;
+        else LOGW("Rules: rule " + String(index) + " skipped: " + error);
+        index++;
+    }
+    int counts[kTypes] = {};
+    for (int i = 0; i < n; i++) counts[static_cast<int>(parsed[i].type)]++;
+    for (int t = 0; t < kTypes; t++) g_first[t + 1] = g_first[t] + counts[t];
+    int next[kTypes];
+    for (int t = 0; t < kTypes; t++) next[t] = g_first[t];
+    for (int i = 0; i < n; i++) g_rules[next[static_cast<int>(parsed[i].type)]++] = parsed[i];
+    g_count = n;
+    LOGI("Rules: " + String(n) + " rule(s) loaded");
+}
+
+} // namespace
+
+void setupRules() {
+    memRegisterStatic(MEM_EVENTS, sizeof(g_rules) * 2); // table + parse scratch
+    load();
+}
+
+void serviceRules() {
+    if (g_reloadRequested.exchange(false)) load();
+}
+
+void rulesOnEvent(const Event &event) {
+    int type = static_cast<int>(event.type);
+    for (int i = g_first[type]; i < g_first[type + 1]; i++) {
+        Rule &rule = g_rules[i];
+        if (event.value < rule.min || event.value > rule.max) continue;
+        uint32_t now = millis();
+        if (rule.cooldownMs && rule.fired && now - rule.lastMs < rule.cooldownMs) {
+            rule.suppressed++;
+            continue;
+        }
+        rule.lastMs = now;
+        rule.fired++;
+        if (!runAction(rule.action)) LOGW(String("Rules: action failed: ") + rule.action);
+    }
+}
+
+void rulesReload() {
+    g_reloadRequested = true;
+}
+
+void rulesDescribe(JsonObject out) {
+    // Counters are read without locking, display only
+    JsonArray rules = out.createNestedArray("rules");
+    for (int i = 0; i < g_count; i++) {
+        const Rule &r = g_rules[i];
+        JsonObject o = rules.createNestedObject();
+        o["on"] = eventTypeName(r.type);
+        if (r.min != INT32_MIN) o["min"] = r.min;
+        if (r.max != INT32_MAX) o["max"] = r.max;
+        o["do"] = r.action;
+        if (r.cooldownMs) o["cooldown_ms"] = r.cooldownMs;
+        o["fired"] = r.fired;
+        o["suppressed"] = r.suppressed;
+    }
+    out["reload_pending"] = g_reloadRequested.load();
+}
@@ -0,0 +1,311 @@
+#include "Scheduler.h"
+
+#include <LittleFS.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "Actions.h"
+#include "Journal.h"
+#include "Logger.h"
+#include "MemoryPolicy.h"
+
+static TimerWheel g_wheel(SCHEDULER_MAX_TIMERS, MEM_SCHEDULE);
+static std::vector<ScheduleRule, MemAllocator<ScheduleRule, MEM_SCHEDULE>> g_rules;
+static SemaphoreHandle_t g_mutex = nullptr;
+static uint16_t g_nextRuleId = 1;
+static bool g_timeSynced = false;
+static int g_tzOffsetMinutes = 0;
+
+static const char *const kKindNames[] = {"once", "daily", "hourly", "interval"};
+
+// Monotonic wheel ticks; esp_timer is 64-bit so the uint32 tick wraps cleanly
+static uint32_t nowTick() {
+    return static_cast<uint32_t>(esp_timer_get_time() / (SCHEDULER_TICK_MS * 1000LL));
+}
+
+static uint32_t msToTicks(uint32_t ms) {
+    return (ms + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+}
+
+static void lock() { if (g_mutex) xSemaphoreTake(g_mutex, portMAX_DELAY); }
+static void unlock() { if (g_mutex) xSemaphoreGive(g_mutex); }
+
+static ScheduleRule *findRule(uint16_t id) {
+    for (ScheduleRule &r : g_rules) {
+        if (r.id == id) return &r;
+    }
+    return nullptr;
+}
+
+// Next run strictly after `now`, or 0 when the rule cannot run (yet)
+static time_t computeNextDue(const ScheduleRule &r, time_t now) {
+    switch (r.kind) {
+        case RuleKind::Interval:
+            return now + (r.at ? r.at : 1);
+        case RuleKind::Once:
+            return (g_timeSynced && static_cast<time_t>(r.at) > now) ? r.at : 0;
+        case RuleKind::Daily:
+        case RuleKind::Hourly: {
+            if (!g_timeSynced) return 0;
+            time_t period = r.kind == RuleKind::Daily ? 86400 : 3600;
+            time_t local = now + g_tzOffsetMinutes * 60;
+            time_t next = local - (local % period) + (r.at % period);
+            if (next <= local) next += period;
+            return next - g_tzOffsetMinutes * 60;
+        }
+    }
+    return 0;
+}
+
+static void onRuleTimer(uint32_t id);
+
+// Caller holds the lock
+static void armRule(ScheduleRule &r, time_t now) {
+    if (r.timer) g_wheel.cancel(r.timer);
+    r.timer = 0;
+    r.nextDue = r.enabled ? computeNextDue(r, now) : 0;
+    if (r.nextDue == 0) return;
+    uint64_t ms = static_cast<uint64_t>(r.nextDue - now) * 1000ULL;
+    uint32_t ticks = ms / SCHEDULER_TICK_MS > TimerWheel::MAX_DELAY ? TimerWheel::MAX_DELAY : ms / SCHEDULER_TICK_MS;
+    r.timer = g_wheel.arm(ticks, onRuleTimer, r.id);
+    if (!r.timer) LOGE("Scheduler: timer pool exhausted, rule " + String(r.id) + " not armed");
+}
+
+static void saveRules() {
+    JsonDocument doc(memJsonAllocator(MEM_SCHEDULE));
+    doc["tz"] = g_tzOffsetMinutes;
+    JsonArray arr = doc.createNestedArray("rules");
+    for (const ScheduleRule &r : g_rules) {
+        JsonObject o = arr.createNestedObject();
+        o["id"] = r.id;
+        o["kind"] = kKindNames[static_cast<int>(r.kind)];
+        o["at"] = r.at;
+        o["action"] = r.action;
+        o["enabled"] = r.enabled;
+    }
+    File f = LittleFS.open(SCHEDULE_FILE, "w");
+    if (!f) {
+        LOGE("Scheduler: cannot write " SCHEDULE_FILE);
+        return;
+    }
+    serializeJson(doc, f);
+    f.close();
+}
+
+static void loadRules() {
+    File f = LittleFS.open(SCHEDULE_FILE, "r");
+    if (!f) return;
+    JsonDocument doc(memJsonAllocator(MEM_SCHEDULE));
+    DeserializationError err = deserializeJson(doc, f);
+    f.close();
+    if (err) {
+        LOGE("Scheduler: " SCHEDULE_FILE " is invalid: " + String(err.c_str()));
+        return;
+    }
+    g_tzOffsetMinutes = doc["tz"] | 0;
+    for (JsonObject o : doc["rules"].as<JsonArray>()) {
+        RuleKind kind;
+        if (!schedulerParseKind(o["kind"] | "", kind)) continue;
+        if (g_rules.size() >= SCHEDULER_MAX_RULES) break;
+        ScheduleRule r = {};
+        r.id = o["id"] | 0;
+        r.kind = kind;
+        r.at = o["at"] | 0;
+        r.action = o["action"] | "";
+        r.enabled = o["enabled"] | true;
+        if (r.id == 0 || r.action.length() == 0) continue;
+        if (r.id >= g_nextRuleId) g_nextRuleId = r.id + 1;
+        g_rules.push_back(r);
+    }
+    LOGI("Scheduler: loaded " + String(static_cast<int>(g_rules.size())) + " rule(s)");
+}
+
+static void onRuleTimer(uint32_t id) {
+    String action;
+    lock();
+    ScheduleRule *r = findRule(static_cast<uint16_t>(id));
+    if (!r) {
+        unlock();
+        return;
+    }
+    r->timer = 0;
+    time_t now = time(nullptr);
+    if (r->kind != RuleKind::Interval && now < r->nextDue) {
+        // Clamped long delay (or clock moved back): wait for the rest
+        armRule(*r, now);
+        unlock();
+        return;
+    }
+    action = r->action;
+    if (r->kind == RuleKind::Once) {
+        r->enabled = false;
+        r->nextDue = 0;
+        saveRules();
+    } else {
+        armRule(*r, now);
+    }
+    unlock();
+
+    LOGI("Scheduler: rule " + String(id) + " -> " + action);
+    journalSetCause(("schedule:" + String(id)).c_str());
+    runAction(action);
+    journalSetCause(nullptr);
+}
+
+void setupScheduler() {
+    g_mutex = xSemaphoreCreateMutex();
+    if (!g_wheel.begin(nowTick())) {
+        LOGE("Scheduler: cannot allocate timer pool");
+        return;
+    }
+    lock();
+    loadRules();
+    time_t now = time(nullptr);
+    for (ScheduleRule &r : g_rules) armRule(r, now);
+    unlock();
+}
+
+void serviceScheduler() {
+    lock();
+    g_wheel.advance(nowTick());
+    unlock();
+
+    // Run callbacks outside the lock: they may arm new timers
+    for (;;) {
+        TimerWheel::Callback cb;
+        uint32_t arg;
+        lock();
+        bool got = g_wheel.popExpired(cb, arg);
+        unlock();
+        if (!got) break;
+        if (cb) cb(arg);
+    }
+}
+
+void schedulerSetTime(time_t epoch, int tzOffsetMinutes) {
+    struct timeval tv = {};
+    tv.tv_sec = epoch;
+    settimeofday(&tv, nullptr);
+
+    lock();
+    bool tzChanged = tzOffsetMinutes != g_tzOffsetMinutes;
+    g_tzOffsetMinutes = tzOffsetMinutes;
+    g_timeSynced = true;
+    for (ScheduleRule &r : g_rules) armRule(r, epoch);
+    if (tzChanged) saveRules();
+    unlock();
+    LOGI("Scheduler: clock set to " + String(static_cast<long>(epoch)) + " (tz " + String(tzOffsetMinutes) + " min)");
+}
+
+bool schedulerTimeSynced() {
+    return g_timeSynced;
+}
+
+bool schedulerParseKind(const String &text, RuleKind &kind) {
+    for (int i = 0; i < 4; i++) {
+        if (text == kKindNames[i]) {
+            kind = static_cast<RuleKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool schedulerParseAt(RuleKind kind, const String &text, uint32_t &at) {
+    if (text.length() == 0) return false;
+    if (kind == RuleKind::Once || kind == RuleKind::Interval) {
+        at = strtoul(text.c_str(), nullptr, 10);
+        return at > 0;
+    }
+    // Colon-separated fields, most significant first
+    uint32_t fields[3] = {0, 0, 0};
+    int count = 0;
+    int start = 0;
+    while (count < 3) {
+        int colon = text.indexOf(':', start);
+        String part = colon < 0 ? text.substring(start) : text.substring(start, colon);
+        fields[count++] = part.toInt();
+        if (colon < 0) break;
+        start = colon + 1;
+    }
+    if (kind == RuleKind::Daily) {
+        if (count < 2 || fields[0] > 23 || fields[1] > 59 || fields[2] > 59) return false;
+        at = fields[0] * 3600 + fields[1] * 60 + fields[2];
+    } else {
+        if (count > 2 || fields[0] > 59 || fields[1] > 59) return false;
+        at = fields[0] * 60 + fields[1];
+    }
+    return true;
+}
+
+int schedulerAddRule(RuleKind kind, uint32_t at, const String &action) {
+    if (action.length() == 0) return -1;
+    lock();
+    if (g_rules.size() >= SCHEDULER_MAX_RULES) {
+        unlock();
+        return -1;
+    }
+    ScheduleRule r = {};
+    r.id = g_nextRuleId++;
+    r.kind = kind;
+    r.at = at;
+    r.action = action;
+    r.enabled = true;
+    g_rules.push_back(r);
+    armRule(g_rules.back(), time(nullptr));
+    saveRules();
+    int id = r.id;
+    unlock();
+    return id;
+}
+
+bool schedulerRemoveRule(uint16_t id) {
+    lock();
+    for (size_t i = 0; i < g_rules.size(); i++) {
+        if (g_rules[i].id != id) continue;
+        if (g_rules[i].timer) g_wheel.cancel(g_rules[i].timer);
+        g_rules.erase(g_rules.begin() + i);
+        saveRules();
+        unlock();
+        return true;
+    }
+    unlock();
+    return false;
+}
+
+TimerWheel::Handle schedulerAfter(uint32_t delayMs, TimerWheel::Callback cb, uint32_t arg) {
+    lock();
+    TimerWheel::Handle h = g_wheel.arm(msToTicks(delayMs), cb, arg);
+    unlock();
+    return h;
+}
+
+bool schedulerCancel(TimerWheel::Handle handle) {
+    lock();
+    bool ok = g_wheel.cancel(handle);
+    unlock();
+    return ok;
+}
+
+void schedulerDescribe(JsonDocument &doc) {
+    lock();
+    doc["synced"] = g_timeSynced;
+    doc["time"] = static_cast<long>(time(nullptr));
+    doc["tz"] = g_tzOffsetMinutes;
+    doc["pending_timers"] = g_wheel.pending();
+    doc["timer_capacity"] = g_wheel.capacity();
+    JsonArray arr = doc.createNestedArray("rules");
+    for (const ScheduleRule &r : g_rules) {
+        JsonObject o = arr.createNestedObject();
+        o["id"] = r.id;
+        o["kind"] = kKindNames[static_cast<int>(r.kind)];
+        o["at"] = r.at;
+        o["action"] = r.action;
+        o["enabled"] = r.enabled;
+        o["next"] = static_cast<long>(r.nextDue);
+    }
+    unlock();
+}
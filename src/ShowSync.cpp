@@ -0,0 +1,180 @@
+#include "ShowSync.h"
+
+#include <AsyncUDP.h>
+#include <LittleFS.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+
+#include "Actions.h"
+#include "Journal.h"
+#include "Logger.h"
+#include "MemoryPolicy.h"
+
+namespace {
+
+AsyncUDP g_udp;
+// Shared with the UDP receive task and the request task
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+ShowSyncNode g_node;
+uint32_t g_cuesRun = 0;
+uint32_t g_cuesLate = 0;
+
+const char *const kRoleNames[] = {"off", "leader", "follower"};
+
+int64_t localUs() {
+    return esp_timer_get_time();
+}
+
+void sendPacket(SyncPacket &p) {
+    p.sentUs = localUs(); // stamp last
+    g_udp.writeTo(reinterpret_cast<const uint8_t *>(&p), sizeof(p), SHOW_SYNC_GROUP, SHOW_SYNC_PORT);
+}
+
+// Runs on the AsyncUDP task. The clock fit is too slow for a spinlock
+// (software doubles over the whole window), so it runs on a copy.
+void onPacket(AsyncUDPPacket &packet) {
+    static ClockEstimator snapshot; // this task only
+    int64_t now = localUs();
+    portENTER_CRITICAL(&g_mux);
+    bool sampled = g_node.receive(packet.data(), packet.length(), now, true);
+    if (sampled) snapshot = g_node.clock();
+    portEXIT_CRITICAL(&g_mux);
+    if (!sampled) return;
+    ClockEstimator::Fit fit = snapshot.fit();
+    portENTER_CRITICAL(&g_mux);
+    g_node.applyFit(fit);
+    portEXIT_CRITICAL(&g_mux);
+}
+
+void saveRole() {
+    File f = LittleFS.open(SHOW_SYNC_FILE, "w");
+    if (!f) return;
+    f.printf("{\"role\":\"%s\"}", kRoleNames[static_cast<int>(g_node.role())]);
+    f.close();
+}
+
+} // namespace
+
+bool showSyncParseRole(const String &text, SyncRole &role) {
+    for (int i = 0; i < 3; i++) {
+        if (text == kRoleNames[i]) {
+            role = static_cast<SyncRole>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void setupShowSync() {
+    memRegisterStatic(MEM_SHOW, sizeof(g_node));
+    uint32_t nodeId = static_cast<uint32_t>(ESP.getEfuseMac());
+    g_node.begin(nodeId ? nodeId : 1);
+    if (!g_udp.listenMulticast(SHOW_SYNC_GROUP, SHOW_SYNC_PORT)) {
+        LOGE("Show sync: cannot join multicast group");
+        return;
+    }
+    g_udp.onPacket([](AsyncUDPPacket packet) { onPacket(packet); });
+
+    SyncRole role = SyncRole::Off;
+    File f = LittleFS.open(SHOW_SYNC_FILE, "r");
+    if (f) {
+        StaticJsonDocument<64> doc;
+        if (!deserializeJson(doc, f)) showSyncParseRole(doc["role"] | "off", role);
+        f.close();
+    }
+    portENTER_CRITICAL(&g_mux);
+    g_node.setRole(role);
+    portEXIT_CRITICAL(&g_mux);
+    LOGI(String("Show sync: node ") + String(g_node.nodeId(), HEX) + " role " + kRoleNames[static_cast<int>(role)]);
+}
+
+bool showSyncSetRole(SyncRole role) {
+    portENTER_CRITICAL(&g_mux);
+    g_node.setRole(role);
+    portEXIT_CRITICAL(&g_mux);
+    saveRole();
+    LOGI(String("Show sync: role ") + kRoleNames[static_cast<int>(role)]);
+    return true;
+}
+
+SyncRole showSyncRole() {
+    return g_node.role();
+}
+
+bool showSyncNow(int64_t &timelineUs) {
+    int64_t now = localUs();
+    portENTER_CRITICAL(&g_mux);
+    bool ok = g_node.timeline(now, timelineUs);
+    portEXIT_CRITICAL(&g_mux);
+    return ok;
+}
+
+bool showSyncCue(const String &action, uint32_t delayMs) {
+    SyncPacket p;
+    portENTER_CRITICAL(&g_mux);
+    bool ok = g_node.cue(action.c_str(), localUs(), static_cast<int64_t>(delayMs) * 1000, p);
+    portEXIT_CRITICAL(&g_mux);
+    if (ok) sendPacket(p);
+    return ok;
+}
+
+void serviceShowSync() {
+    SyncRole role = g_node.role();
+    if (role == SyncRole::Off) return;
+    int64_t now = localUs();
+
+    if (role == SyncRole::Leader) {
+        static int64_t lastBeacon = 0;
+        if (now - lastBeacon >= SHOW_SYNC_BEACON_MS * 1000LL) {
+            lastBeacon = now;
+            SyncPacket p;
+            portENTER_CRITICAL(&g_mux);
+            g_node.beacon(now, p);
+            portEXIT_CRITICAL(&g_mux);
+            sendPacket(p);
+        }
+    }
+
+    // Run due cues on the shared timeline
+    for (;;) {
+        char action[SHOW_SYNC_ACTION_LEN];
+        int64_t lateUs = 0;
+        portENTER_CRITICAL(&g_mux);
+        bool due = g_node.takeDue(now, action, sizeof(action), lateUs);
+        portEXIT_CRITICAL(&g_mux);
+        if (!due) break;
+        g_cuesRun++;
+        if (lateUs > 20000) g_cuesLate++;
+        journalSetCause("sync:cue");
+        runAction(action);
+        journalSetCause(nullptr);
+    }
+}
+
+void showSyncDescribe(JsonDocument &doc) {
+    SyncRole role = g_node.role();
+    doc["role"] = kRoleNames[static_cast<int>(role)];
+    doc["node"] = String(g_node.nodeId(), HEX);
+    doc["cues_run"] = g_cuesRun;
+    doc["cues_late"] = g_cuesLate;
+    int64_t timeline = 0;
+    bool aligned = showSyncNow(timeline);
+    doc["aligned"] = aligned;
+    if (aligned) doc["timeline_ms"] = timeline / 1000;
+    if (role == SyncRole::Follower) {
+        portENTER_CRITICAL(&g_mux);
+        uint32_t leader = g_node.leader();
+        int samples = g_node.clock().samples();
+        double drift = g_node.clock().driftPpm();
+        int64_t offset = g_node.clock().offsetUs();
+        int64_t since = localUs() - g_node.lastBeaconUs();
+        uint32_t duplicates = g_node.duplicates();
+        portEXIT_CRITICAL(&g_mux);
+        doc["leader"] = String(leader, HEX);
+        doc["samples"] = samples;
+        doc["offset_us"] = offset;
+        doc["drift_ppm"] = drift;
+        doc["last_beacon_ms"] = since / 1000;
+        doc["duplicates"] = duplicates;
+    }
+}
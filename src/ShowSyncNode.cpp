@@ -0,0 +1,146 @@
+#include "ShowSyncNode.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+void copyAction(char *dst, size_t size, const char *src) {
+    size_t n = src ? strnlen(src, size - 1) : 0;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+} // namespace
+
+void ShowSyncNode::setRole(SyncRole role) {
+    role_ = role;
+    leaderId_ = 0;
+    clock_.reset();
+    for (Cue &c : cues_) c.used = false;
+    forget();
+}
+
+void ShowSyncNode::forget() {
+    recentCount_ = 0;
+    recentNext_ = 0;
+}
+
+bool ShowSyncNode::seen(uint32_t seq) const {
+    for (int i = 0; i < recentCount_; i++) {
+        if (recent_[i] == seq) return true;
+    }
+    return false;
+}
+
+bool ShowSyncNode::addCue(uint32_t seq, int64_t atUs, const char *action, int repeats) {
+    if (seen(seq)) {
+        duplicates_++;
+        return false;
+    }
+    Cue *slot = nullptr;
+    for (Cue &c : cues_) {
+        if (!c.used) {
+            slot = &c;
+            break;
+        }
+    }
+    if (!slot) return false;
+    slot->used = true;
+    slot->seq = seq;
+    slot->atUs = atUs;
+    slot->repeatsLeft = repeats;
+    copyAction(slot->action, sizeof(slot->action), action);
+    recent_[recentNext_] = seq;
+    recentNext_ = (recentNext_ + 1) % SHOW_SYNC_RECENT_CUES;
+    if (recentCount_ < SHOW_SYNC_RECENT_CUES) recentCount_++;
+    return true;
+}
+
+void ShowSyncNode::fill(SyncPacket &p, uint8_t type, uint32_t seq, int64_t atUs, const char *action,
+                        int64_t nowUs) const {
+    memset(&p, 0, sizeof(p));
+    p.magic = MAGIC;
+    p.version = VERSION;
+    p.type = type;
+    p.node = nodeId_;
+    p.seq = seq;
+    p.atUs = atUs;
+    if (action) copyAction(p.action, sizeof(p.action), action);
+    p.sentUs = nowUs; // the leader timeline is its local clock
+}
+
+bool ShowSyncNode::receive(const uint8_t *data, size_t len, int64_t nowUs, bool deferFit) {
+    if (role_ != SyncRole::Follower || len < sizeof(SyncPacket)) return false;
+    SyncPacket p;
+    memcpy(&p, data, sizeof(p));
+    if (p.magic != MAGIC || p.version != VERSION || p.node == nodeId_) return false;
+    p.action[SHOW_SYNC_ACTION_LEN - 1] = '\0';
+
+    // Follow the lowest node id among active leaders
+    bool stale = nowUs - lastBeaconUs_ > LEADER_TIMEOUT_US;
+    if ((leaderId_ == 0 || stale || p.node < leaderId_) && p.node != leaderId_) {
+        leaderId_ = p.node;
+        clock_.reset();
+        for (Cue &c : cues_) c.used = false;
+        forget();
+    }
+    if (p.node != leaderId_) return false;
+    if (clock_.valid() && llabs(clock_.toRemote(nowUs) - p.sentUs) > RESYNC_JUMP_US) {
+        // A rebooted leader numbers its packets from 1 again
+        clock_.reset();
+        forget();
+    }
+    if (deferFit) clock_.record(nowUs, p.sentUs);
+    else clock_.addSample(nowUs, p.sentUs);
+    lastBeaconUs_ = nowUs;
+    if (p.type == TYPE_CUE) addCue(p.seq, p.atUs, p.action, 0);
+    return true;
+}
+
+bool ShowSyncNode::cue(const char *action, int64_t nowUs, int64_t delayUs, SyncPacket &out) {
+    if (role_ != SyncRole::Leader || !action || strlen(action) >= SHOW_SYNC_ACTION_LEN) return false;
+    int64_t at = nowUs + delayUs;
+    uint32_t seq = ++seq_;
+    if (!addCue(seq, at, action, SHOW_SYNC_CUE_REPEATS - 1)) return false;
+    fill(out, TYPE_CUE, seq, at, action, nowUs);
+    return true;
+}
+
+void ShowSyncNode::beacon(int64_t nowUs, SyncPacket &out) {
+    // A pending cue rides in place of a plain beacon (both carry the clock)
+    for (Cue &c : cues_) {
+        if (c.used && c.repeatsLeft > 0 && c.atUs > nowUs) {
+            c.repeatsLeft--;
+            fill(out, TYPE_CUE, c.seq, c.atUs, c.action, nowUs);
+            return;
+        }
+    }
+    fill(out, TYPE_BEACON, ++seq_, 0, nullptr, nowUs);
+}
+
+bool ShowSyncNode::takeDue(int64_t nowUs, char *action, size_t len, int64_t &lateUs) {
+    for (Cue &c : cues_) {
+        if (!c.used) continue;
+        int64_t localAt;
+        if (role_ == SyncRole::Leader) localAt = c.atUs;
+        else if (clock_.valid()) localAt = clock_.toLocal(c.atUs);
+        else continue;
+        if (nowUs < localAt) continue;
+        lateUs = nowUs - localAt;
+        copyAction(action, len, c.action);
+        c.used = false;
+        return true;
+    }
+    return false;
+}
+
+bool ShowSyncNode::timeline(int64_t localUs, int64_t &timelineUs) const {
+    if (role_ == SyncRole::Leader) {
+        timelineUs = localUs;
+        return true;
+    }
+    if (role_ != SyncRole::Follower || !clock_.valid()) return false;
+    timelineUs = clock_.toRemote(localUs);
+    return true;
+}
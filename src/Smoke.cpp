@@ -1,32 +1,43 @@
 #include "Smoke.h"
 
+#if BOARD_HAS_SMOKE
+
+#include "DeviceState.h"
+
 void setupSmoke() {
-    pinMode(SMOKE_1, OUTPUT);
-    pinMode(SMOKE_2, OUTPUT);
+    boardForEach<ChannelGroup::Smoke>([](const BoardChannel &c, int) { pinMode(c.pin, OUTPUT); });
     trySmoke();
     turnOffSmoke();
 }
 
+static int smokeIndex(int smokePin) {
+    return kSmokePins.indexOf(smokePin);
+}
+
 void setSmoke(int smokePin, int state) {
+    int index = smokeIndex(smokePin);
+    if (index < 0) return; // only pins the board profile declares
     digitalWrite(smokePin, state);
+    deviceStateSetSmoke(index, state != LOW);
 }
 
 bool getSmoke(int ledPin) {
-    return digitalRead(ledPin);
+    int index = smokeIndex(ledPin);
+    return index >= 0 && deviceStateSnapshot().smoke[index];
 }
 
 
 void turnOnSmoke() {
-    digitalWrite(SMOKE_1, HIGH);
-    digitalWrite(SMOKE_2, HIGH);
+    for (int i = 0; i < kSmokePins.count; i++) setSmoke(kSmokePins[i], HIGH);
 }
 
 void turnOffSmoke() {
-    digitalWrite(SMOKE_1, LOW);
-    digitalWrite(SMOKE_2, LOW);
+    for (int i = 0; i < kSmokePins.count; i++) setSmoke(kSmokePins[i], LOW);
 }
 
 void trySmoke() {
     turnOnSmoke();
     delay(1000);
-}
\ No newline at end of file
+}
+
+#endif // BOARD_HAS_SMOKE
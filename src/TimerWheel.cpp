@@ -0,0 +1,141 @@
+#include "TimerWheel.h"
+
+#include <string.h>
+
+TimerWheel::TimerWheel(uint16_t capacity, MemSubsystem subsystem)
+    : nodes(nullptr), sub(subsystem), cap(capacity < NIL ? capacity : NIL - 1), freeHead(NIL), used(0), current(0) {}
+
+TimerWheel::~TimerWheel() {
+    memFree(nodes);
+}
+
+bool TimerWheel::begin(uint32_t nowTick) {
+    if (!nodes) {
+        // Walked on every loop pass: internal RAM
+        nodes = static_cast<Node *>(memAlloc(sub, MemClass::Hot, cap * sizeof(Node)));
+        if (!nodes) return false;
+        memset(nodes, 0, cap * sizeof(Node));
+    }
+    current = nowTick;
+    used = 0;
+    for (uint16_t &head : heads) head = NIL;
+    freeHead = NIL;
+    for (int i = cap - 1; i >= 0; i--) {
+        nodes[i].list = LIST_FREE;
+        nodes[i].next = freeHead;
+        freeHead = static_cast<uint16_t>(i);
+    }
+    return true;
+}
+
+void TimerWheel::link(uint16_t index, uint16_t list) {
+    Node &n = nodes[index];
+    n.list = list;
+    n.prev = NIL;
+    n.next = heads[list];
+    if (n.next != NIL) nodes[n.next].prev = index;
+    heads[list] = index;
+}
+
+void TimerWheel::unlink(uint16_t index) {
+    Node &n = nodes[index];
+    if (n.prev != NIL) nodes[n.prev].next = n.next;
+    else heads[n.list] = n.next;
+    if (n.next != NIL) nodes[n.next].prev = n.prev;
+    n.next = n.prev = NIL;
+}
+
+// A timer lives on the lowest level whose higher digits match the current
+// tick, in the slot of its own digit at that level. The top level takes
+// everything else and is re-placed when its slot comes round.
+void TimerWheel::place(uint16_t index) {
+    uint32_t expires = nodes[index].expires;
+    if (static_cast<int32_t>(expires - current) <= 0) {
+        link(index, LIST_EXPIRED);
+        return;
+    }
+    int level = 0;
+    while (level < LEVELS - 1 && (expires >> (SLOT_BITS * (level + 1))) != (current >> (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    uint16_t slot = (expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+    link(index, static_cast<uint16_t>(level * SLOTS + slot));
+}
+
+void TimerWheel::cascade(int level) {
+    uint16_t list = static_cast<uint16_t>(level * SLOTS + ((current >> (SLOT_BITS * level)) & (SLOTS - 1)));
+    uint16_t i = heads[list];
+    heads[list] = NIL;
+    while (i != NIL) {
+        uint16_t next = nodes[i].next;
+        place(i);
+        i = next;
+    }
+}
+
+TimerWheel::Handle TimerWheel::arm(uint32_t delayTicks, Callback cb, uint32_t arg) {
+    if (!nodes || freeHead == NIL) return 0;
+    if (delayTicks == 0) delayTicks = 1;
+    if (delayTicks > MAX_DELAY) delayTicks = MAX_DELAY;
+
+    uint16_t index = freeHead;
+    Node &n = nodes[index];
+    freeHead = n.next;
+    n.expires = current + delayTicks;
+    n.cb = cb;
+    n.arg = arg;
+    place(index);
+    used++;
+    return (static_cast<uint32_t>(n.gen) << 16 | index) + 1;
+}
+
+bool TimerWheel::cancel(Handle handle) {
+    if (!nodes || handle == 0) return false;
+    uint32_t raw = handle - 1;
+    uint16_t index = raw & 0xFFFF;
+    if (index >= cap) return false;
+    Node &n = nodes[index];
+    if (n.gen != (raw >> 16) || n.list == LIST_FREE) return false;
+    unlink(index);
+    n.list = LIST_FREE;
+    n.gen++;
+    n.next = freeHead;
+    freeHead = index;
+    used--;
+    return true;
+}
+
+void TimerWheel::advance(uint32_t nowTick) {
+    if (!nodes) return;
+    while (static_cast<int32_t>(nowTick - current) > 0) {
+        current++;
+        // Cascade from the highest level whose lower digits just rolled over
+        int top = 0;
+        while (top < LEVELS - 1 && (current & ((1u << (SLOT_BITS * (top + 1))) - 1)) == 0) top++;
+        for (int level = top; level > 0; level--) cascade(level);
+
+        uint16_t list = current & (SLOTS - 1);
+        uint16_t i = heads[list];
+        heads[list] = NIL;
+        while (i != NIL) {
+            uint16_t next = nodes[i].next;
+            link(i, LIST_EXPIRED);
+            i = next;
+        }
+    }
+}
+
+bool TimerWheel::popExpired(Callback &cb, uint32_t &arg) {
+    uint16_t index = heads[LIST_EXPIRED];
+    if (index == NIL) return false;
+    Node &n = nodes[index];
+    cb = n.cb;
+    arg = n.arg;
+    unlink(index);
+    n.list = LIST_FREE;
+    n.gen++;
+    n.next = freeHead;
+    freeHead = index;
+    used--;
+    return true;
+}
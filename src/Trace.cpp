@@ -0,0 +1,294 @@
+#include "Trace.h"
+#include "Logger.h"
+#include "MemoryPolicy.h"
+
+#include <esp_ipc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <hal/cpu_hal.h>
+
+std::atomic<bool> g_traceActive{false};
+
+namespace {
+
+enum : uint8_t { KIND_EMPTY = 0, KIND_COMPLETE = 'X', KIND_INSTANT = 'i' };
+
+struct TraceEvent {
+    const char *name;
+    uint32_t start; // cycles
+    uint32_t dur;   // cycles
+    TaskHandle_t task;
+    uint32_t arg;
+    uint8_t kind; // written last, with release ordering
+};
+
+struct CoreBuffer {
+    TraceEvent *events = nullptr;
+    std::atomic<uint32_t> next{0};
+    // Cycle counters are per core and not synchronised: each core gets its own
+    // (ccount, esp_timer) pair, taken on that core when the capture starts
+    uint32_t anchorCycles = 0;
+    int64_t anchorUs = 0;
+};
+
+CoreBuffer g_cores[portNUM_PROCESSORS];
+uint32_t g_capacity = 0;
+std::atomic<uint32_t> g_dropped{0};
+std::atomic<uint32_t> g_generation{0};
+uint32_t g_windowCycles = 0;
+uint32_t g_windowMs = 0;
+int64_t g_startUs = 0;
+uint32_t g_cpuMhz = 240;
+
+// Task names, snapshotted at export time so handles of deleted tasks are
+// never dereferenced
+struct TaskName {
+    TaskHandle_t handle;
+    char name[configMAX_TASK_NAME_LEN];
+};
+TaskName g_taskNames[32];
+size_t g_taskNameCount = 0;
+
+void takeAnchor(void *arg) {
+    CoreBuffer *core = static_cast<CoreBuffer *>(arg);
+    core->anchorUs = esp_timer_get_time();
+    core->anchorCycles = cpu_hal_get_cycle_count();
+}
+
+bool allocateBuffers() {
+    if (g_capacity) return true;
+    // 24 bytes per event: full size in PSRAM, a quarter of it in internal RAM
+    uint32_t capacity = psramFound() ? TRACE_EVENTS_PER_CORE : TRACE_EVENTS_PER_CORE / 4;
+    size_t bytes = sizeof(TraceEvent) * capacity;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        void *mem = memAlloc(MEM_TRACE, MemClass::Cold, bytes);
+        if (!mem) {
+            for (int i = 0; i < c; i++) {
+                memFree(g_cores[i].events);
+                g_cores[i].events = nullptr;
+            }
+            return false;
+        }
+        g_cores[c].events = static_cast<TraceEvent *>(mem);
+    }
+    g_capacity = capacity;
+    return true;
+}
+
+inline void record(uint8_t kind, const char *name, uint32_t start, uint32_t dur, uint32_t arg) {
+    CoreBuffer &core = g_cores[xPortGetCoreID()];
+    uint32_t end = start + dur - core.anchorCycles;
+    if (end > g_windowCycles) {
+        // Past the window (or about to wrap the cycle counter): stop here
+        g_traceActive.store(false, std::memory_order_relaxed);
+        return;
+    }
+    if (start - core.anchorCycles > end) {
+        // Began before this capture was armed
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint32_t idx = core.next.fetch_add(1, std::memory_order_relaxed);
+    if (idx >= g_capacity) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TraceEvent &ev = core.events[idx];
+    ev.name = name;
+    ev.start = start;
+    ev.dur = dur;
+    ev.task = xTaskGetCurrentTaskHandle();
+    ev.arg = arg;
+    __atomic_store_n(&ev.kind, kind, __ATOMIC_RELEASE);
+}
+
+void snapshotTaskNames() {
+    g_taskNameCount = 0;
+    UBaseType_t n = uxTaskGetNumberOfTasks();
+    TaskStatus_t *status = static_cast<TaskStatus_t *>(malloc(sizeof(TaskStatus_t) * (n + 4)));
+    if (!status) return;
+    n = uxTaskGetSystemState(status, n + 4, nullptr);
+    for (UBaseType_t i = 0; i < n && g_taskNameCount < sizeof(g_taskNames) / sizeof(g_taskNames[0]); i++) {
+        TaskName &t = g_taskNames[g_taskNameCount++];
+        t.handle = status[i].xHandle;
+        strlcpy(t.name, status[i].pcTaskName, sizeof(t.name));
+    }
+    free(status);
+}
+
+const char *taskName(TaskHandle_t handle) {
+    for (size_t i = 0; i < g_taskNameCount; i++) {
+        if (g_taskNames[i].handle == handle) return g_taskNames[i].name;
+    }
+    return "exited";
+}
+
+// Microseconds since the capture started, as "<us>.<ns>"
+void formatUs(char *out, size_t len, uint64_t ns) {
+    snprintf(out, len, "%llu.%03u", static_cast<unsigned long long>(ns / 1000), static_cast<unsigned>(ns % 1000));
+}
+
+uint64_t cyclesToNs(uint32_t cycles) {
+    return static_cast<uint64_t>(cycles) * 1000 / g_cpuMhz;
+}
+
+// Format the next JSON fragment for the cursor into out; 0 when finished
+size_t nextFragment(TraceExportCursor &cur, char *out, size_t len) {
+    enum { HEADER, PROCESSES, EVENTS, FOOTER, DONE };
+    for (;;) {
+        switch (cur.phase) {
+        case HEADER:
+            cur.phase = PROCESSES;
+            return snprintf(out, len, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"cpuMhz\":%u,\"dropped\":%u},\"traceEvents\":[",
+                            static_cast<unsigned>(g_cpuMhz), static_cast<unsigned>(g_dropped.load()));
+        case PROCESSES:
+            if (cur.core < portNUM_PROCESSORS) {
+                uint8_t c = cur.core++;
+                return snprintf(out, len, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"core %u\"}}",
+                                c ? "," : "", c, c);
+            }
+            cur.phase = EVENTS;
+            cur.core = 0;
+            cur.index = 0;
+            continue;
+        case EVENTS: {
+            if (cur.core >= portNUM_PROCESSORS) {
+                cur.phase = FOOTER;
+                continue;
+            }
+            CoreBuffer &core = g_cores[cur.core];
+            uint32_t count = min(core.next.load(), g_capacity);
+            if (cur.index >= count) {
+                cur.core++;
+                cur.index = 0;
+                continue;
+            }
+            const TraceEvent &ev = core.events[cur.index++];
+            if (__atomic_load_n(&ev.kind, __ATOMIC_ACQUIRE) == KIND_EMPTY) continue;
+            // Events from a writer that raced the previous stop land before the anchor
+            uint32_t offset = ev.start - core.anchorCycles;
+            if (offset > g_windowCycles) continue;
+
+            size_t n = 0;
+            // Name each thread the first time it appears on this core
+            bool seen = false;
+            for (uint8_t i = 0; i < cur.seenCount; i++) {
+                if (cur.seen[i].task == ev.task && cur.seen[i].core == cur.core) seen = true;
+            }
+            if (!seen) {
+                if (cur.seenCount < sizeof(cur.seen) / sizeof(cur.seen[0])) {
+                    cur.seen[cur.seenCount].task = ev.task;
+                    cur.seen[cur.seenCount].core = cur.core;
+                    cur.seenCount++;
+                }
+                n += snprintf(out + n, len - n, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                              cur.core, static_cast<unsigned>(reinterpret_cast<uintptr_t>(ev.task)), taskName(ev.task));
+            }
+
+            char ts[24];
+            formatUs(ts, sizeof(ts), static_cast<uint64_t>(core.anchorUs - g_startUs) * 1000 + cyclesToNs(offset));
+            n += snprintf(out + n, len - n, ",{\"name\":\"%.64s\",\"ph\":\"%c\",\"pid\":%u,\"tid\":%u,\"ts\":%s", ev.name, ev.kind,
+                          cur.core, static_cast<unsigned>(reinterpret_cast<uintptr_t>(ev.task)), ts);
+            if (ev.kind == KIND_COMPLETE) {
+                char dur[24];
+                formatUs(dur, sizeof(dur), cyclesToNs(ev.dur));
+                n += snprintf(out + n, len - n, ",\"dur\":%s", dur);
+            } else {
+                n += snprintf(out + n, len - n, ",\"s\":\"t\"");
+            }
+            if (ev.arg) n += snprintf(out + n, len - n, ",\"args\":{\"v\":%u}", static_cast<unsigned>(ev.arg));
+            n += snprintf(out + n, len - n, "}");
+            return min(n, len - 1);
+        }
+        case FOOTER:
+            cur.phase = DONE;
+            return snprintf(out, len, "]}\n");
+        default:
+            return 0;
+        }
+    }
+}
+
+} // namespace
+
+uint32_t traceNow() {
+    return cpu_hal_get_cycle_count();
+}
+
+void traceComplete(const char *name, uint32_t startCycles, uint8_t startCore, uint32_t arg) {
+    uint32_t now = cpu_hal_get_cycle_count();
+    if (!g_traceActive.load(std::memory_order_relaxed)) return;
+    if (startCore != xPortGetCoreID()) {
+        // The task migrated: the two cycle counters are unrelated
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    record(KIND_COMPLETE, name, startCycles, now - startCycles, arg);
+}
+
+void traceInstant(const char *name, uint32_t arg) {
+    record(KIND_INSTANT, name, cpu_hal_get_cycle_count(), 0, arg);
+}
+
+bool traceStart(uint32_t windowMs) {
+    g_traceActive.store(false);
+    if (!allocateBuffers()) {
+        LOGE("Trace: no memory for event buffers");
+        return false;
+    }
+    windowMs = constrain(windowMs, 1u, static_cast<uint32_t>(TRACE_MAX_WINDOW_MS));
+    g_cpuMhz = getCpuFrequencyMhz();
+    g_windowMs = windowMs;
+    g_windowCycles = windowMs * 1000 * g_cpuMhz;
+    g_dropped.store(0);
+    g_generation.fetch_add(1);
+    g_startUs = esp_timer_get_time();
+    int self = xPortGetCoreID();
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        CoreBuffer &core = g_cores[c];
+        for (uint32_t i = 0; i < g_capacity; i++) core.events[i].kind = KIND_EMPTY;
+        core.next.store(0);
+        if (c == self) takeAnchor(&core);
+        else esp_ipc_call_blocking(c, takeAnchor, &core);
+    }
+    g_traceActive.store(true);
+    LOGI("Trace: capturing for " + String(windowMs) + " ms (" + String(g_capacity) + " events per core)");
+    return true;
+}
+
+void traceStop() {
+    g_traceActive.store(false);
+}
+
+TraceStats traceStats() {
+    TraceStats s = {};
+    s.active = g_traceActive.load();
+    for (int c = 0; c < portNUM_PROCESSORS && c < 2; c++) s.events[c] = min(g_cores[c].next.load(), g_capacity);
+    s.dropped = g_dropped.load();
+    s.windowMs = g_windowMs;
+    if (g_startUs) s.elapsedMs = min<uint32_t>((esp_timer_get_time() - g_startUs) / 1000, g_windowMs);
+    return s;
+}
+
+size_t traceExport(TraceExportCursor &cur, uint8_t *buf, size_t maxLen) {
+    if (cur.generation == 0) {
+        cur.generation = g_generation.load();
+        snapshotTaskNames();
+    } else if (cur.generation != g_generation.load()) {
+        return 0; // a new capture started underneath this download
+    }
+    size_t written = 0;
+    while (written < maxLen) {
+        if (cur.pendingPos == cur.pendingLen) {
+            cur.pendingLen = nextFragment(cur, cur.pending, sizeof(cur.pending));
+            cur.pendingPos = 0;
+            if (cur.pendingLen == 0) break;
+        }
+        size_t n = min(maxLen - written, cur.pendingLen - cur.pendingPos);
+        memcpy(buf + written, cur.pending + cur.pendingPos, n);
+        cur.pendingPos += n;
+        written += n;
+    }
+    return written;
+}
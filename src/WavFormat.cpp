@@ -0,0 +1,121 @@
+#include "WavFormat.h"
+
+#include <string.h>
+
+namespace {
+
+uint32_t le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint16_t le16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+void put32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+} // namespace
+
+bool wavParseHeader(WavSource &src, WavFormat &out) {
+    out = WavFormat();
+    uint8_t hdr[12];
+    if (src.read(hdr, 12) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) return false;
+
+    bool haveFmt = false;
+    for (;;) {
+        uint8_t chunk[8];
+        if (src.read(chunk, 8) != 8) return false;
+        uint32_t size = le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if (size < 16 || src.read(fmt, 16) != 16) return false;
+            uint16_t format = le16(fmt);
+            out.channels = le16(fmt + 2);
+            out.rate = le32(fmt + 4);
+            out.bits = le16(fmt + 14);
+            // 1 = PCM, 0xFFFE = extensible (PCM sub-format assumed)
+            if ((format != 1 && format != 0xFFFE) || out.channels < 1 || out.channels > 2 ||
+                (out.bits != 8 && out.bits != 16) || out.rate == 0) {
+                return false;
+            }
+            if (!src.skip(size - 16 + (size & 1))) return false;
+            haveFmt = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFmt) return false;
+            out.frameBytes = out.channels * out.bits / 8;
+            out.dataBytes = size;
+            return true;
+        } else if (!src.skip(size + (size & 1))) {
+            return false;
+        }
+    }
+}
+
+void wavToStereo16(const uint8_t *in, size_t frames, const WavFormat &format, int16_t *out) {
+    for (size_t i = 0; i < frames; i++) {
+        const uint8_t *p = in + i * format.frameBytes;
+        int16_t l, r;
+        if (format.bits == 16) {
+            l = static_cast<int16_t>(le16(p));
+            r = format.channels == 2 ? static_cast<int16_t>(le16(p + 2)) : l;
+        } else {
+            l = static_cast<int16_t>((p[0] - 128) * 256);
+            r = format.channels == 2 ? static_cast<int16_t>((p[1] - 128) * 256) : l;
+        }
+        out[2 * i] = l;
+        out[2 * i + 1] = r;
+    }
+}
+
+void wavHeader(uint8_t hdr[WAV_HEADER_BYTES], uint32_t rate, uint32_t frames) {
+    uint32_t dataBytes = frames * 4;
+    memcpy(hdr, "RIFF", 4);
+    put32(hdr + 4, 36 + dataBytes);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    put32(hdr + 16, 16);
+    put16(hdr + 20, 1); // PCM
+    put16(hdr + 22, 2);
+    put32(hdr + 24, rate);
+    put32(hdr + 28, rate * 4);
+    put16(hdr + 32, 4);
+    put16(hdr + 34, 16);
+    memcpy(hdr + 36, "data", 4);
+    put32(hdr + 40, dataBytes);
+}
+
+bool WavDecoder::begin(WavSource &src) {
+    src_ = &src;
+    remaining_ = 0;
+    if (!wavParseHeader(src, format_)) return false;
+    remaining_ = format_.dataBytes;
+    return true;
+}
+
+size_t WavDecoder::read(int16_t *out, size_t frames) {
+    const uint32_t frameBytes = format_.frameBytes;
+    size_t done = 0;
+    while (done < frames && remaining_ >= frameBytes) {
+        size_t want = frames - done;
+        if (want > sizeof(buf_) / frameBytes) want = sizeof(buf_) / frameBytes;
+        if (want > remaining_ / frameBytes) want = remaining_ / frameBytes;
+        size_t got = src_->read(buf_, want * frameBytes) / frameBytes;
+        if (got == 0) {
+            remaining_ = 0; // truncated file
+            break;
+        }
+        remaining_ -= got * frameBytes;
+        wavToStereo16(buf_, got, format_, out + 2 * done);
+        done += got;
+    }
+    return done;
+}
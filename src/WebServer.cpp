@@ -1,176 +1,580 @@
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <LittleFS.h>
+#include <memory>
+#include "ApiResponse.h"
 #include "Leds.h"
 #include "Smoke.h"
 #include "WebServer.h"
 #include "AudioPlayer.h"
+#include "DeviceState.h"
 #include "Logger.h"
 #include "Pwm.h"
 #include "WifiRouter.h"
+#include "Actions.h"
+#include "Scheduler.h"
+#include "ShowSync.h"
+#include "Journal.h"
+#include "CommandQueue.h"
+#include "Trace.h"
+#include "MemoryPolicy.h"
+#include "Effects.h"
+#include "EventBus.h"
+#include "Rules.h"
+#include "HandlerGuard.h"
+#include "BenchTask.h"
+#include "Files.h"
+#include "Envelope.h"
 
 AsyncWebServer server(80);
+AsyncEventSource logEvents("/api/logs/stream");
+
+// Records per /api/logs response and per SSE push
+static constexpr size_t LOG_PAGE_RECORDS = 64;
+static constexpr unsigned long LOG_PUSH_INTERVAL_MS = 250;
+static uint32_t logStreamCursor = 0;
+
+// Handlers only queue control changes (CommandQueue.h); 503 when it is full
+static const char *const kQueueFull = "Command queue full, try again";
+
+static void addLogRecord(JsonArray records, const Logger::Record &r) {
+  JsonObject o = records.createNestedObject();
+  o["seq"] = r.seq;
+  o["ts"] = r.timestamp;
+  o["level"] = Logger::instance().levelToString(r.level);
+  o["msg"] = r.message;
+}
+
+static String logEventPayload(const Logger::Record &r) {
+  StaticJsonDocument<384> doc;
+  doc["seq"] = r.seq;
+  doc["ts"] = r.timestamp;
+  doc["level"] = Logger::instance().levelToString(r.level);
+  doc["msg"] = r.message;
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+// Register a GET API route. State changes made by the handler are
+// attributed to the request in the journal (minus passwords), the handler
+// shows up in traces under the route name, and its time on the network task
+// is checked against budgetMs (HandlerGuard.h); failFast false keeps the
+// route reachable when fail-fast trips everything else.
+static void onApi(const char *uri, ArRequestHandlerFunction handler, uint32_t budgetMs = GUARD_BUDGET_MS,
+                  bool failFast = true) {
+  GuardRoute *guard = guardRegister(uri, budgetMs, failFast);
+  server.on(uri, HTTP_GET, [uri, handler, guard](AsyncWebServerRequest *req) {
+    if (!guardAdmit(guard)) {
+      sendApiError(req, 503, "Route disabled after repeated overruns (see /api/guard)");
+      return;
+    }
+    HandlerGuard timing(guard);
+    TRACE_SCOPE(uri);
+    String cause = req->url();
+    for (size_t i = 0; i < req->params(); i++) {
+      AsyncWebParameter *p = req->getParam(i);
+      if (p->name() == "pwd" || p->name() == "pass") continue;
+      cause += cause.indexOf('?') < 0 ? '?' : '&';
+      cause += p->name();
+      cause += '=';
+      cause += p->value();
+    }
+    journalSetCause(cause.c_str());
+    handler(req);
+    journalSetCause(nullptr);
+  });
+}
+
+// Shared by /api/status and the encoding benchmark
+static void buildStatusDocument(JsonDocument &json) {
+  DeviceState state = deviceStateSnapshot();
+  json["status"] = "ok";
+  json["uptime_ms"] = millis();
+  json["version"] = state.version;
+  JsonArray leds = json.createNestedArray("leds");
+  for (int i = 0; i < kLightPins.count; i++) leds.add(state.led[i] >> 8);
+#if BOARD_HAS_MILL
+  json["mill"] = state.mill;
+#endif
+  boardForEach<ChannelGroup::Smoke>([&](const BoardChannel &c, int slot) { json[c.name] = state.smoke[slot]; });
+  json["fire"] = state.fireActive;
+  json["playing"] = state.audioPlaying;
+  json["volume"] = state.volume;
+  commandQueueDescribe(json.createNestedObject("commands"));
+}
+
+static const char *contentTypeFor(const String &path) {
+  static const char *const types[][2] = {
+      {".html", "text/html"},       {".css", "text/css"},          {".js", "application/javascript"},
+      {".json", "application/json"}, {".svg", "image/svg+xml"},     {".png", "image/png"},
+      {".jpg", "image/jpeg"},       {".ico", "image/x-icon"},      {".woff2", "font/woff2"},
+      {".woff", "font/woff"},       {".txt", "text/plain"},        {".wav", "audio/wav"},
+      {".mp3", "audio/mpeg"},
+  };
+  for (const auto &t : types) {
+    if (path.endsWith(t[0])) return t[1];
+  }
+  return "application/octet-stream";
+}
+
+// Boot time as the files' Last-Modified, as serveStatic() did
+static String staticLastModified;
+
+// Static files go through fsOpen() and are read in chunks of at most the
+// mount profile's chunk size (Files.h)
+static void sendStaticFile(AsyncWebServerRequest *req, const String &path) {
+  if (req->hasHeader("If-Modified-Since") && req->header("If-Modified-Since") == staticLastModified) {
+    req->send(304);
+    return;
+  }
+  auto file = std::make_shared<File>(fsOpen(path.c_str()));
+  if (!*file || file->isDirectory()) {
+    sendApiError(req, 404, "Not found");
+    return;
+  }
+  size_t chunk = fsProfile().chunkBytes;
+  AsyncWebServerResponse *res = req->beginResponse(contentTypeFor(path), file->size(), [file, chunk](uint8_t *buf, size_t maxLen, size_t) -> size_t {
+    if (chunk && maxLen > chunk) maxLen = chunk;
+    TRACE_SCOPE_ARG("fs.read", maxLen);
+    int n = file->read(buf, maxLen);
+    return n > 0 ? n : 0;
+  });
+  res->addHeader("Cache-Control", "no-cache");
+  res->addHeader("Last-Modified", staticLastModified);
+  req->send(res);
+}
+
+void serviceWebServer() {
+  static unsigned long lastPush = 0;
+  unsigned long now = millis();
+  if (now - lastPush < LOG_PUSH_INTERVAL_MS) return;
+  lastPush = now;
+
+  if (logEvents.count() == 0) {
+    // Nobody listening: keep the cursor at the live edge
+    logStreamCursor = Logger::instance().nextSeq();
+    return;
+  }
+  std::vector<Logger::Record> records;
+  logStreamCursor = Logger::instance().readRetained(logStreamCursor, records, LOG_PAGE_RECORDS);
+  for (const Logger::Record &r : records) {
+    logEvents.send(logEventPayload(r).c_str(), "log", r.seq);
+  }
+}
+
+// Start a benchmark job and answer 202; /api/bench has the result
+static void startBench(AsyncWebServerRequest *req, const char *name, BenchJob job) {
+  if (!benchStart(name, std::move(job))) {
+    sendApiError(req, 409, "Cannot start the benchmark, is one running? (see /api/bench)");
+    return;
+  }
+  StaticJsonDocument<96> doc;
+  doc["bench"] = name;
+  doc["state"] = "running";
+  sendApiResponse(req, 202, doc);
+}
 
 void setupWebServer() {
-  // ✅ React Router fallback
+  setupHandlerGuard();
+
+  char lastModified[32];
+  time_t bootTime = time(nullptr);
+  strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&bootTime));
+  staticLastModified = lastModified;
+
+  // Static files (React build), with the React Router fallback: paths that
+  // are not files get index.html
   server.onNotFound([](AsyncWebServerRequest *request) {
     String path = request->url();
     if (!path.startsWith("/api")) {
-      // Return index.html for React routes
-      request->send(LittleFS, "/index.html", "text/html");
+      if (path.endsWith("/")) path += "index.html";
+      sendStaticFile(request, LittleFS.exists(path) ? path : String("/index.html"));
     } else {
       LOGE("("+request->url() + ") API route not found");
-      request->send(404, "application/json", R"({"error":"API route not found"})");
+      sendApiError(request, 404, "API route not found");
+    }
+  });
+
+  // Status endpoint: one coherent snapshot of every output
+  onApi("/api/status", [](AsyncWebServerRequest *req) {
+    StaticJsonDocument<512> json;
+    buildStatusDocument(json);
+    sendApiResponse(req, 200, json);
+  });
+
+  // Benchmarks run on the bench task (BenchTask.h): each route answers 202
+  // once its job is started, /api/bench reports progress and the result.
+  onApi("/api/bench", [](AsyncWebServerRequest *req) {
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    benchDescribe(doc.to<JsonObject>());
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Encoding benchmark: bytes and us per response for JSON/MessagePack/CBOR
+  // on the status document and a page of retained logs. ?n=<iterations>
+  onApi("/api/bench/encoding", [](AsyncWebServerRequest *req) {
+    int iterations = req->hasParam("n") ? constrain(req->getParam("n")->value().toInt(), 1, 5000) : 200;
+    startBench(req, "encoding", [iterations](JsonObject out) {
+      StaticJsonDocument<512> status;
+      buildStatusDocument(status);
+
+      std::vector<Logger::Record> records;
+      Logger::instance().readRetained(0, records, 16);
+      JsonDocument logs(memJsonAllocator(MEM_WEB));
+      logs["next"] = records.empty() ? 0 : records.back().seq + 1;
+      JsonArray arr = logs.createNestedArray("records");
+      for (const Logger::Record &r : records) addLogRecord(arr, r);
+
+      out["iterations"] = iterations;
+      benchmarkEncodings(status, iterations, out.createNestedObject("status"));
+      benchmarkEncodings(logs, iterations, out.createNestedObject("logs"));
+      return 200;
+    });
+  });
+
+  // Audio decode throughput (I2S backend): /api/bench/audio?path=3&seconds=5
+  // decodes without playing; &out=/render.wav also renders it to LittleFS.
+  onApi("/api/bench/audio", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("path")) {
+      sendApiError(req, 400, "Missing 'path' param");
+      return;
+    }
+    String path = req->getParam("path")->value();
+    uint32_t seconds = req->hasParam("seconds") ? constrain(req->getParam("seconds")->value().toInt(), 1, 30) : 5;
+    String out = req->hasParam("out") ? req->getParam("out")->value() : String("");
+    startBench(req, "audio", [path, seconds, out](JsonObject doc) {
+      AudioBenchResult r;
+      if (!audioBenchmark(path.c_str(), seconds, out.c_str(), r)) {
+        doc["error"] = String("Cannot decode with the ") + audioBackendName() + " backend" +
+                       (out.length() ? " or no room on LittleFS" : "");
+        return 404;
+      }
+      doc["frames"] = r.frames;
+      doc["sample_rate"] = r.sampleRate;
+      doc["decode_us"] = r.decodeUs;
+      if (r.decodeUs > 0) {
+        doc["frames_per_s"] = static_cast<uint32_t>(static_cast<uint64_t>(r.frames) * 1000000 / r.decodeUs);
+        // Seconds of audio decoded per second of CPU; must stay well above 1
+        doc["realtime_factor"] = r.sampleRate ? static_cast<double>(r.frames) / r.sampleRate / (r.decodeUs / 1e6) : 0;
+      }
+      if (out.length()) {
+        doc["out"] = out;
+        doc["sink_us"] = r.sinkUs;
+        if (r.outLimited) doc["out_limited"] = true; // stopped short of filling LittleFS
+      }
+      return 200;
+    });
+  });
+
+  // Fire model: cost per frame on this CPU and the golden-output check
+  // (same reference run as tools/firebench). ?frames=N (default 500)
+  onApi("/api/bench/fire", [](AsyncWebServerRequest *req) {
+    int frames = req->hasParam("frames") ? constrain(req->getParam("frames")->value().toInt(), 1, 5000) : FIRE_GOLDEN_FRAMES;
+    startBench(req, "fire", [frames](JsonObject doc) {
+      std::unique_ptr<FireSim> sim(new FireSim());
+      sim->begin(3);
+      sim->reset(FIRE_GOLDEN_SEED);
+      uint32_t maxUs = 0;
+      uint32_t totalUs = 0;
+      for (int i = 0; i < frames; i++) {
+        uint32_t t = micros();
+        sim->step();
+        uint32_t us = micros() - t;
+        totalUs += us;
+        maxUs = max(maxUs, us);
+      }
+      // The checksum is only comparable after exactly FIRE_GOLDEN_FRAMES
+      sim->reset(FIRE_GOLDEN_SEED);
+      for (int i = 0; i < FIRE_GOLDEN_FRAMES; i++) sim->step();
+      uint32_t checksum = sim->checksum();
+
+      doc["grid"] = String(FIRE_GRID_W) + "x" + String(FIRE_GRID_H);
+      doc["frames"] = frames;
+      doc["avg_us"] = totalUs / frames;
+      doc["max_us"] = maxUs;
+      char hex[9];
+      snprintf(hex, sizeof(hex), "%08x", static_cast<unsigned>(checksum));
+      doc["checksum"] = hex;
+      doc["golden"] = checksum == FIRE_GOLDEN_CHECKSUM;
+      return 200;
+    });
+  });
+
+  // Filesystem suite (FsBench.h) with the current mount profile. ?path=<file>
+  // reads an existing file, otherwise a scratch file of ?kb=N (default 64)
+  // is written and removed, capped at a share of the free space; ?reads=N
+  // random reads of ?size=N bytes, ?ops=N metadata operations per kind.
+  onApi("/api/bench/fs", [](AsyncWebServerRequest *req) {
+    FsBenchConfig config;
+    String path = req->hasParam("path") ? req->getParam("path")->value() : String("");
+    if (req->hasParam("kb")) config.scratchBytes = constrain(req->getParam("kb")->value().toInt(), 1, 1024) * 1024;
+    if (!path.length()) {
+      size_t total = LittleFS.totalBytes();
+      size_t used = LittleFS.usedBytes();
+      size_t cap = (total > used ? total - used : 0) / FSBENCH_SCRATCH_FREE_SHARE / 1024 * 1024;
+      if (cap == 0) {
+        sendApiError(req, 507, "Not enough free space for the scratch file");
+        return;
+      }
+      config.scratchBytes = min<size_t>(config.scratchBytes, cap);
+    }
+    if (req->hasParam("reads")) config.randomReads = constrain(req->getParam("reads")->value().toInt(), 1, 5000);
+    if (req->hasParam("size")) config.randomReadBytes = constrain(req->getParam("size")->value().toInt(), 1, 8192);
+    if (req->hasParam("ops")) config.metaOps = constrain(req->getParam("ops")->value().toInt(), 1, 200);
+    config.seed = esp_random();
+    startBench(req, "fs", [config, path](JsonObject doc) mutable {
+      if (path.length()) config.path = path.c_str();
+      fsBenchmark(config, doc);
+      return doc["ok"].as<bool>() ? 200 : 500;
+    });
+  });
+
+  // Effect VM cost per frame against the frame budget, for every stored
+  // effect or ?name=<effect>; ?frames=N (default 50)
+  onApi("/api/bench/effects", [](AsyncWebServerRequest *req) {
+    uint32_t frames = req->hasParam("frames") ? constrain(req->getParam("frames")->value().toInt(), 1, 500) : 50;
+    String name = req->hasParam("name") ? req->getParam("name")->value() : String("");
+    startBench(req, "effects", [name, frames](JsonObject doc) {
+      effectsBenchmark(name, frames, doc);
+      return 200;
+    });
+  });
+
+  // User light effects (registered before /api/effects)
+  //   /api/effects/save?name=lantern&src=<url-encoded source>  compile and store
+  //   /api/effects/run?name=lantern   /api/effects/stop   /api/effects/remove?name=..
+  onApi("/api/effects/save", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("name") || !req->hasParam("src")) {
+      sendApiError(req, 400, "Missing 'name' or 'src' param");
+      return;
+    }
+    String error;
+    uint32_t ops = 0;
+    if (!effectSave(req->getParam("name")->value(), req->getParam("src")->value(), error, &ops)) {
+      sendApiError(req, 400, error.c_str());
+      return;
+    }
+    StaticJsonDocument<96> doc;
+    doc["saved"] = req->getParam("name")->value();
+    doc["ops_per_frame"] = ops;
+    sendApiResponse(req, 200, doc);
+  });
+
+  onApi("/api/effects/run", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("name")) {
+      sendApiError(req, 400, "Missing 'name' param");
+      return;
+    }
+    String error;
+    if (!effectRun(req->getParam("name")->value(), error)) {
+      sendApiError(req, 400, error.c_str());
+      return;
+    }
+    StaticJsonDocument<96> doc;
+    doc["running"] = req->getParam("name")->value();
+    sendApiResponse(req, 200, doc);
+  });
+
+  onApi("/api/effects/stop", [](AsyncWebServerRequest *req) {
+    effectStop();
+    StaticJsonDocument<32> doc;
+    doc["stopped"] = true;
+    sendApiResponse(req, 200, doc);
+  });
+
+  onApi("/api/effects/remove", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("name")) {
+      sendApiError(req, 400, "Missing 'name' param");
+      return;
+    }
+    bool ok = effectRemove(req->getParam("name")->value());
+    StaticJsonDocument<32> doc;
+    doc["removed"] = ok;
+    sendApiResponse(req, ok ? 200 : 404, doc);
+  });
+
+  onApi("/api/effects", [](AsyncWebServerRequest *req) {
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    effectsDescribe(doc.to<JsonObject>());
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Live log tail over server-sent events; reconnecting clients resume from
+  // Last-Event-ID. Registered before /api/logs, whose handler also matches /api/logs/*
+  logEvents.onConnect([](AsyncEventSourceClient *client) {
+    if (client->lastId() == 0) return;
+    std::vector<Logger::Record> records;
+    Logger::instance().readRetained(client->lastId() + 1, records, LOG_PAGE_RECORDS);
+    for (const Logger::Record &r : records) {
+      client->send(logEventPayload(r).c_str(), "log", r.seq);
     }
   });
+  server.addHandler(&logEvents);
+
+  // Retained logs: /api/logs?since=<seq>[&limit=N]; pass back `next` as `since`
+  onApi("/api/logs", [](AsyncWebServerRequest *req) {
+    uint32_t since = req->hasParam("since") ? strtoul(req->getParam("since")->value().c_str(), nullptr, 10) : 0;
+    size_t limit = LOG_PAGE_RECORDS;
+    if (req->hasParam("limit")) limit = constrain(req->getParam("limit")->value().toInt(), 1, (long)LOG_PAGE_RECORDS);
 
-  // Status endpoint
-  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *req) {
-    StaticJsonDocument<200> json;
-    json["status"] = "ok";
-    json["uptime_ms"] = millis();
+    std::vector<Logger::Record> records;
+    uint32_t dropped = 0;
+    uint32_t next = Logger::instance().readRetained(since, records, limit, &dropped);
 
-    String out;
-    serializeJson(json, out);
-    req->send(200, "application/json", out);
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    doc["next"] = next;
+    doc["dropped"] = dropped;
+    doc["more"] = next != Logger::instance().nextSeq();
+    JsonArray arr = doc.createNestedArray("records");
+    for (const Logger::Record &r : records) addLogRecord(arr, r);
+    sendApiResponse(req, 200, doc);
   });
 
   // LED control
-  server.on("/api/led", HTTP_GET, [](AsyncWebServerRequest *req) {
+  onApi("/api/led", [](AsyncWebServerRequest *req) {
     if (!req->hasParam("color") || !req->hasParam("state")) {
-      req->send(400, "application/json", R"({"error":"Missing 'color' or 'state' param"})");
+      sendApiError(req, 400, "Missing 'color' or 'state' param");
       return;
     }
 
     String color = req->getParam("color")->value();
     String state = req->getParam("state")->value();
-    int brightness = req->hasParam("brightness") ? req->getParam("brightness")->value().toInt() : 255;
-    brightness = constrain(brightness, 0, 255);
-
-    int pin = -1;
-    if (color == "red") pin = LED_ONE;
-    else if (color == "yellow") pin = LED_TWO;
-    else if (color == "green") pin = LED_THREE;
-
-    if (pin == -1) {
-      req->send(400, "application/json", R"({"error":"Unknown color"})");
+    const BoardChannel *light = boardChannel(color, ChannelGroup::Lights);
+    if (!light) {
+      sendApiError(req, 400, "Unknown color");
       return;
     }
+    int channel = CMD_LED0 + boardSlot(*light);
+    int brightness = req->hasParam("brightness") ? req->getParam("brightness")->value().toInt() : light->max;
+    brightness = constrain(brightness, light->min, light->max);
 
+    // Slider updates are coalesced per LED and applied by the loop task
     if (state == "on") {
       // Only set the requested LED, do not turn off others
-      analogWrite(pin, brightness);
+      commandSet(static_cast<CommandChannel>(channel), brightness);
     } else if (state == "off") {
-      analogWrite(pin, 0);
+      commandSet(static_cast<CommandChannel>(channel), 0);
     } else {
-      req->send(400, "application/json", R"({"error":"Unknown state"})");
+      sendApiError(req, 400, "Unknown state");
       return;
     }
 
-    String resp = "{\"color\":\"" + color + "\",\"state\":\"" + state + "\",\"brightness\":" + String(brightness) + "}";
-    req->send(200, "application/json", resp);
+    StaticJsonDocument<128> doc;
+    doc["color"] = color;
+    doc["state"] = state;
+    doc["brightness"] = brightness;
+    sendApiResponse(req, 200, doc);
   });
 
+#if BOARD_HAS_MILL
   // Mill (PWM) control - read or set mill power
-  server.on("/api/mill", HTTP_GET, [](AsyncWebServerRequest *req) {
+  onApi("/api/mill", [](AsyncWebServerRequest *req) {
     StaticJsonDocument<192> doc;
 
     // If `power` param present, attempt to set PWM. For safety require `pwd` query param.
     if (req->hasParam("power")) {
       if (!req->hasParam("pwd")) {
         doc["error"] = "Missing 'pwd' parameter";
-        String out;
-        serializeJson(doc, out);
-        req->send(401, "application/json", out);
+        sendApiResponse(req, 401, doc);
         return;
       }
 
       String pwd = req->getParam("pwd")->value();
       if (pwd != String(WIFI_PASSWORD)) {
         doc["error"] = "Unauthorized";
-        String out;
-        serializeJson(doc, out);
-        req->send(401, "application/json", out);
+        sendApiResponse(req, 401, doc);
         return;
       }
 
       int power = req->getParam("power")->value().toInt();
       power = constrain(power, 0, 255);
-      setPwm(power);
+      commandSet(CMD_MILL, power);
       doc["set"] = true;
-      doc["power"] = getPwm();
+      doc["power"] = power;
 
-      String out;
-      serializeJson(doc, out);
-      req->send(200, "application/json", out);
+      sendApiResponse(req, 200, doc);
       return;
     }
 
     // No power param: return current status
     doc["power"] = getPwm();
-    String out;
-    serializeJson(doc, out);
-    req->send(200, "application/json", out);
+    sendApiResponse(req, 200, doc);
   });
+#endif
 
   // Boost / fire-effect control endpoint
-  server.on("/api/boost", HTTP_GET, [](AsyncWebServerRequest *req) {
-    StaticJsonDocument<256> doc;
+  onApi("/api/boost", [](AsyncWebServerRequest *req) {
+    StaticJsonDocument<512> doc;
 
     // Supported query forms:
     //  - /api/boost?action=start
     //  - /api/boost?action=stop
     //  - /api/boost?start=true
     //  - /api/boost?stop=true
+    //  - /api/boost?cooling=55&sparking=120[&zone=n]  -> tune one zone or all
     //  - /api/boost  -> returns status
 
     bool handled = false;
+    bool active = isFireEffectActive();
+    int request = -1; // 1 start, 0 stop
     if (req->hasParam("action")) {
       String action = req->getParam("action")->value();
-      if (action == "start") {
-        startFireEffect();
-        doc["action"] = "start";
-        handled = true;
-      } else if (action == "stop") {
-        stopFireEffect();
-        doc["action"] = "stop";
-        handled = true;
-      }
+      if (action == "start") request = 1;
+      else if (action == "stop") request = 0;
     }
-
-    if (!handled) {
-      if (req->hasParam("start")) {
-        String v = req->getParam("start")->value();
-        if (v == "1" || v.equalsIgnoreCase("true")) {
-          startFireEffect();
-          doc["action"] = "start";
-          handled = true;
-        }
+    if (request < 0 && req->hasParam("start")) {
+      String v = req->getParam("start")->value();
+      if (v == "1" || v.equalsIgnoreCase("true")) request = 1;
+    }
+    if (request < 0 && req->hasParam("stop")) {
+      String v = req->getParam("stop")->value();
+      if (v == "1" || v.equalsIgnoreCase("true")) request = 0;
+    }
+    if (request >= 0) {
+      if (!commandPost(request ? CommandType::FireStart : CommandType::FireStop)) {
+        sendApiError(req, 503, kQueueFull);
+        return;
       }
+      active = request;
+      doc["action"] = request ? "start" : "stop";
+      handled = true;
     }
 
-    if (!handled) {
-      if (req->hasParam("stop")) {
-        String v = req->getParam("stop")->value();
-        if (v == "1" || v.equalsIgnoreCase("true")) {
-          stopFireEffect();
-          doc["action"] = "stop";
-          handled = true;
-        }
+    if (req->hasParam("cooling") || req->hasParam("sparking")) {
+      int only = req->hasParam("zone") ? req->getParam("zone")->value().toInt() : -1;
+      if (only >= fireZoneCount()) {
+        sendApiError(req, 400, "Unknown zone");
+        return;
+      }
+      for (int z = 0; z < fireZoneCount(); z++) {
+        if (only >= 0 && z != only) continue;
+        FireZone p = getFireZone(z);
+        if (req->hasParam("cooling")) p.cooling = constrain(req->getParam("cooling")->value().toInt(), 0, 255);
+        if (req->hasParam("sparking")) p.sparking = constrain(req->getParam("sparking")->value().toInt(), 0, 255);
+        setFireZone(z, p.cooling, p.sparking);
       }
+      handled = true;
+    }
+    JsonArray zones = doc.createNestedArray("zones");
+    for (int z = 0; z < fireZoneCount(); z++) {
+      FireZone p = getFireZone(z);
+      JsonObject o = zones.createNestedObject();
+      o["cooling"] = p.cooling;
+      o["sparking"] = p.sparking;
     }
 
-    // If not a state-changing request, just return current status
-    doc["active"] = isFireEffectActive();
+    // If not a state-changing request, just return current status. A queued
+    // start/stop reports the state it will have on the next frame.
+    doc["active"] = active;
     doc["message"] = handled ? "Action applied" : "No action; returning status";
 
-    String out;
-    serializeJson(doc, out);
-    req->send(handled ? 200 : 200, "application/json", out);
+    sendApiResponse(req, 200, doc);
   });
 
+#if BOARD_HAS_SMOKE
   // Smoke control
-  server.on("/api/smoke", HTTP_GET, [](AsyncWebServerRequest *req) {
+  onApi("/api/smoke", [](AsyncWebServerRequest *req) {
     StaticJsonDocument<256> doc;
 
     // If `action` param present, perform a command
@@ -178,142 +582,443 @@ void setupWebServer() {
       String action = req->getParam("action")->value();
 
       if (action == "try") {
-        trySmoke();
+        // A one-second puff, timed by the scheduler rather than a delay() here
+        if (!commandPostAction("smoke:puff:1000")) {
+          sendApiError(req, 503, kQueueFull);
+          return;
+        }
         doc["action"] = "try";
-        doc["message"] = "Performed smoke test";
+        doc["message"] = "Smoke test queued";
 
       } else if (action == "on") {
-        turnOnSmoke();
+        if (!commandPost(CommandType::SmokeOn)) {
+          sendApiError(req, 503, kQueueFull);
+          return;
+        }
         doc["action"] = "on";
         doc["message"] = "Smoke output(s) turned on";
 
       } else if (action == "off") {
-        turnOffSmoke();
+        if (!commandPost(CommandType::SmokeOff)) {
+          sendApiError(req, 503, kQueueFull);
+          return;
+        }
         doc["action"] = "off";
         doc["message"] = "Smoke output(s) turned off";
 
       } else if (action == "set") {
-        // set expects led (1|2 or pin) and brightness (0..255)
+        // set expects led (1-based output number or channel name) and brightness (0..255)
         if (!req->hasParam("led") || !req->hasParam("brightness")) {
           doc["error"] = "Missing 'led' or 'brightness' parameter for action=set";
-          String out;
-          serializeJson(doc, out);
-          req->send(400, "application/json", out);
+          sendApiResponse(req, 400, doc);
           return;
         }
 
-        int ledVal = req->getParam("led")->value().toInt();
+        // Only outputs the board profile declares; never a raw pin number
+        String led = req->getParam("led")->value();
+        const BoardChannel *smoke = boardChannel(led, ChannelGroup::Smoke);
+        int slot = smoke ? boardSlot(*smoke) : led.toInt() - 1;
+        if (slot < 0 || slot >= kSmokePins.count) {
+          doc["error"] = "Unknown smoke output; this board has " + String(kSmokePins.count);
+          sendApiResponse(req, 400, doc);
+          return;
+        }
+        smoke = &kBoardChannels[boardFind(ChannelGroup::Smoke, slot)];
         int brightness = req->getParam("brightness")->value().toInt();
-        brightness = constrain(brightness, 0, 255);
-
-        int pin = -1;
-        if (ledVal == 1) pin = SMOKE_1;
-        else if (ledVal == 2) pin = SMOKE_2;
-        else pin = ledVal; // allow direct pin numbers if user passes them
+        brightness = constrain(brightness, smoke->min, smoke->max);
 
-        setSmoke(pin, brightness);
+        commandSet(static_cast<CommandChannel>(CMD_SMOKE0 + slot), brightness);
         doc["action"] = "set";
-        doc["led"] = ledVal;
+        doc["led"] = slot + 1;
         doc["brightness"] = brightness;
         doc["message"] = "Smoke output set";
 
       } else {
         doc["error"] = "Unknown action; allowed: try,on,off,set";
-        String out;
-        serializeJson(doc, out);
-        req->send(400, "application/json", out);
+        sendApiResponse(req, 400, doc);
+        return;
+      }
+    }
+
+    // Always include current status of every smoke output
+    DeviceState state = deviceStateSnapshot();
+    boardForEach<ChannelGroup::Smoke>([&](const BoardChannel &c, int slot) { doc[c.name] = state.smoke[slot]; });
+
+    sendApiResponse(req, 200, doc);
+  });
+#endif
+
+  // === Clock, scheduler and actions ===
+
+  // Time sync from the browser: /api/time?epoch=<unix s>&tz=<minutes east of UTC>
+  onApi("/api/time", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("epoch")) {
+      time_t epoch = strtoul(req->getParam("epoch")->value().c_str(), nullptr, 10);
+      int tz = req->hasParam("tz") ? req->getParam("tz")->value().toInt() : 0;
+      if (epoch < 1600000000) {
+        sendApiError(req, 400, "epoch must be a unix timestamp in seconds");
+        return;
+      }
+      schedulerSetTime(epoch, tz);
+    }
+    StaticJsonDocument<128> doc;
+    doc["synced"] = schedulerTimeSynced();
+    doc["time"] = static_cast<long>(time(nullptr));
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Add a rule: /api/schedule/add?kind=daily&at=21:00&action=scene:night
+  //   kind: once (at=epoch), daily (at=HH:MM[:SS]), hourly (at=MM[:SS]), interval (at=seconds)
+  onApi("/api/schedule/add", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("kind") || !req->hasParam("at") || !req->hasParam("action")) {
+      sendApiError(req, 400, "Missing 'kind', 'at' or 'action' param");
+      return;
+    }
+    RuleKind kind;
+    uint32_t at = 0;
+    if (!schedulerParseKind(req->getParam("kind")->value(), kind)) {
+      sendApiError(req, 400, "Unknown kind; allowed: once,daily,hourly,interval");
+      return;
+    }
+    if (!schedulerParseAt(kind, req->getParam("at")->value(), at)) {
+      sendApiError(req, 400, "Invalid 'at' for this kind");
+      return;
+    }
+    int id = schedulerAddRule(kind, at, req->getParam("action")->value());
+    if (id < 0) {
+      sendApiError(req, 507, "Rule table full");
+      return;
+    }
+    StaticJsonDocument<64> doc;
+    doc["id"] = id;
+    sendApiResponse(req, 200, doc);
+  });
+
+  onApi("/api/schedule/remove", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("id")) {
+      sendApiError(req, 400, "Missing 'id' param");
+      return;
+    }
+    bool ok = schedulerRemoveRule(req->getParam("id")->value().toInt());
+    StaticJsonDocument<64> doc;
+    doc["removed"] = ok;
+    sendApiResponse(req, ok ? 200 : 404, doc);
+  });
+
+  // Rules, next run times and timer usage (registered after /api/schedule/*)
+  onApi("/api/schedule", [](AsyncWebServerRequest *req) {
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    schedulerDescribe(doc);
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Run an action spec on the next loop pass: /api/action?run=scene:bell
+  onApi("/api/action", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("run")) {
+      sendApiError(req, 400, "Missing 'run' param");
+      return;
+    }
+    // Actions touch outputs and the DFPlayer: run them on the loop task
+    String spec = req->getParam("run")->value();
+    if (spec.length() >= COMMAND_ACTION_LEN) {
+      sendApiError(req, 400, "Action too long");
+      return;
+    }
+    if (!commandPostAction(spec.c_str())) {
+      sendApiError(req, 503, kQueueFull);
+      return;
+    }
+    StaticJsonDocument<64> doc;
+    doc["queued"] = true;
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Journal status; ?flush=1 writes buffered records now. The files themselves
+  // are served as /journal.bin and /journal.1.bin by the static handler.
+  onApi("/api/journal", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("flush")) journalFlush();
+    StaticJsonDocument<192> doc;
+    File current = LittleFS.open(JOURNAL_FILE, "r");
+    File rotated = LittleFS.open(JOURNAL_ROTATED_FILE, "r");
+    doc["bytes"] = current ? current.size() : 0;
+    doc["rotated_bytes"] = rotated ? rotated.size() : 0;
+    doc["max_bytes"] = JOURNAL_MAX_BYTES;
+    doc["dropped"] = journalDroppedRecords();
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Event tracing. ?start=<ms> arms a capture, ?status=1 reports progress,
+  // no parameters stops it and downloads Chrome trace JSON (load it in
+  // ui.perfetto.dev or chrome://tracing).
+  onApi("/api/trace", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("start") || req->hasParam("status")) {
+      if (req->hasParam("start") && !traceStart(req->getParam("start")->value().toInt())) {
+        sendApiError(req, 500, "No memory for trace buffers");
         return;
       }
+      TraceStats s = traceStats();
+      StaticJsonDocument<192> doc;
+      doc["active"] = s.active;
+      doc["window_ms"] = s.windowMs;
+      doc["elapsed_ms"] = s.elapsedMs;
+      JsonArray events = doc.createNestedArray("events");
+      events.add(s.events[0]);
+      events.add(s.events[1]);
+      doc["dropped"] = s.dropped;
+      sendApiResponse(req, 200, doc);
+      return;
     }
+    traceStop();
+    auto cursor = std::make_shared<TraceExportCursor>();
+    AsyncWebServerResponse *res = req->beginChunkedResponse("application/json", [cursor](uint8_t *buf, size_t maxLen, size_t) {
+      return traceExport(*cursor, buf, maxLen);
+    });
+    res->addHeader("Content-Disposition", "attachment; filename=\"trace.json\"");
+    req->send(res);
+  });
 
-    // Always include current status of both smoke outputs
-    doc["smoke1"] = getSmoke(SMOKE_1);
-    doc["smoke2"] = getSmoke(SMOKE_2);
+  // Memory map: internal/PSRAM heap totals and bytes per subsystem
+  onApi("/api/memory", [](AsyncWebServerRequest *req) {
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    memDescribe(doc.to<JsonObject>());
+    sendApiResponse(req, 200, doc);
+  });
 
-    String out;
-    serializeJson(doc, out);
-    req->send(200, "application/json", out);
+  // Event bus counters and the rules bound to events. ?reload=1 re-reads
+  // /rules.json (applied by the loop before the next event)
+  onApi("/api/rules", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("reload")) rulesReload();
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    JsonObject root = doc.to<JsonObject>();
+    eventBusDescribe(root.createNestedObject("bus"));
+    rulesDescribe(root);
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Handler time budgets: per-route counters and the last offenders with
+  // backtraces. ?failfast=1|0 rejects routes that keep overrunning,
+  // ?reset=1 clears counters and re-admits tripped routes.
+  onApi("/api/guard", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("failfast")) guardSetFailFast(req->getParam("failfast")->value().toInt() != 0);
+    if (req->hasParam("reset")) guardReset();
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    guardDescribe(doc.to<JsonObject>());
+    sendApiResponse(req, 200, doc);
+  }, GUARD_BUDGET_MS, false);
+
+  // Filesystem usage and mount profile. ?max_open_files=&read_ahead=&chunk=
+  // change and save it (max_open_files from the next boot).
+  onApi("/api/fs", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("max_open_files") || req->hasParam("read_ahead") || req->hasParam("chunk")) {
+      FsProfile p = fsProfile();
+      if (req->hasParam("max_open_files")) p.maxOpenFiles = constrain(req->getParam("max_open_files")->value().toInt(), 0, 255);
+      if (req->hasParam("read_ahead")) p.readAheadBytes = constrain(req->getParam("read_ahead")->value().toInt(), 0, 65535);
+      if (req->hasParam("chunk")) p.chunkBytes = constrain(req->getParam("chunk")->value().toInt(), 0, 65535);
+      String error;
+      if (!fsSetProfile(p, error)) {
+        sendApiError(req, 400, error.c_str());
+        return;
+      }
+    }
+    StaticJsonDocument<384> doc;
+    fsDescribe(doc.to<JsonObject>());
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Soundtrack envelope: playback position, outputs and counters.
+  // ?fire_depth=&mill_depth=(0-100 %)&smoke_beat=(0-255, 0 off)
+  // &smoke_puff_ms=&smoke_cooldown_ms=&latency_ms= change and save the config.
+  onApi("/api/envelope", [](AsyncWebServerRequest *req) {
+    static const char *const keys[] = {"fire_depth", "mill_depth", "smoke_beat", "smoke_puff_ms", "smoke_cooldown_ms", "latency_ms"};
+    bool change = false;
+    for (const char *key : keys) change |= req->hasParam(key);
+    if (change) {
+      EnvelopeConfig c = envelopeConfig();
+      auto param = [req](const char *key, long fallback, long lo, long hi) {
+        return req->hasParam(key) ? constrain(req->getParam(key)->value().toInt(), lo, hi) : fallback;
+      };
+      c.fireDepth = param("fire_depth", c.fireDepth, 0, 255);
+      c.millDepth = param("mill_depth", c.millDepth, 0, 255);
+      c.smokeBeat = param("smoke_beat", c.smokeBeat, 0, 255);
+      c.smokePuffMs = param("smoke_puff_ms", c.smokePuffMs, 0, 65535);
+      c.smokeCooldownMs = param("smoke_cooldown_ms", c.smokeCooldownMs, 0, 65535);
+      c.latencyMs = param("latency_ms", c.latencyMs, -32768, 32767);
+      String error;
+      if (!envelopeSetConfig(c, error)) {
+        sendApiError(req, 400, error.c_str());
+        return;
+      }
+    }
+    StaticJsonDocument<512> doc;
+    envelopeDescribe(doc.to<JsonObject>());
+    sendApiResponse(req, 200, doc);
+  });
+
+  // Board profile: channel table and which subsystems are compiled in
+  onApi("/api/board", [](AsyncWebServerRequest *req) {
+    StaticJsonDocument<1024> doc;
+    boardDescribe(doc.to<JsonObject>());
+    sendApiResponse(req, 200, doc);
+  });
+
+  // WiFi diagnostics: AP clients with RSSI/phy, STA state machine.
+  // ?ssid=..&pass=..&pwd=.. sets the upstream network (empty ssid disables it).
+  onApi("/api/wifi", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("ssid")) {
+      if (!req->hasParam("pwd") || req->getParam("pwd")->value() != String(WIFI_PASSWORD)) {
+        sendApiError(req, 401, "Unauthorized");
+        return;
+      }
+      String pass = req->hasParam("pass") ? req->getParam("pass")->value() : String("");
+      if (!wifiSetStation(req->getParam("ssid")->value(), pass)) {
+        sendApiError(req, 400, "ssid or pass too long");
+        return;
+      }
+    }
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    wifiDescribe(doc);
+    sendApiResponse(req, 200, doc);
+  });
+
+  // === Multi-diorama show sync ===
+
+  // Leader only: /api/sync/cue?action=scene:bell&delay=500 runs on every node in sync
+  onApi("/api/sync/cue", [](AsyncWebServerRequest *req) {
+    if (!req->hasParam("action")) {
+      sendApiError(req, 400, "Missing 'action' param");
+      return;
+    }
+    uint32_t delayMs = req->hasParam("delay") ? req->getParam("delay")->value().toInt() : 500;
+    bool ok = showSyncCue(req->getParam("action")->value(), delayMs);
+    StaticJsonDocument<64> doc;
+    doc["cued"] = ok;
+    sendApiResponse(req, ok ? 200 : 409, doc);
+  });
+
+  // Sync status; ?role=leader|follower|off to change role (persisted)
+  onApi("/api/sync", [](AsyncWebServerRequest *req) {
+    if (req->hasParam("role")) {
+      SyncRole role;
+      if (!showSyncParseRole(req->getParam("role")->value(), role)) {
+        sendApiError(req, 400, "Unknown role; allowed: leader,follower,off");
+        return;
+      }
+      showSyncSetRole(role);
+    }
+    StaticJsonDocument<384> doc;
+    showSyncDescribe(doc);
+    sendApiResponse(req, 200, doc);
   });
 
   // === DFPlayer-backed Audio endpoints ===
 
   // List files on SD - not supported by DFPlayer over UART
-  server.on("/api/sd/list", HTTP_GET, [](AsyncWebServerRequest *req) {
-    StaticJsonDocument<256> doc;
-    doc["error"] = "Listing files is not available when using DFPlayer Mini over UART. Use numeric track indices with /api/sd/play?path=/001.mp3 or /api/sd/play?path=1";
-    String out;
-    serializeJson(doc, out);
-    req->send(200, "application/json", out);
+  onApi("/api/sd/list", [](AsyncWebServerRequest *req) {
+    std::vector<String> files;
+    if (!audioListFiles(files)) {
+      StaticJsonDocument<256> doc;
+      doc["error"] = "Listing files is not available when using DFPlayer Mini over UART. Use numeric track indices with /api/sd/play?path=/001.mp3 or /api/sd/play?path=1";
+      sendApiResponse(req, 200, doc);
+      return;
+    }
+    JsonDocument doc(memJsonAllocator(MEM_WEB));
+    doc["backend"] = audioBackendName();
+    JsonArray arr = doc.createNestedArray("files");
+    for (size_t i = 0; i < files.size(); i++) {
+      JsonObject f = arr.createNestedObject();
+      f["track"] = i + 1; // usable as /api/sd/play?path=<track>
+      f["path"] = files[i];
+    }
+    sendApiResponse(req, 200, doc);
   });
 
   // Play file (path param required) - DFPlayer expects numeric track index or filename starting with number
-  server.on("/api/sd/play", HTTP_GET, [](AsyncWebServerRequest *req) {
+  onApi("/api/sd/play", [](AsyncWebServerRequest *req) {
     if (!req->hasParam("path")) {
-      req->send(400, "application/json", R"({"error":"Missing 'path' param"})");
+      sendApiError(req, 400, "Missing 'path' param");
       return;
     }
     String path = req->getParam("path")->value();
-    bool ok = playFile(path.c_str());
-    if (!ok) {
-      req->send(500, "application/json", R"({"error":"Failed to start playback; use numeric index like /api/sd/play?path=/001.mp3 or /api/sd/play?path=1"})");
+    int index = audioTrackIndex(path.c_str());
+    if (index <= 0 || !commandPost(CommandType::Play, index)) {
+      sendApiError(req, index <= 0 ? 400 : 503, "Failed to start playback; use numeric index like /api/sd/play?path=/001.mp3 or /api/sd/play?path=1");
       return;
     }
-    String resp = "{\"playing\":true,\"path\":\"" + path + "\"}";
-    req->send(200, "application/json", resp);
+    StaticJsonDocument<128> doc;
+    doc["playing"] = true;
+    doc["path"] = path;
+    sendApiResponse(req, 200, doc);
   });
 
   // Stop playback
-  server.on("/api/sd/stop", HTTP_GET, [](AsyncWebServerRequest *req) {
-    stopPlayback();
-    req->send(200, "application/json", R"({"playing":false})");
+  onApi("/api/sd/stop", [](AsyncWebServerRequest *req) {
+    if (!commandPost(CommandType::Stop)) {
+      sendApiError(req, 503, kQueueFull);
+      return;
+    }
+    StaticJsonDocument<32> doc;
+    doc["playing"] = false;
+    sendApiResponse(req, 200, doc);
   });
 
   // Playback status
-  server.on("/api/sd/status", HTTP_GET, [](AsyncWebServerRequest *req) {
-    StaticJsonDocument<128> doc;
-    doc["playing"] = isPlaying();
-    String out;
-    serializeJson(doc, out);
-    req->send(200, "application/json", out);
+  onApi("/api/sd/status", [](AsyncWebServerRequest *req) {
+    StaticJsonDocument<384> doc;
+    AudioStatus s;
+    bool detailed = audioGetStatus(s);
+    doc["playing"] = s.playing;
+    doc["backend"] = audioBackendName();
+    if (detailed) {
+      if (s.playing) {
+        doc["path"] = s.path;
+        doc["position_frames"] = s.positionFrames;
+        if (s.sampleRate) doc["position_ms"] = s.positionFrames * 1000 / s.sampleRate;
+        if (s.lengthFrames && s.sampleRate) doc["length_ms"] = s.lengthFrames * 1000 / s.sampleRate;
+      }
+      doc["sample_rate"] = s.sampleRate;
+      doc["channels"] = s.channels;
+      doc["underruns"] = s.underruns;
+      doc["decode_errors"] = s.decodeErrors;
+    }
+    sendApiResponse(req, 200, doc);
   });
 
   // Volume control: GET to read, pass ?level=N to set (0..30)
-  server.on("/api/sd/volume", HTTP_GET, [](AsyncWebServerRequest *req) {
+  onApi("/api/sd/volume", [](AsyncWebServerRequest *req) {
     if (req->hasParam("level")) {
       int level = req->getParam("level")->value().toInt();
       if (level < 0 || level > 30) {
-        req->send(400, "application/json", R"({"error":"level must be between 0 and 30"})");
+        sendApiError(req, 400, "level must be between 0 and 30");
         return;
       }
-      bool ok = audioSetVolume(level);
+      // Coalesced and rate-limited before it reaches the DFPlayer UART
+      commandSet(CMD_VOLUME, level);
       DynamicJsonDocument doc(128);
-      doc["set"] = ok;
-      doc["volume"] = audioGetVolume();
-      String out;
-      serializeJson(doc, out);
-      req->send(ok ? 200 : 500, "application/json", out);
+      doc["set"] = true;
+      doc["volume"] = level;
+      sendApiResponse(req, 200, doc);
     } else {
       DynamicJsonDocument doc(128);
       doc["volume"] = audioGetVolume();
-      String out;
-      serializeJson(doc, out);
-      req->send(200, "application/json", out);
+      sendApiResponse(req, 200, doc);
     }
   });
 
-  // Reinitialize DFPlayer (attempt retries) and return success
-  server.on("/api/sd/reinit", HTTP_GET, [](AsyncWebServerRequest *req) {
-    bool ok = audioReinit();
-    DynamicJsonDocument doc(256);
-    doc["reinit"] = ok;
-    doc["info"] = audioGetInfo();
-    String out;
-    serializeJson(doc, out);
-    req->send(ok ? 200 : 500, "application/json", out);
+  // Reinitialize the audio backend on the next loop pass (the DFPlayer probe
+  // takes seconds); the outcome shows up in /api/sd/info
+  onApi("/api/sd/reinit", [](AsyncWebServerRequest *req) {
+    if (!commandPost(CommandType::Reinit)) {
+      sendApiError(req, 503, kQueueFull);
+      return;
+    }
+    StaticJsonDocument<48> doc;
+    doc["queued"] = true;
+    doc["reinit"] = "queued"; // the bundled UI only checks that this is set
+    sendApiResponse(req, 202, doc);
   });
 
   // Return DFPlayer diagnostic info (last init messages)
-  server.on("/api/sd/info", HTTP_GET, [](AsyncWebServerRequest *req) {
+  onApi("/api/sd/info", [](AsyncWebServerRequest *req) {
     String info = audioGetInfo();
     if (info.length() == 0) {
       req->send(200, "text/plain", "No DFPlayer diagnostic info available");
@@ -322,12 +1027,10 @@ void setupWebServer() {
     }
   });
 
-  // Mount static files (React build) after API routes so /api/* isn't intercepted
-  server.serveStatic("/", LittleFS, "/")
-      .setDefaultFile("index.html")
-      .setCacheControl("no-cache")
-      .setLastModified(time(nullptr))
-      .setAuthentication("", ""); // no gzip
+  // The STA credentials live on LittleFS; keep them out of the static handler
+  server.on(WIFI_CONFIG_FILE, HTTP_ANY, [](AsyncWebServerRequest *req) {
+    sendApiError(req, 404, "Not found");
+  });
 
   server.begin();
   Serial.println("[OK] AsyncWebServer started on port 80");
@@ -3,54 +3,352 @@
 //
 #include "WifiRouter.h"
 
+#include <LittleFS.h>
+#include <esp_netif.h>
+#include <esp_netif_sta_list.h>
+#include <esp_wifi.h>
+#include "freertos/FreeRTOS.h"
+
 #include "Logger.h"
+#include "MemoryPolicy.h"
 
-void setupWiFi(const char *ssid, const char *password) {
-    try {
-        WiFi.mode(WIFI_MODE_AP);
-        WiFi.softAP(ssid, password);
-        LOGI("Access Point IP: " + WiFi.softAPIP().toString());
-    } catch (const std::exception &err) {
-        LOGE("Exception during setup: " + String(err.what()) );
+namespace {
+
+constexpr int kMaxStations = 12; // connected plus recently departed
+constexpr uint32_t kEventGotIp = 1;
+constexpr uint32_t kEventDisconnected = 2;
+
+struct Station {
+    bool used;
+    bool connected;
+    uint8_t mac[6];
+    uint32_t ip;
+    int8_t rssi;
+    int8_t rssiMin;
+    int16_t rssiAvg; // EWMA, 1/4 weight
+    uint8_t phy;     // bit 0 11b, 1 11g, 2 11n, 3 long range
+    uint16_t joins;
+    uint32_t connectedMs;
+    uint32_t lastSeenMs;
+};
+
+// Written by the WiFi event task, consumed by serviceWiFi()
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t g_events = 0;
+uint8_t g_lastReason = 0;
+Station g_stations[kMaxStations];
+uint16_t g_apPeak = 0;
+
+// Pending STA configuration from wifiSetStation()
+char g_staSsid[33] = "";
+char g_staPass[65] = "";
+bool g_configChanged = false;
+
+// State machine, loop task only
+StaState g_state = StaState::Disabled;
+uint32_t g_stateSince = 0;
+uint32_t g_backoffMs = WIFI_BACKOFF_MIN_MS;
+uint32_t g_retryAt = 0;
+uint32_t g_attempts = 0;
+uint32_t g_disconnects = 0;
+const char *const kStateNames[] = {"disabled", "connecting", "connected", "backoff"};
+
+String macToString(const uint8_t mac[6]) {
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return String(buf);
+}
+
+// Caller holds g_mux. Reuses the entry for a known MAC, else a free slot, else
+// the station that left longest ago.
+Station *stationFor(const uint8_t mac[6]) {
+    Station *freeSlot = nullptr;
+    Station *oldest = nullptr;
+    for (Station &s : g_stations) {
+        if (s.used && memcmp(s.mac, mac, 6) == 0) return &s;
+        if (!s.used && !freeSlot) freeSlot = &s;
+        if (s.used && !s.connected && (!oldest || s.lastSeenMs < oldest->lastSeenMs)) oldest = &s;
     }
+    Station *s = freeSlot ? freeSlot : oldest;
+    if (!s) return nullptr;
+    *s = {};
+    s->used = true;
+    memcpy(s->mac, mac, 6);
+    return s;
 }
 
-void checkWiFiConnection() {
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("WiFi not connected, attempting to reconnect...");
-        WiFi.reconnect();
-        unsigned long startAttemptTime = millis();
-        while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < 10000) {
-            delay(100);
+void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    uint32_t now = millis();
+    portENTER_CRITICAL(&g_mux);
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            g_events |= kEventGotIp;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            g_events |= kEventDisconnected;
+            g_lastReason = info.wifi_sta_disconnected.reason;
+            break;
+        case ARDUINO_EVENT_WIFI_AP_STACONNECTED: {
+            Station *s = stationFor(info.wifi_ap_staconnected.mac);
+            if (s) {
+                s->connected = true;
+                s->joins++;
+                s->connectedMs = now;
+                s->lastSeenMs = now;
+            }
+            break;
         }
-        if (WiFi.status() == WL_CONNECTED) {
-            LOGI("Reconnected attempt: " + String(millis()));
-            LOGI("Reconnected to WiFi!");
-        } else {
-            LOGE("Failed to reconnect to WiFi.");
+        case ARDUINO_EVENT_WIFI_AP_STADISCONNECTED: {
+            Station *s = stationFor(info.wifi_ap_stadisconnected.mac);
+            if (s) {
+                s->connected = false;
+                s->lastSeenMs = now;
+            }
+            break;
         }
+        default:
+            break;
     }
+    portEXIT_CRITICAL(&g_mux);
 }
 
-String getWiFiStatus() {
-    switch (WiFi.status()) {
-        case WL_NO_SHIELD: return "No WiFi shield";
-        case WL_IDLE_STATUS: return "Idle";
-        case WL_NO_SSID_AVAIL: return "No SSID available";
-        case WL_SCAN_COMPLETED: return "Scan completed";
-        case WL_CONNECTED: return "Connected";
-        case WL_CONNECT_FAILED: return "Connection failed";
-        case WL_CONNECTION_LOST: return "Connection lost";
-        case WL_DISCONNECTED: return "Disconnected";
-        default: return "Unknown status";
+void loadConfig() {
+    strlcpy(g_staSsid, WIFI_STA_SSID, sizeof(g_staSsid));
+    strlcpy(g_staPass, WIFI_STA_PASSWORD, sizeof(g_staPass));
+    File f = LittleFS.open(WIFI_CONFIG_FILE, "r");
+    if (!f) return;
+    StaticJsonDocument<192> doc;
+    if (!deserializeJson(doc, f)) {
+        strlcpy(g_staSsid, doc["ssid"] | "", sizeof(g_staSsid));
+        strlcpy(g_staPass, doc["pass"] | "", sizeof(g_staPass));
+    }
+    f.close();
+}
+
+void saveConfig(const String &ssid, const String &password) {
+    File f = LittleFS.open(WIFI_CONFIG_FILE, "w");
+    if (!f) return;
+    StaticJsonDocument<192> doc;
+    doc["ssid"] = ssid;
+    doc["pass"] = password;
+    serializeJson(doc, f);
+    f.close();
+}
+
+void enterState(StaState state, uint32_t now) {
+    g_state = state;
+    g_stateSince = now;
+}
+
+// Exponential backoff with +-25% jitter so several dioramas do not retry in step
+void scheduleRetry(uint32_t now) {
+    uint32_t jitter = g_backoffMs / 4;
+    g_retryAt = now + g_backoffMs - jitter + esp_random() % (2 * jitter + 1);
+    g_backoffMs = min<uint32_t>(g_backoffMs * 2, WIFI_BACKOFF_MAX_MS);
+    enterState(StaState::Backoff, now);
+}
+
+void applyConfig(uint32_t now) {
+    char ssid[sizeof(g_staSsid)];
+    portENTER_CRITICAL(&g_mux);
+    strlcpy(ssid, g_staSsid, sizeof(ssid));
+    g_configChanged = false;
+    g_events = 0;
+    portEXIT_CRITICAL(&g_mux);
+
+    if (g_state != StaState::Disabled) WiFi.disconnect(false);
+    g_backoffMs = WIFI_BACKOFF_MIN_MS;
+    if (ssid[0] == '\0') {
+        WiFi.mode(WIFI_MODE_AP);
+        enterState(StaState::Disabled, now);
+        return;
+    }
+    WiFi.mode(WIFI_MODE_APSTA);
+    g_retryAt = now; // connect on this pass
+    enterState(StaState::Backoff, now);
+}
+
+void startConnect(uint32_t now) {
+    char ssid[sizeof(g_staSsid)];
+    char pass[sizeof(g_staPass)];
+    portENTER_CRITICAL(&g_mux);
+    strlcpy(ssid, g_staSsid, sizeof(ssid));
+    strlcpy(pass, g_staPass, sizeof(pass));
+    g_events = 0;
+    portEXIT_CRITICAL(&g_mux);
+    g_attempts++;
+    WiFi.begin(ssid, pass); // returns immediately; the outcome arrives as an event
+    enterState(StaState::Connecting, now);
+}
+
+void sampleStations(uint32_t now) {
+    wifi_sta_list_t list = {};
+    esp_netif_sta_list_t ips = {};
+    if (esp_wifi_ap_get_sta_list(&list) != ESP_OK) return;
+    bool haveIps = esp_netif_get_sta_list(&list, &ips) == ESP_OK;
+
+    portENTER_CRITICAL(&g_mux);
+    for (int i = 0; i < list.num; i++) {
+        const wifi_sta_info_t &info = list.sta[i];
+        Station *s = stationFor(info.mac);
+        if (!s) continue;
+        if (!s->connected) {
+            // Joined before the event handler was registered
+            s->connected = true;
+            s->connectedMs = now;
+            s->joins = max<uint16_t>(s->joins, 1);
+        }
+        if (s->rssiAvg == 0) s->rssiAvg = info.rssi;
+        s->rssi = info.rssi;
+        s->rssiAvg += (info.rssi - s->rssiAvg) / 4;
+        if (s->rssiMin == 0 || info.rssi < s->rssiMin) s->rssiMin = info.rssi;
+        s->phy = info.phy_11b | info.phy_11g << 1 | info.phy_11n << 2 | info.phy_lr << 3;
+        s->lastSeenMs = now;
+        if (haveIps && i < ips.num) s->ip = ips.sta[i].ip.addr;
+    }
+    if (list.num > g_apPeak) g_apPeak = list.num;
+    portEXIT_CRITICAL(&g_mux);
+}
+
+} // namespace
+
+void setupWiFi(const char *ssid, const char *password) {
+    memRegisterStatic(MEM_WIFI, sizeof(g_stations));
+    loadConfig();
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false); // serviceWiFi() owns retries
+    WiFi.onEvent(onWiFiEvent);
+    WiFi.mode(g_staSsid[0] ? WIFI_MODE_APSTA : WIFI_MODE_AP);
+    if (!WiFi.softAP(ssid, password, 1, 0, WIFI_AP_MAX_CLIENTS)) {
+        LOGE("WiFi: cannot start access point");
     }
+    LOGI("Access Point IP: " + WiFi.softAPIP().toString());
+    g_configChanged = true; // first serviceWiFi() pass starts the STA side
+}
+
+void serviceWiFi() {
+    uint32_t now = millis();
+    static uint32_t lastSample = 0;
+    if (now - lastSample >= WIFI_STATION_SAMPLE_MS) {
+        lastSample = now;
+        sampleStations(now);
+    }
+
+    if (g_configChanged) applyConfig(now);
+
+    portENTER_CRITICAL(&g_mux);
+    uint32_t events = g_events;
+    uint8_t reason = g_lastReason;
+    g_events = 0;
+    portEXIT_CRITICAL(&g_mux);
+
+    switch (g_state) {
+        case StaState::Disabled:
+            break;
+        case StaState::Connecting:
+            if (events & kEventGotIp) {
+                g_backoffMs = WIFI_BACKOFF_MIN_MS;
+                enterState(StaState::Connected, now);
+                LOGI("WiFi: connected to " + WiFi.SSID() + " as " + WiFi.localIP().toString());
+            } else if (events & kEventDisconnected || now - g_stateSince > WIFI_STA_CONNECT_TIMEOUT_MS) {
+                WiFi.disconnect(false);
+                scheduleRetry(now);
+                LOGW("WiFi: connect failed (reason " + String(reason) + "), retry in " + String(g_retryAt - now) + " ms");
+            }
+            break;
+        case StaState::Connected:
+            if (events & kEventDisconnected) {
+                g_disconnects++;
+                scheduleRetry(now);
+                LOGW("WiFi: connection lost (reason " + String(reason) + ")");
+            }
+            break;
+        case StaState::Backoff:
+            if (static_cast<int32_t>(now - g_retryAt) >= 0) startConnect(now);
+            break;
+    }
+}
+
+bool wifiSetStation(const String &ssid, const String &password) {
+    if (ssid.length() >= sizeof(g_staSsid) || password.length() >= sizeof(g_staPass)) return false;
+    saveConfig(ssid, password);
+    portENTER_CRITICAL(&g_mux);
+    strlcpy(g_staSsid, ssid.c_str(), sizeof(g_staSsid));
+    strlcpy(g_staPass, password.c_str(), sizeof(g_staPass));
+    g_configChanged = true;
+    portEXIT_CRITICAL(&g_mux);
+    return true;
+}
+
+StaState wifiStaState() {
+    return g_state;
+}
+
+String getWiFiStatus() {
+    return kStateNames[static_cast<int>(g_state)];
 }
 
 String getLocalIP() {
-    return WiFi.localIP().toString();
+    if (g_state == StaState::Connected) return WiFi.localIP().toString();
+    return WiFi.softAPIP().toString();
+}
+
+String getApIP() {
+    return WiFi.softAPIP().toString();
 }
 
 String getSSID() {
-    return WiFi.SSID();
+    return g_state == StaState::Connected ? WiFi.SSID() : WiFi.softAPSSID();
 }
 
+void wifiDescribe(JsonDocument &doc) {
+    uint32_t now = millis();
+    JsonObject ap = doc.createNestedObject("ap");
+    ap["ssid"] = WiFi.softAPSSID();
+    ap["ip"] = WiFi.softAPIP().toString();
+    ap["channel"] = WiFi.channel();
+    ap["clients"] = WiFi.softAPgetStationNum();
+    ap["max_clients"] = WIFI_AP_MAX_CLIENTS;
+
+    JsonObject sta = doc.createNestedObject("sta");
+    sta["state"] = kStateNames[static_cast<int>(g_state)];
+    sta["for_ms"] = now - g_stateSince;
+    sta["attempts"] = g_attempts;
+    sta["disconnects"] = g_disconnects;
+    if (g_state == StaState::Connected) {
+        sta["ssid"] = WiFi.SSID();
+        sta["ip"] = WiFi.localIP().toString();
+        sta["rssi"] = WiFi.RSSI();
+    } else if (g_state == StaState::Backoff) {
+        sta["retry_in_ms"] = static_cast<int32_t>(g_retryAt - now);
+    }
+
+    Station copy[kMaxStations];
+    portENTER_CRITICAL(&g_mux);
+    memcpy(copy, g_stations, sizeof(copy));
+    sta["last_reason"] = g_lastReason;
+    ap["peak_clients"] = g_apPeak;
+    portEXIT_CRITICAL(&g_mux);
+
+    static const char *const kPhy[] = {"11b", "11g", "11n", "lr"};
+    JsonArray list = doc.createNestedArray("stations");
+    for (const Station &s : copy) {
+        if (!s.used) continue;
+        JsonObject o = list.createNestedObject();
+        o["mac"] = macToString(s.mac);
+        o["connected"] = s.connected;
+        if (s.ip) o["ip"] = IPAddress(s.ip).toString();
+        o["rssi"] = s.rssi;
+        o["rssi_avg"] = s.rssiAvg;
+        o["rssi_min"] = s.rssiMin;
+        JsonArray phy = o.createNestedArray("phy");
+        for (int b = 0; b < 4; b++) {
+            if (s.phy & (1 << b)) phy.add(kPhy[b]);
+        }
+        // 11b-only or weak clients hold the shared channel longest per byte
+        o["slow"] = s.rssiAvg < WIFI_WEAK_RSSI || s.phy == 1;
+        o["joins"] = s.joins;
+        if (s.connected) o["connected_s"] = (now - s.connectedMs) / 1000;
+        else o["left_s"] = (now - s.lastSeenMs) / 1000;
+    }
+}
@@ -6,28 +6,71 @@
 #include "Logger.h"
 #include "Smoke.h"
 #include "Pwm.h"
+#include "PixelStrip.h"
+#include "Actions.h"
+#include "Scheduler.h"
+#include "ShowSync.h"
+#include "Journal.h"
+#include "CommandQueue.h"
+#include "Effects.h"
+#include "EventBus.h"
+#include "Rules.h"
+#include "Envelope.h"
+#include "MemoryPolicy.h"
 
 void setup() {
   Serial.begin(115200);
   Logger::init("DIORAMA", Logger::DEBUG);
+  // Keep the RAM log tail (/api/logs) to INFO and above
+  Logger::instance().setRetentionLevel(Logger::INFO);
   delay(3000);
   LOGI("ESP 32 is booting");
 
+  LOGI("Board profile: " BOARD_NAME);
   setupLeds();
+  setupPixelStrip();
+#if BOARD_HAS_MILL
   setupPwm();
+#endif
+#if BOARD_HAS_SMOKE
   setupSmoke();
-  setupAudioSystem();
-  setupWiFi(WIFI_SSID, WIFI_PASSWORD);
+#endif
 
   setupFileSystem();
+  setupAudioSystem(); // the I2S backend lists its files at startup
+  setupWiFi(WIFI_SSID, WIFI_PASSWORD);
+  setupJournal();
+  setupActions();
+  setupRules();
+  setupScheduler();
+  setupShowSync();
+  setupCommandQueue();
+  setupEffects();
+  setupEnvelope();
+  setupEventBus(); // drops what the self-tests above published
   setupWebServer();
+  memLogMap();
 }
 
 void loop() {
+  // Frame boundary: apply queued control changes before rendering
+  serviceCommandQueue();
+  serviceAudio();
+  // Subsystem events (and the rules bound to them) before rendering
+  serviceEventBus();
+  // Soundtrack envelope into the fire/mill/smoke (starts on TrackStarted)
+  serviceEnvelope();
   // Run non-blocking fire animation for LEDs only when requested
   if (isFireEffectActive()) {
     fireEffect();
   }
+  serviceEffects();
+  serviceWiFi();
+  serviceShowSync();
+  serviceScheduler();
+  serviceRules();
+  serviceWebServer();
+  serviceJournal();
   // keep loop cooperative; fireEffect handles its own frame timing
   delay(1);
 }
@@ -0,0 +1,219 @@
+// Effect compiler, bytecode verifier and VM: programs compile to what they
+// say, images that would break the VM's unchecked loop are refused on load,
+// and arithmetic saturates instead of wrapping.
+
+#include <unity.h>
+
+#include <string.h>
+#include <vector>
+
+#include "EffectVm.h"
+
+namespace {
+
+// Image layout (EffectVm.cpp): "FXB1", slots, max stack, u16le main length,
+// u16le pixel length, code
+constexpr size_t kHeaderLen = 10;
+enum : uint8_t { OP_PUSH = 1, OP_LOAD, OP_STORE, OP_ADD };
+
+std::vector<uint8_t> compile(const char *source) {
+    std::vector<uint8_t> image;
+    String error;
+    if (!effectCompile(source, image, error)) TEST_FAIL_MESSAGE(error.c_str());
+    return image;
+}
+
+// Compile, load and run one frame at t = tMs
+void runOnce(EffectVm &vm, const char *source, uint32_t tMs = 0) {
+    std::vector<uint8_t> image = compile(source);
+    String error;
+    if (!vm.load(image.data(), image.size(), error)) TEST_FAIL_MESSAGE(error.c_str());
+    vm.runFrame(tMs, 20);
+}
+
+String compileError(const char *source) {
+    std::vector<uint8_t> image;
+    String error;
+    TEST_ASSERT_FALSE(effectCompile(source, image, error));
+    return error;
+}
+
+std::vector<uint8_t> image(const std::vector<uint8_t> &main, const std::vector<uint8_t> &pixel = {}) {
+    std::vector<uint8_t> img = {'F', 'X', 'B', '1', FXS_USER, EFFECT_STACK,
+                                static_cast<uint8_t>(main.size()), static_cast<uint8_t>(main.size() >> 8),
+                                static_cast<uint8_t>(pixel.size()), static_cast<uint8_t>(pixel.size() >> 8)};
+    img.insert(img.end(), main.begin(), main.end());
+    img.insert(img.end(), pixel.begin(), pixel.end());
+    return img;
+}
+
+String loadError(const std::vector<uint8_t> &img) {
+    EffectVm vm;
+    String error;
+    TEST_ASSERT_FALSE(vm.load(img.data(), img.size(), error));
+    TEST_ASSERT_FALSE(vm.loaded());
+    return error;
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_arithmetic_and_functions() {
+    EffectVm vm;
+    runOnce(vm, "led0 = 0.25 + 0.5 * 2 - 1\n"
+                "led1 = sin(0.25) - cos(0.5)\n"
+                "led2 = min(3, 2) + max(-1, 0) + clamp(5, 0, 1) + abs(-1) + floor(1.75) + frac(2.25)");
+    TEST_ASSERT_EQUAL_INT32(FX_ONE / 4, vm.led(0));
+    TEST_ASSERT_EQUAL_INT32(2 * FX_ONE, vm.led(1));
+    TEST_ASSERT_EQUAL_INT32(5 * FX_ONE + FX_ONE / 4, vm.led(2));
+}
+
+void test_comparisons_select_and_division_by_zero() {
+    EffectVm vm;
+    runOnce(vm, "led0 = (1 < 2) + (2 <= 2) + (3 > 4) + (1 == 1) + (1 != 1)\n"
+                "led1 = select(0, 5, 7) + select(0.5, 1, 0)\n"
+                "led2 = 1 / 0 + 7 % 0");
+    TEST_ASSERT_EQUAL_INT32(3 * FX_ONE, vm.led(0));
+    TEST_ASSERT_EQUAL_INT32(8 * FX_ONE, vm.led(1));
+    TEST_ASSERT_EQUAL_INT32(0, vm.led(2));
+}
+
+void test_results_saturate() {
+    EffectVm vm;
+    runOnce(vm, "led0 = 30000 * 30000\n"
+                "led1 = -30000 - 30000\n"
+                "led2 = mix(0, 1, 0.5)");
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, vm.led(0));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, vm.led(1));
+    TEST_ASSERT_EQUAL_INT32(FX_ONE / 2, vm.led(2));
+}
+
+void test_mix_saturates_at_the_extremes() {
+    // Saturated operands: (b - a) * c is within one bit of int64
+    EffectVm vm;
+    runOnce(vm, "lo = -30000 * 30000\n"
+                "hi = 30000 * 30000\n"
+                "led0 = mix(lo, hi, hi)\n"
+                "led1 = mix(lo, hi, lo)\n"
+                "led2 = mix(hi, lo, lo)");
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, vm.led(0));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, vm.led(1));
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, vm.led(2));
+}
+
+void test_variables_persist_and_inputs_advance() {
+    EffectVm vm;
+    std::vector<uint8_t> img = compile("count = count + 1\nled0 = count\nled1 = t\nled2 = frame");
+    String error;
+    TEST_ASSERT_TRUE(vm.load(img.data(), img.size(), error));
+    for (uint32_t f = 0; f < 3; f++) vm.runFrame(f * 500, 500);
+    TEST_ASSERT_EQUAL_INT32(3 * FX_ONE, vm.led(0));
+    TEST_ASSERT_EQUAL_INT32(FX_ONE, vm.led(1)); // 1000 ms
+    TEST_ASSERT_EQUAL_INT32(2 * FX_ONE, vm.led(2));
+    TEST_ASSERT_TRUE(vm.writesLed(0));
+}
+
+void test_pixel_block() {
+    EffectVm vm;
+    runOnce(vm, "led0 = 0.5\npixel { r = x  g = led0  b = i - n }");
+    TEST_ASSERT_TRUE(vm.hasPixelBlock());
+    uint8_t r, g, b;
+    vm.runPixel(2, 4, r, g, b);
+    TEST_ASSERT_EQUAL_UINT8(128, r);
+    TEST_ASSERT_EQUAL_UINT8(128, g);
+    TEST_ASSERT_EQUAL_UINT8(0, b);
+    vm.runPixel(4, 4, r, g, b);
+    TEST_ASSERT_EQUAL_UINT8(255, r);
+}
+
+void test_cost_is_known_at_load() {
+    EffectVm vm;
+    runOnce(vm, "led0 = 1\npixel { r = 1 }");
+    // PUSH + STORE in each section
+    TEST_ASSERT_EQUAL_UINT32(2, vm.opsPerFrame(0));
+    TEST_ASSERT_EQUAL_UINT32(2 + 2 * 10, vm.opsPerFrame(10));
+    TEST_ASSERT_FALSE(vm.writesLed(1));
+}
+
+void test_compile_errors_name_the_line() {
+    TEST_ASSERT_EQUAL_STRING("line 2: expected ')'", compileError("led0 = 1\nled1 = (1 + 2").c_str());
+    TEST_ASSERT_EQUAL_STRING("line 1: sin() takes 1 argument(s)", compileError("led0 = sin(1, 2)").c_str());
+    TEST_ASSERT_EQUAL_STRING("line 1: unknown function 'foo'", compileError("led0 = foo(1)").c_str());
+    TEST_ASSERT_EQUAL_STRING("line 1: 't' is read-only", compileError("t = 1").c_str());
+    TEST_ASSERT_EQUAL_STRING("line 1: 'r' can only be set in the pixel block", compileError("r = 1").c_str());
+    TEST_ASSERT_EQUAL_STRING("line 1: number out of range", compileError("led0 = 40000").c_str());
+    TEST_ASSERT_EQUAL_STRING("line 1: only one top-level pixel block is allowed",
+                             compileError("pixel { r = 1 } pixel { g = 1 }").c_str());
+}
+
+void test_verifier_rejects_unsafe_images() {
+    const uint8_t push1[] = {OP_PUSH, 0, 0, 1, 0};
+
+    // What the compiler would produce for "led0 = 1" loads fine
+    std::vector<uint8_t> ok(push1, push1 + 5);
+    ok.insert(ok.end(), {OP_STORE, FXS_LED0});
+    EffectVm vm;
+    String error;
+    TEST_ASSERT_TRUE(vm.load(image(ok).data(), image(ok).size(), error));
+
+    std::vector<uint8_t> badOp = {0xEE};
+    TEST_ASSERT_EQUAL_STRING("bad opcode at 0", loadError(image(badOp)).c_str());
+
+    std::vector<uint8_t> truncated(push1, push1 + 3);
+    TEST_ASSERT_EQUAL_STRING("bad opcode at 0", loadError(image(truncated)).c_str());
+
+    std::vector<uint8_t> underflow = {OP_ADD};
+    TEST_ASSERT_EQUAL_STRING("stack underflow at 0", loadError(image(underflow)).c_str());
+
+    std::vector<uint8_t> overflow;
+    for (int i = 0; i <= EFFECT_STACK; i++) overflow.insert(overflow.end(), push1, push1 + 5);
+    TEST_ASSERT_EQUAL_STRING("stack overflow at 80", loadError(image(overflow)).c_str());
+
+    std::vector<uint8_t> unbalanced(push1, push1 + 5);
+    TEST_ASSERT_EQUAL_STRING("unbalanced stack", loadError(image(unbalanced)).c_str());
+
+    std::vector<uint8_t> slotPastEnd = {OP_LOAD, FXS_USER};
+    TEST_ASSERT_EQUAL_STRING("bad slot at 0", loadError(image(slotPastEnd)).c_str());
+
+    std::vector<uint8_t> storeInput(push1, push1 + 5);
+    storeInput.insert(storeInput.end(), {OP_STORE, FXS_T});
+    TEST_ASSERT_EQUAL_STRING("bad slot at 5", loadError(image(storeInput)).c_str());
+
+    std::vector<uint8_t> pixelSlotInMain = {OP_LOAD, FXS_X, OP_STORE, FXS_LED0};
+    TEST_ASSERT_EQUAL_STRING("bad slot at 0", loadError(image(pixelSlotInMain)).c_str());
+
+    std::vector<uint8_t> img = image(ok);
+    img.push_back(0); // length fields no longer match
+    TEST_ASSERT_EQUAL_STRING("corrupt effect image", loadError(img).c_str());
+    img = image(ok);
+    img[0] = 'X';
+    TEST_ASSERT_EQUAL_STRING("not an effect image", loadError(img).c_str());
+}
+
+void test_failed_load_keeps_the_running_program() {
+    EffectVm vm;
+    runOnce(vm, "led0 = 0.5");
+    std::vector<uint8_t> bad = image({OP_ADD});
+    String error;
+    TEST_ASSERT_FALSE(vm.load(bad.data(), bad.size(), error));
+    vm.runFrame(40, 20);
+    TEST_ASSERT_EQUAL_INT32(FX_ONE / 2, vm.led(0));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_arithmetic_and_functions);
+    RUN_TEST(test_comparisons_select_and_division_by_zero);
+    RUN_TEST(test_results_saturate);
+    RUN_TEST(test_mix_saturates_at_the_extremes);
+    RUN_TEST(test_variables_persist_and_inputs_advance);
+    RUN_TEST(test_pixel_block);
+    RUN_TEST(test_cost_is_known_at_load);
+    RUN_TEST(test_compile_errors_name_the_line);
+    RUN_TEST(test_verifier_rejects_unsafe_images);
+    RUN_TEST(test_failed_load_keeps_the_running_program);
+    return UNITY_END();
+}
@@ -0,0 +1,118 @@
+// PixelFrames over a MemoryFrameSink: what the strip receives, and that a
+// frame being sent is never touched before the sink reports it idle.
+
+#include <unity.h>
+
+#include <string.h>
+#include <vector>
+
+#include "FireSim.h"
+#include "FrameSink.h"
+
+namespace {
+
+constexpr size_t kPixels = 60;
+
+// Holds each submitted frame "on the wire" until waitIdle(), and checks the
+// caller left it alone meanwhile
+class CheckingSink : public MemoryFrameSink {
+public:
+    void submit(const Pixel *pixels, size_t count) override {
+        MemoryFrameSink::submit(pixels, count);
+        sending = pixels;
+        copy.assign(pixels, pixels + count);
+    }
+    void waitIdle() override {
+        if (sending && memcmp(sending, copy.data(), copy.size() * sizeof(Pixel))) overwritten++;
+        sending = nullptr;
+    }
+
+    const Pixel *sending = nullptr;
+    std::vector<Pixel> copy;
+    int overwritten = 0;
+};
+
+Pixel storage[2][kPixels];
+
+void fill(Pixel *frame, uint8_t value) {
+    for (size_t i = 0; i < kPixels; i++) frame[i] = Pixel{value, static_cast<uint8_t>(value + 1), static_cast<uint8_t>(i)};
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_memory_sink_keeps_last_frame_and_counts() {
+    MemoryFrameSink sink;
+    TEST_ASSERT_TRUE(sink.begin(kPixels));
+    Pixel frame[kPixels];
+    fill(frame, 7);
+    sink.submit(frame, kPixels);
+    sink.submit(frame, kPixels);
+    TEST_ASSERT_EQUAL_UINT32(2, sink.frames);
+    TEST_ASSERT_EQUAL_UINT32(2 * kPixels * 3, sink.bytes);
+    TEST_ASSERT_EQUAL_MEMORY(frame, sink.lastFrame(), sizeof(frame));
+}
+
+void test_memory_sink_truncates_to_capacity() {
+    MemoryFrameSink sink;
+    TEST_ASSERT_TRUE(sink.begin(10));
+    Pixel frame[kPixels];
+    fill(frame, 3);
+    sink.submit(frame, kPixels);
+    TEST_ASSERT_EQUAL_UINT32(10 * 3, sink.bytes);
+    TEST_ASSERT_EQUAL_MEMORY(frame, sink.lastFrame(), 10 * sizeof(Pixel));
+}
+
+void test_show_sends_back_frame_and_carries_it_over() {
+    MemoryFrameSink sink;
+    TEST_ASSERT_TRUE(sink.begin(kPixels));
+    PixelFrames frames;
+    frames.begin(&sink, storage[0], kPixels);
+    Pixel *first = frames.back();
+    fill(first, 40);
+    frames.show();
+    TEST_ASSERT_EQUAL_MEMORY(first, sink.lastFrame(), kPixels * sizeof(Pixel));
+    // The other buffer is next, starting from what was just sent
+    Pixel *second = frames.back();
+    TEST_ASSERT_TRUE(second != first);
+    TEST_ASSERT_EQUAL_MEMORY(first, second, kPixels * sizeof(Pixel));
+    second[5].r = 200; // incremental update
+    frames.show();
+    TEST_ASSERT_EQUAL_UINT8(200, sink.lastFrame()[5].r);
+    TEST_ASSERT_EQUAL_UINT8(41, sink.lastFrame()[6].r);
+    TEST_ASSERT_TRUE(frames.back() == first);
+}
+
+void test_frame_in_flight_is_never_rendered_into() {
+    CheckingSink sink;
+    TEST_ASSERT_TRUE(sink.begin(kPixels));
+    PixelFrames frames;
+    frames.begin(&sink, storage[0], kPixels);
+    FireSim fire;
+    fire.begin(3);
+    fire.reset(FIRE_GOLDEN_SEED);
+    for (int f = 0; f < 200; f++) {
+        fire.step();
+        Pixel *frame = frames.back();
+        TEST_ASSERT_TRUE(frame != sink.sending);
+        for (size_t k = 0; k < kPixels; k++) {
+            uint16_t level = fire.heightLevel(static_cast<uint16_t>(k * 0xFFFF / (kPixels - 1)));
+            frame[k] = Pixel{0, static_cast<uint8_t>(level >> 8), 0};
+        }
+        frames.show();
+    }
+    TEST_ASSERT_EQUAL_INT(0, sink.overwritten);
+    TEST_ASSERT_EQUAL_UINT32(200, sink.frames);
+    TEST_ASSERT_EQUAL_UINT32(200 * kPixels * 3, sink.bytes);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_memory_sink_keeps_last_frame_and_counts);
+    RUN_TEST(test_memory_sink_truncates_to_capacity);
+    RUN_TEST(test_show_sends_back_frame_and_carries_it_over);
+    RUN_TEST(test_frame_in_flight_is_never_rendered_into);
+    return UNITY_END();
+}
@@ -0,0 +1,268 @@
+// Several ShowSyncNodes on a simulated multicast segment: each node has its
+// own clock offset and drift, every datagram reaches every other node after
+// a few milliseconds of jitter. Checks that followers align on the leader's
+// timeline and run each cue exactly once, however often it is repeated.
+
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ShowSyncNode.h"
+
+namespace {
+
+constexpr int64_t kStepUs = 1000;
+constexpr int64_t kBeaconUs = 500000;
+
+struct SimNode {
+    std::unique_ptr<ShowSyncNode> node{new ShowSyncNode()};
+    int64_t offsetUs;
+    int32_t driftPpm;
+    bool up = true;
+    bool deferFit = false; // fit on a copy, as ShowSync.cpp does
+    std::vector<std::string> ran;
+    std::vector<int64_t> ranAtUs; // simulation time
+
+    int64_t localUs(int64_t t) const { return offsetUs + t + t * driftPpm / 1000000; }
+};
+
+struct InFlight {
+    int64_t deliverAt;
+    size_t to;
+    SyncPacket packet;
+};
+
+struct Network {
+    std::vector<SimNode> nodes;
+    std::vector<InFlight> flight;
+    std::vector<SyncPacket> cuesSent;
+    int64_t t = 0;
+    int64_t lastBeacon = 0;
+    uint32_t rng = 12345;
+
+    SimNode &add(uint32_t id, SyncRole role, int64_t offsetUs, int32_t driftPpm) {
+        nodes.emplace_back();
+        SimNode &n = nodes.back();
+        n.offsetUs = offsetUs;
+        n.driftPpm = driftPpm;
+        n.node->begin(id);
+        n.node->setRole(role);
+        return n;
+    }
+
+    void broadcast(size_t from, const SyncPacket &p) {
+        if (p.type == ShowSyncNode::TYPE_CUE) cuesSent.push_back(p);
+        for (size_t k = 0; k < nodes.size(); k++) {
+            if (k == from) continue;
+            rng = rng * 1664525 + 1013904223;
+            flight.push_back({t + 500 + (rng >> 8) % 4000, k, p});
+        }
+    }
+
+    void deliverAll(const SyncPacket &p) {
+        for (size_t k = 0; k < nodes.size(); k++) flight.push_back({t, k, p});
+    }
+
+    bool cue(size_t from, const char *action, int64_t delayUs) {
+        SyncPacket p;
+        if (!nodes[from].node->cue(action, nodes[from].localUs(t), delayUs, p)) return false;
+        broadcast(from, p);
+        return true;
+    }
+
+    void step() {
+        t += kStepUs;
+        for (size_t i = 0; i < flight.size();) {
+            if (flight[i].deliverAt <= t) {
+                SimNode &n = nodes[flight[i].to];
+                if (n.up) {
+                    const uint8_t *data = reinterpret_cast<const uint8_t *>(&flight[i].packet);
+                    if (n.node->receive(data, sizeof(SyncPacket), n.localUs(t), n.deferFit) && n.deferFit) {
+                        ClockEstimator copy = n.node->clock();
+                        n.node->applyFit(copy.fit());
+                    }
+                }
+                flight.erase(flight.begin() + i);
+            } else {
+                i++;
+            }
+        }
+        bool beacon = t - lastBeacon >= kBeaconUs;
+        if (beacon) lastBeacon = t;
+        for (size_t k = 0; k < nodes.size(); k++) {
+            SimNode &n = nodes[k];
+            if (!n.up) continue;
+            int64_t now = n.localUs(t);
+            if (beacon && n.node->role() == SyncRole::Leader) {
+                SyncPacket p;
+                n.node->beacon(now, p);
+                broadcast(k, p);
+            }
+            char action[SHOW_SYNC_ACTION_LEN];
+            int64_t lateUs;
+            while (n.node->takeDue(now, action, sizeof(action), lateUs)) {
+                n.ran.push_back(action);
+                n.ranAtUs.push_back(t);
+            }
+        }
+    }
+
+    void run(int64_t us) {
+        for (int64_t end = t + us; t < end;) step();
+    }
+};
+
+Network net;
+
+void buildShow() {
+    net = Network();
+    net.add(0x10, SyncRole::Leader, 7000000, 0);
+    net.add(0x21, SyncRole::Follower, -3000000, 40);
+    net.add(0x22, SyncRole::Follower, 125000000, -35);
+    net.add(0x23, SyncRole::Follower, 0, 10).deferFit = true;
+}
+
+} // namespace
+
+void setUp() {
+    buildShow();
+}
+
+void tearDown() {}
+
+void test_followers_align_on_leader_timeline() {
+    net.run(10000000);
+    int64_t leaderTimeline = net.nodes[0].localUs(net.t);
+    for (size_t k = 1; k < net.nodes.size(); k++) {
+        int64_t timeline;
+        TEST_ASSERT_TRUE(net.nodes[k].node->timeline(net.nodes[k].localUs(net.t), timeline));
+        TEST_ASSERT_EQUAL_UINT32(0x10, net.nodes[k].node->leader());
+        TEST_ASSERT_INT64_WITHIN(5000, leaderTimeline, timeline);
+    }
+}
+
+void test_cue_runs_once_everywhere_at_the_same_time() {
+    net.run(10000000);
+    TEST_ASSERT_TRUE(net.cue(0, "smoke:puff:400", 2000000));
+    net.run(4000000); // covers every re-broadcast
+    TEST_ASSERT_EQUAL(SHOW_SYNC_CUE_REPEATS, net.cuesSent.size());
+    int64_t at = net.nodes[0].ranAtUs[0];
+    for (SimNode &n : net.nodes) {
+        TEST_ASSERT_EQUAL(1, n.ran.size());
+        TEST_ASSERT_EQUAL_STRING("smoke:puff:400", n.ran[0].c_str());
+        TEST_ASSERT_INT64_WITHIN(6000, at, n.ranAtUs[0]);
+    }
+}
+
+void test_repeat_after_the_cue_ran_is_dropped() {
+    net.run(10000000);
+    TEST_ASSERT_TRUE(net.cue(0, "fire:on", 300000));
+    net.run(1000000);
+    for (SimNode &n : net.nodes) TEST_ASSERT_EQUAL(1, n.ran.size());
+    // A re-broadcast that arrives late (or a datagram the network duplicated)
+    SyncPacket late = net.cuesSent.front();
+    late.sentUs = net.nodes[0].localUs(net.t);
+    net.deliverAll(late);
+    net.deliverAll(late);
+    net.run(2000000);
+    for (size_t k = 1; k < net.nodes.size(); k++) {
+        TEST_ASSERT_EQUAL(1, net.nodes[k].ran.size());
+        TEST_ASSERT_GREATER_THAN_UINT32(0, net.nodes[k].node->duplicates());
+    }
+}
+
+void test_many_cues_each_run_once() {
+    net.run(10000000);
+    char action[16];
+    for (int i = 0; i < 12; i++) {
+        snprintf(action, sizeof(action), "cue:%d", i);
+        TEST_ASSERT_TRUE(net.cue(0, action, 1000000 + i * 150000));
+        net.run(50000);
+    }
+    net.run(5000000);
+    for (SimNode &n : net.nodes) {
+        TEST_ASSERT_EQUAL(12, n.ran.size());
+        for (int i = 0; i < 12; i++) {
+            snprintf(action, sizeof(action), "cue:%d", i);
+            TEST_ASSERT_EQUAL_STRING(action, n.ran[i].c_str());
+        }
+    }
+}
+
+void test_lowest_node_id_leads() {
+    net.add(0x08, SyncRole::Leader, 900000, 25);
+    net.run(10000000);
+    for (size_t k = 1; k < net.nodes.size(); k++) {
+        if (net.nodes[k].node->role() != SyncRole::Follower) continue;
+        TEST_ASSERT_EQUAL_UINT32(0x08, net.nodes[k].node->leader());
+    }
+}
+
+void test_rebooted_leader_cues_are_not_taken_for_repeats() {
+    net.run(10000000);
+    TEST_ASSERT_TRUE(net.cue(0, "before", 300000));
+    net.run(2000000);
+    // Same node id, clock and sequence numbers start again from zero
+    SimNode &leader = net.nodes[0];
+    leader.node.reset(new ShowSyncNode());
+    leader.node->begin(0x10);
+    leader.node->setRole(SyncRole::Leader);
+    leader.offsetUs = -net.t;
+    net.run(10000000);
+    TEST_ASSERT_TRUE(net.cue(0, "after", 300000));
+    net.run(2000000);
+    for (size_t k = 1; k < net.nodes.size(); k++) {
+        TEST_ASSERT_EQUAL(2, net.nodes[k].ran.size());
+        TEST_ASSERT_EQUAL_STRING("after", net.nodes[k].ran[1].c_str());
+    }
+}
+
+void test_follower_without_leader_runs_nothing() {
+    net.nodes[0].up = false;
+    net.run(3000000);
+    for (size_t k = 1; k < net.nodes.size(); k++) {
+        int64_t timeline;
+        TEST_ASSERT_FALSE(net.nodes[k].node->timeline(net.nodes[k].localUs(net.t), timeline));
+        SyncPacket p;
+        TEST_ASSERT_FALSE(net.nodes[k].node->cue("smoke:on", 0, 0, p));
+    }
+}
+
+void test_fit_from_before_a_reset_is_dropped() {
+    ShowSyncNode &follower = *net.nodes[3].node;
+    net.run(3000000);
+    int64_t timeline;
+    TEST_ASSERT_TRUE(follower.timeline(net.nodes[3].localUs(net.t), timeline));
+
+    // Fitted outside the lock while the role changes underneath
+    ClockEstimator::Fit stale = follower.clock().fit();
+    follower.setRole(SyncRole::Follower);
+    follower.applyFit(stale);
+    TEST_ASSERT_FALSE(follower.clock().valid());
+    TEST_ASSERT_FALSE(follower.timeline(net.nodes[3].localUs(net.t), timeline));
+
+    ClockEstimator clock;
+    clock.record(1000, 5000);
+    ClockEstimator::Fit older = clock.fit();
+    clock.record(2000, 6000);
+    TEST_ASSERT_FALSE(clock.apply(older));
+    TEST_ASSERT_TRUE(clock.apply(clock.fit()));
+    TEST_ASSERT_EQUAL_INT64(6000, clock.toRemote(2000));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_followers_align_on_leader_timeline);
+    RUN_TEST(test_cue_runs_once_everywhere_at_the_same_time);
+    RUN_TEST(test_repeat_after_the_cue_ran_is_dropped);
+    RUN_TEST(test_many_cues_each_run_once);
+    RUN_TEST(test_lowest_node_id_leads);
+    RUN_TEST(test_rebooted_leader_cues_are_not_taken_for_repeats);
+    RUN_TEST(test_follower_without_leader_runs_nothing);
+    RUN_TEST(test_fit_from_before_a_reset_is_dropped);
+    return UNITY_END();
+}
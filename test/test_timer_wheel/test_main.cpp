@@ -0,0 +1,144 @@
+// Hierarchical timer wheel behind the scheduler and smoke puffs: timers fire
+// on their tick in expiry order, including those that cascade down from the
+// upper levels, stale handles are ignored, and a full pool refuses new timers.
+
+#include <unity.h>
+
+#include <vector>
+
+#include "TimerWheel.h"
+
+namespace {
+
+std::vector<uint32_t> g_fired;
+
+void record(uint32_t arg) {
+    g_fired.push_back(arg);
+}
+
+// Advance one tick at a time to `tick`, running what expires on the way
+void runTo(TimerWheel &wheel, uint32_t tick) {
+    while (wheel.now() != tick) {
+        wheel.advance(wheel.now() + 1);
+        TimerWheel::Callback cb;
+        uint32_t arg;
+        while (wheel.popExpired(cb, arg)) cb(arg);
+    }
+}
+
+} // namespace
+
+void setUp() {
+    g_fired.clear();
+}
+
+void tearDown() {}
+
+void test_fires_in_expiry_order() {
+    TimerWheel wheel(8, MEM_SCHEDULE);
+    TEST_ASSERT_TRUE(wheel.begin(1000));
+    wheel.arm(5, record, 5);
+    wheel.arm(1, record, 1);
+    wheel.arm(3, record, 3);
+    wheel.arm(0, record, 0); // treated as one tick
+    runTo(wheel, 1002);
+    TEST_ASSERT_EQUAL(2, g_fired.size());
+    runTo(wheel, 1010);
+    const uint32_t expected[] = {1, 0, 3, 5};
+    TEST_ASSERT_EQUAL(4, g_fired.size());
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(expected, g_fired.data(), 4);
+    TEST_ASSERT_EQUAL(0, wheel.pending());
+}
+
+void test_cascades_across_levels() {
+    TimerWheel wheel(8, MEM_SCHEDULE);
+    TEST_ASSERT_TRUE(wheel.begin(37));
+    const uint32_t delays[] = {TimerWheel::SLOTS + 5,                       // level 1
+                               TimerWheel::SLOTS * TimerWheel::SLOTS + 7,   // level 2
+                               TimerWheel::SLOTS * TimerWheel::SLOTS * 70}; // level 3
+    for (uint32_t d : delays) wheel.arm(d, record, d);
+    for (size_t i = 0; i < 3; i++) {
+        runTo(wheel, 37 + delays[i] - 1);
+        TEST_ASSERT_EQUAL_MESSAGE(i, g_fired.size(), "fired early");
+        runTo(wheel, 37 + delays[i]);
+        TEST_ASSERT_EQUAL_UINT32(delays[i], g_fired.back());
+    }
+    TEST_ASSERT_EQUAL(3, g_fired.size());
+}
+
+void test_cascades_across_the_tick_counter_wrap() {
+    TimerWheel wheel(4, MEM_SCHEDULE);
+    TEST_ASSERT_TRUE(wheel.begin(0xFFFFFFF0));
+    wheel.arm(0x20, record, 1);
+    runTo(wheel, 0x0F);
+    TEST_ASSERT_EQUAL(0, g_fired.size());
+    runTo(wheel, 0x10);
+    TEST_ASSERT_EQUAL(1, g_fired.size());
+}
+
+void test_long_delays_are_clamped() {
+    TimerWheel wheel(2, MEM_SCHEDULE);
+    TEST_ASSERT_TRUE(wheel.begin(0));
+    wheel.arm(0xFFFFFFFF, record, 1);
+    wheel.advance(TimerWheel::MAX_DELAY);
+    TimerWheel::Callback cb;
+    uint32_t arg;
+    TEST_ASSERT_TRUE(wheel.popExpired(cb, arg));
+    TEST_ASSERT_EQUAL_UINT32(1, arg);
+}
+
+void test_cancel_ignores_stale_handles() {
+    TimerWheel wheel(1, MEM_SCHEDULE);
+    TEST_ASSERT_TRUE(wheel.begin(0));
+    TEST_ASSERT_FALSE(wheel.cancel(0));
+
+    TimerWheel::Handle fired = wheel.arm(2, record, 1);
+    runTo(wheel, 2);
+    TEST_ASSERT_EQUAL(1, g_fired.size());
+    TEST_ASSERT_FALSE(wheel.cancel(fired));
+
+    // Same node, new generation: the old handle must not cancel it
+    TimerWheel::Handle cancelled = wheel.arm(2, record, 2);
+    TEST_ASSERT_TRUE(wheel.cancel(cancelled));
+    TEST_ASSERT_FALSE(wheel.cancel(cancelled));
+    TimerWheel::Handle live = wheel.arm(2, record, 3);
+    TEST_ASSERT_FALSE(wheel.cancel(fired));
+    TEST_ASSERT_FALSE(wheel.cancel(cancelled));
+    runTo(wheel, 4);
+    TEST_ASSERT_EQUAL(2, g_fired.size());
+    TEST_ASSERT_EQUAL_UINT32(3, g_fired.back());
+    TEST_ASSERT_FALSE(wheel.cancel(live));
+}
+
+void test_pool_exhaustion() {
+    TimerWheel wheel(3, MEM_SCHEDULE);
+    TEST_ASSERT_EQUAL(0, wheel.arm(1, record, 0)); // before begin()
+    TEST_ASSERT_TRUE(wheel.begin(0));
+    TimerWheel::Handle h[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        h[i] = wheel.arm(10 + i, record, i);
+        TEST_ASSERT_NOT_EQUAL(0, h[i]);
+    }
+    TEST_ASSERT_EQUAL(3, wheel.pending());
+    TEST_ASSERT_EQUAL(0, wheel.arm(1, record, 9));
+
+    TEST_ASSERT_TRUE(wheel.cancel(h[1]));
+    TEST_ASSERT_NOT_EQUAL(0, wheel.arm(1, record, 9));
+    TEST_ASSERT_EQUAL(0, wheel.arm(1, record, 10));
+    runTo(wheel, 20);
+    const uint32_t expected[] = {9, 0, 2};
+    TEST_ASSERT_EQUAL(3, g_fired.size());
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(expected, g_fired.data(), 3);
+    TEST_ASSERT_EQUAL(0, wheel.pending());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fires_in_expiry_order);
+    RUN_TEST(test_cascades_across_levels);
+    RUN_TEST(test_cascades_across_the_tick_counter_wrap);
+    RUN_TEST(test_long_delays_are_clamped);
+    RUN_TEST(test_cancel_ignores_stale_handles);
+    RUN_TEST(test_pool_exhaustion);
+    return UNITY_END();
+}
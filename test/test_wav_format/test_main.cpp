@@ -0,0 +1,269 @@
+// WAV container parsing, sample conversion and streaming decode behind the
+// I2S backend's decoder, and the file sink that renders its output.
+
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "PcmSink.h"
+#include "WavFormat.h"
+
+namespace {
+
+class MemorySource : public WavSource {
+public:
+    explicit MemorySource(const std::vector<uint8_t> &bytes) : bytes_(bytes) {}
+
+    size_t read(uint8_t *buf, size_t len) override {
+        size_t n = pos_ < bytes_.size() ? bytes_.size() - pos_ : 0;
+        if (n > len) n = len;
+        memcpy(buf, bytes_.data() + pos_, n);
+        pos_ += n;
+        return n;
+    }
+
+    bool skip(uint32_t bytes) override {
+        if (pos_ + bytes > bytes_.size()) return false;
+        pos_ += bytes;
+        return true;
+    }
+
+    size_t pos() const { return pos_; }
+
+private:
+    const std::vector<uint8_t> &bytes_;
+    size_t pos_ = 0;
+};
+
+void put(std::vector<uint8_t> &v, const char *tag) {
+    v.insert(v.end(), tag, tag + 4);
+}
+
+void put16(std::vector<uint8_t> &v, uint16_t x) {
+    v.push_back(x & 0xff);
+    v.push_back(x >> 8);
+}
+
+void put32(std::vector<uint8_t> &v, uint32_t x) {
+    put16(v, x & 0xffff);
+    put16(v, x >> 16);
+}
+
+void fmtChunk(std::vector<uint8_t> &v, uint16_t format, uint16_t channels, uint32_t rate, uint16_t bits,
+              uint32_t extra = 0) {
+    put(v, "fmt ");
+    put32(v, 16 + extra);
+    put16(v, format);
+    put16(v, channels);
+    put32(v, rate);
+    put32(v, rate * channels * bits / 8);
+    put16(v, channels * bits / 8);
+    put16(v, bits);
+    v.insert(v.end(), extra, 0);
+}
+
+std::vector<uint8_t> readFile(const char *path) {
+    std::vector<uint8_t> bytes;
+    FILE *f = fopen(path, "rb");
+    if (!f) return bytes;
+    uint8_t buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) bytes.insert(bytes.end(), buf, buf + n);
+    fclose(f);
+    return bytes;
+}
+
+std::vector<uint8_t> riff() {
+    std::vector<uint8_t> v;
+    put(v, "RIFF");
+    put32(v, 0); // size is not checked
+    put(v, "WAVE");
+    return v;
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_parses_plain_pcm() {
+    std::vector<uint8_t> v = riff();
+    fmtChunk(v, 1, 2, 44100, 16);
+    put(v, "data");
+    put32(v, 400);
+    size_t dataAt = v.size();
+    v.insert(v.end(), 400, 0);
+    MemorySource src(v);
+    WavFormat f;
+    TEST_ASSERT_TRUE(wavParseHeader(src, f));
+    TEST_ASSERT_EQUAL(2, f.channels);
+    TEST_ASSERT_EQUAL_UINT32(44100, f.rate);
+    TEST_ASSERT_EQUAL(16, f.bits);
+    TEST_ASSERT_EQUAL_UINT32(4, f.frameBytes);
+    TEST_ASSERT_EQUAL_UINT32(400, f.dataBytes);
+    TEST_ASSERT_EQUAL(dataAt, src.pos());
+}
+
+void test_skips_unknown_and_odd_sized_chunks() {
+    std::vector<uint8_t> v = riff();
+    // Extensible fmt chunk with its 24-byte extension
+    fmtChunk(v, 0xFFFE, 1, 22050, 8, 24);
+    put(v, "LIST");
+    put32(v, 5); // odd: padded to 6
+    v.insert(v.end(), 6, 'x');
+    put(v, "data");
+    put32(v, 3);
+    size_t dataAt = v.size();
+    v.insert(v.end(), {0x80, 0xff, 0x00});
+    MemorySource src(v);
+    WavFormat f;
+    TEST_ASSERT_TRUE(wavParseHeader(src, f));
+    TEST_ASSERT_EQUAL(1, f.channels);
+    TEST_ASSERT_EQUAL_UINT32(1, f.frameBytes);
+    TEST_ASSERT_EQUAL_UINT32(3, f.dataBytes);
+    TEST_ASSERT_EQUAL(dataAt, src.pos());
+}
+
+void test_rejects_what_the_decoder_cannot_play() {
+    struct {
+        uint16_t format, channels, bits;
+    } bad[] = {{3, 2, 32}, {1, 2, 24}, {1, 6, 16}, {1, 0, 16}, {2, 1, 4}};
+    for (auto &b : bad) {
+        std::vector<uint8_t> v = riff();
+        fmtChunk(v, b.format, b.channels, 8000, b.bits);
+        put(v, "data");
+        put32(v, 0);
+        MemorySource src(v);
+        WavFormat f;
+        TEST_ASSERT_FALSE(wavParseHeader(src, f));
+    }
+}
+
+void test_rejects_broken_containers() {
+    WavFormat f;
+    std::vector<uint8_t> dataFirst = riff();
+    put(dataFirst, "data");
+    put32(dataFirst, 0);
+    fmtChunk(dataFirst, 1, 1, 8000, 8);
+    MemorySource a(dataFirst);
+    TEST_ASSERT_FALSE(wavParseHeader(a, f));
+
+    std::vector<uint8_t> noData = riff();
+    fmtChunk(noData, 1, 1, 8000, 8);
+    MemorySource b(noData);
+    TEST_ASSERT_FALSE(wavParseHeader(b, f));
+
+    std::vector<uint8_t> chunkPastEnd = riff();
+    fmtChunk(chunkPastEnd, 1, 1, 8000, 8);
+    put(chunkPastEnd, "junk");
+    put32(chunkPastEnd, 1000);
+    MemorySource c(chunkPastEnd);
+    TEST_ASSERT_FALSE(wavParseHeader(c, f));
+
+    std::vector<uint8_t> notWave = riff();
+    memcpy(notWave.data() + 8, "AVI ", 4);
+    MemorySource d(notWave);
+    TEST_ASSERT_FALSE(wavParseHeader(d, f));
+}
+
+void test_converts_8_bit_mono_to_16_bit_stereo() {
+    WavFormat f;
+    f.channels = 1;
+    f.bits = 8;
+    f.frameBytes = 1;
+    const uint8_t in[] = {0x80, 0xff, 0x00, 0x81};
+    int16_t out[8];
+    wavToStereo16(in, 4, f, out);
+    const int16_t expected[] = {0, 0, 32512, 32512, -32768, -32768, 256, 256};
+    TEST_ASSERT_EQUAL_MEMORY(expected, out, sizeof(expected));
+}
+
+void test_converts_16_bit_mono_and_stereo() {
+    WavFormat mono;
+    mono.channels = 1;
+    mono.bits = 16;
+    mono.frameBytes = 2;
+    const uint8_t monoIn[] = {0x34, 0x12, 0x00, 0x80};
+    int16_t out[4];
+    wavToStereo16(monoIn, 2, mono, out);
+    const int16_t monoExpected[] = {0x1234, 0x1234, -32768, -32768};
+    TEST_ASSERT_EQUAL_MEMORY(monoExpected, out, sizeof(monoExpected));
+
+    WavFormat stereo = mono;
+    stereo.channels = 2;
+    stereo.frameBytes = 4;
+    const uint8_t stereoIn[] = {0x01, 0x00, 0xff, 0xff, 0xff, 0x7f, 0x00, 0x00};
+    wavToStereo16(stereoIn, 2, stereo, out);
+    const int16_t stereoExpected[] = {1, -1, 32767, 0};
+    TEST_ASSERT_EQUAL_MEMORY(stereoExpected, out, sizeof(stereoExpected));
+}
+
+void test_sink_header_reads_back() {
+    std::vector<uint8_t> v(WAV_HEADER_BYTES);
+    wavHeader(v.data(), 48000, 1000);
+    v.resize(WAV_HEADER_BYTES + 4000);
+    MemorySource src(v);
+    WavFormat f;
+    TEST_ASSERT_TRUE(wavParseHeader(src, f));
+    TEST_ASSERT_EQUAL(2, f.channels);
+    TEST_ASSERT_EQUAL(16, f.bits);
+    TEST_ASSERT_EQUAL_UINT32(48000, f.rate);
+    TEST_ASSERT_EQUAL_UINT32(4000, f.dataBytes);
+    TEST_ASSERT_EQUAL(WAV_HEADER_BYTES, src.pos());
+    // RIFF size covers everything after its own field
+    TEST_ASSERT_EQUAL_UINT32(v.size() - 8, v[4] | v[5] << 8 | v[6] << 16 | static_cast<uint32_t>(v[7]) << 24);
+}
+
+void test_decoder_streams_through_the_file_sink() {
+    // 8-bit mono claiming more data than the file holds (truncated)
+    std::vector<uint8_t> v = riff();
+    fmtChunk(v, 1, 1, 8000, 8);
+    put(v, "data");
+    put32(v, 5000);
+    for (int i = 0; i < 3000; i++) v.push_back(static_cast<uint8_t>(i));
+    MemorySource src(v);
+    WavDecoder dec;
+    TEST_ASSERT_TRUE(dec.begin(src));
+    TEST_ASSERT_EQUAL_UINT32(5000, dec.lengthFrames());
+
+    const char *path = "test_wav_sink.wav";
+    WavFileSink sink(path);
+    TEST_ASSERT_TRUE(sink.begin(dec.format().rate));
+    int16_t buf[2 * 700]; // not a multiple of the decoder's read size
+    size_t n, total = 0;
+    while ((n = dec.read(buf, 700)) > 0) {
+        TEST_ASSERT_EQUAL(n, sink.write(buf, n));
+        total += n;
+    }
+    sink.end();
+    TEST_ASSERT_EQUAL(3000, total);
+    TEST_ASSERT_EQUAL_UINT32(3000, sink.frames());
+
+    std::vector<uint8_t> out = readFile(path);
+    remove(path);
+    TEST_ASSERT_EQUAL(WAV_HEADER_BYTES + 3000 * 4, out.size());
+    MemorySource back(out);
+    WavFormat f;
+    TEST_ASSERT_TRUE(wavParseHeader(back, f));
+    TEST_ASSERT_EQUAL_UINT32(8000, f.rate);
+    TEST_ASSERT_EQUAL_UINT32(3000 * 4, f.dataBytes);
+    std::vector<int16_t> expected(2 * 3000);
+    wavToStereo16(v.data() + v.size() - 3000, 3000, dec.format(), expected.data());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), out.data() + WAV_HEADER_BYTES, 3000 * 4);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_parses_plain_pcm);
+    RUN_TEST(test_skips_unknown_and_odd_sized_chunks);
+    RUN_TEST(test_rejects_what_the_decoder_cannot_play);
+    RUN_TEST(test_rejects_broken_containers);
+    RUN_TEST(test_converts_8_bit_mono_to_16_bit_stereo);
+    RUN_TEST(test_converts_16_bit_mono_and_stereo);
+    RUN_TEST(test_sink_header_reads_back);
+    RUN_TEST(test_decoder_streams_through_the_file_sink);
+    return UNITY_END();
+}
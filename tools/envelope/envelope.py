@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Precompute loudness and beat envelopes for the soundtrack.
+
+The firmware streams <ENVELOPE_DIR>/NNN.env while track NNN plays and uses
+it to drive the fire, the mill and smoke bursts (format: include/Envelope.h).
+Build them into the LittleFS image source, next to the I2S tracks:
+
+    envelope.py build sd/001.mp3 sd/002.mp3 -o data/audio
+    envelope.py build storm.wav --track 7 -o data/audio --rate 250
+    envelope.py show data/audio/001.env
+
+WAV files are read directly; anything else is decoded with ffmpeg, which must
+be on PATH. The track number comes from the file name's leading digits
+(DFPlayer naming) unless --track is given; for the I2S backend it is the
+file's position in the sorted /audio list.
+
+Loudness is the frame RMS in dB, normalised so the track's loud passages
+(98th percentile) reach 255 and LOUDNESS_RANGE_DB below that is 0. Beats
+are onsets in the low band (kick, drums, thunder): frames whose energy
+jumps well above the last second's average, reduced to one peak per
+BEAT_MIN_GAP_S and scaled by how far they stand out.
+"""
+
+import argparse
+import array
+import math
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import wave
+
+MAGIC = b"ENV1"
+VERSION = 0
+HEADER = struct.Struct("<4sHBBI")
+
+DECODE_RATE = 22050
+LOUDNESS_RANGE_DB = 40.0
+BASS_CUTOFF_HZ = 150.0
+BEAT_HISTORY_S = 1.0
+BEAT_MIN_GAP_S = 0.12
+BEAT_THRESHOLD = 1.6  # energy over the running average that counts as an onset
+
+
+def read_wav(path):
+    with wave.open(path, "rb") as w:
+        width, channels, rate = w.getsampwidth(), w.getnchannels(), w.getframerate()
+        raw = w.readframes(w.getnframes())
+    if width == 1:
+        samples = [(b - 128) << 8 for b in raw]
+    elif width == 2:
+        samples = array.array("h", raw)
+        if sys.byteorder != "little":
+            samples.byteswap()
+    elif width in (3, 4):
+        samples = [int.from_bytes(raw[i:i + width], "little", signed=True) >> (8 * (width - 2))
+                   for i in range(0, len(raw), width)]
+    else:
+        raise ValueError("%s: %d-byte samples not supported" % (path, width))
+    if channels > 1:
+        samples = [sum(samples[i:i + channels]) // channels for i in range(0, len(samples), channels)]
+    return samples, rate
+
+
+def read_ffmpeg(path):
+    if not shutil.which("ffmpeg"):
+        raise ValueError("%s: not a WAV file and ffmpeg is not on PATH" % path)
+    raw = subprocess.run(["ffmpeg", "-v", "error", "-i", path, "-f", "s16le", "-ac", "1",
+                          "-ar", str(DECODE_RATE), "-"], check=True, stdout=subprocess.PIPE).stdout
+    samples = array.array("h", raw)
+    if sys.byteorder != "little":
+        samples.byteswap()
+    return samples, DECODE_RATE
+
+
+def decode(path):
+    if path.lower().endswith(".wav"):
+        try:
+            return read_wav(path)
+        except wave.Error:
+            pass  # compressed WAV; let ffmpeg have it
+    return read_ffmpeg(path)
+
+
+def frame_energies(samples, sample_rate, rate):
+    """Mean square per frame, full band and low band."""
+    alpha = 1.0 - math.exp(-2.0 * math.pi * BASS_CUTOFF_HZ / sample_rate)
+    count = int(len(samples) * rate / sample_rate)
+    full, bass = [], []
+    low = 0.0
+    start = 0
+    for f in range(count):
+        end = min(len(samples), int((f + 1) * sample_rate / rate))
+        e = eb = 0.0
+        for i in range(start, end):
+            x = samples[i] / 32768.0
+            low += alpha * (x - low)
+            e += x * x
+            eb += low * low
+        n = max(1, end - start)
+        full.append(e / n)
+        bass.append(eb / n)
+        start = end
+    return full, bass
+
+
+def loudness(full):
+    db = [10.0 * math.log10(e) if e > 1e-10 else -100.0 for e in full]
+    ordered = sorted(db)
+    top = ordered[min(len(ordered) - 1, int(len(ordered) * 0.98))] if ordered else 0.0
+    floor = top - LOUDNESS_RANGE_DB
+    return [max(0, min(255, round((d - floor) * 255.0 / LOUDNESS_RANGE_DB))) for d in db]
+
+
+def beats(bass, rate):
+    history = max(1, int(BEAT_HISTORY_S * rate))
+    gap = max(1, int(BEAT_MIN_GAP_S * rate))
+    strength = [0.0] * len(bass)
+    running = 0.0
+    for f, e in enumerate(bass):
+        avg = running / min(f, history) if f else 0.0
+        if f >= history:
+            running -= bass[f - history]
+        running += e
+        if avg > 1e-9 and e > avg * BEAT_THRESHOLD:
+            strength[f] = e / avg
+    # One peak per gap: drop anything a stronger neighbour covers
+    out = [0] * len(bass)
+    for f, s in enumerate(strength):
+        if s and s == max(strength[max(0, f - gap):f + gap + 1]):
+            # BEAT_THRESHOLD -> 1, four times that -> 255
+            out[f] = max(1, min(255, round((s - BEAT_THRESHOLD) * 255.0 / (3 * BEAT_THRESHOLD)) + 1))
+    return out
+
+
+def track_number(path):
+    m = re.match(r"(\d+)", os.path.basename(path))
+    return int(m.group(1)) if m else None
+
+
+def cmd_build(args):
+    if args.track is not None and len(args.files) != 1:
+        sys.exit("--track needs exactly one file")
+    os.makedirs(args.output, exist_ok=True)
+    for path in args.files:
+        track = args.track if args.track is not None else track_number(path)
+        if not track:
+            sys.exit("%s: no leading track number, use --track" % path)
+        samples, sample_rate = decode(path)
+        full, bass = frame_energies(samples, sample_rate, args.rate)
+        loud = loudness(full)
+        beat = beats(bass, args.rate)
+        body = bytearray()
+        for l, b in zip(loud, beat):
+            body += bytes((l, b))
+        out = os.path.join(args.output, "%03d.env" % track)
+        with open(out, "wb") as f:
+            f.write(HEADER.pack(MAGIC, args.rate, VERSION, 0, len(loud)))
+            f.write(body)
+        print("%s -> %s: %d frames at %d Hz (%.1f s), %d beats, %d bytes"
+              % (path, out, len(loud), args.rate, len(loud) / args.rate, sum(1 for b in beat if b),
+                 HEADER.size + len(body)))
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, rate, version, _, frames = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        sys.exit("%s: not an envelope" % path)
+    body = data[HEADER.size:HEADER.size + 2 * frames]
+    return rate, list(body[0::2]), list(body[1::2])
+
+
+def cmd_show(args):
+    rate, loud, beat = load(args.file)
+    print("%s: %d frames at %d Hz (%.1f s), %d beats" % (args.file, len(loud), rate, len(loud) / rate,
+                                                         sum(1 for b in beat if b)))
+    step = max(1, int(rate * args.step))
+    for f in range(0, len(loud), step):
+        level = max(loud[f:f + step])
+        hit = max(beat[f:f + step])
+        print("%7.2f s %3d %-32s %s" % (f / rate, level, "#" * (level // 8), "* %d" % hit if hit else ""))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("build", help="write NNN.env for each track")
+    p.add_argument("files", nargs="+")
+    p.add_argument("-o", "--output", default="data/audio", help="LittleFS image directory (default data/audio)")
+    p.add_argument("--rate", type=int, default=200, help="frames per second (default 200)")
+    p.add_argument("--track", type=int, help="track number when the file name has none")
+    p.set_defaults(func=cmd_build)
+
+    p = sub.add_parser("show", help="print an envelope as a bar chart")
+    p.add_argument("file")
+    p.add_argument("--step", type=float, default=0.1, help="seconds per line (default 0.1)")
+    p.set_defaults(func=cmd_show)
+
+    args = ap.parse_args()
+    if getattr(args, "rate", 200) < 1 or getattr(args, "rate", 200) > 1000:
+        sys.exit("--rate must be 1-1000")
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
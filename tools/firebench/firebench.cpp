@@ -0,0 +1,81 @@
+// Host benchmark and golden-output check for the fire model (FireSim.h).
+//
+//   g++ -O2 -std=c++17 -Iinclude src/FireSim.cpp tools/firebench/firebench.cpp -o firebench
+//   ./firebench                      check the golden checksum, time a frame
+//   ./firebench --frames 20000 --zones 2 --seed 42
+//   ./firebench --show 40            print the flame (one line per frame)
+//
+// Exits non-zero when the golden checksum does not match, so it can gate a
+// change to the model; the message prints the value to put in FireSim.h.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "FireSim.h"
+
+namespace {
+
+uint32_t goldenChecksum() {
+    FireSim sim;
+    sim.begin(3);
+    sim.reset(FIRE_GOLDEN_SEED);
+    for (int i = 0; i < FIRE_GOLDEN_FRAMES; i++) sim.step();
+    return sim.checksum();
+}
+
+void show(FireSim &sim, int frames) {
+    const char *ramp = " .:-=+*#%@";
+    for (int f = 0; f < frames; f++) {
+        sim.step();
+        char line[FIRE_GRID_H + 1];
+        for (int k = 0; k < FIRE_GRID_H; k++) {
+            uint16_t pos = static_cast<uint16_t>(k * 0xFFFF / (FIRE_GRID_H - 1));
+            line[k] = ramp[sim.heightLevel(pos) * 9 / 0xFFFF];
+        }
+        line[FIRE_GRID_H] = '\0';
+        std::printf("%4d |%s| zones", f, line);
+        for (int z = 0; z < sim.zones(); z++) std::printf(" %5u", sim.zoneLevel(z));
+        std::printf("\n");
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int frames = 100000;
+    int zones = 3;
+    int showFrames = 0;
+    uint32_t seed = FIRE_GOLDEN_SEED;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--frames")) frames = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--zones")) zones = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--seed")) seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 0));
+        else if (!std::strcmp(argv[i], "--show")) showFrames = std::atoi(argv[i + 1]);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    uint32_t golden = goldenChecksum();
+    bool match = golden == FIRE_GOLDEN_CHECKSUM;
+    std::printf("golden: %08x after %d frames (expected %08x) %s\n", golden, FIRE_GOLDEN_FRAMES,
+                FIRE_GOLDEN_CHECKSUM, match ? "ok" : "MISMATCH");
+
+    FireSim sim;
+    sim.begin(zones);
+    sim.reset(seed);
+    if (showFrames > 0) {
+        show(sim, showFrames);
+        return match ? 0 : 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) sim.step();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::printf("grid %dx%d, %d zone(s): %d frames, %.0f ns/frame (checksum %08x)\n", FIRE_GRID_W, FIRE_GRID_H,
+                sim.zones(), frames, frames ? static_cast<double>(ns) / frames : 0.0, sim.checksum());
+    return match ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+// Host run of the filesystem suite (FsBench.h) on littlefs over an in-memory
+// block device, loaded from an image file or freshly formatted. Use it to try
+// cache, lookahead and read sizes that are fixed in the device's sdkconfig,
+// on the image the device actually serves:
+//
+//   pio run -t buildfs                        # .pio/build/<env>/littlefs.bin
+//   git clone https://github.com/littlefs-project/littlefs $LFS
+//   cc -O2 -c $LFS/lfs.c $LFS/lfs_util.c
+//   g++ -O2 -std=c++17 -Iinclude -I$LFS src/FsBench.cpp tools/fsbench/fsbench.cpp lfs.o lfs_util.o -o fsbench
+//
+//   ./fsbench --image .pio/build/esp32-s3-devkitc-1/littlefs.bin --path /index.html
+//   ./fsbench --cache 2048 --lookahead 256 --kb 256
+//
+// Host time says little about SPI flash, so every phase also reports the
+// bytes littlefs read from the block device; --flash-ns adds a modelled
+// cost per device byte to the timings (about 25 ns for 80 MHz QIO).
+// Defaults match esp_littlefs (read/prog 128, cache 512, lookahead 128).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "FsBench.h"
+#include "lfs.h"
+
+namespace {
+
+struct BlockDevice {
+    std::vector<uint8_t> data;
+    uint32_t blockSize = 4096;
+    uint64_t bytesRead = 0;
+};
+
+int bdRead(const lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+    BlockDevice *bd = static_cast<BlockDevice *>(c->context);
+    std::memcpy(buffer, &bd->data[static_cast<size_t>(block) * bd->blockSize + off], size);
+    bd->bytesRead += size;
+    return 0;
+}
+
+int bdProg(const lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
+    BlockDevice *bd = static_cast<BlockDevice *>(c->context);
+    std::memcpy(&bd->data[static_cast<size_t>(block) * bd->blockSize + off], buffer, size);
+    return 0;
+}
+
+int bdErase(const lfs_config *c, lfs_block_t block) {
+    BlockDevice *bd = static_cast<BlockDevice *>(c->context);
+    std::memset(&bd->data[static_cast<size_t>(block) * bd->blockSize], 0xFF, bd->blockSize);
+    return 0;
+}
+
+int bdSync(const lfs_config *) {
+    return 0;
+}
+
+class LfsTarget : public FsBenchTarget {
+public:
+    LfsTarget(lfs_t &lfs, BlockDevice &bd, uint32_t flashNs) : lfs_(lfs), bd_(bd), flashNs_(flashNs) {}
+
+    uint32_t nowUs() override {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+        return static_cast<uint32_t>(us + bd_.bytesRead * flashNs_ / 1000);
+    }
+    bool open(const char *path, bool write) override {
+        int flags = write ? LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC : LFS_O_RDONLY;
+        return lfs_file_open(&lfs_, &file_, path, flags) == 0;
+    }
+    int read(uint8_t *buf, size_t len) override { return lfs_file_read(&lfs_, &file_, buf, len); }
+    int write(const uint8_t *buf, size_t len) override { return lfs_file_write(&lfs_, &file_, buf, len); }
+    bool seek(uint32_t pos) override { return lfs_file_seek(&lfs_, &file_, pos, LFS_SEEK_SET) >= 0; }
+    uint32_t size() override { return lfs_file_size(&lfs_, &file_); }
+    void close() override { lfs_file_close(&lfs_, &file_); }
+    bool exists(const char *path) override {
+        lfs_info info;
+        return lfs_stat(&lfs_, path, &info) == 0;
+    }
+    int list(const char *dir) override {
+        lfs_dir_t d;
+        if (lfs_dir_open(&lfs_, &d, dir) != 0) return -1;
+        lfs_info info;
+        int n = 0;
+        while (lfs_dir_read(&lfs_, &d, &info) > 0) {
+            if (std::strcmp(info.name, ".") && std::strcmp(info.name, "..")) n++;
+        }
+        lfs_dir_close(&lfs_, &d);
+        return n;
+    }
+    bool remove(const char *path) override { return lfs_remove(&lfs_, path) == 0; }
+    uint64_t deviceBytesRead() override { return bd_.bytesRead; }
+
+private:
+    lfs_t &lfs_;
+    BlockDevice &bd_;
+    uint32_t flashNs_;
+    lfs_file_t file_;
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+bool loadImage(const char *path, BlockDevice &bd) {
+    FILE *f = std::fopen(path, "rb");
+    if (!f) return false;
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    bd.data.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    bool ok = size > 0 && std::fread(bd.data.data(), 1, bd.data.size(), f) == bd.data.size();
+    std::fclose(f);
+    return ok;
+}
+
+void printTiming(const char *name, const FsBenchTiming &t) {
+    std::printf("%-12s %6u ops  avg %7u us  max %7u us", name, t.count, t.avgUs(), t.maxUs);
+    if (t.bytes) std::printf("  %7u KiB/s", t.kibPerSec());
+    std::printf("  device %8llu B\n", static_cast<unsigned long long>(t.deviceBytes));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *image = nullptr;
+    const char *path = nullptr;
+    uint32_t blocks = 256;
+    uint32_t readSize = 128, progSize = 128, cacheSize = 512, lookahead = 128;
+    uint32_t flashNs = 0;
+    BlockDevice bd;
+    FsBenchConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char *v = argv[i + 1];
+        uint32_t n = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+        if (!std::strcmp(argv[i], "--image")) image = v;
+        else if (!std::strcmp(argv[i], "--path")) path = v;
+        else if (!std::strcmp(argv[i], "--block-size")) bd.blockSize = n;
+        else if (!std::strcmp(argv[i], "--blocks")) blocks = n;
+        else if (!std::strcmp(argv[i], "--read-size")) readSize = n;
+        else if (!std::strcmp(argv[i], "--prog-size")) progSize = n;
+        else if (!std::strcmp(argv[i], "--cache")) cacheSize = n;
+        else if (!std::strcmp(argv[i], "--lookahead")) lookahead = n;
+        else if (!std::strcmp(argv[i], "--flash-ns")) flashNs = n;
+        else if (!std::strcmp(argv[i], "--kb")) config.scratchBytes = n * 1024;
+        else if (!std::strcmp(argv[i], "--reads")) config.randomReads = n;
+        else if (!std::strcmp(argv[i], "--size")) config.randomReadBytes = n;
+        else if (!std::strcmp(argv[i], "--ops")) config.metaOps = n;
+        else if (!std::strcmp(argv[i], "--seed")) config.seed = n;
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (image) {
+        if (!loadImage(image, bd) || bd.data.size() % bd.blockSize) {
+            std::fprintf(stderr, "cannot load %s as %u-byte blocks\n", image, bd.blockSize);
+            return 2;
+        }
+        blocks = static_cast<uint32_t>(bd.data.size() / bd.blockSize);
+    } else {
+        bd.data.assign(static_cast<size_t>(blocks) * bd.blockSize, 0xFF);
+    }
+
+    lfs_config cfg;
+    std::memset(&cfg, 0, sizeof(cfg));
+    cfg.context = &bd;
+    cfg.read = bdRead;
+    cfg.prog = bdProg;
+    cfg.erase = bdErase;
+    cfg.sync = bdSync;
+    cfg.read_size = readSize;
+    cfg.prog_size = progSize;
+    cfg.block_size = bd.blockSize;
+    cfg.block_count = blocks;
+    cfg.block_cycles = 512;
+    cfg.cache_size = cacheSize;
+    cfg.lookahead_size = lookahead;
+
+    lfs_t lfs;
+    if (!image && lfs_format(&lfs, &cfg) != 0) {
+        std::fprintf(stderr, "format failed\n");
+        return 1;
+    }
+    if (lfs_mount(&lfs, &cfg) != 0) {
+        std::fprintf(stderr, "mount failed (check --block-size)\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> buffer(8192);
+    config.path = path;
+    config.buffer = buffer.data();
+    config.bufferBytes = buffer.size();
+    LfsTarget target(lfs, bd, flashNs);
+    FsBenchResult r;
+    bool ok = fsBenchRun(target, config, r);
+    lfs_unmount(&lfs);
+
+    std::printf("%u x %u B blocks, read %u, prog %u, cache %u, lookahead %u%s\n", blocks, bd.blockSize, readSize,
+                progSize, cacheSize, lookahead, flashNs ? ", modelled flash" : "");
+    std::printf("%s: %u bytes\n", path ? path : FSBENCH_SCRATCH_PATH, r.fileBytes);
+    printTiming("open", r.open);
+    for (int c = 0; c < FSBENCH_MAX_CHUNKS && r.chunks[c]; c++) {
+        char name[24];
+        std::snprintf(name, sizeof(name), "seq %u", r.chunks[c]);
+        printTiming(name, r.sequential[c]);
+    }
+    printTiming("random", r.random);
+    printTiming("stat", r.stat);
+    printTiming("list", r.list);
+    printTiming("create", r.create);
+    printTiming("remove", r.remove);
+    if (!ok) std::fprintf(stderr, "failed: %s\n", r.error);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""Decode, profile and replay the device state journal.
+
+The firmware appends delta-encoded state changes to /journal.bin on LittleFS
+and rotates the previous file to /journal.1.bin (format: include/Journal.h).
+Fetch both from the device, then:
+
+    journal.py fetch --host 192.168.4.1 -o run/
+    journal.py timeline run/journal.1.bin run/journal.bin
+    journal.py profile run/journal.1.bin run/journal.bin
+    journal.py replay run/journal.bin --host 192.168.4.2 --speed 4 --pwd secret
+
+Replay drives a second device through the regular HTTP API so a recorded show
+(or the sequence of requests that led to a fault) can be reproduced on the
+bench. LED frames rendered by the fire or a user effect are not journaled;
+replaying the effect's start reproduces them.
+"""
+
+import argparse
+import http.client
+import os
+import sys
+import time
+from collections import Counter, defaultdict
+from urllib.parse import quote
+
+FILE_MAGIC = b"DJ01"
+BATCH_MAGIC = ord("J")
+TAG_AUDIO = 0x40
+TAG_CAUSE = 0x41
+TAG_EFFECT = 0x42
+TAG_BOOT = 0xF0
+TAG_KEYFRAME = 0xF1
+
+# Must match enum JournalField
+FIELDS = ["led0", "led1", "led2", "smoke0", "smoke1", "mill", "fire", "playing", "volume"]
+AUDIO_CMDS = {1: "play", 2: "stop", 3: "volume", 4: "reinit"}
+LED_COLORS = ["red", "yellow", "green"]
+
+# esp_reset_reason_t
+RESET_REASONS = ["unknown", "poweron", "ext", "sw", "panic", "int_wdt", "task_wdt", "wdt",
+                 "deepsleep", "brownout", "sdio"]
+
+
+class Reader:
+    def __init__(self, data, pos=0):
+        self.data = data
+        self.pos = pos
+
+    def eof(self):
+        return self.pos >= len(self.data)
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise EOFError
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        value = shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            if b < 0x80:
+                return value
+            shift += 7
+
+    def zigzag(self):
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+    def bytes(self, n):
+        if self.pos + n > len(self.data):
+            raise EOFError
+        out = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return out
+
+
+def decode(path):
+    """Yield (ms, kind, detail, cause, state) for every record in a journal file.
+
+    kind is a field name, "audio", "effect", "boot" or "keyframe"; state is the full field
+    dict after the record is applied.
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(FILE_MAGIC):
+        raise ValueError(f"{path}: not a journal file")
+    r = Reader(data, len(FILE_MAGIC))
+    while not r.eof():
+        try:
+            if r.byte() != BATCH_MAGIC:
+                raise ValueError(f"{path}: bad batch header at offset {r.pos - 1}")
+            length = r.byte() | r.byte() << 8
+            batch = Reader(r.bytes(length))
+        except EOFError:
+            print(f"{path}: truncated final batch", file=sys.stderr)
+            return
+        yield from decode_batch(path, batch)
+
+
+def decode_batch(path, r):
+    try:
+        if r.byte() != TAG_KEYFRAME:
+            raise ValueError(f"{path}: batch without keyframe")
+        ms = r.varint()
+        state = {name: r.varint() for name in FIELDS}
+        cause = ""
+        yield ms, "keyframe", None, cause, dict(state)
+        while not r.eof():
+            ms += r.varint()
+            tag = r.byte()
+            if tag < len(FIELDS):
+                name = FIELDS[tag]
+                state[name] += r.zigzag()
+                yield ms, name, state[name], cause, dict(state)
+            elif tag == TAG_AUDIO:
+                cmd = r.byte()
+                arg = r.zigzag()
+                yield ms, "audio", (AUDIO_CMDS.get(cmd, str(cmd)), arg), cause, dict(state)
+            elif tag == TAG_CAUSE:
+                cause = r.bytes(r.varint()).decode("utf-8", "replace")
+            elif tag == TAG_EFFECT:
+                name = r.bytes(r.varint()).decode("utf-8", "replace")
+                yield ms, "effect", name or None, cause, dict(state)
+            elif tag == TAG_BOOT:
+                reason = r.varint()
+                name = RESET_REASONS[reason] if reason < len(RESET_REASONS) else str(reason)
+                yield ms, "boot", name, cause, dict(state)
+            else:
+                raise ValueError(f"{path}: unknown tag 0x{tag:02x}")
+    except EOFError:
+        print(f"{path}: corrupt batch", file=sys.stderr)
+
+
+def decode_all(paths):
+    for path in paths:
+        yield from decode(path)
+
+
+def fmt_ms(ms):
+    s, ms = divmod(ms, 1000)
+    m, s = divmod(s, 60)
+    h, m = divmod(m, 60)
+    return f"{h:02d}:{m:02d}:{s:02d}.{ms:03d}"
+
+
+def cmd_timeline(args):
+    for ms, kind, detail, cause, _ in decode_all(args.files):
+        if kind == "keyframe" and not args.keyframes:
+            continue
+        if kind == "audio":
+            detail = f"{detail[0]} {detail[1]}"
+        suffix = f"  <- {cause}" if cause else ""
+        print(f"{fmt_ms(ms)}  {kind:<8} {detail if detail is not None else ''}{suffix}")
+
+
+def cmd_profile(args):
+    per_field = Counter()
+    per_cause = Counter()
+    per_cause_field = defaultdict(Counter)
+    boots = []
+    first = last = None
+    for ms, kind, detail, cause, _ in decode_all(args.files):
+        if kind == "keyframe":
+            continue
+        if kind == "boot":
+            boots.append((ms, detail))
+            continue
+        first = ms if first is None else first
+        last = ms
+        per_field[kind] += 1
+        per_cause[cause or "(internal)"] += 1
+        per_cause_field[cause or "(internal)"][kind] += 1
+
+    total = sum(per_field.values())
+    span = (last - first) / 1000 if total and last > first else 0
+    print(f"{total} change(s) over {span:.1f}s, {len(boots)} boot(s)")
+    for ms, reason in boots:
+        print(f"  boot at {fmt_ms(ms)}: {reason}")
+    print("\nper field:")
+    for name, n in per_field.most_common():
+        rate = f"{n / span:8.2f}/s" if span else ""
+        print(f"  {name:<10} {n:8d} {rate}")
+    print("\nper cause:")
+    for cause, n in per_cause.most_common(args.top):
+        fields = ", ".join(f"{k}={v}" for k, v in per_cause_field[cause].most_common())
+        print(f"  {n:8d}  {cause}  [{fields}]")
+
+
+def replay_requests(kind, detail, state, pwd):
+    """Map one journal record to the API request(s) that reproduce it."""
+    if kind.startswith("led"):
+        color = LED_COLORS[int(kind[3])]
+        level = detail >> 8
+        on = "on" if level else "off"
+        return [f"/api/led?color={color}&state={on}&brightness={level}"]
+    if kind.startswith("smoke"):
+        return [f"/api/smoke?action=set&led={int(kind[5]) + 1}&brightness={255 if detail else 0}"]
+    if kind == "mill":
+        if pwd is None:
+            return []
+        return [f"/api/mill?power={detail}&pwd={quote(pwd)}"]
+    if kind == "fire":
+        return ["/api/boost?action=" + ("start" if detail else "stop")]
+    if kind == "effect":
+        return [f"/api/effects/run?name={quote(detail)}" if detail else "/api/effects/stop"]
+    if kind == "volume":
+        return [f"/api/sd/volume?level={detail}"]
+    if kind == "audio":
+        cmd, arg = detail
+        if cmd == "play":
+            return [f"/api/sd/play?path={arg}"]
+        if cmd == "stop":
+            return ["/api/sd/stop"]
+    return []
+
+
+def cmd_replay(args):
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    if args.pwd is None:
+        print("no --pwd given: mill changes are skipped", file=sys.stderr)
+    start_wall = None
+    start_ms = None
+    last_ms = None
+    sent = failed = 0
+    for ms, kind, detail, cause, state in decode_all(args.files):
+        # A reboot restarts millis(); re-anchor the replay clock. Keyframes
+        # start every batch and must not, or the gaps between batches vanish.
+        if kind == "boot" or (last_ms is not None and ms < last_ms):
+            start_wall = start_ms = None
+        last_ms = ms
+        if kind in ("keyframe", "boot"):
+            continue
+        if start_ms is None:
+            start_ms, start_wall = ms, time.monotonic()
+        if args.start is not None and ms < args.start:
+            continue
+        due = start_wall + (ms - start_ms) / 1000 / args.speed
+        delay = due - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+        for path in replay_requests(kind, detail, state, args.pwd):
+            if args.verbose:
+                print(f"{fmt_ms(ms)}  GET {path}" + (f"  <- {cause}" if cause else ""))
+            try:
+                conn.request("GET", path)
+                resp = conn.getresponse()
+                resp.read()
+                ok = resp.status < 400
+            except (OSError, http.client.HTTPException):
+                conn.close()
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+                ok = False
+            sent += 1
+            failed += 0 if ok else 1
+    print(f"replayed {sent} request(s), {failed} failed")
+    return 1 if failed else 0
+
+
+def cmd_fetch(args):
+    os.makedirs(args.output, exist_ok=True)
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    conn.request("GET", "/api/journal?flush=1")
+    conn.getresponse().read()
+    time.sleep(0.5)  # the flush happens on the next loop pass
+    for name in ("journal.1.bin", "journal.bin"):
+        conn.request("GET", "/" + name)
+        resp = conn.getresponse()
+        body = resp.read()
+        if resp.status != 200:
+            print(f"{name}: HTTP {resp.status}", file=sys.stderr)
+            continue
+        with open(os.path.join(args.output, name), "wb") as f:
+            f.write(body)
+        print(f"{name}: {len(body)} bytes")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="command", required=True)
+
+    def device(p):
+        p.add_argument("--host", required=True)
+        p.add_argument("--port", type=int, default=80)
+        p.add_argument("--timeout", type=float, default=5.0)
+
+    p = sub.add_parser("timeline", help="print every change with its cause")
+    p.add_argument("files", nargs="+", help="oldest first (journal.1.bin before journal.bin)")
+    p.add_argument("--keyframes", action="store_true", help="also print batch keyframes")
+    p.set_defaults(func=cmd_timeline)
+
+    p = sub.add_parser("profile", help="count changes per field and per cause")
+    p.add_argument("files", nargs="+")
+    p.add_argument("--top", type=int, default=20)
+    p.set_defaults(func=cmd_profile)
+
+    p = sub.add_parser("replay", help="reproduce the journal on a device")
+    p.add_argument("files", nargs="+")
+    device(p)
+    p.add_argument("--speed", type=float, default=1.0, help="time scale, 2 = twice as fast")
+    p.add_argument("--start", type=int, help="skip records before this millis() value")
+    p.add_argument("--pwd", help="password for /api/mill (mill changes skipped without it)")
+    p.add_argument("-v", "--verbose", action="store_true")
+    p.set_defaults(func=cmd_replay)
+
+    p = sub.add_parser("fetch", help="flush and download the journal files")
+    device(p)
+    p.add_argument("-o", "--output", default=".")
+    p.set_defaults(func=cmd_fetch)
+
+    args = ap.parse_args()
+    return args.func(args) or 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
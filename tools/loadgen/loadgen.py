@@ -0,0 +1,259 @@
+#!/usr/bin/env python3
+"""Replay recorded UI sessions against the diorama web server.
+
+Each virtual visitor replays a session file (see sessions/) on its own
+keep-alive connection, honouring the recorded inter-request delays. The tool
+reports per-route throughput, p50/p99/p999 latency and error rate, can sweep
+the visitor count to find where control latency degrades, and can save or
+compare against a baseline to catch regressions between firmware versions.
+
+Examples:
+    loadgen.py --host 192.168.4.1 --users 4 --duration 60
+    loadgen.py --host 192.168.4.1 --sweep 1,2,4,8 --save-baseline v1.2.json
+    loadgen.py --host 192.168.4.1 --users 4 --compare v1.2.json
+    loadgen.py --har capture.har --write-session sessions/mine.json
+"""
+
+import argparse
+import http.client
+import json
+import math
+import os
+import sys
+import threading
+import time
+from collections import defaultdict
+from urllib.parse import urlsplit
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_SESSION = os.path.join(HERE, "sessions", "ui_default.json")
+
+
+def route_of(path):
+    """Group requests by route: strip the query string, fold bundle assets."""
+    route = urlsplit(path).path
+    if route.startswith("/assets/"):
+        return "/assets/*"
+    return route
+
+
+def load_session(path):
+    with open(path) as f:
+        session = json.load(f)
+    events = session["events"]
+    events.sort(key=lambda e: e["t_ms"])
+    return session.get("name", os.path.basename(path)), events
+
+
+def session_from_har(har_path):
+    """Turn a browser HAR capture of the UI into a replayable session."""
+    with open(har_path) as f:
+        entries = json.load(f)["log"]["entries"]
+    if not entries:
+        return []
+    from datetime import datetime
+
+    def ts(e):
+        return datetime.fromisoformat(e["startedDateTime"].replace("Z", "+00:00")).timestamp()
+
+    t0 = ts(entries[0])
+    events = []
+    for e in entries:
+        if e["request"]["method"] != "GET":
+            continue
+        url = urlsplit(e["request"]["url"])
+        path = url.path + ("?" + url.query if url.query else "")
+        events.append({"t_ms": int((ts(e) - t0) * 1000), "path": path})
+    return events
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latency = defaultdict(list)  # route -> [seconds]
+        self.errors = defaultdict(int)
+        self.bytes = defaultdict(int)
+
+    def record(self, route, seconds, ok, size):
+        with self.lock:
+            if ok:
+                self.latency[route].append(seconds)
+            else:
+                self.errors[route] += 1
+            self.bytes[route] += size
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    # Nearest rank: the smallest value with at least p% of samples at or below it
+    k = max(0, math.ceil(p / 100.0 * len(sorted_values)) - 1)
+    return sorted_values[min(k, len(sorted_values) - 1)]
+
+
+class Visitor(threading.Thread):
+    def __init__(self, host, port, events, stats, deadline, timeout, speed):
+        super().__init__(daemon=True)
+        self.host, self.port = host, port
+        self.events, self.stats = events, stats
+        self.deadline, self.timeout, self.speed = deadline, timeout, speed
+        self.conn = None
+
+    def connect(self):
+        if self.conn is None:
+            self.conn = http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+
+    def fetch(self, path):
+        route = route_of(path)
+        start = time.perf_counter()
+        ok, size = False, 0
+        try:
+            self.connect()
+            self.conn.request("GET", path, headers={"Connection": "keep-alive"})
+            resp = self.conn.getresponse()
+            body = resp.read()
+            size = len(body)
+            ok = resp.status < 400
+            if resp.getheader("Connection", "").lower() == "close":
+                self.conn.close()
+                self.conn = None
+        except (OSError, http.client.HTTPException):
+            if self.conn is not None:
+                self.conn.close()
+            self.conn = None
+        self.stats.record(route, time.perf_counter() - start, ok, size)
+
+    def run(self):
+        while time.monotonic() < self.deadline:
+            t0 = time.monotonic()
+            for e in self.events:
+                due = t0 + e["t_ms"] / 1000.0 / self.speed
+                now = time.monotonic()
+                if due > self.deadline:
+                    return
+                if due > now:
+                    time.sleep(due - now)
+                self.fetch(e["path"])
+
+
+def run_load(host, port, events, users, duration, ramp, timeout, speed):
+    stats = Stats()
+    start = time.monotonic()
+    deadline = start + duration
+    visitors = []
+    for i in range(users):
+        v = Visitor(host, port, events, stats, deadline, timeout, speed)
+        visitors.append(v)
+        v.start()
+        if ramp > 0 and i + 1 < users:
+            time.sleep(ramp / users)
+    for v in visitors:
+        v.join()
+    elapsed = time.monotonic() - start
+    return summarize(stats, elapsed, users)
+
+
+def summarize(stats, elapsed, users):
+    routes = {}
+    for route in sorted(set(stats.latency) | set(stats.errors)):
+        lat = sorted(stats.latency[route])
+        errs = stats.errors[route]
+        total = len(lat) + errs
+        routes[route] = {
+            "requests": total,
+            "rps": total / elapsed if elapsed else 0.0,
+            "p50_ms": percentile(lat, 50) * 1000,
+            "p99_ms": percentile(lat, 99) * 1000,
+            "p999_ms": percentile(lat, 99.9) * 1000,
+            "error_rate": errs / total if total else 0.0,
+            "bytes": stats.bytes[route],
+        }
+    return {"users": users, "elapsed_s": elapsed, "routes": routes}
+
+
+def print_report(result):
+    print("\n== %d visitor(s), %.1f s ==" % (result["users"], result["elapsed_s"]))
+    print("%-18s %8s %8s %9s %9s %9s %7s" % ("route", "reqs", "req/s", "p50 ms", "p99 ms", "p999 ms", "err %"))
+    for route, r in result["routes"].items():
+        print("%-18s %8d %8.1f %9.1f %9.1f %9.1f %7.2f" % (
+            route, r["requests"], r["rps"], r["p50_ms"], r["p99_ms"], r["p999_ms"], r["error_rate"] * 100))
+
+
+def compare(results, baseline, tolerance):
+    """Return a list of regressions of current results against a baseline."""
+    regressions = []
+    base_by_users = {r["users"]: r for r in baseline["results"]}
+    for result in results:
+        base = base_by_users.get(result["users"])
+        if base is None:
+            continue
+        for route, cur in result["routes"].items():
+            ref = base["routes"].get(route)
+            if ref is None:
+                continue
+            for key in ("p50_ms", "p99_ms"):
+                if ref[key] > 0 and cur[key] > ref[key] * (1 + tolerance):
+                    regressions.append("%d users %s %s: %.1f -> %.1f" % (result["users"], route, key, ref[key], cur[key]))
+            if cur["error_rate"] > ref["error_rate"] + 0.01:
+                regressions.append("%d users %s error rate: %.2f%% -> %.2f%%" % (
+                    result["users"], route, ref["error_rate"] * 100, cur["error_rate"] * 100))
+    return regressions
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--host", default="192.168.4.1", help="device or host-build address (default: AP address)")
+    ap.add_argument("--port", type=int, default=80)
+    ap.add_argument("--session", default=DEFAULT_SESSION, help="recorded session file")
+    ap.add_argument("--users", type=int, default=1, help="simultaneous visitors")
+    ap.add_argument("--sweep", help="comma-separated visitor counts, e.g. 1,2,4,8")
+    ap.add_argument("--duration", type=float, default=30.0, help="seconds per run")
+    ap.add_argument("--ramp", type=float, default=2.0, help="seconds to ramp up visitors")
+    ap.add_argument("--speed", type=float, default=1.0, help="replay speed multiplier")
+    ap.add_argument("--timeout", type=float, default=5.0, help="per-request timeout in seconds")
+    ap.add_argument("--save-baseline", metavar="FILE")
+    ap.add_argument("--compare", metavar="FILE", help="fail if results regress against this baseline")
+    ap.add_argument("--tolerance", type=float, default=0.25, help="allowed latency growth vs baseline (0.25 = 25%%)")
+    ap.add_argument("--label", default="", help="firmware version label stored in the baseline")
+    ap.add_argument("--har", help="convert a browser HAR capture into a session")
+    ap.add_argument("--write-session", metavar="FILE", help="output file for --har")
+    args = ap.parse_args()
+
+    if args.har:
+        events = session_from_har(args.har)
+        out = {"name": os.path.basename(args.har), "events": events}
+        with open(args.write_session or "session.json", "w") as f:
+            json.dump(out, f, indent=1)
+        print("wrote %d events" % len(events))
+        return 0
+
+    name, events = load_session(args.session)
+    counts = [int(x) for x in args.sweep.split(",")] if args.sweep else [args.users]
+    print("session %s: %d events over %.1f s" % (name, len(events), events[-1]["t_ms"] / 1000.0))
+
+    results = []
+    for users in counts:
+        result = run_load(args.host, args.port, events, users, args.duration, args.ramp, args.timeout, args.speed)
+        print_report(result)
+        results.append(result)
+
+    if args.save_baseline:
+        with open(args.save_baseline, "w") as f:
+            json.dump({"label": args.label, "session": name, "results": results}, f, indent=1)
+        print("\nbaseline saved to %s" % args.save_baseline)
+
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+        regressions = compare(results, baseline, args.tolerance)
+        if regressions:
+            print("\nREGRESSIONS vs %s (%s):" % (args.compare, baseline.get("label", "")))
+            for r in regressions:
+                print("  " + r)
+            return 1
+        print("\nno regressions vs %s" % args.compare)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
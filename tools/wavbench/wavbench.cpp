@@ -0,0 +1,177 @@
+// Host decode-throughput run of the I2S backend's WAV path: WavDecoder
+// (WavFormat.h) feeding WavFileSink (PcmSink.h), the same pair the device's
+// /api/bench/audio uses with &out=.
+//
+//   g++ -O2 -std=c++17 -Iinclude src/WavFormat.cpp src/PcmSink.cpp tools/wavbench/wavbench.cpp -o wavbench
+//   ./wavbench                           synthesize 60 s of 16-bit stereo and of 8-bit mono
+//   ./wavbench --in data/bell.wav --out /tmp/bell16.wav
+//   ./wavbench --seconds 300 --chunk 512
+//
+// Decode and sink time are reported apart, as on the device. The rendered
+// file is read back and checked against the decoded frame count; a mismatch
+// exits non-zero.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "PcmSink.h"
+#include "WavFormat.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+class StdioSource : public WavSource {
+public:
+    explicit StdioSource(FILE *f) : f_(f) {}
+    size_t read(uint8_t *buf, size_t len) override { return std::fread(buf, 1, len, f_); }
+    bool skip(uint32_t bytes) override { return std::fseek(f_, bytes, SEEK_CUR) == 0; }
+
+private:
+    FILE *f_;
+};
+
+void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = v >> (8 * i);
+}
+
+void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+// A `seconds` long sweep in the given PCM layout
+bool synthesize(const char *path, uint16_t channels, uint16_t bits, uint32_t rate, uint32_t seconds) {
+    FILE *f = std::fopen(path, "wb");
+    if (!f) return false;
+    uint32_t frameBytes = channels * bits / 8;
+    uint32_t dataBytes = rate * seconds * frameBytes;
+    uint8_t hdr[WAV_HEADER_BYTES];
+    std::memcpy(hdr, "RIFF", 4);
+    put32(hdr + 4, 36 + dataBytes);
+    std::memcpy(hdr + 8, "WAVEfmt ", 8);
+    put32(hdr + 16, 16);
+    put16(hdr + 20, 1);
+    put16(hdr + 22, channels);
+    put32(hdr + 24, rate);
+    put32(hdr + 28, rate * frameBytes);
+    put16(hdr + 32, frameBytes);
+    put16(hdr + 34, bits);
+    std::memcpy(hdr + 36, "data", 4);
+    put32(hdr + 40, dataBytes);
+    std::fwrite(hdr, sizeof(hdr), 1, f);
+
+    std::vector<uint8_t> second(rate * frameBytes);
+    for (uint32_t s = 0; s < seconds; s++) {
+        for (uint32_t i = 0; i < rate * channels; i++) {
+            uint32_t v = (i * (s + 7) * 131) & 0xFFFF;
+            if (bits == 8) second[i] = v >> 8;
+            else put16(&second[2 * i], v);
+        }
+        std::fwrite(second.data(), second.size(), 1, f);
+    }
+    return std::fclose(f) == 0;
+}
+
+// Decode `in` into `out`; false when the rendered file does not hold every frame
+bool run(const char *in, const char *out, size_t chunk) {
+    FILE *f = std::fopen(in, "rb");
+    if (!f) {
+        std::fprintf(stderr, "cannot open %s\n", in);
+        return false;
+    }
+    StdioSource src(f);
+    WavDecoder dec;
+    if (!dec.begin(src)) {
+        std::fprintf(stderr, "%s: not 8/16-bit PCM\n", in);
+        std::fclose(f);
+        return false;
+    }
+    WavFileSink sink(out);
+    if (!sink.begin(dec.format().rate)) {
+        std::fprintf(stderr, "cannot create %s\n", out);
+        std::fclose(f);
+        return false;
+    }
+
+    std::vector<int16_t> buf(2 * chunk);
+    Clock::duration decode{}, write{};
+    uint64_t frames = 0;
+    for (;;) {
+        Clock::time_point t0 = Clock::now();
+        size_t n = dec.read(buf.data(), chunk);
+        Clock::time_point t1 = Clock::now();
+        decode += t1 - t0;
+        if (n == 0) break;
+        sink.write(buf.data(), n);
+        write += Clock::now() - t1;
+        frames += n;
+    }
+    sink.end();
+    std::fclose(f);
+
+    const WavFormat &fmt = dec.format();
+    double seconds = fmt.rate ? static_cast<double>(frames) / fmt.rate : 0;
+    auto us = [](Clock::duration d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+    long long decodeUs = us(decode), sinkUs = us(write);
+    std::printf("%s: %u ch %u-bit %u Hz, %llu frames (%.1f s)\n", in, fmt.channels, fmt.bits, fmt.rate,
+                static_cast<unsigned long long>(frames), seconds);
+    std::printf("  decode %lld us (%.0fx realtime), sink %lld us (%.0fx realtime)\n", decodeUs,
+                decodeUs ? seconds * 1e6 / decodeUs : 0.0, sinkUs, sinkUs ? seconds * 1e6 / sinkUs : 0.0);
+
+    FILE *back = std::fopen(out, "rb");
+    if (!back) return false;
+    StdioSource check(back);
+    WavFormat rendered;
+    bool ok = wavParseHeader(check, rendered) && rendered.channels == 2 && rendered.bits == 16 &&
+              rendered.dataBytes == frames * 4 && std::fseek(back, 0, SEEK_END) == 0 &&
+              static_cast<uint64_t>(std::ftell(back)) == WAV_HEADER_BYTES + frames * 4;
+    std::fclose(back);
+    std::printf("  %s: %s\n", out, ok ? "ok" : "MISMATCH");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *in = nullptr;
+    std::string out = "wavbench_out.wav";
+    uint32_t seconds = 60;
+    size_t chunk = 512; // AUDIO_DMA_FRAMES
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--in")) in = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--out")) out = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--seconds")) seconds = static_cast<uint32_t>(std::atoi(argv[i + 1]));
+        else if (!std::strcmp(argv[i], "--chunk")) chunk = static_cast<size_t>(std::atoi(argv[i + 1]));
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (chunk == 0 || seconds == 0) {
+        std::fprintf(stderr, "--chunk and --seconds must be positive\n");
+        return 2;
+    }
+    if (in) return run(in, out.c_str(), chunk) ? 0 : 1;
+
+    struct {
+        uint16_t channels, bits;
+        uint32_t rate;
+        const char *path;
+    } inputs[] = {{2, 16, 44100, "wavbench_s16.wav"}, {1, 8, 22050, "wavbench_u8.wav"}};
+    bool ok = true;
+    for (auto &input : inputs) {
+        if (!synthesize(input.path, input.channels, input.bits, input.rate, seconds)) {
+            std::fprintf(stderr, "cannot write %s\n", input.path);
+            return 1;
+        }
+        ok = run(input.path, out.c_str(), chunk) && ok;
+        std::remove(input.path);
+    }
+    std::remove(out.c_str());
+    return ok ? 0 : 1;
+}